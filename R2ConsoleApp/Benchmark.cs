@@ -0,0 +1,365 @@
+﻿using System.Diagnostics;
+using System.Globalization;
+using System.Text;
+
+/// <summary>
+/// Benchmark and replay harness. Replays RomeShell log files (the LOG_SHELL output of RomeDLL)
+/// or a canned workload built from the Dane County scenario in Main, for N iterations, and reports
+/// throughput and p50/p99 latency per command type. Save the results with --out before a DLL update
+/// and compare against them with --baseline afterwards.
+///   R2ConsoleApp --bench [iterations] [--out file.csv] [--baseline file.csv] [--tolerance 0.10] [--stats]
+///   R2ConsoleApp --replay shell.log [iterations] [same options]
+/// --bench-floats times getting a daily output array of the canned workload in another unit, as one
+/// float array and as strings value by value, and checks that they agree.
+///   R2ConsoleApp --bench-floats [iterations] [--attr SIM_DAY_PPT] [--unit U_INCH]
+/// </summary>
+internal partial class Program
+{
+    // The Main scenario in RomeShell form, so a canned run and a replayed log take the same path.
+    static readonly string[] BenchWorkload =
+    {
+        @"RomeFilesOpen ""profiles\default"" 0",
+        @"RomeFileSetAttrValue ""CLIMATE_PTR"" ""climates\USA\Wisconsin\Dane County"" 0",
+        @"RomeFileSetAttrValue ""SOIL_PTR"" ""soils\SSURGO\Dane County, Wisconsin\AsC2 Ashdale silt loam, 6 to 12 percent slopes, eroded\Ashdale Silt loam  100%"" 0",
+        @"RomeFileSetAttrValue ""SLOPE_STEEP"" ""5"" 0",
+        @"RomeFileSetAttrValue ""SLOPE_HORIZ"" ""140"" 0",
+        @"RomeFileSetAttrValue ""#RD:SLOPE_ROT_BUILD_SUB_OBJ_PTR:ROTATION_BUILDER_MAN_PTRS"" ""managements\Cg-Sb test"" 0",
+        @"RomeFileSetAttrValue ""#RD:SLOPE_ROT_BUILD_SUB_OBJ_PTR:ROT_BUILD_APPLY"" ""Yes"" 0",
+        @"RomeFileSetAttrValue ""#RD:MAN_BASE_PTR:MAN_BASE_ROTATION_CHOICE"" ""Yes"" 0",
+        @"RomeFileSetAttrValue ""#RD:MAN_BASE_PTR:OP_DATE"" ""#INSERT"" 0",
+        @"RomeFileSetAttrValue ""#RD:MAN_BASE_PTR:OP_DATE"" ""11/1/1"" 0",
+        @"RomeFileSetAttrValue ""#RD:MAN_BASE_PTR:OP_PTR"" ""operations\No operation"" 0",
+        @"RomeFileSetAttrValue ""#RD:MAN_BASE_PTR:MAN_OP_VEG_NUM_HARV_UNITS"" ""100"" 4",
+        @"RomeFileSetAttrValue ""#RD:MAN_BASE_PTR:MAN_OP_VEG_NUM_HARV_UNITS"" ""30"" 12",
+        @"RomeFileGetAttrValue ""NET_C_FACTOR"" 0",
+        @"RomeEngineRun",
+        @"RomeFileGetAttrValue ""SLOPE_DEGRAD"" 0",
+        @"RomeFileGetAttrSize ""#RD:MAN_BASE_PTR:OP_DATE""",
+        @"RomeFileGetAttrValue ""#RD:MAN_BASE_PTR:OP_DATE"" 0",
+        @"RomeFileGetAttrValue ""#RD:MAN_BASE_PTR:OP_PTR"" 0",
+        @"RomeFilesCloseAll 0",
+    };
+
+    const double BenchDefaultTolerance = 0.10;
+    // A daily array of the canned workload, stored in mm, so there are thousands of values to convert
+    const string FloatBenchDefaultAttr = "SIM_DAY_PPT";
+    const string FloatBenchDefaultUnit = "U_INCH";
+
+    static int RunBenchmark(string[] args)
+    {
+        string mode = args[0];
+        string[] script;
+        int argNext = 1;
+        if (mode == "--replay")
+        {
+            if (args.Length < 2)
+                throw new ArgumentException("--replay needs a RomeShell log file");
+            script = File.ReadAllLines(args[1]);
+            argNext = 2;
+        }
+        else
+            script = BenchWorkload;
+
+        int iterations = 10;
+        if (argNext < args.Length && int.TryParse(args[argNext], out int n))
+        {
+            iterations = Math.Max(1, n);
+            argNext++;
+        }
+
+        string? outPath = null;
+        string? baselinePath = null;
+        double tolerance = BenchDefaultTolerance;
+        bool showStats = false;
+        for (int ii = argNext; ii < args.Length; ii++)
+        {
+            switch (args[ii])
+            {
+                case "--out": outPath = args[++ii]; break;
+                case "--baseline": baselinePath = args[++ii]; break;
+                case "--tolerance": tolerance = double.Parse(args[++ii], CultureInfo.InvariantCulture); break;
+                case "--stats": showStats = true; break;
+                default: throw new ArgumentException($"Unknown benchmark option '{args[ii]}'");
+            }
+        }
+
+        var commands = new List<string[]>();
+        int skipped = 0;
+        foreach (string line in script)
+        {
+            string[] cmd = ParseShellLine(line);
+            if (cmd.Length == 0)
+                continue;
+            if (!IsReplayable(cmd[0]))
+            {
+                skipped++;
+                continue;
+            }
+            commands.Add(cmd);
+        }
+        if (skipped > 0)
+            Console.WriteLine($"Skipping {skipped} log lines with commands the harness doesn't replay.");
+
+        if (showStats)
+            rusle2.GetStats(true);
+
+        var timings = new Dictionary<string, List<double>>();
+        int failures = 0;
+        var watch = new Stopwatch();
+        var total = Stopwatch.StartNew();
+        for (int iter = 0; iter < iterations; iter++)
+        {
+            var files = new Dictionary<string, IntPtr>(StringComparer.OrdinalIgnoreCase);
+            IntPtr current = IntPtr.Zero;
+            foreach (string[] cmd in commands)
+            {
+                watch.Restart();
+                if (!ReplayCommand(cmd, files, ref current))
+                    failures++;
+                watch.Stop();
+                if (!timings.TryGetValue(cmd[0], out var list))
+                    timings[cmd[0]] = list = new List<double>();
+                list.Add(watch.Elapsed.TotalMilliseconds);
+            }
+            // Start every iteration from an empty file system so a replayed log that never closes its
+            // files measures the same work each time instead of an ever-warmer cache.
+            rusle2.FilesCloseAll();
+        }
+        total.Stop();
+
+        Console.WriteLine($"{commands.Count} commands x {iterations} iterations in {total.Elapsed.TotalMilliseconds:F1} ms ({failures} failed)");
+        Console.WriteLine($"{"Command",-28} {"Count",8} {"Total ms",10} {"Ops/s",10} {"p50 ms",9} {"p99 ms",9}");
+        var results = new List<(string command, int count, double totalMs, double p50, double p99)>();
+        foreach (var pair in timings.OrderBy(p => p.Key, StringComparer.Ordinal))
+        {
+            List<double> list = pair.Value;
+            list.Sort();
+            double sum = list.Sum();
+            double p50 = Percentile(list, 0.50), p99 = Percentile(list, 0.99);
+            results.Add((pair.Key, list.Count, sum, p50, p99));
+            double opsPerSec = sum > 0 ? list.Count * 1000.0 / sum : 0;
+            Console.WriteLine($"{pair.Key,-28} {list.Count,8} {sum,10:F1} {opsPerSec,10:F0} {p50,9:F3} {p99,9:F3}");
+        }
+
+        if (showStats)
+            Console.WriteLine(rusle2.GetStats());
+
+        if (outPath != null)
+        {
+            var csv = new StringBuilder("command,count,total_ms,p50_ms,p99_ms\n");
+            foreach (var row in results)
+                csv.AppendLine(string.Format(CultureInfo.InvariantCulture, "{0},{1},{2:F4},{3:F4},{4:F4}",
+                    row.command, row.count, row.totalMs, row.p50, row.p99));
+            File.WriteAllText(outPath, csv.ToString());
+        }
+
+        int regressions = 0;
+        if (baselinePath != null)
+        {
+            var baseline = new Dictionary<string, double>();
+            foreach (string line in File.ReadLines(baselinePath).Skip(1))
+            {
+                string[] cells = line.Split(',');
+                if (cells.Length >= 4)
+                    baseline[cells[0]] = double.Parse(cells[3], CultureInfo.InvariantCulture);
+            }
+            foreach (var row in results)
+            {
+                if (!baseline.TryGetValue(row.command, out double before) || before <= 0)
+                    continue;
+                double change = (row.p50 - before) / before;
+                if (change > tolerance)
+                {
+                    regressions++;
+                    Console.WriteLine($"REGRESSION {row.command}: p50 {before:F3} -> {row.p50:F3} ms ({change:P0})");
+                }
+            }
+            Console.WriteLine(regressions == 0 ? "No p50 regressions against the baseline." : $"{regressions} p50 regressions against the baseline.");
+        }
+
+        return (regressions > 0 || failures > 0) ? 1 : 0;
+    }
+
+    static int RunFloatBenchmark(string[] args)
+    {
+        int iterations = 100;
+        int argNext = 1;
+        if (argNext < args.Length && int.TryParse(args[argNext], out int n))
+        {
+            iterations = Math.Max(1, n);
+            argNext++;
+        }
+        string attr = FloatBenchDefaultAttr;
+        string unit = FloatBenchDefaultUnit;
+        for (int ii = argNext; ii < args.Length; ii++)
+        {
+            switch (args[ii])
+            {
+                case "--attr": attr = args[++ii]; break;
+                case "--unit": unit = args[++ii]; break;
+                default: throw new ArgumentException($"Unknown benchmark option '{args[ii]}'");
+            }
+        }
+
+        // Set up and run the canned scenario, leaving its file open.
+        var files = new Dictionary<string, IntPtr>(StringComparer.OrdinalIgnoreCase);
+        IntPtr file = IntPtr.Zero;
+        foreach (string line in BenchWorkload)
+        {
+            string[] cmd = ParseShellLine(line);
+            if (!ReplayCommand(cmd, files, ref file))
+                throw new InvalidOperationException($"The canned workload failed at '{line}'");
+            if (cmd[0] == "RomeEngineRun")
+                break;
+        }
+        int size = rusle2.FileGetAttrSize(file, attr);
+        if (size <= 0)
+            throw new InvalidOperationException($"'{attr}' has no values in the canned workload");
+        var arrays = new[] { (attr, unit) };
+        var indexes = Enumerable.Range(0, size).Select(index => (attr, index)).ToArray();
+
+        double[] GetFloats() => rusle2.FileGetFloatArrays(file, arrays, out _, out int[] sizes) is double[] v && sizes[0] == size
+            ? v : throw new InvalidOperationException($"Couldn't get '{attr}' in '{unit}'");
+        double[] GetStrings() => rusle2.FileGetAttrValues(file, indexes, unit)
+            .Select(value => double.Parse(value ?? "NaN", CultureInfo.InvariantCulture)).ToArray();
+        (double ms, double[] values) Time(Func<double[]> get)
+        {
+            double[] values = get(); // Warm up
+            var watch = Stopwatch.StartNew();
+            for (int iter = 0; iter < iterations; iter++)
+                values = get();
+            return (watch.Elapsed.TotalMilliseconds / iterations, values);
+        }
+
+        var floats = Time(GetFloats);
+        var strings = Time(GetStrings);
+
+        // The strings are rounded by R2's formatting, so they only have to agree to their precision.
+        double MaxDiff(double[] a, double[] b) => a.Zip(b, (x, y) => Math.Abs(x - y) / Math.Max(1.0, Math.Abs(y))).Max();
+        double stringDiff = MaxDiff(floats.values, strings.values);
+        Console.WriteLine($"{attr} in {unit}: {size} values x {iterations} iterations");
+        Console.WriteLine($"{"Path",-28} {"ms/call",10} {"Speedup",8}");
+        Console.WriteLine($"{"Float array",-28} {floats.ms,10:F3} {1.0,8:F1}");
+        Console.WriteLine($"{"Strings and double.Parse",-28} {strings.ms,10:F3} {strings.ms / floats.ms,8:F1}");
+        Console.WriteLine($"Largest relative difference from the strings: {stringDiff:E2}");
+        return (stringDiff > 1e-3) ? 1 : 0;
+    }
+
+    static bool IsReplayable(string command)
+    {
+        switch (command)
+        {
+            case "Activate":
+            case "RomeDatabaseOpen":
+            case "RomeFilesOpen":
+            case "RomeFileClose":
+            case "RomeFilesCloseAll":
+            case "RomeFileSetAttrValue":
+            case "RomeFileGetAttrValue":
+            case "RomeFileGetAttrSize":
+            case "RomeEngineRun":
+            case "RomeEngineRunEx":
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Runs one parsed RomeShell command against the files opened so far in this iteration.
+    // "Activate" (or a RomeFilesOpen) selects the file the following attr commands apply to.
+    static bool ReplayCommand(string[] cmd, Dictionary<string, IntPtr> files, ref IntPtr current)
+    {
+        string Arg(int i) => i < cmd.Length ? cmd[i] : "";
+        int IntArg(int i) => int.TryParse(Arg(i), out int v) ? v : 0;
+
+        switch (cmd[0])
+        {
+            case "Activate":
+                if (!files.TryGetValue(Arg(1), out current))
+                {
+                    current = rusle2.FilesOpen(Arg(1));
+                    if (current != IntPtr.Zero)
+                        files[Arg(1)] = current;
+                }
+                return current != IntPtr.Zero;
+            case "RomeDatabaseOpen":
+                return rusle2.OpenDatabase(Arg(1));
+            case "RomeFilesOpen":
+                current = rusle2.FilesOpen(Arg(1), IntArg(2));
+                if (current == IntPtr.Zero)
+                    return false;
+                files[Arg(1)] = current;
+                return true;
+            case "RomeFileClose":
+                if (!files.TryGetValue(Arg(1), out IntPtr file))
+                    return false;
+                files.Remove(Arg(1));
+                if (file == current)
+                    current = IntPtr.Zero;
+                return rusle2.FileClose(file);
+            case "RomeFilesCloseAll":
+                files.Clear();
+                current = IntPtr.Zero;
+                return rusle2.FilesCloseAll();
+            case "RomeFileSetAttrValue":
+                return current != IntPtr.Zero && rusle2.FileSetAttrValue(current, Arg(1), Arg(2), IntArg(3)) >= 0;
+            case "RomeFileGetAttrValue":
+                return current != IntPtr.Zero && rusle2.FileGetAttrValue(current, Arg(1), IntArg(2)) != null;
+            case "RomeFileGetAttrSize":
+                return current != IntPtr.Zero && rusle2.FileGetAttrSize(current, Arg(1)) >= 0;
+            case "RomeEngineRun":
+                return rusle2.EngineRun();
+            case "RomeEngineRunEx":
+                return rusle2.EngineRunEx() >= 0;
+            default:
+                return false;
+        }
+    }
+
+    // Splits a RomeShell line into the command and its arguments. Arguments are either bare words or
+    // double-quoted strings; RomeDLL writes quoted strings verbatim, so there are no escapes to undo.
+    // Blank lines and "//" comments give an empty array.
+    static string[] ParseShellLine(string line)
+    {
+        var parts = new List<string>();
+        string text = line.Trim();
+        if (text.Length == 0 || text.StartsWith("//"))
+            return Array.Empty<string>();
+        int pos = 0;
+        while (pos < text.Length)
+        {
+            if (char.IsWhiteSpace(text[pos]))
+            {
+                pos++;
+                continue;
+            }
+            int end;
+            if (text[pos] == '"')
+            {
+                end = text.IndexOf('"', pos + 1);
+                if (end < 0)
+                    end = text.Length;
+                parts.Add(text.Substring(pos + 1, end - pos - 1));
+                pos = end + 1;
+            }
+            else
+            {
+                end = pos;
+                while (end < text.Length && !char.IsWhiteSpace(text[end]))
+                    end++;
+                parts.Add(text.Substring(pos, end - pos));
+                pos = end;
+            }
+        }
+        return parts.ToArray();
+    }
+
+    // Nearest-rank percentile of an already sorted list.
+    static double Percentile(List<double> sorted, double fraction)
+    {
+        if (sorted.Count == 0)
+            return 0;
+        int rank = (int)Math.Ceiling(fraction * sorted.Count) - 1;
+        return sorted[Math.Clamp(rank, 0, sorted.Count - 1)];
+    }
+}
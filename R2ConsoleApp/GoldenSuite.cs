@@ -0,0 +1,320 @@
+﻿using System.Diagnostics;
+using System.Globalization;
+using System.Text;
+
+/// <summary>
+/// Golden-output regression and throughput suite. Runs a matrix of slopes built from the canned Dane County
+/// scenario against sample.gdb, one at a time and through EngineRunBatch, and checks every output against
+/// the golden values saved by an earlier run with --update. Without a golden file the outputs are only checked
+/// between the serial and batch runs, and the suite exits with 2 (not configured) instead of 0. Also
+/// reports the startup time (RomeInit of a new core and RomeDatabaseOpen), runs per second and peak memory,
+/// which --out saves and --baseline compares against, as for --bench.
+///   R2ConsoleApp --golden [golden.csv] [--update] [--iterations N] [--tolerance 1e-6] [--out file.csv] [--baseline file.csv] [--stats]
+/// --nested-batch runs the matrix through EngineRunBatch from a change listener, which R2 calls holding the
+/// profile's core, and checks that it finishes within the timeout and agrees with a batch run outside it.
+///   R2ConsoleApp --nested-batch [timeoutSeconds]
+/// </summary>
+internal partial class Program
+{
+    const string GoldenDefaultPath = @"..\..\..\golden.csv";
+    const string GoldenProfile = @"profiles\default";
+    const double GoldenDefaultTolerance = 1e-6;
+    static readonly string[] GoldenSteepness = { "2", "5", "9", "15" };
+    static readonly string[] GoldenLengths = { "50", "140", "300" };
+    static readonly (string attrName, int index)[] GoldenOutputs = { ("SLOPE_DEGRAD", 0), ("NET_C_FACTOR", 0) };
+
+    sealed record GoldenScenario(string Name, IReadOnlyList<(string attrName, string value, int index)> Inputs);
+
+    static int RunGoldenSuite(string[] args, string r2Path)
+    {
+        string goldenPath = GoldenDefaultPath;
+        int argNext = 1;
+        if (argNext < args.Length && !args[argNext].StartsWith("--"))
+            goldenPath = args[argNext++];
+        bool update = false;
+        int iterations = 3;
+        double tolerance = GoldenDefaultTolerance;
+        string? outPath = null;
+        string? baselinePath = null;
+        bool showStats = false;
+        for (int ii = argNext; ii < args.Length; ii++)
+        {
+            switch (args[ii])
+            {
+                case "--update": update = true; break;
+                case "--iterations": iterations = Math.Max(1, int.Parse(args[++ii])); break;
+                case "--tolerance": tolerance = double.Parse(args[++ii], CultureInfo.InvariantCulture); break;
+                case "--out": outPath = args[++ii]; break;
+                case "--baseline": baselinePath = args[++ii]; break;
+                case "--stats": showStats = true; break;
+                default: throw new ArgumentException($"Unknown golden suite option '{args[ii]}'");
+            }
+        }
+
+        // The static rusle2 started R2 before Main, so time starting a core of its own, as each worker does.
+        var watch = Stopwatch.StartNew();
+        using (SnapPlus.Models.Erosion.Rusle2.CreateInstance(Directory.GetCurrentDirectory()))
+            watch.Stop();
+        double initMs = watch.Elapsed.TotalMilliseconds;
+        watch.Restart();
+        if (!rusle2.OpenDatabase(r2Path))
+            throw new Exception($"Couldn't open database with path '{r2Path}'");
+        double openMs = watch.Elapsed.TotalMilliseconds;
+
+        List<GoldenScenario> scenarios = GoldenScenarios();
+        var metrics = new List<(string metric, double value)>
+        {
+            ("init_ms", initMs),
+            ("database_open_ms", openMs),
+        };
+
+        // One at a time on this thread, as Main runs its scenario.
+        string[]?[] serial = new string[]?[scenarios.Count];
+        int failures = 0;
+        watch.Restart();
+        for (int iter = 0; iter < iterations; iter++)
+        {
+            for (int ii = 0; ii < scenarios.Count; ii++)
+            {
+                serial[ii] = GoldenRunSerial(scenarios[ii]);
+                if (serial[ii] == null)
+                    failures++;
+            }
+        }
+        double serialSec = watch.Elapsed.TotalSeconds;
+        metrics.Add(("serial_runs_per_sec", scenarios.Count * iterations / serialSec));
+
+        // The same scenarios spread over worker cores.
+        var runs = scenarios.Select(s => (GoldenProfile, s.Inputs)).ToArray();
+        string[][] batch = Array.Empty<string[]>();
+        watch.Restart();
+        for (int iter = 0; iter < iterations; iter++)
+            batch = rusle2.EngineRunBatch(runs, GoldenOutputs);
+        double batchSec = watch.Elapsed.TotalSeconds;
+        metrics.Add(("batch_runs_per_sec", scenarios.Count * iterations / batchSec));
+
+        using (var process = Process.GetCurrentProcess())
+        {
+            process.Refresh();
+            metrics.Add(("peak_working_set_mb", process.PeakWorkingSet64 / (1024.0 * 1024.0)));
+            metrics.Add(("peak_paged_mb", process.PeakPagedMemorySize64 / (1024.0 * 1024.0)));
+        }
+
+        // The batch has to agree with the serial runs exactly, whatever the golden values are.
+        int mismatches = 0;
+        for (int ii = 0; ii < scenarios.Count; ii++)
+        {
+            for (int jj = 0; jj < GoldenOutputs.Length; jj++)
+            {
+                string? one = serial[ii]?[jj];
+                string? many = (ii < batch.Length) ? batch[ii]?[jj] : null;
+                if (one != many)
+                {
+                    mismatches++;
+                    Console.WriteLine($"BATCH MISMATCH {scenarios[ii].Name} {GoldenOutputs[jj].attrName}: serial '{one}', batch '{many}'");
+                }
+            }
+        }
+
+        bool configured = true;
+        var values = new Dictionary<string, string?>(StringComparer.Ordinal);
+        for (int ii = 0; ii < scenarios.Count; ii++)
+            for (int jj = 0; jj < GoldenOutputs.Length; jj++)
+                values[$"{scenarios[ii].Name},{GoldenOutputs[jj].attrName}"] = serial[ii]?[jj];
+
+        if (update)
+        {
+            var csv = new StringBuilder("scenario,output,value\n");
+            foreach (var pair in values)
+                csv.AppendLine($"{pair.Key},{pair.Value}");
+            File.WriteAllText(goldenPath, csv.ToString());
+            Console.WriteLine($"Saved {values.Count} golden values to '{goldenPath}'.");
+        }
+        else if (!File.Exists(goldenPath))
+        {
+            configured = false;
+            Console.WriteLine($"NOT CONFIGURED: no golden values in '{goldenPath}'; save them from a trusted build with --update");
+        }
+        else
+        {
+            var golden = new Dictionary<string, string>(StringComparer.Ordinal);
+            foreach (string line in File.ReadLines(goldenPath).Skip(1))
+            {
+                int split = line.LastIndexOf(',');
+                if (split > 0)
+                    golden[line.Substring(0, split)] = line.Substring(split + 1);
+            }
+            foreach (var pair in values)
+            {
+                if (!golden.TryGetValue(pair.Key, out string? expected))
+                {
+                    mismatches++;
+                    Console.WriteLine($"NO GOLDEN VALUE {pair.Key}; save them again with --update");
+                }
+                else if (!GoldenAgrees(expected, pair.Value, tolerance))
+                {
+                    mismatches++;
+                    Console.WriteLine($"GOLDEN MISMATCH {pair.Key}: expected '{expected}', got '{pair.Value}'");
+                }
+            }
+            Console.WriteLine(mismatches == 0 ? $"All {values.Count} outputs match the golden values." : $"{mismatches} outputs don't match.");
+        }
+
+        Console.WriteLine($"{scenarios.Count} scenarios x {iterations} iterations ({failures} failed runs)");
+        foreach (var (metric, value) in metrics)
+            Console.WriteLine($"{metric,-28} {value,12:F1}");
+        if (showStats)
+        {
+            Console.WriteLine(rusle2.GetStats());
+            Console.WriteLine(rusle2.GetMemoryStats());
+        }
+
+        if (outPath != null)
+        {
+            var csv = new StringBuilder("metric,value\n");
+            foreach (var (metric, value) in metrics)
+                csv.AppendLine(string.Format(CultureInfo.InvariantCulture, "{0},{1:F4}", metric, value));
+            File.WriteAllText(outPath, csv.ToString());
+        }
+
+        int regressions = 0;
+        if (baselinePath != null)
+        {
+            var baseline = new Dictionary<string, double>();
+            foreach (string line in File.ReadLines(baselinePath).Skip(1))
+            {
+                string[] cells = line.Split(',');
+                if (cells.Length >= 2)
+                    baseline[cells[0]] = double.Parse(cells[1], CultureInfo.InvariantCulture);
+            }
+            foreach (var (metric, value) in metrics)
+            {
+                if (!baseline.TryGetValue(metric, out double before) || before <= 0)
+                    continue;
+                // Runs per second should go up; times and memory should go down.
+                double change = metric.EndsWith("_per_sec") ? (before - value) / before : (value - before) / before;
+                if (change > BenchDefaultTolerance)
+                {
+                    regressions++;
+                    Console.WriteLine($"REGRESSION {metric}: {before:F1} -> {value:F1} ({change:P0} worse)");
+                }
+            }
+            Console.WriteLine(regressions == 0 ? "No regressions against the baseline." : $"{regressions} regressions against the baseline.");
+        }
+
+        rusle2.FilesCloseAll();
+        if (mismatches > 0 || failures > 0 || regressions > 0)
+            return 1;
+        return configured ? 0 : 2;
+    }
+
+    static int RunNestedBatchCheck(string[] args)
+    {
+        int timeoutSec = args.Length > 1 ? int.Parse(args[1], CultureInfo.InvariantCulture) : 300;
+        var runs = GoldenScenarios().Select(s => (GoldenProfile, s.Inputs)).ToArray();
+        string[][] direct = rusle2.EngineRunBatch(runs, GoldenOutputs);
+
+        IntPtr file = rusle2.FilesOpen(GoldenProfile);
+        if (file == IntPtr.Zero)
+        {
+            Console.WriteLine($"FAILED: couldn't open '{GoldenProfile}'");
+            return 1;
+        }
+        string[][]? nested = null;
+        if (!rusle2.FileListenChanges(file, changes => nested ??= rusle2.EngineRunBatch(runs, GoldenOutputs)))
+        {
+            Console.WriteLine("FAILED: couldn't listen to the profile");
+            return 1;
+        }
+
+        // The listener runs inside EngineRun, so a batch waiting on the caller's lock never returns.
+        Task<bool> run = Task.Run(() => rusle2.FileSetAttrValue(file, "SLOPE_STEEP", "9", 0) >= 0 && rusle2.EngineRun());
+        if (!run.Wait(TimeSpan.FromSeconds(timeoutSec)))
+        {
+            Console.WriteLine($"DEADLOCK: the nested batch didn't finish in {timeoutSec} s");
+            return 1;
+        }
+        rusle2.FileStopListening(file);
+        rusle2.FilesCloseAll();
+        if (!run.Result || nested == null)
+        {
+            Console.WriteLine("FAILED: the engine didn't run, or the listener didn't run the batch");
+            return 1;
+        }
+
+        int mismatches = 0;
+        for (int ii = 0; ii < runs.Length; ii++)
+        {
+            for (int jj = 0; jj < GoldenOutputs.Length; jj++)
+            {
+                string? outside = direct[ii]?[jj];
+                string? inside = nested[ii]?[jj];
+                if (outside == null || outside != inside)
+                {
+                    mismatches++;
+                    Console.WriteLine($"NESTED MISMATCH run {ii} {GoldenOutputs[jj].attrName}: outside '{outside}', nested '{inside}'");
+                }
+            }
+        }
+        Console.WriteLine(mismatches == 0 ? $"The nested batch of {runs.Length} runs matches." : $"{mismatches} nested outputs don't match.");
+        return mismatches == 0 ? 0 : 1;
+    }
+
+    // The inputs of the canned workload, with each combination of steepness and length.
+    static List<GoldenScenario> GoldenScenarios()
+    {
+        var inputs = new List<(string attrName, string value, int index)>();
+        foreach (string line in BenchWorkload)
+        {
+            string[] cmd = ParseShellLine(line);
+            if (cmd.Length >= 4 && cmd[0] == "RomeFileSetAttrValue")
+                inputs.Add((cmd[1], cmd[2], int.Parse(cmd[3], CultureInfo.InvariantCulture)));
+        }
+
+        var scenarios = new List<GoldenScenario>();
+        foreach (string steep in GoldenSteepness)
+        {
+            foreach (string length in GoldenLengths)
+            {
+                var scenario = inputs.Select(input => input.attrName switch
+                {
+                    "SLOPE_STEEP" => (input.attrName, steep, input.index),
+                    "SLOPE_HORIZ" => (input.attrName, length, input.index),
+                    _ => input,
+                }).ToArray();
+                scenarios.Add(new GoldenScenario($"steep{steep}_horiz{length}", scenario));
+            }
+        }
+        return scenarios;
+    }
+
+    // Runs a scenario on a fresh copy of the profile, and returns its outputs or null if it failed.
+    static string[]? GoldenRunSerial(GoldenScenario scenario)
+    {
+        IntPtr file = rusle2.FilesOpen(GoldenProfile);
+        if (file == IntPtr.Zero)
+            return null;
+        try
+        {
+            if (rusle2.FileSetAttrValues(file, scenario.Inputs) != scenario.Inputs.Count || !rusle2.EngineRun())
+                return null;
+            return rusle2.FileGetAttrValues(file, GoldenOutputs);
+        }
+        finally
+        {
+            // The profile has inputs set, so the next scenario must not get it back from the open files.
+            rusle2.FilesCloseAll();
+        }
+    }
+
+    // Numbers agree to a relative tolerance, since the golden values are R2's formatted strings; anything else exactly.
+    static bool GoldenAgrees(string expected, string? actual, double tolerance)
+    {
+        if (actual == null)
+            return expected.Length == 0;
+        if (double.TryParse(expected, NumberStyles.Float, CultureInfo.InvariantCulture, out double want)
+            && double.TryParse(actual, NumberStyles.Float, CultureInfo.InvariantCulture, out double got))
+            return Math.Abs(got - want) <= tolerance * Math.Max(1.0, Math.Abs(want));
+        return expected == actual;
+    }
+}
@@ -0,0 +1,245 @@
+﻿using System.Collections.Concurrent;
+using System.Diagnostics;
+using System.IO.Pipes;
+using SnapPlus.Models.Erosion;
+
+/// <summary>
+/// Out-of-process model server. RomeDLL holds one model per process, so the server keeps a pool of
+/// worker processes (this program with --worker), each with R2 initialized and the database open, and
+/// relays each scenario from a Rusle2Client over the named pipe to the next idle worker. The frames are
+/// the Rusle2Protocol ones; the server only decodes them in the workers. A worker that dies is replaced,
+/// failing just the scenario it was running.
+///   R2ConsoleApp --serve [--workers N] [--pipe name]
+/// </summary>
+internal partial class Program
+{
+    sealed class ModelWorker
+    {
+        public Process Process = null!;
+        public AnonymousPipeServerStream ToWorker = null!;
+        public AnonymousPipeServerStream FromWorker = null!;
+    }
+
+    static int RunModelServer(string[] args)
+    {
+        int workerCount = Math.Max(1, Environment.ProcessorCount / 2);
+        string pipeName = Rusle2Protocol.DefaultPipeName;
+        for (int ii = 1; ii < args.Length; ii++)
+        {
+            switch (args[ii])
+            {
+                case "--workers": workerCount = Math.Max(1, int.Parse(args[++ii])); break;
+                case "--pipe": pipeName = args[++ii]; break;
+                default: throw new ArgumentException($"Unknown server option '{args[ii]}'");
+            }
+        }
+
+        // Idle workers, first in first out, so the load is spread over the whole pool.
+        var idle = new BlockingCollection<ModelWorker>(new ConcurrentQueue<ModelWorker>());
+        var workers = new List<ModelWorker>();
+        using var stop = new CancellationTokenSource();
+        Console.CancelKeyPress += (sender, e) =>
+        {
+            e.Cancel = true;
+            stop.Cancel();
+        };
+        try
+        {
+            for (int ii = 0; ii < workerCount; ii++)
+                idle.Add(StartModelWorker(workers));
+            Console.WriteLine($"Serving '{pipeName}' with {workerCount} workers. Press Ctrl+C to stop.");
+            while (!stop.IsCancellationRequested)
+            {
+                var pipe = new NamedPipeServerStream(pipeName, PipeDirection.InOut, NamedPipeServerStream.MaxAllowedServerInstances,
+                    PipeTransmissionMode.Byte, PipeOptions.Asynchronous);
+                try
+                {
+                    pipe.WaitForConnectionAsync(stop.Token).GetAwaiter().GetResult();
+                }
+                catch (OperationCanceledException)
+                {
+                    pipe.Dispose();
+                    break;
+                }
+                // Each client blocks its own thread between frames, so don't tie up the thread pool.
+                Task.Factory.StartNew(() => ServeModelClient(pipe, idle, workers, stop.Token), TaskCreationOptions.LongRunning);
+            }
+        }
+        finally
+        {
+            lock (workers)
+            {
+                foreach (ModelWorker worker in workers)
+                    StopModelWorker(worker);
+                workers.Clear();
+            }
+        }
+        return 0;
+    }
+
+    // Start a worker and wait until it has opened the database, which it signals with an empty frame.
+    static ModelWorker StartModelWorker(List<ModelWorker> workers)
+    {
+        var worker = new ModelWorker
+        {
+            ToWorker = new AnonymousPipeServerStream(PipeDirection.Out, HandleInheritability.Inheritable),
+            FromWorker = new AnonymousPipeServerStream(PipeDirection.In, HandleInheritability.Inheritable),
+        };
+        string exe = Environment.ProcessPath ?? throw new InvalidOperationException("Can't find this program to start workers");
+        var info = new ProcessStartInfo(exe) { UseShellExecute = false };
+        // Under "dotnet R2ConsoleApp.dll" the process is the host, so the workers need the assembly too.
+        if (Path.GetFileNameWithoutExtension(exe).Equals("dotnet", StringComparison.OrdinalIgnoreCase))
+            info.ArgumentList.Add(typeof(Program).Assembly.Location);
+        info.ArgumentList.Add("--worker");
+        info.ArgumentList.Add(worker.ToWorker.GetClientHandleAsString());
+        info.ArgumentList.Add(worker.FromWorker.GetClientHandleAsString());
+        try
+        {
+            worker.Process = Process.Start(info) ?? throw new InvalidOperationException($"Couldn't start '{exe}'");
+            worker.ToWorker.DisposeLocalCopyOfClientHandle();
+            worker.FromWorker.DisposeLocalCopyOfClientHandle();
+            if (Rusle2Protocol.ReadFrame(worker.FromWorker) == null)
+                throw new InvalidOperationException("A model worker exited before it was ready; check that it can open the database");
+        }
+        catch
+        {
+            StopModelWorker(worker);
+            throw;
+        }
+        lock (workers)
+            workers.Add(worker);
+        return worker;
+    }
+
+    // Returns the worker's exit code, or -1 if it had to be killed.
+    static int StopModelWorker(ModelWorker worker)
+    {
+        // Closing the pipe ends the worker's loop; kill it in case it is stuck in R2.
+        worker.ToWorker.Dispose();
+        worker.FromWorker.Dispose();
+        if (worker.Process == null)
+            return -1;
+        int exitCode = -1;
+        try
+        {
+            if (worker.Process.WaitForExit(2000))
+                exitCode = worker.Process.ExitCode;
+            else
+                worker.Process.Kill();
+        }
+        catch (InvalidOperationException)
+        {
+            // Already gone
+        }
+        worker.Process.Dispose();
+        return exitCode;
+    }
+
+    static void ServeModelClient(NamedPipeServerStream pipe, BlockingCollection<ModelWorker> idle, List<ModelWorker> workers, CancellationToken stop)
+    {
+        using (pipe)
+        {
+            try
+            {
+                byte[]? request;
+                while ((request = Rusle2Protocol.ReadFrame(pipe)) != null)
+                {
+                    byte[] response = RunOnModelWorker(request, idle, workers, stop);
+                    Rusle2Protocol.WriteFrame(pipe, response, response.Length);
+                }
+            }
+            catch (IOException)
+            {
+                // The client went away
+            }
+            catch (InvalidDataException)
+            {
+                // Not our protocol; drop the connection rather than guess where the next frame starts
+            }
+            catch (OperationCanceledException)
+            {
+                // Shutting down
+            }
+        }
+    }
+
+    static byte[] RunOnModelWorker(byte[] request, BlockingCollection<ModelWorker> idle, List<ModelWorker> workers, CancellationToken stop)
+    {
+        ModelWorker worker = idle.Take(stop);
+        try
+        {
+            Rusle2Protocol.WriteFrame(worker.ToWorker, request, request.Length);
+            byte[]? response = Rusle2Protocol.ReadFrame(worker.FromWorker);
+            if (response == null)
+                throw new EndOfStreamException();
+            idle.Add(worker);
+            return response;
+        }
+        catch (IOException)
+        {
+            // The worker died, e.g. R2 crashed on this scenario. Replace it so the pool keeps its size.
+            lock (workers)
+                workers.Remove(worker);
+            int exitCode = StopModelWorker(worker);
+            try
+            {
+                if (!stop.IsCancellationRequested)
+                    idle.Add(StartModelWorker(workers));
+            }
+            catch (InvalidOperationException ex)
+            {
+                Console.WriteLine($"Couldn't replace a model worker: {ex.Message}");
+            }
+            byte[] error = Rusle2Protocol.EncodeError($"The model worker failed (exit code {exitCode})", out int length);
+            return error[..length];
+        }
+    }
+
+    // The worker side: runs after Main has opened the database, until the server closes the pipe.
+    static int RunModelWorker(string[] args)
+    {
+        if (args.Length < 3)
+            throw new ArgumentException("--worker needs the server's pipe handles");
+        using var fromServer = new AnonymousPipeClientStream(PipeDirection.In, args[1]);
+        using var toServer = new AnonymousPipeClientStream(PipeDirection.Out, args[2]);
+        Rusle2Protocol.WriteFrame(toServer, Array.Empty<byte>(), 0);
+        byte[]? request;
+        while ((request = Rusle2Protocol.ReadFrame(fromServer)) != null)
+        {
+            byte[] response;
+            int length;
+            try
+            {
+                response = RunModelScenario(Rusle2Protocol.DecodeRequest(request), out length);
+            }
+            catch (Exception ex) when (ex is InvalidDataException || ex is EndOfStreamException)
+            {
+                response = Rusle2Protocol.EncodeError($"Bad request: {ex.Message}", out length);
+            }
+            Rusle2Protocol.WriteFrame(toServer, response, length);
+        }
+        return 0;
+    }
+
+    static byte[] RunModelScenario(Rusle2Scenario scenario, out int length)
+    {
+        IntPtr file = rusle2.FilesOpen(scenario.FileName);
+        if (file == IntPtr.Zero)
+            return Rusle2Protocol.EncodeError($"Couldn't open '{scenario.FileName}'", out length);
+        try
+        {
+            int set = rusle2.FileSetAttrValues(file, scenario.Inputs);
+            if (set != scenario.Inputs.Count)
+                return Rusle2Protocol.EncodeError($"Only {Math.Max(set, 0)} of {scenario.Inputs.Count} inputs could be set", out length);
+            if (rusle2.EngineRun() == false)
+                return Rusle2Protocol.EncodeError("Couldn't run the engine", out length);
+            return Rusle2Protocol.EncodeResponse(rusle2.FileGetAttrValues(file, scenario.Outputs, scenario.AttrUnits), out length);
+        }
+        finally
+        {
+            // Inputs like "#RD:MAN_BASE_PTR:OP_DATE" change the files the scenario points to as well, so
+            // close everything to start the next scenario from the database again.
+            rusle2.FilesCloseAll();
+        }
+    }
+}
@@ -13,9 +13,43 @@ internal partial class Program
         string dir = Directory.GetCurrentDirectory();
         string r2Path = @"..\..\..\sample.gdb";
         Console.WriteLine($"Hello, World! I'm in '{dir}' and want '{r2Path}'");
+        // The server only relays scenarios to its workers, which load R2 themselves.
+        if (args.Length > 0 && args[0] == "--serve")
+        {
+            Environment.ExitCode = RunModelServer(args);
+            return;
+        }
+        // The suite opens the database itself, to time starting R2.
+        if (args.Length > 0 && args[0] == "--golden")
+        {
+            Environment.ExitCode = RunGoldenSuite(args, r2Path);
+            return;
+        }
         
         if (rusle2.OpenDatabase(r2Path) == false)
             throw new Exception($"Couldn't open database with path '{r2Path}'. Maybe set the startup path in Visual Studio?");
+        if (args.Length > 0 && (args[0] == "--bench" || args[0] == "--replay"))
+        {
+            Environment.ExitCode = RunBenchmark(args);
+            rusle2.FilesCloseAll();
+            return;
+        }
+        if (args.Length > 0 && args[0] == "--bench-floats")
+        {
+            Environment.ExitCode = RunFloatBenchmark(args);
+            rusle2.FilesCloseAll();
+            return;
+        }
+        if (args.Length > 0 && args[0] == "--nested-batch")
+        {
+            Environment.ExitCode = RunNestedBatchCheck(args);
+            return;
+        }
+        if (args.Length > 0 && args[0] == "--worker")
+        {
+            Environment.ExitCode = RunModelWorker(args);
+            return;
+        }
          if (rusle2.ProfileOpen() == false)
             throw new Exception("Could not open profile");
         SetProfAttr("CLIMATE_PTR",@"climates\USA\Wisconsin\Dane County",0);
@@ -1,4 +1,6 @@
 ﻿using System;
+using System.Collections.Generic;
+using System.Threading.Tasks;
 
 namespace SnapPlus.Models.Erosion.Interfaces
 {
@@ -6,39 +8,84 @@ namespace SnapPlus.Models.Erosion.Interfaces
     {
         bool OpenDatabase(string path);
         bool CloseDatabase();
+        int DatabasePreload(string pattern, bool recurse = true);
+        bool DatabaseSetSharedCache(string cacheDir);
+        int FilesPreopen(IReadOnlyList<string> fileNames, int workers = 0);
+        IEnumerable<string[]> DatabaseFindFiles(string pattern, bool recurse = true, params uint[] infoTypes);
         IntPtr FilesOpen(string fileNameInDatabase, int flags = 0);
         // Close the open R2 filesystem
         bool FilesCloseAll();
         bool FileClose(IntPtr filePtr);
+        IntPtr FileClone(IntPtr fileHandle, string newName = null);
+        int FileCaptureBaseline(IntPtr fileHandle);
+        int FileReset(IntPtr fileHandle);
+        bool FileReleaseBaseline(IntPtr fileHandle);
+        bool FileListenChanges(IntPtr fileHandle, Action<IReadOnlyList<(string attrName, int first, int last, bool resized)>> onChanges);
+        bool FileStopListening(IntPtr fileHandle);
         // Close and reopen the profile
         bool ProfileFlush();
         public IntPtr GetFileSysHandle();
         (IntPtr, string) GetProfile();
         bool EngineRun(); // uses internal engine pointer
+        int EngineRunEx(); // uses internal engine pointer
+        Task<int> EngineRunAsync(); // uses internal engine pointer
+        int EngineGetSetCount(); // uses internal engine pointer
+        string[][] EngineRunBatch(IReadOnlyList<(string fileName, IReadOnlyList<(string attrName, string value, int index)> inputs)> runs,
+            IReadOnlyList<(string attrName, int index)> outputs, int workers = 0, Action<int, int> runDone = null);
+        string[] FileRunCached(IntPtr fileHandle, IReadOnlyList<(string attrName, int index)> outputs, string attrUnits = "");
+        int ResultCacheSetLimit(int limit);
+        bool SetBatchMode(bool batch);
+        int DumpBatchLog();
+        string GetStats(bool reset = false);
+        string GetMemoryStats();
+        int TrimMemory();
+        int ArenaReset(bool release = false);
+        (int sharedLocks, int exclusiveLocks, int sharedWaits, int exclusiveWaits, int unsettled, double waitMs)? GetLockStats(bool reset = false);
+        int ResultCacheLoad(string path);
+        int ResultCacheSave(string path);
         bool EngineGetAutorun(); // uses internal engine pointer
         bool EngineSetAutorun(bool autoRun); // uses internal engine pointer
         string GetTitle(string key);
+        string[] GetTitles(IReadOnlyList<string> keys);
+        bool TemplateLoad(string fileName);
         IntPtr ProfileGetAttr(string attrName);
         IntPtr FileGetAttr(IntPtr fileHandle, string attrName);
         int FileGetAttrSize(IntPtr fileHandle, string attrName);
         int GetAttrDimSize(string attrName);
         string FileGetAttrValue(IntPtr fileHandle, string attrName, int index);
+        bool FileTryGetAttrValue(IntPtr fileHandle, string attrName, int index, Span<char> value, out int charsWritten);
         //18Aug21 JWW Get GDB Climate precip in inches
         string FileGetAttrValueAux(IntPtr fileHandle, string attrName, int index, string attrUnits);
         int FileSetAttrValue(IntPtr fileHandle, string attrName, string value, int index);
+        int FileSetAttrValues(IntPtr fileHandle, IReadOnlyList<(string attrName, string value, int index)> values);
+        string[] FileGetAttrValues(IntPtr fileHandle, IReadOnlyList<(string attrName, int index)> attrs, string attrUnits = "");
+        double[] FileGetFloatArrays(IntPtr fileHandle, IReadOnlyList<(string attrName, string attrUnits)> attrs, out int[] offsets, out int[] sizes);
+        double[] ProfileGetFloatArrays(IReadOnlyList<(string attrName, string attrUnits)> attrs, out int[] offsets, out int[] sizes);
+        IntPtr FileResolveAttr(IntPtr fileHandle, string attrName);
+        IntPtr ProfileResolveAttr(string attrName);
+        void AttrHandleClose(IntPtr attrHandle);
+        int AttrHandleGetSize(IntPtr attrHandle);
+        string AttrHandleGetValue(IntPtr attrHandle, int index, string attrUnits = "");
+        int AttrHandleSetValue(IntPtr attrHandle, string value, int index);
         bool ProfileOpen(string profileName = @"profiles\default");
         int ProfileSetAttrSize(string attrName, int newSize);
         int FileSetAttrSize(IntPtr fileHandle, string attrName, int newSize);
+        int FileSetDimRows(IntPtr fileHandle, string dimAttr, IReadOnlyList<string> columns, IReadOnlyList<string[]> rows);
+        int ProfileSetDimRows(string dimAttr, IReadOnlyList<string> columns, IReadOnlyList<string[]> rows);
         int ProfileGetAttrSize(string attrName);
         string ProfileGetAttrValue(string attrName, int index);
         int ProfileSetAttrValue(string attrName, string value, int index);
+        int ProfileSetAttrValues(IReadOnlyList<(string attrName, string value, int index)> values);
+        string[] ProfileGetAttrValues(IReadOnlyList<(string attrName, int index)> attrs);
         string GetPropertyStr(int propertyId);
         string GetLastError();
         void ClearLastError();
         int GetScienceVersion();
         bool FileSaveAsXml(IntPtr fileHandle, string filePath);
+        bool FileSaveAsBinary(IntPtr fileHandle, string filePath);
         int FilesGetCount(IntPtr fileSystemPtr);
         IntPtr FilesGetItem(IntPtr fileSystemPtr, int index);
+        string[] FilesGetDependencies(IntPtr fileSystemPtr, string fileName);
         string FileGetFullname(IntPtr fileHandle);
 
 
@@ -36,6 +36,10 @@
 #include "rxfiles.h"
 #include "titles.h"     // UnitTestCanRun()
 
+#include <malloc.h>     // _heapmin()
+#include <psapi.h>      // GetProcessMemoryInfo()
+#pragma comment(lib, "psapi.lib")
+
 
 #ifdef BUILD_MOSES // ROMEDLL_IGNORE
 #include "mainfrm.h"
@@ -43,6 +47,209 @@
 
 typedef struct DBFIND RT_DBFIND;    //!< Opaque pointer to find result sets returned by Rome API.
 
+//! One attr value passed to RomeFileGetAttrValues() and RomeFileSetAttrValues().
+typedef struct RT_AttrValue
+{
+    RT_CNAME pszAttr;   //!< The parameter name used by the catalog (e.g. "SLOPE_STEEP").
+    RT_INT   nIndex;    //!< The "flat" index (use 0 for a 1x1 attr).
+    RT_CSTR  pszValue;  //!< The value string to set, or the value string returned.
+    RT_CNAME pszUnit;   //!< The unit of the value, or NULL / empty for the template unit.
+    RT_INT   nResult;   //!< The result for this value, set by the API function.
+} RT_AttrValue;
+
+//! One array of values returned by RomeFileGetFloatArrays().
+typedef struct RT_FloatArray
+{
+    RT_CNAME pszAttr;   //!< The parameter name used by the catalog (e.g. "SLOPE_DEGRAD").
+    RT_UINT  nVariant;  //!< The variant to get the values in (e.g. #RX_VARIANT_CATALOG).
+    RT_CNAME pszUnit;   //!< The unit to get the values in, or NULL / empty for the catalog unit.
+    RT_INT   nOffset;   //!< The index of the first value in the caller's buffer, set by the API function.
+    RT_INT   nSize;     //!< The number of values, set by the API function.
+    RT_INT   nResult;   //!< The result for this array, set by the API function.
+} RT_FloatArray;
+
+//! Flags for RomeEngineRunEx(). None are defined yet, so the flags must be 0.
+#define RX_ENGINE_RUN_FLAGMASK      0
+
+//! A pre-resolved attr returned by RomeFileResolveAttr().
+//! This is an opaque pointer to API callers.
+typedef struct ATTRHANDLE
+{
+    CRomeCore* pCore;       //!< The core of @c pFile, which outlives the file.
+    CFileObj* pFile;        //!< The file the attr name was resolved in.
+    CString   sAttr;        //!< The attr name as passed to RomeFileResolveAttr() (e.g. "#RD:MAN_BASE_PTR:OP_DATE").
+    CAttr*    pAttr;        //!< The resolved attr, or NULL if it must be resolved again.
+    LONG      nGeneration;  //!< The attr handle generation of the core (see AttrHandlesInvalidate()) when @c pAttr was resolved.
+} RT_AttrHandle;
+
+//! A forward-only search cursor returned by RomeDatabaseFindOpenStream().
+//! Only the folder being listed (or the query result being read) is held at a time.
+//! This is an opaque pointer to API callers.
+typedef struct DBCURSOR
+{
+    CRomeCore*   pCore;         //!< The core of @c pDatabase, which is checked before @c pDatabase is used.
+    RT_Database* pDatabase;     //!< The database being searched.
+    CString      sPattern;      //!< The pattern, or the SQL query for #RX_DBFIND_QUERY.
+    UINT         nFlags;        //!< The find flags, as passed to RomeDatabaseFindOpenStream().
+    DBFIND*      pFind;         //!< The folder listing or query result being read, or NULL if none is open.
+    long         nNext;         //!< The next row of @c pFind to return.
+    CStringList  Folders;       //!< For #RX_DBFIND_RECURSE, the folders still to be listed, next first.
+    BOOL         bDone;         //!< TRUE when nothing is left to open.
+} RT_DBCursor;
+
+//! One run passed to RomeEngineRunBatch().
+typedef struct RT_BatchItem
+{
+    RT_CSTR       pszFile;      //!< The file to open and run, as for RomeFilesOpen() (e.g. "profiles\farm1").
+    RT_AttrValue* pInputs;      //!< The values to set in the file before running, or NULL.
+    RT_INT        nInputs;      //!< The number of elements in @c pInputs.
+    RT_AttrValue* pOutputs;     //!< The values to get from the file after running, or NULL.
+    RT_INT        nOutputs;     //!< The number of elements in @c pOutputs.
+    RT_PCHAR      pOutBuf;      //!< The caller-owned buffer to return the output value strings in.
+    RT_UINT       nOutBufLen;   //!< The length of @c pOutBuf.
+    RT_INT        nWorker;      //!< The worker which ran this item, set by the API function.
+    RT_INT        nResult;      //!< The result for this item, set by the API function.
+} RT_BatchItem;
+
+//! Events sent by RomeEngineRunBatch() to its event handler.
+#define RX_EVENT_BATCH_ITEM_DONE    1       //!< An item finished. The event data is its #RT_BatchItem.
+
+//! Events sent by RomeEngineRunAsync() to its event handler.
+#define RX_EVENT_ENGINE_RUN_DONE    2       //!< The run finished. The event data is the result of RomeEngineRunEx(), cast to a pointer.
+
+//! Events sent to a listener added by RomeListenerCoalesced().
+#define RX_EVENT_CHANGES            3       //!< Attr values changed. The event data is an #RT_ChangeBatch.
+
+//! The kinds of change in an #RT_ChangeEvent.
+#define RX_CHANGE_VALUE             1       //!< Values in the index range were set.
+#define RX_CHANGE_SIZE              2       //!< The attr (or the dimension it is on) was resized.
+
+//! The changes to one attr since the last batch, coalesced.
+typedef struct RT_ChangeEvent
+{
+    RT_FileObj*   pFile;        //!< The file the changes were made through.
+    RT_SubObj*    pObj;         //!< The object the attr belongs to (another file's for a "#RD:" chained attr).
+    RT_CNAME      pszAttr;      //!< The attr name.
+    RT_INT        nFirst;       //!< The lowest index set or inserted at, or -1 if there is none.
+    RT_INT        nLast;        //!< The highest index set or inserted at, or -1 if there is none.
+    RT_UINT       nFlags;       //!< The kinds of change, #RX_CHANGE_VALUE and/or #RX_CHANGE_SIZE.
+} RT_ChangeEvent;
+
+//! The event data of #RX_EVENT_CHANGES. It is only valid during the callback.
+typedef struct RT_ChangeBatch
+{
+    const RT_ChangeEvent* pEvents;  //!< The changes, in the order each attr first changed.
+    RT_INT        nEvents;      //!< The number of elements in @c pEvents.
+} RT_ChangeBatch;
+
+//! The largest number of workers used by RomeEngineRunBatch() and RomeFilesPreopen().
+#define RX_BATCH_MAXWORKERS         64
+
+//! The default number of results kept by the result cache (see RomeResultCacheSetLimit()).
+#define RX_RESULTCACHE_DEFAULTLIMIT 1000
+
+//! The header of files written by RomeResultCacheSave().
+#define RX_RESULTCACHE_MAGIC        "RomeResultCache"
+#define RX_RESULTCACHE_VERSION      2
+
+//! Flags for RomeFileSaveAsEx(), in addition to those in the SDK header (e.g. #RX_FILE_SAVEASEX_CALC).
+#define RX_FILE_SAVEASEX_BINARY     0x10000 //!< Save an external file as a binary snapshot, as the "#BIN:" prefix does.
+
+//! The header of binary snapshots written by the "#BIN:" prefix of RomeFileSaveAsEx().
+//! A snapshot is another container for what an XML file holds: the same value strings, in flat
+//!   tables instead of elements. It isn't a dump of the decoded model, so opening one still
+//!   parses every value and runs the engine, as opening XML does.
+#define BINSNAP_MAGIC               "RomeSnap"
+#define BINSNAP_VERSION             1
+
+//! Flags of a binary snapshot (see BINSNAPHEADER).
+#define BINSNAP_CALC                0x0001  //!< Calculated values (catalog flag #ACF_NO_USER_EDIT) were saved too, for reading only.
+
+//! Flags of an attr in a binary snapshot (see BINSNAPATTR).
+#define BINSNAP_ATTR_PTR            0x0001  //!< A pointer or subobject attr. The engine is drained after setting it.
+#define BINSNAP_ATTR_DIM            0x0002  //!< A dimension. Its size is set, instead of its values.
+#define BINSNAP_ATTR_CALC           0x0004  //!< A calculated value. It isn't set when the snapshot is opened.
+
+//! The layout of a binary snapshot. It is read in place from a mapped view of the file, so
+//!   the header is followed by the attr table, the value table and then the string pool,
+//!   all 4-byte aligned. Strings are byte offsets into the pool, which starts with an
+//!   empty string and ends with a NUL, and repeated strings are stored once.
+typedef struct BINSNAPHEADER
+{
+    char szMagic[8];    //!< #BINSNAP_MAGIC, without a NUL.
+    UINT nVersion;      //!< #BINSNAP_VERSION.
+    UINT nHeaderSize;   //!< sizeof(BINSNAPHEADER), so the header can grow in later versions.
+    UINT nScience;      //!< The science version (see RomeGetScienceVersion()) of the saving DLL.
+    UINT nFlags;        //!< #BINSNAP_CALC.
+    UINT nObjType;      //!< The object type (e.g. "PROFILE").
+    UINT nFileName;     //!< The fullname of the saved file (e.g. "profiles\workingarm1").
+    UINT nAttrs;        //!< The number of BINSNAPATTR records.
+    UINT nValues;       //!< The number of value strings, for all attrs.
+    UINT nPoolSize;     //!< The size of the string pool in bytes.
+} BINSNAPHEADER;
+
+//! An attr in a binary snapshot, in the order they are set when it is opened.
+typedef struct BINSNAPATTR
+{
+    UINT nName;         //!< The attr name, which may be chained into a subobject (e.g. "#RD:SLOPE_ROT_BUILD_SUB_OBJ_PTR:ROT_BUILD_APPLY").
+    UINT nUnit;         //!< The unit the values are in.
+    UINT nFlags;        //!< #BINSNAP_ATTR_PTR, #BINSNAP_ATTR_DIM and #BINSNAP_ATTR_CALC.
+    UINT nFirst;        //!< The index of the first value in the value table.
+    UINT nCount;        //!< The number of values (the size of a dimension).
+} BINSNAPATTR;
+
+//! The starting value of a 64-bit FNV-1a hash (see HashFnv1a()).
+#define FNV1A_64_INIT               0xCBF29CE484222325ui64
+
+//! Pragmas handled by RomeFilesPragma() itself, instead of CFileSys::Pragma().
+//! These are well above the values used by CFileSys::Pragma() (e.g. #RX_PRAGMA_DB_CLEAR_CACHE).
+#define RX_PRAGMA_BATCH_MODE        0x10000 //!< Enter batch mode if @c pExtra is non-NULL, leave it if NULL.
+#define RX_PRAGMA_BATCH_DUMP        0x10001 //!< Write the batch mode diagnostic ring to the history log.
+#define RX_PRAGMA_TRIM              0x10002 //!< Free the memory held by the API caches (see MemTrim()).
+
+//! The number of calls kept in the diagnostic ring of a core in batch mode.
+#define RX_BATCH_RINGSIZE           256
+
+//! Counters for the API gate of a core (see ROME_API_READLOCK()), returned by RomeGetLockStats().
+typedef struct RT_LockStats
+{
+    RT_INT  nSharedLocks;       //!< Read-only calls which shared the gate with each other.
+    RT_INT  nExclusiveLocks;    //!< Calls which had the gate to themselves.
+    RT_INT  nSharedWaits;       //!< Shared locks which had to wait for a call which had the gate to itself.
+    RT_INT  nExclusiveWaits;    //!< Exclusive locks which had to wait for another call.
+    RT_INT  nUnsettled;         //!< Read-only calls which took the gate exclusively, because the engine had updates pending or the attr had to be created.
+    double  dWaitMs;            //!< The total time spent waiting for the gate, in milliseconds.
+} RT_LockStats;
+
+//! The largest number of API gates a thread may hold shared at once, in nested calls for separate cores.
+#define RX_APIGATE_MAXHELD          16
+
+//! The number of latency buckets kept for each timer reported by RomeGetStats().
+//! Bucket @c i counts the calls which took less than 2^i microseconds, and the last
+//!   bucket counts all longer calls (over half a second).
+#define ROMESTAT_BUCKETS            20
+
+//! The largest number of API functions timed by RomeGetStats().
+#define ROMESTAT_MAXFUNCS           160
+
+//! The size of each block of the string arena of a thread (see RomeArenaReset()).
+//! A longer string gets a block of its own.
+#define RX_ARENA_BLOCKSIZE          0x10000
+
+//! Flags for RomeArenaReset().
+#define RX_ARENA_RESET              0x0000  //!< Reuse the arena from its start, enabling it if needed.
+#define RX_ARENA_RELEASE            0x0001  //!< Free the arena, and go back to per-function result strings.
+
+//! Flags for RomeFileReset().
+#define RX_FILERESET_RESTORE        0x0000  //!< Restore the file to its baseline.
+#define RX_FILERESET_CAPTURE        0x0001  //!< Capture the file's current values as its baseline.
+#define RX_FILERESET_RELEASE        0x0002  //!< Free the file's baseline.
+
+//! How an API function takes the API gate of a core (see CApiGateLock).
+#define APIGATE_EXCLUSIVE           0   //!< Alone, for calls which may change the model.
+#define APIGATE_SHARED              1   //!< Shared with other read-only calls.
+#define APIGATE_SETTLED             2   //!< Shared if the engine has no updates pending, otherwise exclusive.
+
 
 #ifdef _DEBUG
 #undef THIS_FILE
@@ -109,244 +316,4395 @@ Rome API functions generally have the following structure:
 // There should be no global variables use unless absolutely necessary.
 // Global variables are incompatible with thread-safe code.
 
+//! The Rome cores created by RomeInit() with the "/NewCore" argument.
+//! The static App instance is not in this list.
+//! The state the API keeps for a core is in the core itself (see CoreApi()), so this
+//!   list is only used to validate core pointers.
+//! Access is guarded by #RomeCoresLock.
+LOCAL CList<CRomeCore*, CRomeCore*> RomeCores;
+
+//! The lock for #RomeCores. RomeCoreIsValid() holds it shared, so the cores don't wait for each other.
+LOCAL SRWLOCK RomeCoresLock = SRWLOCK_INIT;
+
+//! The core (CRomeCore*) which opened each find result set (DBFIND*) returned by RomeDatabaseFindOpen(),
+//!   so that the other find functions take the gate of the core whose database the result set reads.
+//! Access is guarded by #RomeFindsLock.
+LOCAL CMapPtrToPtr RomeFinds;
+
+//! The lock for #RomeFinds.
+LOCAL SRWLOCK RomeFindsLock = SRWLOCK_INIT;
+
+//! The lock around the history and RomeShell logs, which all cores write to.
+//! It is only held while an entry is written (see ROME_API_LOG() and ROME_API_LOGELEM()),
+//!   so the calls of separate cores only wait for each other while they log.
+//!   The entries of calls on separate cores may be interleaved in the logs.
+//! Nothing else is locked while it is held, so it may be taken under any other lock.
+LOCAL CCriticalSection ApiLogLock;
+
+//! Holds #ApiLogLock while an entry is written to the history or RomeShell log.
+class CApiLogHold
+{
+public:
+    CApiLogHold()  { ApiLogLock.Lock(); }
+    ~CApiLogHold() { ApiLogLock.Unlock(); }
+};
+
+//! Releases #ApiLogLock after the start tag of a log element is written,
+//!   and takes it again for its end tag (see ROME_API_LOGELEM()).
+class CApiLogPause
+{
+public:
+    CApiLogPause()  { ApiLogLock.Unlock(); }
+    ~CApiLogPause() { ApiLogLock.Lock(); }
+};
+
+//! Write an entry to the history or RomeShell log under #ApiLogLock.
+//! This is an expression with the value of @p write, e.g. ROME_API_LOG(LogFilePrintf0(LOG_SHELL, "RomeExit\n")).
+#define ROME_API_LOG(write)             ((void)CApiLogHold(), (write))
+
+//! Declare a history log element (CLogFileElement) for the rest of the scope.
+//! Its start tag and its end tag are written under #ApiLogLock, which isn't held in between.
+#define ROME_API_LOGELEM(elem)          ROME_API_LOGELEM_(elem, __LINE__)
+#define ROME_API_LOGELEM_(elem, n)      ROME_API_LOGELEM__(elem, n)
+#define ROME_API_LOGELEM__(elem, n)     CApiLogHold ApiLogHold##n; elem; CApiLogPause ApiLogPause##n
+
+//! A change waiting in a listener added by RomeListenerCoalesced().
+typedef struct PENDINGCHANGE
+{
+    CFileObj*  pFile;       //!< The file the change was made through.
+    CSubObj*   pObj;        //!< The object the attr belongs to.
+    CAttr*     pAttr;       //!< The attr, only compared to merge changes, since it may be deleted before delivery.
+    CString    sAttr;       //!< The attr name.
+    int        nFirst;      //!< The lowest index changed, or -1.
+    int        nLast;       //!< The highest index changed, or -1.
+    UINT       nFlags;      //!< #RX_CHANGE_VALUE and/or #RX_CHANGE_SIZE.
+} PENDINGCHANGE;
+
+typedef CArray<PENDINGCHANGE, const PENDINGCHANGE&> PENDINGCHANGES;
+
+//! A listener added by RomeListenerCoalesced().
+typedef struct COALESCEDLISTENER
+{
+    UINT             nTargetType;   //!< #RX_LISTENER_TARGET_FILE or #RX_LISTENER_TARGET_OBJ.
+    RT_void*         pTarget;       //!< The file or object listened to.
+    RT_void*         pObserver;     //!< The observer passed to the event handler.
+    RT_EventHandler  pEventHandler; //!< The event handler.
+    PENDINGCHANGES   Pending;       //!< The changes since the last batch, one for each attr.
+    CMap<CAttr*, CAttr*, INT_PTR, INT_PTR> PendingIndex;   //!< The index in @c Pending of each attr's change.
+} COALESCEDLISTENER;
+
+typedef CList<COALESCEDLISTENER*, COALESCEDLISTENER*> COALESCEDLISTENERS;
+
+//! A saved result in the cache used by RomeFileRunCached().
+typedef struct RESULTCACHEENTRY
+{
+    CString      sKey;      //!< The fingerprint of the inputs and outputs (see ResultCacheKey()).
+    CStringArray aValues;   //!< The output value strings, in the order requested.
+    CByteArray   aFound;    //!< For each output, TRUE if the value was found, FALSE if getting it failed.
+} RESULTCACHEENTRY;
+
+//! The results saved by RomeFileRunCached(), most recently used first.
+//! This is shared by all cores, since the key doesn't depend on the core.
+//! Access is guarded by RFX_CRITICAL_SECTION().
+LOCAL CList<RESULTCACHEENTRY*, RESULTCACHEENTRY*> ResultCacheList;
+
+//! The position in #ResultCacheList of each cached result, by key.
+//! Access is guarded by RFX_CRITICAL_SECTION().
+LOCAL CMapStringToPtr ResultCacheMap;
+
+//! The largest number of results kept in #ResultCacheList. 0 disables the cache.
+//! Access is guarded by RFX_CRITICAL_SECTION().
+LOCAL int ResultCacheLimit = RX_RESULTCACHE_DEFAULTLIMIT;
+
+//! An API call recorded in the diagnostic ring of a core in batch mode.
+typedef struct BATCHLOGENTRY
+{
+    LPCSTR pszFunc;         //!< The API function name. This is a string literal, so it isn't copied.
+    char   szAttr[48];      //!< The attr name, truncated if needed.
+    int    nIndex;          //!< The index argument.
+    int    nResult;         //!< The result (#RX_TRUE, #RX_FALSE or #RX_FAILURE).
+} BATCHLOGENTRY;
+
+//! The batch mode state of a core (see #RX_PRAGMA_BATCH_MODE).
+typedef struct BATCHCORE
+{
+    volatile BOOL       bOn;                    //!< TRUE while the core is in batch mode.
+    BATCHLOGENTRY       aRing[RX_BATCH_RINGSIZE];
+    int                 nNext;                  //!< The total number of calls recorded in @c aRing.
+} BATCHCORE;
+
+//! The reader/writer gate taken by the API functions of a core.
+//! It is the core's API lock: calls for separate cores take separate gates.
+typedef struct APIGATE
+{
+    SRWLOCK          Lock;              //!< Held shared by read-only calls, or exclusively by all other calls.
+    CCriticalSection ReadLock;          //!< Taken by shared holders around their (short) access to the model.
+    volatile DWORD   nOwner;            //!< The thread holding the gate exclusively, or 0.
+    int              nDepth;            //!< The number of nested API calls made by @c nOwner.
+    volatile LONG    nSharedLocks;
+    volatile LONG    nExclusiveLocks;
+    volatile LONG    nSharedWaits;
+    volatile LONG    nExclusiveWaits;
+    volatile LONG    nUnsettled;
+    volatile LONGLONG nWaitTicks;       //!< In QueryPerformanceCounter() ticks.
+} APIGATE;
+
+//! A gate held shared by this thread, with the number of nested API calls using it.
+typedef struct APIGATEHELD
+{
+    APIGATE* pGate;
+    int      nDepth;
+} APIGATEHELD;
+
+//! The gates this thread holds shared, so nested API calls don't take them again.
+LOCAL __declspec(thread) APIGATEHELD ApiGatesHeld[RX_APIGATE_MAXHELD];
+LOCAL __declspec(thread) int ApiGatesHeldCount = 0;
+
+//! The number of RomeInit() calls in progress on this thread, which hold RFX_CRITICAL_SECTION().
+//! RomeEngineRunBatch() doesn't start workers within them, since each worker's RomeInit() would wait for it.
+LOCAL __declspec(thread) int RomeInitDepth = 0;
+
+//! Counts a RomeInit() call in #RomeInitDepth while it is in scope.
+class CRomeInitScope
+{
+public:
+    CRomeInitScope()  { RomeInitDepth++; }
+    ~CRomeInitScope() { RomeInitDepth--; }
+};
+
+//! The template file last loaded by RomeTemplateLoad(), with its size and write time then.
+struct TEMPLATESTAMP
+{
+    CString   sPath;            //!< The full path of the template file.
+    ULONGLONG nSize;            //!< The size of the file when it was loaded.
+    ULONGLONG nWriteTime;       //!< The last write time of the file (a FILETIME) when it was loaded.
+};
+
+//! The state the API keeps for a Rome core.
+//! Apart from the gate, and where noted, it is only used by the core's calls holding its gate exclusively.
+typedef struct COREAPI
+{
+    APIGATE            Gate;
+    BATCHCORE          Batch;           //!< See CoreGetBatch().
+    volatile LONG      nApiSets;        //!< The number of attr values changed through the API since the engine last ran (Interlocked).
+    volatile LONG      nAttrHandleGeneration;   //!< See AttrHandlesInvalidate() (Interlocked).
+    COALESCEDLISTENERS Listeners;       //!< The listeners added by RomeListenerCoalesced().
+    CMapPtrToPtr       FileBaselines;   //!< The baselines captured by RomeFileReset() (FILEBASELINE*), by file (CFileObj*).
+    CString            sSharedCacheDir; //!< The folder of the shared database cache (see RomeDatabaseSetSharedCache()), or empty.
+    TEMPLATESTAMP      Template;        //!< The template loaded by RomeTemplateLoad(), so loading it again unchanged can be skipped.
+                                        //!<   The path is empty if the active template may differ from a file on disk.
+
+    COREAPI();
+} COREAPI;
+
+//! A Rome core created by RomeInit() with the "/NewCore" argument, which holds its own API state.
+//! It is freed by RomeExit() through this type.
+class CRomeApiCore : public CRomeCore
+{
+public:
+    COREAPI Api;
+};
+
+//! The API state of the static App instance, which isn't a CRomeApiCore.
+LOCAL COREAPI AppApi;
+
+//! A block of the string arena of a thread (see RomeArenaReset()).
+//! The strings are stored in the block after this header.
+typedef struct ARENABLOCK
+{
+    ARENABLOCK* pNext;
+    UINT        nSize;      //!< The number of bytes for strings in this block.
+    UINT        nUsed;
+} ARENABLOCK;
+
+//! The string arena of this thread, or NULL if it isn't enabled.
+//! The blocks are kept (and reused) when the arena is reset.
+LOCAL __declspec(thread) ARENABLOCK* ArenaFirst = NULL;
+
+//! The block of #ArenaFirst that new strings are added to.
+LOCAL __declspec(thread) ARENABLOCK* ArenaCurrent = NULL;
+
+//! The number of CArenaBypass objects in scope on this thread.
+LOCAL __declspec(thread) int ArenaBypassDepth = 0;
+
+//! The bytes allocated for the string arenas of all threads, for RomeGetMemoryStats().
+//! Access is through the Interlocked*() functions.
+LOCAL volatile LONG ArenaBytes = 0;
+
+//! A timer reported by RomeGetStats(): a call count, the total time and a latency histogram.
+//! Access is through the Interlocked*() functions.
+typedef struct ROMESTAT
+{
+    LPCSTR            pszName;                      //!< The function timed. This is a string literal.
+    volatile LONG     nCalls;
+    volatile LONGLONG nTicks;                       //!< In QueryPerformanceCounter() ticks.
+    volatile LONG     aBuckets[ROMESTAT_BUCKETS];
+} ROMESTAT;
+
+//! The timers for each API function, in the order they were first called.
+//! Additions are guarded by RFX_CRITICAL_SECTION().
+LOCAL ROMESTAT* RomeStatFuncs[ROMESTAT_MAXFUNCS];
+LOCAL volatile LONG RomeStatFuncCount = 0;
+
+//! The timers for the work done inside API functions.
+LOCAL ROMESTAT RomeStatLockWait      = { "lockWait" };      //!< Waiting for an API gate (see ApiGateAcquire()).
+LOCAL ROMESTAT RomeStatFinishUpdates = { "finishUpdates" }; //!< In CEngineBase::FinishUpdates().
+LOCAL ROMESTAT RomeStatEngineRun     = { "engineRun" };     //!< In CEngineBase::Run().
+
+//! The counters reported by RomeGetStats().
+//! Access is through the Interlocked*() functions.
+LOCAL volatile LONG RomeStatAttrFinds    = 0;   //!< Calls to FindOrCreate().
+LOCAL volatile LONG RomeStatAttrCreates  = 0;   //!< Calls to FindOrCreate() which created the attr.
+LOCAL volatile LONG RomeStatFileOpens    = 0;   //!< Files opened by RomeFilesOpen().
+LOCAL volatile LONG RomeStatFileOpenHits = 0;   //!< Files opened by RomeFilesOpen() which were already open.
+LOCAL volatile LONG RomeStatSharedHits   = 0;   //!< Database files opened from a shared cache (see RomeDatabaseSetSharedCache()).
+LOCAL volatile LONG RomeStatSharedSaves  = 0;   //!< Database files saved to a shared cache.
+LOCAL volatile LONG RomeStatTemplateHits = 0;   //!< Calls to RomeTemplateLoad() which found the template already loaded.
+
+// Defined after the binary snapshot functions they use.
+LOCAL BOOL SharedCacheOpen(CFileSys* pFiles, LPCSTR pszFullname, UINT nFlags, CFileObj*& pFO);
+LOCAL void FileBaselinesPrune(CRomeCore& Core, BOOL bAll);
+LOCAL BOOL ResultCacheKey(CRomeCore& Core, CFileObj* pFile, const RT_AttrValue* pOutputs, int nOutputs, RT_UINT nVariant, CString& sKey);
+
 
 /////////////////////////////////////////////////////////////////////////////
 // Global utility functions
 
-#if USE_ROMESHELL_LOGGING
-
-//! Activate a filename for use in the RomeShell log file.
-//! This will generate an "Activate" command if the filename
-//!   is different from the currently active one.
-//! @param pszFile  The filename to activate.
-//!                 This may be empty or NULL.
-//! @return TRUE on success, FALSE on failure.
+//! Check that a pointer refers to a live Rome core.
+//! This is either the static App instance, or a core created by RomeInit()
+//!   with the "/NewCore" argument which hasn't been freed by RomeExit() yet.
+//! @param pCore  The core pointer to test. This may be NULL.
+//! @return TRUE if this is a valid core, FALSE otherwise.
 //!
-BOOL LogShellActivate(LPCSTR pszFile)
+BOOL RomeCoreIsValid(const CRomeCore* pCore)
 {
-    CString sOldFile = ::RomeThreadGetNamedString("LogShellActivate");
-    CString sNewFile = pszFile;
-    BOOL bSuccess = TRUE;
-    if (!FullnameEquals(pszFile, sOldFile))
-    {
-        bSuccess = (LogFilePrintf0(LOG_SHELL, "Activate \"%s\"\n", sNewFile) > 0);
-        RomeThreadSetNamedString("LogShellActivate", sNewFile);
-    }
-    return bSuccess;
+    if (pCore == NULL)
+        return FALSE;
+    if (pCore == &App)
+        return TRUE;
+
+    AcquireSRWLockShared(&RomeCoresLock);
+    const BOOL bValid = (RomeCores.Find((CRomeCore*)pCore) != NULL);
+    ReleaseSRWLockShared(&RomeCoresLock);
+    return bValid;
 }
 
-#endif // USE_ROMESHELL_LOGGING
 
+//! Add a core created by RomeInit() with the "/NewCore" argument to #RomeCores, or remove it.
+//! A removed core is no longer valid, so no new API call can take its gate.
+//! @param pCore      The core.
+//! @param bRegister  TRUE to add it, FALSE to remove it.
+//!
+LOCAL void RomeCoreRegister(CRomeCore* pCore, BOOL bRegister)
+{
+    AcquireSRWLockExclusive(&RomeCoresLock);
+    POSITION pos = RomeCores.Find(pCore);
+    if (bRegister && !pos)
+        RomeCores.AddTail(pCore);
+    else
+    if (!bRegister && pos)
+        RomeCores.RemoveAt(pos);
+    ReleaseSRWLockExclusive(&RomeCoresLock);
+}
 
-/////////////////////////////////////////////////////////////////////////////
-//! @name Rome session functions
-//! @{
 
-//! Get a pointer to the Rome database interface.
-//! This pointer is used for all Rome database operations.
-//! This pointer does not need to be freed or released when finished using it.
-//! @note This will return a non-NULL pointer, even if a database hasn't been opened
-//!   using RomeDatabaseOpen(). The pointer represents the abstract interface itself,
-//!   not the database connection.
-//! @param pApp  The Rome interface pointer obtained from RomeInit().
-//! @return the interface pointer, or NULL on failure.
+//! Record the core which opened a find result set, or forget it when the result set is closed.
+//! @param pFind  The find result set.
+//! @param pCore  The core which opened it, or NULL to forget it.
 //!
-//! @RomeAPI Wrapper for CRomeCore::Files.
+LOCAL void FindSetRegister(DBFIND* pFind, CRomeCore* pCore)
+{
+    AcquireSRWLockExclusive(&RomeFindsLock);
+    if (pCore)
+        RomeFinds.SetAt(pFind, pCore);
+    else
+        RomeFinds.RemoveKey(pFind);
+    ReleaseSRWLockExclusive(&RomeFindsLock);
+}
+
+
+//! Get the core which opened a find result set.
+//! @param pFind  The find result set. This may be NULL.
+//! @return  The core, or NULL if the result set isn't open (or its core has been freed).
 //!
-ROME_API RT_Database* RomeGetDatabase(RT_App* pApp)
+LOCAL CRomeCore* FindSetGetCore(DBFIND* pFind)
 {
-    try
-    {
-	    // Switch to the app's MFC module state while in this scope.
-	    // This is required for many MFC functions to work correctly.
-	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+    void* pCore = NULL;
+    AcquireSRWLockShared(&RomeFindsLock);
+    RomeFinds.Lookup(pFind, pCore);
+    ReleaseSRWLockShared(&RomeFindsLock);
+    return RomeCoreIsValid((CRomeCore*)pCore)? (CRomeCore*)pCore: NULL;
+}
 
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pApp,             "RomeGetDatabase: NULL Rome app pointer.");
-        BOOL bValidApp = (pApp == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,        "RomeGetDatabase: invalid Rome app pointer.");
-		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,         "RomeGetDatabase: RomeExit() has already been called.");
-#if USE_ROMEAPI_THREADIdS
-        THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,     "RomeGetDatabase: Rome API function called on different thread from RomeInit().");
-#endif
 
-        ROME_API_LOCK();
+COREAPI::COREAPI()
+{
+    InitializeSRWLock(&Gate.Lock);
+    Gate.nOwner = 0;
+    Gate.nDepth = 0;
+    Gate.nSharedLocks = Gate.nExclusiveLocks = 0;
+    Gate.nSharedWaits = Gate.nExclusiveWaits = Gate.nUnsettled = 0;
+    Gate.nWaitTicks = 0;
+    Batch.bOn  = FALSE;
+    Batch.nNext = 0;
+    nApiSets = 0;
+    nAttrHandleGeneration = 0;
+    Template.nSize = Template.nWriteTime = 0;
+}
 
-        // Does not require command logging.
 
-        return &pApp->Files;
-    }
-    catch (...)
-    {
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(0,                "RomeGetDatabase: exception.");
-    }
+//! Get the API state of a core.
+//! @param Core  A valid Rome core (see RomeCoreIsValid()).
+//! @return  The state held by the core, or #AppApi for the static App instance.
+//!
+inline COREAPI& CoreApi(const CRomeCore& Core)
+{
+    if (&Core == &App)
+        return AppApi;
+    return static_cast<CRomeApiCore&>(const_cast<CRomeCore&>(Core)).Api;
 }
 
 
-//! Return a full disk path given a path relative to the Rome root directory.
-//! If the directory has been redirected somewhere else,
-//!   then that location will be returned instead.
-//! @param pApp  The Rome interface pointer obtained from RomeInit().
-//! @param pszPath  A path (or file) name relative to the root directory.
-//!   The name argument is case-insensitive.
-//!   Standard subdirectory names which may be redirected:
-//!   - Binaries  For program executables and DLLs.
-//!   - Export    For files exported from Rusle2.
-//!   - Import    For files to be imported into Rusle2.
-//!   - Session   Used to store temporary files.
-//!   - Users     Used to store user templates.<br>
-//!   Examples:
-//!   - "Binaries"
-//!   - "Export\"
-//!   - "Import\database-name.gdb"
-//!   - "Session\Temp"<br>
-//!   If the path starts with an unrecognized directory, it is appended as a
-//!     subfolder of the root directory.
-//! @return The full pathname for the requested path, or NULL on error.
+//! Mark the attrs resolved by RomeFileResolveAttr() in a core as stale.
+//! This must be called by API functions which close files, remove attrs,
+//!   or set pointer values (which re-target "#RD:" chained attr names).
+//! @param Core  The Rome core whose attr handles are stale.
 //!
-//! @note The root directory is returned on NULL or empty string.
-//! @note This function works successfully on files and folders which don't exist.
-//!   That is because it works on the path name @em strings and redirection mappings,
-//!   not on the actual files and directories themselves.
-//! @RomeAPI Wrapper for CCoreSession::GetPath().
+void AttrHandlesInvalidate(CRomeCore& Core)
+{
+    InterlockedIncrement(&CoreApi(Core).nAttrHandleGeneration);
+}
+
+
+//! Count an attr value changed through the API, for RomeEngineGetSetCount().
+//! @param Core  The Rome core the changed attr belongs to.
 //!
-ROME_API RT_CSTR RomeGetDirectory(RT_App* pApp, RT_CSTR pszPath /*= NULL*/)
+void EngineCountSet(CRomeCore& Core)
 {
-    try
-    {
-        // Switch to the app's MFC module state while in this scope.
-        // This is required for many MFC functions to work correctly.
-        AFX_MANAGE_STATE(AfxGetAppModuleState());
+    InterlockedIncrement(&CoreApi(Core).nApiSets);
+}
 
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pApp,             "RomeGetDirectory: NULL Rome app pointer.");
-        BOOL bValidApp = (pApp == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,        "RomeGetDirectory: Invalid Rome app pointer.");
-		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,         "RomeGetDirectory: RomeExit() has already been called.");
-#if USE_ROMEAPI_THREADIdS
-        THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,     "RomeGetDirectory: Rome API function called on different thread from RomeInit().");
-#endif
 
-        ROME_API_LOCK();
+//! Get the number of attr values changed through the API since the engine last ran.
+//! @param Core    The Rome core to get the count for.
+//! @param bReset  TRUE to reset the count to 0 (when the engine runs).
+//! @return  The number of changed values.
+//!
+int EngineGetSets(CRomeCore& Core, BOOL bReset)
+{
+    volatile LONG& nApiSets = CoreApi(Core).nApiSets;
+    return bReset? InterlockedExchange(&nApiSets, 0): nApiSets;
+}
 
-        // Does not require command logging.
-        // Don't log this function - it gets called too many times and floods the log file.
-//    	CLogFileElement1(LOGELEM_HIST, "user", "RomeGetDirectory", "path='%s'/>\n", (CString)XMLEncode(pszPath));
 
-        return pApp->User.GetPath(pszPath);
-    }
-    catch (...)
-    {
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeGetDirectory: exception.");
+//! Record an attr changed through the API for the coalesced listeners on its file or object.
+//! @param Core    The Rome core the changed attr belongs to.
+//! @param pFile   The file the change was made through.
+//! @param pAttr   The changed attr.
+//! @param nIndex  The index set or inserted at, or -1 if there is none (e.g. for a resize).
+//! @param nFlags  #RX_CHANGE_VALUE or #RX_CHANGE_SIZE.
+//!
+void ListenersAddChange(CRomeCore& Core, CFileObj* pFile, CAttr* pAttr, int nIndex, UINT nFlags)
+{
+    COALESCEDLISTENERS& Listeners = CoreApi(Core).Listeners;
+    if (Listeners.IsEmpty())
+        return;
+
+    CSubObj* pObj = pAttr->GetObj();
+    POSITION pos = Listeners.GetHeadPosition();
+    while (pos)
+    {
+        COALESCEDLISTENER* pListener = Listeners.GetNext(pos);
+        RT_void* pTarget = (pListener->nTargetType == RX_LISTENER_TARGET_FILE)? (RT_void*)pFile: (RT_void*)pObj;
+        if (pListener->pTarget != pTarget)
+            continue;
+
+        // A deleted attr's address may be reused, so the name and file have to match too.
+        INT_PTR nAt = -1;
+        BOOL bFound = pListener->PendingIndex.Lookup(pAttr, nAt);
+        if (!bFound || pListener->Pending[nAt].pFile != pFile || pListener->Pending[nAt].sAttr != pAttr->GetName())
+        {
+            PENDINGCHANGE Change;
+            Change.pFile  = pFile;
+            Change.pObj   = pObj;
+            Change.pAttr  = pAttr;
+            Change.sAttr  = pAttr->GetName();
+            Change.nFirst = -1;
+            Change.nLast  = -1;
+            Change.nFlags = 0;
+            nAt = pListener->Pending.Add(Change);
+            pListener->PendingIndex.SetAt(pAttr, nAt);
+        }
+
+        PENDINGCHANGE& Change = pListener->Pending[nAt];
+        if (nIndex >= 0)
+        {
+            Change.nFirst = (Change.nFirst < 0)? nIndex: min(Change.nFirst, nIndex);
+            Change.nLast  = max(Change.nLast, nIndex);
+        }
+        Change.nFlags |= nFlags;
     }
 }
 
 
-//! Get a full disk path given a path relative to the Rome root directory.
-//! @see RomeGetDirectory() [above] for full documentation.
-//!
-//! This version is required for use by Intel Fortran, which can't use functions
-//!   which return a string pointer. Instead it must have its first 2 arguments
-//!   be a pointer to a buffer and its length, to return the string in.
-//!   The function must have a return type of void.
-//! @param[out] pBuf The pointer to a buffer to return a NUL-terminated string in.
-//! @param nBufLen   The length of the buffer to return a NUL-terminated string in.
-//! @param pApp      The Rome interface pointer obtained from RomeInit().
-//! @param pszPath   A path (or file) name relative to the root directory.
-//!
-//! @RomeAPI Wrapper for RomeGetDirectory().
-//! @FortranAPI This function allows calling RomeGetDirectory() from Fortran.
+//! Merge the pending changes of another listener into a batch, so each attr is listed once.
+//! @param Into  The batch, which gets the changes it hasn't got yet.
+//! @param From  The changes to add.
 //!
-ROME_API RT_void RomeGetDirectoryF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_App* pApp, RT_CSTR pszPath /*= NULL*/)
+LOCAL void PendingChangesMerge(PENDINGCHANGES& Into, const PENDINGCHANGES& From)
 {
-    try
-    {
-        // Does not require AFX_MANAGE_STATE() macro.
-
-	    // Switch to the app's MFC module state while in this scope.
-	    // This is required for many MFC functions to work correctly.
-	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+    CMap<CAttr*, CAttr*, INT_PTR, INT_PTR> Index;
+    for (INT_PTR i = 0; i < Into.GetSize(); i++)
+        Index.SetAt(Into[i].pAttr, i);
 
-		// Validate arguments unique to the Fortran function version.
-		// The remaining arguments will be validated in the normal Rome API call.
-        ASSERT_OR_SETERROR_AND_RETURN(pBuf,           "RomeGetDirectoryF: NULL buffer pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN(nBufLen > 0,    "RomeGetDirectoryF: non-positive buffer length.");
+    for (INT_PTR i = 0; i < From.GetSize(); i++)
+    {
+        const PENDINGCHANGE& Change = From[i];
+        INT_PTR nAt = -1;
+        if (!Index.Lookup(Change.pAttr, nAt) || Into[nAt].pFile != Change.pFile || Into[nAt].sAttr != Change.sAttr)
+        {
+            Index.SetAt(Change.pAttr, Into.Add(Change));
+            continue;
+        }
+        PENDINGCHANGE& Merged = Into[nAt];
+        if (Change.nFirst >= 0)
+        {
+            Merged.nFirst = (Merged.nFirst < 0)? Change.nFirst: min(Merged.nFirst, Change.nFirst);
+            Merged.nLast  = max(Merged.nLast, Change.nLast);
+        }
+        Merged.nFlags |= Change.nFlags;
+    }
+}
 
-        ROME_API_LOCK();
 
-        // Does not require command logging.
+//! A batch of changes taken from a coalesced listener, to be delivered once all are taken.
+typedef struct COALESCEDDELIVERY
+{
+    RT_void*         pObserver;
+    RT_EventHandler  pEventHandler;
+    PENDINGCHANGES*  pChanges;
+} COALESCEDDELIVERY;
+
+//! Deliver the changes collected by the coalesced listeners of a core, as one batch for each listener.
+//! This is called when the engine has finished: by RomeEngineRun(), RomeEngineRunEx(),
+//!   RomeEngineFinishUpdates() and RomeFileRunCached().
+//! The handlers are called on this thread, holding the core's API lock, so they may call the API
+//!   (and add or remove listeners, since the batches are all taken first).
+//! The listeners of a core with the same event handler and observer get a single batch,
+//!   so a change seen by several of them (e.g. by a file listener and an object listener
+//!   on the same file) is delivered once.
+//! @param Core  The Rome core whose engine finished.
+//!
+void ListenersDeliver(CRomeCore& Core)
+{
+    COALESCEDLISTENERS& Listeners = CoreApi(Core).Listeners;
+    if (Listeners.IsEmpty())
+        return;
 
-        LPCSTR pszDir  = RomeGetDirectory(pApp, pszPath);
-        CopyStrF(pBuf, nBufLen, pszDir);
+    CArray<COALESCEDDELIVERY, const COALESCEDDELIVERY&> aDeliveries;
+    {
+        POSITION pos = Listeners.GetHeadPosition();
+        while (pos)
+        {
+            COALESCEDLISTENER* pListener = Listeners.GetNext(pos);
+            if (pListener->Pending.GetSize() == 0)
+                continue;
+            INT_PTR d = 0;
+            while (d < aDeliveries.GetSize() &&
+                   (aDeliveries[d].pObserver != pListener->pObserver || aDeliveries[d].pEventHandler != pListener->pEventHandler))
+                d++;
+            if (d < aDeliveries.GetSize())
+                PendingChangesMerge(*aDeliveries[d].pChanges, pListener->Pending);
+            else
+            {
+                COALESCEDDELIVERY Delivery = { pListener->pObserver, pListener->pEventHandler, new PENDINGCHANGES };
+                Delivery.pChanges->Copy(pListener->Pending);
+                aDeliveries.Add(Delivery);
+            }
+            pListener->Pending.RemoveAll();
+            pListener->PendingIndex.RemoveAll();
+        }
     }
-    catch (...)
+
+    for (INT_PTR d = 0; d < aDeliveries.GetSize(); d++)
     {
+        const COALESCEDDELIVERY& Delivery = aDeliveries[d];
+        const PENDINGCHANGES& Changes = *Delivery.pChanges;
+        CArray<RT_ChangeEvent, const RT_ChangeEvent&> aEvents;
+        aEvents.SetSize(Changes.GetSize());
+        for (INT_PTR i = 0; i < Changes.GetSize(); i++)
+        {
+            aEvents[i].pFile   = Changes[i].pFile;
+            aEvents[i].pObj    = (RT_SubObj*)Changes[i].pObj;
+            aEvents[i].pszAttr = Changes[i].sAttr;
+            aEvents[i].nFirst  = Changes[i].nFirst;
+            aEvents[i].nLast   = Changes[i].nLast;
+            aEvents[i].nFlags  = Changes[i].nFlags;
+        }
+        RT_ChangeBatch Batch = { aEvents.GetData(), (RT_INT)aEvents.GetSize() };
+        // A failing handler mustn't keep the other listeners from their batches.
         try
         {
-            if (pBuf && nBufLen > 0)
-                *pBuf = 0;
-            CString sInfo; sInfo.Format("RomeGetDirectoryF: exception for Buffer = '0x%08X', Length = %d, Name = '%s'.", pBuf, nBufLen, (CString)pszPath);
-            ASSERT_OR_SETERROR_AND_RETURN(0,        sInfo);
+            Delivery.pEventHandler(Delivery.pObserver, RX_EVENT_CHANGES, &Batch);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN(0,        "RomeGetDirectoryF: exception in catch block.");
+            ASSERT(FALSE);
         }
+        delete Delivery.pChanges;
     }
 }
 
 
-//! Get a pointer to the Rome engine interface.
-//! This pointer does not need to be freed or released when finished using it.
-//! @param pApp  The Rome interface pointer obtained from RomeInit().
-//! @return  The interface pointer, or NULL on failure.
+//! Remove the coalesced listeners of a core, with their pending changes.
+//! @param Core  The Rome core which is exiting.
 //!
-//! @RomeAPI Wrapper for CRomeCore::Engine.
+void ListenersRemoveCore(CRomeCore& Core)
+{
+    COALESCEDLISTENERS& Listeners = CoreApi(Core).Listeners;
+    while (!Listeners.IsEmpty())
+        delete Listeners.RemoveHead();
+}
+
+
+//! Get the batch mode state of a core (see #RX_PRAGMA_BATCH_MODE).
+//! This is called by the frequently used API functions to skip logging,
+//!   so it doesn't take a lock.
+//! @param Core  The Rome core to test.
+//! @return  The batch mode state, or NULL if the core isn't in batch mode.
 //!
-ROME_API RT_Engine* RomeGetEngine(RT_App* pApp)
+BATCHCORE* CoreGetBatch(const CRomeCore& Core)
 {
-    try
-    {
-        // Switch to the app's MFC module state while in this scope.
-        // This is required for many MFC functions to work correctly.
-        AFX_MANAGE_STATE(AfxGetAppModuleState());
+    BATCHCORE& Batch = CoreApi(Core).Batch;
+    return Batch.bOn? &Batch: NULL;
+}
 
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pApp,             "RomeGetEngine: NULL Rome app pointer.");
-        BOOL bValidApp = (pApp == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,        "RomeGetEngine: invalid Rome app pointer.");
-		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,         "RomeGetEngine: RomeExit() has already been called.");
-#if USE_ROMEAPI_THREADIdS
-        THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,     "RomeGetEngine: Rome API function called on different thread from RomeInit().");
-#endif
 
-        ROME_API_LOCK();
+//! Enter or leave batch mode for a core.
+//! Entering batch mode clears the diagnostic ring.
+//! @param Core    The Rome core.
+//! @param bBatch  TRUE to enter batch mode, FALSE to leave it.
+//! @note The caller must hold the API lock of the core.
+//!
+void CoreSetBatch(CRomeCore& Core, BOOL bBatch)
+{
+    BATCHCORE& Batch = CoreApi(Core).Batch;
+    if (bBatch && !Batch.bOn)
+        Batch.nNext = 0;
+    Batch.bOn = bBatch;
+}
 
-	    // Does not require command logging.
 
-	    return &pApp->Engine;
-    }
-    catch (...)
+//! Record an API call in the diagnostic ring of a core in batch mode.
+//! This replaces the history log entry, and only copies the arguments shown.
+//! @note The caller must hold the API lock of the core.
+//!
+void BatchLog(BATCHCORE* pBatch, LPCSTR pszFunc, LPCSTR pszAttr, int nIndex, int nResult)
+{
+    BATCHLOGENTRY& entry = pBatch->aRing[pBatch->nNext % RX_BATCH_RINGSIZE];
+    entry.pszFunc = pszFunc;
+    strncpy(entry.szAttr, pszAttr? pszAttr: "", sizeof(entry.szAttr) - 1);
+    entry.szAttr[sizeof(entry.szAttr) - 1] = '\0';
+    entry.nIndex  = nIndex;
+    entry.nResult = nResult;
+    pBatch->nNext++;
+}
+
+
+//! Write the diagnostic ring of a core in batch mode to the history log, oldest call first.
+//! @note The caller must hold the API lock of the core.
+//! @return  The number of calls written.
+//!
+int BatchDump(BATCHCORE* pBatch)
+{
+    // The ring is written as one block, so it isn't interleaved with other cores' entries.
+    CSingleLock LogLock(&ApiLogLock, TRUE);
+    const int nCount = min(pBatch->nNext, RX_BATCH_RINGSIZE);
+    ROME_API_LOG(LogFilePrintf2(LOG_HIST, "<batchlog calls='%d' kept='%d'>\n", pBatch->nNext, nCount));
+    for (int i = pBatch->nNext - nCount; i < pBatch->nNext; i++)
+    {
+        const BATCHLOGENTRY& entry = pBatch->aRing[i % RX_BATCH_RINGSIZE];
+        ROME_API_LOG(LogFilePrintf4(LOG_HIST, "<call func='%s' attr='%s' index='%d' result='%d'/>\n",
+                       entry.pszFunc, (CString)XMLEncode(entry.szAttr), entry.nIndex, entry.nResult));
+    }
+    ROME_API_LOG(LogFilePrintf0(LOG_HIST, "</batchlog>\n"));
+    return nCount;
+}
+
+
+//! Get the timer for an API function, adding it on first use.
+//! @param pszName  The function name. This must be a string literal (e.g. @c __FUNCTION__).
+//! @return  The timer, or NULL if there are already #ROMESTAT_MAXFUNCS timers.
+//!
+ROMESTAT* RomeStatRegister(LPCSTR pszName)
+{
+    RFX_CRITICAL_SECTION();
+    for (int i = 0; i < RomeStatFuncCount; i++)
     {
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(0,                "RomeGetEngine: exception.");
+        if (streq(RomeStatFuncs[i]->pszName, pszName))
+            return RomeStatFuncs[i];
     }
+    if (RomeStatFuncCount >= ROMESTAT_MAXFUNCS)
+        return NULL;
+
+    ROMESTAT* pStat = new ROMESTAT;
+    memset(pStat, 0, sizeof(ROMESTAT));
+    pStat->pszName = pszName;
+    RomeStatFuncs[RomeStatFuncCount] = pStat;
+    InterlockedIncrement(&RomeStatFuncCount);
+    return pStat;
 }
 
 
-//! Get a pointer to the Rome filesystem interface.
+//! Count a call in a timer.
+//! @param pStat   The timer. This may be NULL.
+//! @param nTicks  The time the call took, in QueryPerformanceCounter() ticks.
+//!
+void RomeStatAdd(ROMESTAT* pStat, LONGLONG nTicks)
+{
+    if (pStat == NULL)
+        return;
+
+    static LONGLONG nFreq = 0;
+    if (nFreq == 0)
+    {
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        nFreq = freq.QuadPart;
+    }
+
+    // Find the power of 2 bucket for the time in microseconds.
+    const LONGLONG nMicros = nTicks * 1000000 / nFreq;
+    int nBucket = 0;
+    while (nBucket < ROMESTAT_BUCKETS - 1 && (nMicros >> nBucket) > 0)
+        nBucket++;
+
+    InterlockedIncrement(&pStat->nCalls);
+    InterlockedExchangeAdd64(&pStat->nTicks, nTicks);
+    InterlockedIncrement(&pStat->aBuckets[nBucket]);
+}
+
+
+//! Reset a timer to no calls.
+//!
+void RomeStatReset(ROMESTAT* pStat)
+{
+    InterlockedExchange(&pStat->nCalls, 0);
+    InterlockedExchange64(&pStat->nTicks, 0);
+    for (int i = 0; i < ROMESTAT_BUCKETS; i++)
+        InterlockedExchange(&pStat->aBuckets[i], 0);
+}
+
+
+//! Times the scope it is declared in, for RomeGetStats().
+//!
+class CRomeStatTimer
+{
+public:
+    CRomeStatTimer(ROMESTAT* pStat)
+    {
+        m_pStat = pStat;
+        QueryPerformanceCounter(&m_nStart);
+    }
+
+    ~CRomeStatTimer()
+    {
+        LARGE_INTEGER nEnd;
+        QueryPerformanceCounter(&nEnd);
+        RomeStatAdd(m_pStat, nEnd.QuadPart - m_nStart.QuadPart);
+    }
+
+protected:
+    ROMESTAT*     m_pStat;
+    LARGE_INTEGER m_nStart;
+};
+
+//! Time the API function this is used in, for RomeGetStats().
+//! The timer is looked up once per function, the first time it is called.
+//! This is part of ROME_API_WRITELOCK() and ROME_API_READLOCK(), so that the time
+//!   includes waiting for the lock.
+#define ROME_API_STAT()                 static ROMESTAT* pApiStat = RomeStatRegister(__FUNCTION__); CRomeStatTimer ApiStatTimer(pApiStat)
+
+
+//! Call CEngineBase::FinishUpdates(), timing it for RomeGetStats().
+//!
+template <class TEngine> void StatFinishUpdates(TEngine& Engine)
+{
+    CRomeStatTimer Timer(&RomeStatFinishUpdates);
+    Engine.FinishUpdates();
+}
+
+
+//! Call CEngineBase::Run(), timing it for RomeGetStats().
+//!
+template <class TEngine> RT_BOOL StatEngineRun(TEngine& Engine)
+{
+    CRomeStatTimer Timer(&RomeStatEngineRun);
+    return Engine.Run();
+}
+
+
+//! Call FindOrCreate(), counting the attrs found and created for RomeGetStats().
+//!
+CAttr* StatFindOrCreate(LPCSTR pszAttr, CFileObj* pFile)
+{
+    const int nParams = pFile->m_params.GetCount();
+    CAttr* pAttr = FindOrCreate(pszAttr, pFile);
+    InterlockedIncrement(&RomeStatAttrFinds);
+    if (pFile->m_params.GetCount() > nParams)
+        InterlockedIncrement(&RomeStatAttrCreates);
+    return pAttr;
+}
+
+
+//! Check whether the string arena of this thread gets the strings returned by the API.
+//!
+inline BOOL ArenaIsActive()
+{
+    return (ArenaFirst != NULL) && (ArenaBypassDepth == 0);
+}
+
+
+//! Copy a string returned by an API function into the string arena of this thread.
+//! The copy stays valid until the next RomeArenaReset() on this thread,
+//!   unlike the thread-local result strings, which are reused by the next call.
+//! Blocks left over from before the last reset are reused before new ones are allocated.
+//! @param pszResult  The string to return. This may be NULL.
+//! @return  The copy, or @p pszResult itself if the arena isn't active (or it is NULL).
+//!
+LOCAL RT_CSTR ArenaResult(LPCSTR pszResult)
+{
+    if (pszResult == NULL || !ArenaIsActive())
+        return pszResult;
+
+    const UINT nLen = (UINT)strlen(pszResult) + 1;
+    ARENABLOCK* pBlock = ArenaCurrent;
+    while (pBlock->nUsed + nLen > pBlock->nSize)
+    {
+        if (pBlock->pNext == NULL)
+        {
+            const UINT nSize = max(nLen, (UINT)RX_ARENA_BLOCKSIZE);
+            ARENABLOCK* pNew = (ARENABLOCK*)malloc(sizeof(ARENABLOCK) + nSize);
+            if (pNew == NULL)
+                return pszResult;
+            InterlockedExchangeAdd(&ArenaBytes, (LONG)(sizeof(ARENABLOCK) + nSize));
+            pNew->pNext = NULL;
+            pNew->nSize = nSize;
+            pNew->nUsed = 0;
+            pBlock->pNext = pNew;
+        }
+        pBlock = pBlock->pNext;
+    }
+    ArenaCurrent = pBlock;
+
+    char* pszCopy = (char*)(pBlock + 1) + pBlock->nUsed;
+    memcpy(pszCopy, pszResult, nLen);
+    pBlock->nUsed += nLen;
+    return pszCopy;
+}
+
+
+//! Keeps the API functions called in its scope from copying their results into the string arena.
+//! This is used by the Fortran (*F) functions, which copy the result into the caller's buffer at once.
+//!
+class CArenaBypass
+{
+public:
+    CArenaBypass()  { ArenaBypassDepth++; }
+    ~CArenaBypass() { ArenaBypassDepth--; }
+};
+
+
+//! Acquire an API gate, counting the time spent if it has to wait.
+//!
+LOCAL void ApiGateAcquire(APIGATE* pGate, BOOL bShared)
+{
+    if (bShared? TryAcquireSRWLockShared(&pGate->Lock): TryAcquireSRWLockExclusive(&pGate->Lock))
+        return;
+
+    LARGE_INTEGER nStart, nEnd;
+    QueryPerformanceCounter(&nStart);
+    if (bShared)
+        AcquireSRWLockShared(&pGate->Lock);
+    else
+        AcquireSRWLockExclusive(&pGate->Lock);
+    QueryPerformanceCounter(&nEnd);
+
+    InterlockedIncrement(bShared? &pGate->nSharedWaits: &pGate->nExclusiveWaits);
+    InterlockedExchangeAdd64(&pGate->nWaitTicks, nEnd.QuadPart - nStart.QuadPart);
+    RomeStatAdd(&RomeStatLockWait, nEnd.QuadPart - nStart.QuadPart);
+}
+
+
+//! Find a gate in the gates this thread holds shared.
+//! @return  The index in #ApiGatesHeld, or -1 if this thread doesn't hold @p pGate shared.
+//!
+LOCAL int ApiGateFindHeld(const APIGATE* pGate)
+{
+    for (int i = 0; i < ApiGatesHeldCount; i++)
+    {
+        if (ApiGatesHeld[i].pGate == pGate)
+            return i;
+    }
+    return -1;
+}
+
+
+//! Check whether this thread holds a gate, shared or exclusively.
+//!
+LOCAL BOOL ApiGateIsHeld(const APIGATE* pGate)
+{
+    return (pGate->nOwner == GetCurrentThreadId()) || (ApiGateFindHeld(pGate) >= 0);
+}
+
+
+//! Holds the API gate of a core for the scope of an API function.
+//! Read-only functions hold it shared, and all other functions hold it exclusively
+//!   (see ROME_API_WRITELOCK()).
+//! The shared holders of a gate still take turns reading the model (see GetReadLock()),
+//!   so they only overlap in their validation, logging and copying of results.
+//! A nested API call on the same thread (from a Fortran wrapper or an event handler)
+//!   uses the gate its caller holds.
+//! @note A call which changes the model can't be nested in a read-only call for the same core,
+//!   since the shared gate can't be taken exclusively. The constructor throws instead, so the
+//!   API function fails through its catch handler, as it does when #RX_APIGATE_MAXHELD is exceeded.
+//!
+class CApiGateLock
+{
+public:
+    CApiGateLock(const CRomeCore* pCore, int nMode)
+    {
+        m_pGate     = RomeCoreIsValid(pCore)? &CoreApi(*pCore).Gate: NULL;
+        m_bShared   = FALSE;
+        if (m_pGate == NULL)
+            return;
+
+        const DWORD nThread = GetCurrentThreadId();
+        if (m_pGate->nOwner == nThread)
+        {
+            m_pGate->nDepth++;
+            return;
+        }
+        const int nHeld = ApiGateFindHeld(m_pGate);
+        if (nHeld >= 0)
+        {
+            if (nMode == APIGATE_EXCLUSIVE)
+            {
+                TRACE0("CApiGateLock: a call which changes the model was made inside a read-only call.\n");
+                AfxThrowNotSupportedException();
+            }
+            ApiGatesHeld[nHeld].nDepth++;
+            m_bShared = TRUE;
+            return;
+        }
+
+        if (nMode != APIGATE_EXCLUSIVE)
+        {
+            if (ApiGatesHeldCount >= RX_APIGATE_MAXHELD)
+            {
+                TRACE0("CApiGateLock: too many gates held shared by this thread.\n");
+                AfxThrowNotSupportedException();
+            }
+            ApiGateAcquire(m_pGate, TRUE);
+            if (nMode == APIGATE_SHARED || const_cast<CRomeCore*>(pCore)->Engine.IsFinished())
+            {
+                InterlockedIncrement(&m_pGate->nSharedLocks);
+                ApiGatesHeld[ApiGatesHeldCount].pGate  = m_pGate;
+                ApiGatesHeld[ApiGatesHeldCount].nDepth = 1;
+                ApiGatesHeldCount++;
+                m_bShared = TRUE;
+                return;
+            }
+
+            // Finishing the updates changes the model, so that must be done alone.
+            ReleaseSRWLockShared(&m_pGate->Lock);
+            InterlockedIncrement(&m_pGate->nUnsettled);
+        }
+
+        AcquireExclusive(pCore);
+    }
+
+    ~CApiGateLock()
+    {
+        if (m_pGate == NULL)
+            return;
+
+        if (m_bShared)
+        {
+            const int nHeld = ApiGateFindHeld(m_pGate);
+            ASSERT(nHeld >= 0);
+            if (nHeld >= 0 && --ApiGatesHeld[nHeld].nDepth == 0)
+            {
+                ApiGatesHeld[nHeld] = ApiGatesHeld[--ApiGatesHeldCount];
+                ReleaseSRWLockShared(&m_pGate->Lock);
+            }
+        }
+        else
+        if (--m_pGate->nDepth == 0)
+        {
+            m_pGate->nOwner = 0;
+            ReleaseSRWLockExclusive(&m_pGate->Lock);
+        }
+    }
+
+    //! Is the gate held shared? If not, it is held exclusively (or the core is invalid).
+    BOOL IsShared() const { return m_bShared; }
+
+    //! Change a shared hold of the gate into an exclusive one, for a read which turns out to change the model
+    //!   (e.g. since its attr has to be created).
+    //! The gate is released while waiting, so the caller must not rely on anything it found under the shared hold.
+    //! Throws, as the constructor does, if the thread holds the gate shared in an outer call too.
+    //! @param pCore  The core which the gate was taken for.
+    //!
+    void Escalate(const CRomeCore* pCore)
+    {
+        ASSERT(m_bShared);
+        const int nHeld = ApiGateFindHeld(m_pGate);
+        if (nHeld < 0 || ApiGatesHeld[nHeld].nDepth != 1)
+        {
+            TRACE0("CApiGateLock: a call which changes the model was made inside a read-only call.\n");
+            AfxThrowNotSupportedException();
+        }
+        ApiGatesHeld[nHeld] = ApiGatesHeld[--ApiGatesHeldCount];
+        ReleaseSRWLockShared(&m_pGate->Lock);
+        m_bShared = FALSE;
+        InterlockedIncrement(&m_pGate->nUnsettled);
+
+        AcquireExclusive(pCore);
+    }
+
+    //! Get the lock which shared holders take around their access to the model.
+    //! The internals are not known to be safe for concurrent readers, so shared holders
+    //!   read the model one at a time. #ApiLogLock must not be taken while holding it.
+    CCriticalSection* GetReadLock() const { return m_pGate? &m_pGate->ReadLock: NULL; }
+
+protected:
+    void AcquireExclusive(const CRomeCore* pCore)
+    {
+        ApiGateAcquire(m_pGate, FALSE);
+        InterlockedIncrement(&m_pGate->nExclusiveLocks);
+        m_pGate->nOwner = GetCurrentThreadId();
+        m_pGate->nDepth = 1;
+    }
+
+    APIGATE* m_pGate;
+    BOOL     m_bShared;
+};
+
+//! Take the API gate of a core exclusively.
+//! Every API function for a core which may change it takes its gate this way,
+//!   so that it excludes the read-only functions which use ROME_API_READLOCK().
+//! This is the core's API lock; the calls of separate cores only wait for each other
+//!   while they write the logs (see #ApiLogLock).
+#define ROME_API_WRITELOCK(pCore)       ROME_API_STAT(); CApiGateLock ApiGate(pCore, APIGATE_EXCLUSIVE)
+
+//! Take the API gate of a core for a read-only function.
+//! When ApiGate.IsShared(), the function must access the model only while holding
+//!   ApiGate.GetReadLock(), and should log after releasing it.
+//! @param nMode  #APIGATE_SHARED, or #APIGATE_SETTLED if the call needs a settled engine.
+#define ROME_API_READLOCK(pCore, nMode) ROME_API_STAT(); CApiGateLock ApiGate(pCore, nMode)
+
+
+//! Remove the least recently used results from the cache until it isn't over its limit.
+//! @param nLimit  The number of results to keep.
+//! @note The caller must hold RFX_CRITICAL_SECTION().
+//!
+void ResultCacheTrim(int nLimit)
+{
+    while (ResultCacheList.GetCount() > max(nLimit, 0))
+    {
+        RESULTCACHEENTRY* pEntry = ResultCacheList.RemoveTail();
+        ResultCacheMap.RemoveKey(pEntry->sKey);
+        delete pEntry;
+    }
+}
+
+
+//! Look up a result in the cache, and make it the most recently used.
+//! @param sKey     The key from ResultCacheKey().
+//! @param aValues  Returns the output value strings.
+//! @param aFound   Returns for each output if its value was found.
+//! @return TRUE on a hit, FALSE if the result isn't cached.
+//!
+BOOL ResultCacheFind(const CString& sKey, CStringArray& aValues, CByteArray& aFound)
+{
+    RFX_CRITICAL_SECTION();
+    void* pPos = NULL;
+    if (!ResultCacheMap.Lookup(sKey, pPos))
+        return FALSE;
+
+    POSITION pos = (POSITION)pPos;
+    RESULTCACHEENTRY* pEntry = ResultCacheList.GetAt(pos);
+    ResultCacheList.RemoveAt(pos);
+    ResultCacheMap.SetAt(sKey, ResultCacheList.AddHead(pEntry));
+
+    aValues.Copy(pEntry->aValues);
+    aFound.Copy(pEntry->aFound);
+    return TRUE;
+}
+
+
+//! Add a result to the cache as the most recently used, replacing any result with the same key.
+//! This does nothing if the cache is disabled.
+//! @param sKey     The key from ResultCacheKey().
+//! @param aValues  The output value strings.
+//! @param aFound   For each output, TRUE if its value was found.
+//! @return TRUE if the result was added, FALSE if the cache is disabled.
+//!
+BOOL ResultCacheAdd(const CString& sKey, const CStringArray& aValues, const CByteArray& aFound)
+{
+    RFX_CRITICAL_SECTION();
+    if (ResultCacheLimit <= 0)
+        return FALSE;
+
+    void* pPos = NULL;
+    if (ResultCacheMap.Lookup(sKey, pPos))
+    {
+        POSITION pos = (POSITION)pPos;
+        delete ResultCacheList.GetAt(pos);
+        ResultCacheList.RemoveAt(pos);
+        ResultCacheMap.RemoveKey(sKey);
+    }
+
+    RESULTCACHEENTRY* pEntry = new RESULTCACHEENTRY;
+    pEntry->sKey = sKey;
+    pEntry->aValues.Copy(aValues);
+    pEntry->aFound.Copy(aFound);
+    ResultCacheMap.SetAt(sKey, ResultCacheList.AddHead(pEntry));
+
+    ResultCacheTrim(ResultCacheLimit);
+    return TRUE;
+}
+
+
+//! Add bytes to a 64-bit FNV-1a hash.
+//! @param nHash  The hash so far. Start with #FNV1A_64_INIT.
+//! @param pData  The bytes to add.
+//! @param nLen   The number of bytes to add.
+//! @return The new hash.
+//!
+ULONGLONG HashFnv1a(ULONGLONG nHash, const void* pData, size_t nLen)
+{
+    const BYTE* pByte = (const BYTE*)pData;
+    for (size_t i = 0; i < nLen; i++)
+    {
+        nHash ^= pByte[i];
+        nHash *= 0x100000001B3ui64;
+    }
+    return nHash;
+}
+
+
+//! Remove a switch argument from a parsed command line.
+//! @param aArgs      The arguments returned by CRomeCore::ParseArgs().
+//! @param pszSwitch  The switch to remove (e.g. "/NewCore"). The comparison is case-insensitive.
+//! @return TRUE if the switch was found (and removed), FALSE otherwise.
+//!
+BOOL ArgsRemoveSwitch(CStringArray& aArgs, LPCSTR pszSwitch)
+{
+    BOOL bFound = FALSE;
+    // The first argument is the name of the calling app, which is never a switch.
+    for (int i = aArgs.GetSize()-1; i >= 1; i--)
+    {
+        if (aArgs[i].CompareNoCase(pszSwitch) == 0)
+        {
+            aArgs.RemoveAt(i);
+            bFound = TRUE;
+        }
+    }
+    return bFound;
+}
+
+
+#if USE_ROMESHELL_LOGGING
+
+//! Activate a filename for use in the RomeShell log file.
+//! This will generate an "Activate" command if the filename
+//!   is different from the currently active one.
+//! @param pszFile  The filename to activate.
+//!                 This may be empty or NULL.
+//! @return TRUE on success, FALSE on failure.
+//!
+BOOL LogShellActivate(LPCSTR pszFile)
+{
+    CString sOldFile = ::RomeThreadGetNamedString("LogShellActivate");
+    CString sNewFile = pszFile;
+    BOOL bSuccess = TRUE;
+    if (!FullnameEquals(pszFile, sOldFile))
+    {
+        bSuccess = (ROME_API_LOG(LogFilePrintf0(LOG_SHELL, "Activate \"%s\"\n", sNewFile)) > 0);
+        RomeThreadSetNamedString("LogShellActivate", sNewFile);
+    }
+    return bSuccess;
+}
+
+#endif // USE_ROMESHELL_LOGGING
+
+
+/////////////////////////////////////////////////////////////////////////////
+//! @name Rome session functions
+//! @{
+
+//! Get a pointer to the Rome database interface.
+//! This pointer is used for all Rome database operations.
 //! This pointer does not need to be freed or released when finished using it.
+//! @note This will return a non-NULL pointer, even if a database hasn't been opened
+//!   using RomeDatabaseOpen(). The pointer represents the abstract interface itself,
+//!   not the database connection.
 //! @param pApp  The Rome interface pointer obtained from RomeInit().
-//! @return  The interface pointer, or NULL on failure.
+//! @return the interface pointer, or NULL on failure.
+//!
+//! @RomeAPI Wrapper for CRomeCore::Files.
+//!
+ROME_API RT_Database* RomeGetDatabase(RT_App* pApp)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pApp,             "RomeGetDatabase: NULL Rome app pointer.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,        "RomeGetDatabase: invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,         "RomeGetDatabase: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,     "RomeGetDatabase: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(pApp);
+
+        // Does not require command logging.
+
+        return &pApp->Files;
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(0,                "RomeGetDatabase: exception.");
+    }
+}
+
+
+//! Return a full disk path given a path relative to the Rome root directory.
+//! If the directory has been redirected somewhere else,
+//!   then that location will be returned instead.
+//! @param pApp  The Rome interface pointer obtained from RomeInit().
+//! @param pszPath  A path (or file) name relative to the root directory.
+//!   The name argument is case-insensitive.
+//!   Standard subdirectory names which may be redirected:
+//!   - Binaries  For program executables and DLLs.
+//!   - Export    For files exported from Rusle2.
+//!   - Import    For files to be imported into Rusle2.
+//!   - Session   Used to store temporary files.
+//!   - Users     Used to store user templates.<br>
+//!   Examples:
+//!   - "Binaries"
+//!   - "Export\"
+//!   - "Import\database-name.gdb"
+//!   - "Session\Temp"<br>
+//!   If the path starts with an unrecognized directory, it is appended as a
+//!     subfolder of the root directory.
+//! @return The full pathname for the requested path, or NULL on error.
+//!
+//! @note The root directory is returned on NULL or empty string.
+//! @note This function works successfully on files and folders which don't exist.
+//!   That is because it works on the path name @em strings and redirection mappings,
+//!   not on the actual files and directories themselves.
+//! @RomeAPI Wrapper for CCoreSession::GetPath().
+//!
+ROME_API RT_CSTR RomeGetDirectory(RT_App* pApp, RT_CSTR pszPath /*= NULL*/)
+{
+    try
+    {
+        // Switch to the app's MFC module state while in this scope.
+        // This is required for many MFC functions to work correctly.
+        AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pApp,             "RomeGetDirectory: NULL Rome app pointer.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,        "RomeGetDirectory: Invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,         "RomeGetDirectory: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,     "RomeGetDirectory: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(pApp);
+
+        // Does not require command logging.
+        // Don't log this function - it gets called too many times and floods the log file.
+//    	CLogFileElement1(LOGELEM_HIST, "user", "RomeGetDirectory", "path='%s'/>\n", (CString)XMLEncode(pszPath));
+
+        return ArenaResult(pApp->User.GetPath(pszPath));
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeGetDirectory: exception.");
+    }
+}
+
+
+//! Get a full disk path given a path relative to the Rome root directory.
+//! @see RomeGetDirectory() [above] for full documentation.
+//!
+//! This version is required for use by Intel Fortran, which can't use functions
+//!   which return a string pointer. Instead it must have its first 2 arguments
+//!   be a pointer to a buffer and its length, to return the string in.
+//!   The function must have a return type of void.
+//! @param[out] pBuf The pointer to a buffer to return a NUL-terminated string in.
+//! @param nBufLen   The length of the buffer to return a NUL-terminated string in.
+//! @param pApp      The Rome interface pointer obtained from RomeInit().
+//! @param pszPath   A path (or file) name relative to the root directory.
+//!
+//! @RomeAPI Wrapper for RomeGetDirectory().
+//! @FortranAPI This function allows calling RomeGetDirectory() from Fortran.
+//!
+ROME_API RT_void RomeGetDirectoryF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_App* pApp, RT_CSTR pszPath /*= NULL*/)
+{
+    try
+    {
+        // Does not require AFX_MANAGE_STATE() macro.
+
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+		// Validate arguments unique to the Fortran function version.
+		// The remaining arguments will be validated in the normal Rome API call.
+        ASSERT_OR_SETERROR_AND_RETURN(pBuf,           "RomeGetDirectoryF: NULL buffer pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN(nBufLen > 0,    "RomeGetDirectoryF: non-positive buffer length.");
+
+        ROME_API_WRITELOCK(pApp);
+
+        // Does not require command logging.
+
+        CArenaBypass NoArena;
+        LPCSTR pszDir  = RomeGetDirectory(pApp, pszPath);
+        CopyStrF(pBuf, nBufLen, pszDir);
+    }
+    catch (...)
+    {
+        try
+        {
+            if (pBuf && nBufLen > 0)
+                *pBuf = 0;
+            CString sInfo; sInfo.Format("RomeGetDirectoryF: exception for Buffer = '0x%08X', Length = %d, Name = '%s'.", pBuf, nBufLen, (CString)pszPath);
+            ASSERT_OR_SETERROR_AND_RETURN(0,        sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN(0,        "RomeGetDirectoryF: exception in catch block.");
+        }
+    }
+}
+
+
+//! Get a pointer to the Rome engine interface.
+//! This pointer does not need to be freed or released when finished using it.
+//! @param pApp  The Rome interface pointer obtained from RomeInit().
+//! @return  The interface pointer, or NULL on failure.
+//!
+//! @RomeAPI Wrapper for CRomeCore::Engine.
+//!
+ROME_API RT_Engine* RomeGetEngine(RT_App* pApp)
+{
+    try
+    {
+        // Switch to the app's MFC module state while in this scope.
+        // This is required for many MFC functions to work correctly.
+        AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pApp,             "RomeGetEngine: NULL Rome app pointer.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,        "RomeGetEngine: invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,         "RomeGetEngine: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,     "RomeGetEngine: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(pApp);
+
+	    // Does not require command logging.
+
+	    return &pApp->Engine;
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(0,                "RomeGetEngine: exception.");
+    }
+}
+
+
+//! Get a pointer to the Rome filesystem interface.
+//! This pointer does not need to be freed or released when finished using it.
+//! @param pApp  The Rome interface pointer obtained from RomeInit().
+//! @return  The interface pointer, or NULL on failure.
+//!
+//! @RomeAPI Wrapper for CRomeCore::Files.
+//!
+ROME_API RT_Files* RomeGetFiles(RT_App* pApp)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pApp,             "RomeGetFiles: NULL Rome app pointer.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,        "RomeGetFiles: invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,         "RomeGetFiles: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,     "RomeGetFiles: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(pApp);
+
+	    // Does not require command logging.
+
+	    return &pApp->Files;
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(0,                "RomeGetFiles: exception.");
+    }
+}
+
+
+//! Get string properties of the app.
+//! @param pApp  The Rome interface pointer obtained from RomeInit().
+//! @param nProp The property to get.
+//! - #RX_PROPERTYSTR_APPFULLNAME
+//!     Return the full filename of the application executable, including path.
+//!     Example: "C:\Program Files\Rusle2\Binaries\Rusle2.exe".
+//! - #RX_PROPERTYSTR_APPNAME
+//!     Return the English name (title) of the application.
+//!     Example: "Rusle2".
+//! - #RX_PROPERTYSTR_APPPATH
+//!     Return the path to the application executable.
+//!     Example: "C:\Program Files\Rusle2\Binaries".
+//! - #RX_PROPERTYSTR_DBAUTHOR
+//!     Return the global "owner" field of the database.
+//! - #RX_PROPERTYSTR_DBCOMMENTS
+//!     Return the global "info" field of the database.
+//! - #RX_PROPERTYSTR_DBDATE
+//!     Return the global "date" field of the database.
+//! - #RX_PROPERTYSTR_DBFULLNAME
+//!     Get the full filename of the database, including directory.
+//! - #RX_PROPERTYSTR_DBNAME
+//!     Get the short filename of the database.
+//!     Example: "moses.gdb".
+//! - #RX_PROPERTYSTR_DBPATH
+//!     Get the full path of the database.
+//!     Example: "C:\Program Files\Rusle2".
+//!
+//! @return NULL on failure.
+//! @RomeAPI
+//!
+ROME_API RT_CSTR RomeGetPropertyStr(RT_App* pApp, RT_UINT nProp)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pApp,             "RomeGetPropertyStr: NULL Rome app pointer.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,        "RomeGetPropertyStr: invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,         "RomeGetPropertyStr: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,     "RomeGetPropertyStr: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(pApp);
+
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeGetPropertyStr", "type='%d'/>\n", nProp));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeGetPropertyStr %d\n", nProp));
+#endif
+
+	    CString& sResult = RomeThreadGetNamedString("RomeGetPropertyStr");
+
+	    switch (nProp)
+	    {
+		    // Return the full filename of the application executable, including path.
+		    // Example: "C:\Program Files\Rusle2\Binaries\Rusle2.exe".
+		    case RX_PROPERTYSTR_APPFULLNAME:
+		    {
+			    CString sExeName = (LPCSTR)pApp->RomeNotificationSend(RX_NOTIFY_APP_EXENAME, NULL);
+			    if (strempty(sExeName))
+				    return NULL;
+
+                CString sLocal = "Binaries\\" + sExeName + ".exe";
+                {
+                    CArenaBypass NoArena;
+                    sResult = RomeGetDirectory(pApp, sLocal);
+                }
+			    return ArenaResult(sResult);
+		    }
+
+		    // Return the English name (title) of the application.
+		    // Example: "Rusle2".
+		    case RX_PROPERTYSTR_APPNAME:
+		    {
+			    sResult = (LPCSTR)pApp->RomeNotificationSend(RX_NOTIFY_APP_APPNAME, NULL);
+			    if (!strempty(sResult))
+				    return ArenaResult(sResult);
+			    else
+				    return NULL;
+		    }
+
+		    // Return the path to the application executable.
+		    // Example: "C:\Program Files\Rusle2\Binaries".
+		    case RX_PROPERTYSTR_APPPATH:
+		    {
+			    sResult = pApp->User.GetPath("Binaries");
+			    return ArenaResult(sResult);
+		    }
+
+		    case RX_PROPERTYSTR_DBAUTHOR:
+		    {
+			    sResult = DbSysGetInfo(pApp->Files.GetDatalink(), "owner");
+			    return ArenaResult(sResult);
+		    }
+
+		    case RX_PROPERTYSTR_DBCOMMENTS:
+		    {
+			    sResult = DbSysGetInfo(pApp->Files.GetDatalink(), "info");
+			    return ArenaResult(sResult);
+		    }
+
+		    case RX_PROPERTYSTR_DBDATE:
+		    {
+			    sResult = DbSysGetInfo(pApp->Files.GetDatalink(), "date");
+			    return ArenaResult(sResult);
+		    }
+
+		    // Get the full filename of the database, including directory.
+		    case RX_PROPERTYSTR_DBFULLNAME:
+		    {
+			    sResult =  pApp->Files.m_sCurrentDatabase;
+                // todo: validate "sResult" as a URL.
+//              ASSERT(DiskFilePathValidEx(sResult, RX_PATHValid_PATH | RX_PATHValid_EMPTY));
+                sResult.Replace("\\\\", "\\"); // Hack: fix double backslashes.
+			    return ArenaResult(sResult);
+		    }
+
+		    // Get the short filename of the database.
+		    // Example: "moses.gdb".
+		    case RX_PROPERTYSTR_DBNAME:
+		    {
+			    sResult = FullnameGetFilename(pApp->Files.m_sCurrentDatabase);
+                // todo: validate "sResult" as a URL.
+//               ASSERT(DiskFilePathValid(sResult));
+                sResult.Replace("\\\\", "\\"); // Hack: fix double backslashes.
+			    return ArenaResult(sResult);
+		    }
+
+		    // Get the full path of the database.
+		    // Example: "C:\Program Files\Rusle2".
+		    case RX_PROPERTYSTR_DBPATH:
+		    {
+			    sResult = FullnameGetPath(pApp->Files.m_sCurrentDatabase);
+                // todo: validate "sResult" as a URL.
+//              ASSERT(DiskFilePathValid(sResult));
+                sResult.Replace("\\\\", "\\"); // Hack: fix double backslashes.
+			    return ArenaResult(sResult);
+		    }
+
+		    default:
+                ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeGetPropertyStr: unknown property value.");
+	    }
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("RomeGetPropertyStr: exception for Property = '%d'.", nProp);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeGetPropertyStr: exception in catch block.");
+        }
+    }
+}
+
+
+//! Get string properties of the app.
+//! See RomeGetPropertyStr() [above] for full documentation.
+//!
+//! This version is required for use by Intel Fortran, which can't use functions
+//!   which return a string pointer. Instead it must have its first 2 arguments
+//!   be a pointer to a buffer and its length, to return the string in.
+//!   The function must have a return type of void.
+//! @param[out] pBuf  The pointer to a buffer to return a NUL-terminated string in.
+//! @param nBufLen    The length of the buffer to return a NUL-terminated string in.
+//! @param pApp       The Rome interface pointer obtained from RomeInit().
+//! @param nProp      The property to get.
+//!
+//! @RomeAPI Wrapper for RomeGetPropertyStr().
+//! @FortranAPI This function allows calling RomeGetPropertyStr() from Fortran.
+//!
+ROME_API RT_void RomeGetPropertyStrF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_App* pApp, RT_UINT nProp)
+{
+    try
+    {
+        // Does not require AFX_MANAGE_STATE() macro.
+
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+		// Validate arguments unique to the Fortran function version.
+		// The remaining arguments will be validated in the normal Rome API call.
+        ASSERT_OR_SETERROR_AND_RETURN(pBuf,           "RomeGetPropertyStrF: NULL buffer pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN(nBufLen > 0,    "RomeGetPropertyStrF: non-positive buffer length.");
+
+        ROME_API_WRITELOCK(pApp);
+
+        // Does not require command logging.
+
+        CArenaBypass NoArena;
+        LPCSTR pszProp = RomeGetPropertyStr(pApp, nProp);
+        CopyStrF(pBuf, nBufLen, pszProp);
+    }
+    catch (...)
+    {
+        try
+        {
+            if (pBuf && nBufLen > 0)
+                *pBuf = 0;
+            CString sInfo; sInfo.Format("RomeGetPropertyStrF: exception for Buffer = '0x%08X', Length = %d, Property = %d.", pBuf, nBufLen, nProp);
+            ASSERT_OR_SETERROR_AND_RETURN(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN(0,    "RomeGetPropertyStrF: exception in catch block.");
+        }
+    }
+}
+
+
+//! Get the #SCIENCEVERSION of the Rome instance.
+//! @copydoc SCIENCEVERSION
+//! @param pApp  The Rome interface pointer obtained from RomeInit().
+//!
+//! @return  The science version, or zero (0) on error.
+//! @RomeAPI Wrapper for CRomeCore::GetScienceVersion().
+//!
+ROME_API RT_UINT RomeGetScienceVersion(RT_App* pApp)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+	    ASSERT_OR_SETERROR_AND_RETURN_ZERO(pApp,             "RomeGetScienceVersion: NULL Rome app pointer.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(bValidApp,        "RomeGetScienceVersion: invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bExited,         "RomeGetScienceVersion: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bSameThread,     "RomeGetScienceVersion: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(pApp);
+
+	    ROME_API_LOGELEM(CLogFileElement0(LOGELEM_HIST, "user", "RomeGetScienceVersion", "/>\n"));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf0(LOG_SHELL, "RomeGetScienceVersion\n"));
+#endif
+
+	    return pApp->GetScienceVersion();
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(0,                "RomeGetScienceVersion: exception.");
+    }
+}
+
+
+//! Get a pointer to the Rome statusbar interface.
+//! This pointer does not need to be freed or released when finished using it.
+//! @param pApp  The Rome interface pointer obtained from RomeInit().
+//!
+//! @return  The interface pointer, or NULL on failure.
+//! @RomeAPI Wrapper for CMainFrame::StatusBar.
+//!
+ROME_API RT_Statusbar* RomeGetStatusbar(RT_App* pApp)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+#ifdef BUILD_MOSES // ROMEDLL_IGNORE
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pApp,             "RomeGetStatusbar: NULL Rome app pointer.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,        "RomeGetStatusbar: invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,         "RomeGetStatusbar: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,     "RomeGetStatusbar: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(pApp);
+
+	    // Does not require command logging.
+
+	    CMainFrame* pFrame = GetMainFrame();
+	    if (!pFrame)
+		    return NULL;
+
+	    return &(pFrame->StatusBar);
+#else // ROMEDLL_IGNORE
+	UNUSED(pApp);
+	    return NULL;
+#endif // ROMEDLL_IGNORE
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(0,                "RomeGetStatusbar: exception.");
+    }
+}
+
+
+//! Resolve an "AttrName:#ATTR_UNITS" title key to the key of the attr's template unit.
+//! @param Core   The core whose template (or catalog) has the unit.
+//! @param pszKey The title key. This may be NULL.
+//! @return  The unit key, or @p pszKey itself if it isn't an #ATTR_UNITS key.
+//!
+LOCAL LPCSTR TitleKeyResolveUnits(RT_App& Core, LPCSTR pszKey)
+{
+    int location = 0;
+    if (pszKey && (location = ((CString)pszKey).Find(":#ATTR_UNITS")) > -1)
+    {
+        CString sAttrName = ((CString)pszKey).Left(location);
+#if USE_USER_TEMPLATES
+        LPCNAME pszUnit = Core.pPreferences->GetPrefUnit(sAttrName);
+#else
+        CListing* pAttrL = Core.AttrCatalog.GetListing(sAttrName);
+        LPCNAME pszUnit = pAttrL? pAttrL->GetUnit(): "";
+#endif
+        return pszUnit;
+    }
+    return pszKey;
+}
+
+
+//! Get a title string mapped to a title key.
+//! @param pApp   The Rome interface pointer obtained from RomeInit().
+//! @param pszKey The key to lookup.
+//!   There are special values that can be used:
+//! - "#APPVERSION"       - The version of the calling application.
+//! - "#APPNAME"          - The name of the calling application.
+//! - "#BUILDDATE"        - The date the core [science] code was compiled.
+//! - "#BUILDTIME"        - The time the core [science] code was compiled.
+//! - "#COMPILER_OPTIONS" - The options used to compile the project.
+//! - "#ROMEVERSION"      - The version of the core Rome code (may be EXE or DLL)
+//! - "#ROMENAME"         - The name of the core Rome module (may be EXE or DLL)
+//! - "#SCIENCEVERSION"   - The version of the core Rome model, in format YYYYMMDD
+//! - "#STARTTIME"        - The startup time of the current run.
+//! - "#VERSION_TOMCRYPT" - The version of the TOMCRYPT library used (as DLL or compiled in)
+//! - "#VERSION_ZLIB"     - The version of the ZLIB library used (as DLL or compiled in)
+//! @return  The title string if found, or NULL on failure.
+//!
+//! @see Document "Rusle2 Translation Titles.rtf" for more information.
+//! @note This function is also used as a backdoor to add functions to the Rome API
+//!   without having to add new exported functions.
+//!   Special keys handled:
+//! - "Filename1:Filename2:#XML_FILE_COMPARE"<br>
+//!     Do a diff between 2 XML files.
+//! - "AttrName:#ATTR_UNITS"<br>
+//!     Return the title of the current template unit for this parameter.
+//!     The parameter name can be a "remote name" (e.g. "#RD:CLIMATE_PTR:EI_10YEAR").
+//! - "UnitTestCanRun:TestName"<br>
+//!     Return "1" if UnitTestCanRun(TestName) is TRUE, otherwise NULL.
+//! @RomeAPI  Wrapper for TitleGet().
+//!
+ROME_API RT_CSTR RomeGetTitle(RT_App* pApp, RT_CSTR pszKey)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeGetTitle", "key='%s'/>\n", (CString)XMLEncode(pszKey)));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeGetTitle \"%s\"\n", (CString)pszKey));
+#endif
+
+		if (pApp)
+		{
+            BOOL bValidApp = RomeCoreIsValid(pApp);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,        "RomeGetTitle: invalid Rome app pointer.");
+            BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,         "RomeGetTitle: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+            THREADId nCurThreadId = GetCurrentThreadId();
+            BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,     "RomeGetTitle: Rome API function called on different thread from RomeInit().");
+#endif
+        }
+
+        ////////////////////////////////////////
+        // Handle special string arguments first.
+
+		// @todo require a non-NULL Rome interface pointer.
+        RT_App& Core = pApp? *pApp: App;
+
+	    int location = 0;
+#ifdef USE_XML_ARCHIVES
+	    // Run the xml file comparison used for the test suite.  Looking for an argument of the form
+	    // "[LPCSTR]xmlFilename1:[LPCSTR]xmlFilename2:#XML_FILE_COMPARE"
+	    if (pszKey && (location = ((CString)pszKey).Find(":#XML_FILE_COMPARE")) > -1)
+	    {
+		    RT_BOOL bDiff = (RT_BOOL)Core.RomeNotificationSend(RX_NOTIFY_XML_FILE_COMPARE, pszKey);
+		    return Bool2Str(bDiff);
+	    }
+#endif // USE_XML_ARCHIVES
+
+	    // #ATTR_UNITS: return the title of the unit for this parameter, not the parameter title
+	    pszKey = TitleKeyResolveUnits(Core, pszKey);
+
+        if (pszKey && strncmp(pszKey, "UnitTestCanRun:", 15)==0)
+        {
+#if RUN_UNIT_TESTS
+            LPCSTR pszTestName = pszKey + 15;
+            BOOL bCanRun = UnitTestCanRun(pszTestName);
+            return bCanRun? "1": NULL;
+#else
+            return NULL;
+#endif
+        }
+
+        ////////////////////////////////////////
+
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pApp,             "RomeGetTitle: NULL Rome app pointer.");
+
+        // Titles don't depend on the engine, so lookups share the core's API gate.
+        // The title is copied, since another thread may look up a title before the caller uses it.
+        ROME_API_READLOCK(pApp, APIGATE_SHARED);
+
+        CSingleLock ReadLock(ApiGate.GetReadLock(), TRUE);
+	    LPCSTR pszTitle = pApp->Titles.FindAux(pszKey, TITLES_AppGetTitle);
+        if (pszTitle == NULL)
+            return NULL;
+
+        if (ArenaIsActive())
+            return ArenaResult(pszTitle);
+
+        CString& sTitle = RomeThreadGetNamedString("RomeGetTitle");
+        sTitle = pszTitle;
+        return sTitle;
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("RomeGetTitle: exception for key = '%s'.", (CString)pszKey);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeGetTitle: exception in catch block.");
+        }
+    }
+}
+
+
+//! Get a title string mapped to a title key.
+//! See RomeGetTitle() [above] for full documentation.
+//!
+//! This version is required for use by Intel Fortran, which can't use functions
+//!   which return a string pointer. Instead it must have its first 2 arguments
+//!   be a pointer to a buffer and its length, to return the string in.
+//!   The function must have a return type of void.
+//! @param[out] pBuf The pointer to a buffer to return a NUL-terminated string in.
+//! @param nBufLen   The length of the buffer to return a NUL-terminated string in.
+//! @param pApp      The Rome interface pointer obtained from RomeInit().
+//! @param pszKey    The key to lookup.
+//!
+//! @RomeAPI Wrapper for RomeGetTitle().
+//! @FortranAPI This function allows calling RomeGetTitle() from Fortran.
+//!
+ROME_API RT_void RomeGetTitleF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_App* pApp, RT_CSTR pszKey)
+{
+    try
+    {
+        // Does not require AFX_MANAGE_STATE() macro.
+
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+		// Validate arguments unique to the Fortran function version.
+		// The remaining arguments will be validated in the normal Rome API call.
+        ASSERT_OR_SETERROR_AND_RETURN(pBuf,           "RomeGetTitleF: NULL buffer pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN(nBufLen > 0,    "RomeGetTitleF: non-positive buffer length.");
+
+        ROME_API_READLOCK(pApp, APIGATE_SHARED);
+
+        // Does not require command logging.
+
+        CArenaBypass NoArena;
+        LPCSTR pszTitle = RomeGetTitle(pApp, pszKey);
+        CopyStrF(pBuf, nBufLen, pszTitle);
+    }
+    catch (...)
+    {
+        try
+        {
+            if (pBuf && nBufLen > 0)
+                *pBuf = 0;
+            CString sInfo; sInfo.Format("RomeGetPropertyStrF: exception for Buffer = '0x%08X', Length = %d, Key = '%s'.", pBuf, nBufLen, CString(pszKey));
+            ASSERT_OR_SETERROR_AND_RETURN(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN(0,    "RomeGetPropertyStrF: exception in catch block.");
+        }
+    }
+}
+
+
+//! Get the titles mapped to many title keys with one call, e.g. for the labels of a report.
+//! The keys are looked up under one lock, the same way as by RomeGetTitle(),
+//!   including "AttrName:#ATTR_UNITS" keys. The other special keys of RomeGetTitle() aren't handled.
+//! @param pApp     The Rome interface pointer obtained from RomeInit().
+//! @param ppszKeys The keys to look up.
+//! @param nKeys    The number of keys in @p ppszKeys.
+//! @param pBuf     Returns the title of each key in order, each followed by a NUL.
+//!   A key without a title gives an empty string.
+//!   Nothing is written unless all of them fit. This may be NULL if @p nBufLen is 0.
+//! @param nBufLen  The size of @p pBuf in bytes.
+//! @return  The number of bytes the titles need, or #RX_FAILURE (-1) on error.
+//!
+//! @see RomeGetTitle().
+//! @RomeAPI  Wrapper for TitleGet().
+//!
+ROME_API RT_INT RomeGetTitles(RT_App* pApp, RT_CSTR* ppszKeys, RT_UINT nKeys, RT_PCHAR pBuf, RT_UINT nBufLen)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pApp,               "RomeGetTitles: NULL Rome app pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(ppszKeys || !nKeys, "RomeGetTitles: NULL key array.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pBuf || !nBufLen,   "RomeGetTitles: NULL buffer.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,          "RomeGetTitles: invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeGetTitles: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeGetTitles: Rome API function called on different thread from RomeInit().");
+#endif
+
+        // Titles don't depend on the engine, so lookups share the core's API gate.
+        // The titles are only used while the read lock is held, so they aren't copied first.
+        ROME_API_READLOCK(pApp, APIGATE_SHARED);
+
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeGetTitles", "count='%d'/>\n", nKeys));
+
+        CSingleLock ReadLock(ApiGate.GetReadLock(), TRUE);
+        CArray<LPCSTR, LPCSTR> vTitles;
+        vTitles.SetSize(nKeys);
+        UINT nNeeded = 0;
+        for (UINT i = 0; i < nKeys; i++)
+        {
+            LPCSTR pszKey = TitleKeyResolveUnits(*pApp, ppszKeys[i]);
+            LPCSTR pszTitle = pszKey? pApp->Titles.FindAux(pszKey, TITLES_AppGetTitle): NULL;
+            vTitles[i] = pszTitle? pszTitle: "";
+            nNeeded += strlen(vTitles[i]) + 1;
+        }
+
+        if (nNeeded <= nBufLen)
+        {
+            for (UINT i = 0; i < nKeys; i++)
+            {
+                const size_t nLen = strlen(vTitles[i]) + 1;
+                memcpy(pBuf, vTitles[i], nLen);
+                pBuf += nLen;
+            }
+        }
+
+        return (RT_INT)nNeeded; // success
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("RomeGetTitles: exception for Count = %d.", nKeys);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeGetTitles: exception in catch block.");
+        }
+    }
+}
+
+
+//! Create a new (key, title) translation pair and add it to the titles map.
+//! @param pApp      The Rome interface pointer obtained from RomeInit().
+//! @param pszKey    The key string.
+//! @param pszTitle  The string to map to the key.
+//!   If this is NULL, the title will be removed.
+//! @param nFlags    Flags used by titles functions
+//!   (not all flag combinations are legal)
+//! - #RX_TITLES_USER     Add to user  titles
+//! - #RX_TITLES_FIXED    Add to fixed titles
+//! - #RX_TITLES_INTERNAL Add to internal titles
+//! - #RX_TITLES_NODUP    Don't set a duplicate title
+//!
+//! This makes use of the order INTERNAL < FIXED < USER.
+//! Don't set a title in a level when it duplicates
+//!   an existing title with a key at a lower level.
+//! Do set the title if a different title is mapped
+//!   to the same key at the same or a lower level.
+//! @return TRUE on success.
+//!
+//! @see Document "Rusle2 Translation Titles.rtf" for more information.
+//! @RomeAPI  Wrapper for CRomeTitles::TitleSet().
+//!
+ROME_API RT_BOOL RomeSetTitle(RT_App* pApp, RT_CSTR pszKey, RT_CSTR pszTitle, RT_UINT nFlags)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pApp,             "RomeSetTitle: NULL Rome app pointer.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,        "RomeSetTitle: invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,         "RomeSetTitle: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pszKey,           "RomeSetTitle: NULL key string.");
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!strempty(pszKey),"RomeSetTitle: empty key string.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,     "RomeSetTitle: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(pApp);
+
+	    ROME_API_LOGELEM(CLogFileElement3(LOGELEM_HIST, "user", "RomeSetTitle", "key='%s' text='%d' flags='%d'/>\n", (CString)XMLEncode(pszKey), pszTitle, nFlags));
+#if USE_ROMESHELL_LOGGING
+        LPCSTR pszCmdTitle = pszTitle? pszTitle: "#NULL";
+        ROME_API_LOG(LogFilePrintf3(LOG_SHELL, "RomeSetTitle \"%s\" \"%s\" %d\n", pszKey, pszCmdTitle, nFlags));
+#endif
+
+	    return pApp->Titles.TitleSet(pszKey, pszTitle, nFlags);
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("RomeSetTitle: exception for key = '%s' title = '%s' flags='%d'.", (CString)pszKey, (CString)pszTitle, nFlags);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeSetTitle: exception in catch block.");
+        }
+    }
+}
+
+
+#if USE_USER_TEMPLATES
+//! Get the stamp of a template file, for the template a core has loaded (see COREAPI).
+//! @param Core         The core, for its "Users" directory.
+//! @param pszFilename  The name passed to RomeTemplateLoad().
+//!   A short filename is taken to be in the "Users" directory, as LoadTemplate() does.
+//! @param[out] Stamp   Returns the full path, size and write time of the file.
+//! @return  FALSE if the file can't be found by that name.
+//!
+LOCAL BOOL TemplateStampGet(RT_App& Core, LPCSTR pszFilename, TEMPLATESTAMP& Stamp)
+{
+    CString sPath = pszFilename;
+    if (sPath.FindOneOf("\\/:") < 0)
+        sPath = Core.User.GetPath("Users\\" + sPath);
+
+    char szFullPath[MAX_PATH];
+    const DWORD nLen = GetFullPathName(sPath, MAX_PATH, szFullPath, NULL);
+    if (nLen == 0 || nLen >= MAX_PATH)
+        return FALSE;
+    WIN32_FILE_ATTRIBUTE_DATA Data;
+    if (!GetFileAttributesEx(szFullPath, GetFileExInfoStandard, &Data) || (Data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        return FALSE;
+
+    Stamp.sPath      = szFullPath;
+    Stamp.nSize      = ((ULONGLONG)Data.nFileSizeHigh << 32) | Data.nFileSizeLow;
+    Stamp.nWriteTime = ((ULONGLONG)Data.ftLastWriteTime.dwHighDateTime << 32) | Data.ftLastWriteTime.dwLowDateTime;
+    return TRUE;
+}
+#endif // USE_USER_TEMPLATES
+
+
+//! Load a user template file.
+//! Only one parsed template is kept for each core, so switching between templates
+//!   (e.g. English and metric units for alternate reports) costs a full load each time.
+//! @param pApp   The Rome interface pointer obtained from RomeInit().
+//! @param pszFilename The name of the disk template file.
+//!   This can be a short filename, in which case the full path to the
+//!   "Users" directory will be prepended. If the "Users" directory has been
+//!   remapped by configuration setting, that directory will be used.
+//! @return RX_TRUE on success, RX_FALSE on failure or error.
+//!
+//! @note Loading the template which is already loaded is skipped if its file hasn't changed
+//!   since (by size and write time), so it is cheap to load the template for each report.
+//!   Switching to another template always reads and parses its file, even if it was loaded
+//!   before, since CRomeCore::LoadTemplate() applies a template to the core's attrs,
+//!   and the API can't keep a parsed template to apply again. A process which alternates between
+//!   two templates can give each its own core (see RomeInit() "/NewCore").
+//! @see RomeTemplateSave().
+//! @RomeAPI Wrapper for CRomeCore::LoadTemplate().
+//!
+ROME_API RT_BOOL RomeTemplateLoad(RT_App* pApp, RT_CSTR pszFilename)
+{
+#if USE_USER_TEMPLATES
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pApp,                   "RomeTemplateLoad: NULL Rome app pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!strempty(pszFilename), "RomeTemplateLoad: empty path name.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,              "RomeTemplateLoad: invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,               "RomeTemplateLoad: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,           "RomeTemplateLoad: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(pApp);
+
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeTemplateLoad", "file='%s'/>\n", XMLEncode(pszFilename)));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeTemplateLoad \"%s\"\n", pszFilename));
+#endif
+
+        TEMPLATESTAMP Stamp;
+        const BOOL bStamp = TemplateStampGet(*pApp, pszFilename, Stamp);
+        TEMPLATESTAMP& Loaded = CoreApi(*pApp).Template;
+        if (bStamp && !Loaded.sPath.IsEmpty() && Loaded.sPath.CompareNoCase(Stamp.sPath) == 0 &&
+            Loaded.nSize == Stamp.nSize && Loaded.nWriteTime == Stamp.nWriteTime)
+        {
+            InterlockedIncrement(&RomeStatTemplateHits);
+            return RX_TRUE;
+        }
+
+	    BOOL bLoaded = pApp->LoadTemplate(pszFilename);
+        // A failed load may have left part of a template loaded, which no file matches.
+        if (bLoaded && bStamp)
+            Loaded = Stamp;
+        else
+            Loaded.sPath.Empty();
+	    return bLoaded;
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,                      "RomeTemplateLoad: exception.");
+    }
+#else
+	UNUSED2(pApp, pszFilename);
+	return RX_FALSE;
+#endif // USE_USER_TEMPLATES
+}
+
+
+//! Save the active user template.
+//! @param pApp  The Rome interface pointer obtained from RomeInit().
+//! @param pszFilename  The filename to save the template as.
+//!   This can be a short filename, in which case the full path to the
+//!   "Users" directory will be prepended. If the "Users" directory has been
+//!   remapped by configuration setting, that directory will be used.
+//!   If this is NULL, the current name will be used.
+//! @return  RX_TRUE on success, RX_FALSE on failure or error.
+//!
+//! @see RomeTemplateLoad().
+//! @RomeAPI Wrapper for CRomeCore::SaveTemplate().
+//!
+ROME_API RT_BOOL RomeTemplateSave(RT_App* pApp, RT_CSTR pszFilename /*= NULL*/)
+{
+#if USE_USER_TEMPLATES
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pApp,                   "RomeTemplateSave: NULL Rome app pointer.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,              "RomeTemplateSave: invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,               "RomeTemplateSave: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,           "RomeTemplateSave: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(pApp);
+
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeTemplateSave", "file='%s'/>\n", XMLEncode(pszFilename)));
+#if USE_ROMESHELL_LOGGING
+        if (pszFilename)
+            ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeTemplateSave \"%s\"\n", pszFilename));
+        else
+            ROME_API_LOG(LogFilePrintf0(LOG_SHELL, "RomeTemplateSave\n"));
+#endif
+
+	    BOOL bSaved = pApp->SaveTemplate(pszFilename);
+        // The file on disk has changed, or the template has a new name.
+        CoreApi(*pApp).Template.sPath.Empty();
+	    return bSaved;
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,                      "RomeTemplateSave: exception.");
+    }
+#else
+	UNUSED2(pApp, pszFilename);
+	return RX_FALSE;
+#endif // USE_USER_TEMPLATES
+}
+
+
+//! Load results saved by RomeResultCacheSave() into the result cache used by RomeFileRunCached().
+//! Loaded results are added as the most recently used, up to the cache limit.
+//! @param pApp        The Rome interface pointer obtained from RomeInit().
+//! @param pszFilename The full path of the file to load (e.g. "C:\Rusle2\Cache\results.r2c").
+//! @return  The number of results from the file which are in the cache afterwards, or #RX_FAILURE (-1) on error.
+//!   This is less than the number saved if the cache is disabled, its limit is lower, or results were malformed.
+//!
+//! @see RomeResultCacheSave(), RomeResultCacheSetLimit(), RomeFileRunCached().
+//! @RomeAPI
+//!
+ROME_API RT_INT RomeResultCacheLoad(RT_App* pApp, RT_CSTR pszFilename)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pApp,                   "RomeResultCacheLoad: NULL Rome app pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszFilename), "RomeResultCacheLoad: empty filename.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,              "RomeResultCacheLoad: invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,               "RomeResultCacheLoad: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,           "RomeResultCacheLoad: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(pApp);
+
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeResultCacheLoad", "file='%s'/>\n", XMLEncode(pszFilename)));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeResultCacheLoad \"%s\"\n", pszFilename));
+#endif
+
+        CFile File;
+        BOOL bOpen = File.Open(pszFilename, CFile::modeRead | CFile::shareDenyWrite);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bOpen,                  "RomeResultCacheLoad: failed to open file.");
+        CArchive ar(&File, CArchive::load);
+
+        CString sMagic;
+        int nVersion = 0, nEntries = 0;
+        ar >> sMagic >> nVersion >> nEntries;
+        BOOL bValidFile = (sMagic == RX_RESULTCACHE_MAGIC && nVersion == RX_RESULTCACHE_VERSION && nEntries >= 0);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,             "RomeResultCacheLoad: not a result cache file, or from a different version.");
+
+        // Results were saved least recently used first, so adding each as the
+        //   most recently used restores their order.
+        CMapStringToPtr Added;
+        for (int i = 0; i < nEntries; i++)
+        {
+            CString sKey;
+            CStringArray aValues;
+            CByteArray aFound;
+            ar >> sKey;
+            aValues.Serialize(ar);
+            aFound.Serialize(ar);
+            if (aValues.GetSize() == aFound.GetSize() && ResultCacheAdd(sKey, aValues, aFound))
+                Added.SetAt(sKey, NULL);
+        }
+
+        // Later results may have pushed earlier ones out again.
+        RFX_CRITICAL_SECTION();
+        return min((int)Added.GetCount(), ResultCacheLimit);
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("RomeResultCacheLoad: exception for File = '%s'.", (CString)pszFilename);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeResultCacheLoad: exception in catch block.");
+        }
+    }
+}
+
+
+//! Save the result cache used by RomeFileRunCached() to disk, so a later session
+//!   can reuse its results by calling RomeResultCacheLoad().
+//! @param pApp        The Rome interface pointer obtained from RomeInit().
+//! @param pszFilename The full path of the file to save (e.g. "C:\Rusle2\Cache\results.r2c").
+//!   An existing file is replaced.
+//! @return  The number of results saved, or #RX_FAILURE (-1) on error.
+//!
+//! @note Results depend on the science version (see RomeGetScienceVersion()), which is part of each key,
+//!   so results saved by another version of the DLL are loaded but never used.
+//! @see RomeResultCacheLoad(), RomeFileRunCached().
+//! @RomeAPI
+//!
+ROME_API RT_INT RomeResultCacheSave(RT_App* pApp, RT_CSTR pszFilename)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pApp,                   "RomeResultCacheSave: NULL Rome app pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszFilename), "RomeResultCacheSave: empty filename.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,              "RomeResultCacheSave: invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,               "RomeResultCacheSave: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,           "RomeResultCacheSave: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(pApp);
+
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeResultCacheSave", "file='%s'/>\n", XMLEncode(pszFilename)));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeResultCacheSave \"%s\"\n", pszFilename));
+#endif
+
+        CFile File;
+        BOOL bOpen = File.Open(pszFilename, CFile::modeCreate | CFile::modeWrite | CFile::shareExclusive);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bOpen,                  "RomeResultCacheSave: failed to create file.");
+        CArchive ar(&File, CArchive::store);
+
+        RFX_CRITICAL_SECTION();
+
+        const int nEntries = ResultCacheList.GetCount();
+        ar << CString(RX_RESULTCACHE_MAGIC) << (int)RX_RESULTCACHE_VERSION << nEntries;
+
+        // Save the least recently used first, for RomeResultCacheLoad().
+        POSITION pos = ResultCacheList.GetTailPosition();
+        while (pos)
+        {
+            RESULTCACHEENTRY* pEntry = ResultCacheList.GetPrev(pos);
+            ar << pEntry->sKey;
+            pEntry->aValues.Serialize(ar);
+            pEntry->aFound.Serialize(ar);
+        }
+        ar.Close();
+
+        return nEntries;
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("RomeResultCacheSave: exception for File = '%s'.", (CString)pszFilename);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeResultCacheSave: exception in catch block.");
+        }
+    }
+}
+
+
+//! Set the largest number of results kept by the result cache used by RomeFileRunCached().
+//! When the cache is full, the least recently used result is dropped.
+//! @param pApp    The Rome interface pointer obtained from RomeInit().
+//! @param nLimit  The number of results to keep. 0 disables the cache and frees its results.
+//!   The default is #RX_RESULTCACHE_DEFAULTLIMIT.
+//! @return  The previous limit, or #RX_FAILURE (-1) on error.
+//!
+//! @note The cache is shared by all cores.
+//! @see RomeFileRunCached(), RomeResultCacheLoad(), RomeResultCacheSave().
+//! @RomeAPI
+//!
+ROME_API RT_INT RomeResultCacheSetLimit(RT_App* pApp, RT_INT nLimit)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pApp,                 "RomeResultCacheSetLimit: NULL Rome app pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nLimit >= 0,          "RomeResultCacheSetLimit: negative limit.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,            "RomeResultCacheSetLimit: invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,             "RomeResultCacheSetLimit: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,         "RomeResultCacheSetLimit: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(pApp);
+
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeResultCacheSetLimit", "limit='%d'/>\n", nLimit));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeResultCacheSetLimit %d\n", nLimit));
+#endif
+
+        RFX_CRITICAL_SECTION();
+        const int nOldLimit = ResultCacheLimit;
+        ResultCacheLimit = nLimit;
+        ResultCacheTrim(nLimit);
+        return nOldLimit;
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,                    "RomeResultCacheSetLimit: exception.");
+    }
+}
+
+
+//! Get the counters for the API gate of a core.
+//! Read-only calls (RomeFileGetAttrValue(), RomeGetTitle(), RomeDatabaseFindInfo())
+//!   share the gate with each other, while all other calls have it to themselves.
+//! @param pApp    The Rome interface pointer obtained from RomeInit().
+//! @param[out] pStats  The counters since the core was created or they were last reset.
+//! @param bReset  RX_TRUE to reset the counters after getting them.
+//! @return  RX_TRUE on success, RX_FALSE on error.
+//!
+//! @note This doesn't take the gate, so it may be called while other threads hold it.
+//! @RomeAPI
+//!
+ROME_API RT_BOOL RomeGetLockStats(RT_App* pApp, RT_LockStats* pStats, RT_BOOL bReset)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pApp,                   "RomeGetLockStats: NULL Rome app pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pStats,                 "RomeGetLockStats: NULL stats pointer.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,              "RomeGetLockStats: invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,               "RomeGetLockStats: RomeExit() has already been called.");
+
+        APIGATE* pGate = &CoreApi(*pApp).Gate;
+
+        LARGE_INTEGER nFreq;
+        QueryPerformanceFrequency(&nFreq);
+
+        pStats->nSharedLocks    = pGate->nSharedLocks;
+        pStats->nExclusiveLocks = pGate->nExclusiveLocks;
+        pStats->nSharedWaits    = pGate->nSharedWaits;
+        pStats->nExclusiveWaits = pGate->nExclusiveWaits;
+        pStats->nUnsettled      = pGate->nUnsettled;
+        pStats->dWaitMs         = (double)pGate->nWaitTicks * 1000.0 / (double)nFreq.QuadPart;
+
+        if (bReset)
+        {
+            InterlockedExchange(&pGate->nSharedLocks,    0);
+            InterlockedExchange(&pGate->nExclusiveLocks, 0);
+            InterlockedExchange(&pGate->nSharedWaits,    0);
+            InterlockedExchange(&pGate->nExclusiveWaits, 0);
+            InterlockedExchange(&pGate->nUnsettled,      0);
+            InterlockedExchange64(&pGate->nWaitTicks,    0);
+        }
+        return RX_TRUE;
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,                      "RomeGetLockStats: exception.");
+    }
+}
+
+
+//! Append a timer to the JSON text returned by RomeGetStats().
+//!
+LOCAL void RomeStatAppendJson(CString& sJson, const ROMESTAT& stat, double dTicksPerMs)
+{
+    CString sItem;
+    sItem.Format("{\"name\":\"%s\",\"calls\":%d,\"ms\":%.3f,\"buckets\":[", stat.pszName, stat.nCalls, (double)stat.nTicks / dTicksPerMs);
+    sJson += sItem;
+    for (int i = 0; i < ROMESTAT_BUCKETS; i++)
+    {
+        sItem.Format(i? ",%d": "%d", stat.aBuckets[i]);
+        sJson += sItem;
+    }
+    sJson += "]}";
+}
+
+
+//! Get the call counts and timings of the API functions, as JSON text.
+//! The text is an object with these members:
+//! - "functions"      An array of timers, one for each API function which has been called.
+//! - "lockWait"       A timer for the waits for an API gate (see RomeGetLockStats()).
+//! - "finishUpdates"  A timer for the calls to CEngineBase::FinishUpdates().
+//! - "engineRun"      A timer for the calls to CEngineBase::Run().
+//! - "attrFinds", "attrCreates"    The number of calls to FindOrCreate(), and how many created the attr.
+//! - "fileOpens", "fileOpenHits"   The number of files opened by RomeFilesOpen(), and how many were already open.
+//! - "sharedHits", "sharedSaves"   The number of database files opened from a shared cache, and saved to one
+//!                                 (see RomeDatabaseSetSharedCache()).
+//! - "templateHits"                The number of calls to RomeTemplateLoad() which found the template already loaded.
+//!                                 Switching to another template is never a hit, since it is always read again.
+//!
+//! Each timer is an object with its "name", number of "calls", total "ms",
+//!   and a latency histogram "buckets", where bucket @c i counts the calls which took
+//!   less than 2^i microseconds, and the last bucket counts all longer calls.
+//!
+//! @param pApp     The Rome interface pointer obtained from RomeInit().
+//! @param[out] pBuf  The buffer to return the NUL-terminated text in. This may be NULL to get the length needed.
+//! @param nBufLen  The length of @p pBuf.
+//! @param bReset   RX_TRUE to reset the counts after getting them (e.g. between batches).
+//! @return  The length needed for the text, including the NUL, or #RX_FAILURE (-1) on error.
+//!   If this is more than @p nBufLen, the text was not copied (but the counts were still reset).
+//!
+//! @note The times are kept for all cores together, and include nested calls.
+//!   Functions are timed from before they take the API lock, so their time includes lock waits.
+//! @RomeAPI
+//!
+ROME_API RT_INT RomeGetStats(RT_App* pApp, RT_PCHAR pBuf, RT_UINT nBufLen, RT_BOOL bReset)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pApp,                 "RomeGetStats: NULL Rome app pointer.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,            "RomeGetStats: invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,             "RomeGetStats: RomeExit() has already been called.");
+
+        LARGE_INTEGER nFreq;
+        QueryPerformanceFrequency(&nFreq);
+        const double dTicksPerMs = (double)nFreq.QuadPart / 1000.0;
+
+        CString sJson = "{\"functions\":[";
+        const int nFuncs = RomeStatFuncCount;
+        BOOL bFirst = TRUE;
+        for (int i = 0; i < nFuncs; i++)
+        {
+            const ROMESTAT* pStat = RomeStatFuncs[i];
+            if (pStat->nCalls == 0)
+                continue;
+            if (!bFirst)
+                sJson += ",";
+            RomeStatAppendJson(sJson, *pStat, dTicksPerMs);
+            bFirst = FALSE;
+        }
+        sJson += "],\"lockWait\":";
+        RomeStatAppendJson(sJson, RomeStatLockWait, dTicksPerMs);
+        sJson += ",\"finishUpdates\":";
+        RomeStatAppendJson(sJson, RomeStatFinishUpdates, dTicksPerMs);
+        sJson += ",\"engineRun\":";
+        RomeStatAppendJson(sJson, RomeStatEngineRun, dTicksPerMs);
+        CString sCounts;
+        sCounts.Format(",\"attrFinds\":%d,\"attrCreates\":%d,\"fileOpens\":%d,\"fileOpenHits\":%d,\"sharedHits\":%d,\"sharedSaves\":%d,\"templateHits\":%d}",
+                       RomeStatAttrFinds, RomeStatAttrCreates, RomeStatFileOpens, RomeStatFileOpenHits, RomeStatSharedHits, RomeStatSharedSaves,
+                       RomeStatTemplateHits);
+        sJson += sCounts;
+
+        if (bReset)
+        {
+            for (int i = 0; i < nFuncs; i++)
+                RomeStatReset(RomeStatFuncs[i]);
+            RomeStatReset(&RomeStatLockWait);
+            RomeStatReset(&RomeStatFinishUpdates);
+            RomeStatReset(&RomeStatEngineRun);
+            InterlockedExchange(&RomeStatAttrFinds,    0);
+            InterlockedExchange(&RomeStatAttrCreates,  0);
+            InterlockedExchange(&RomeStatFileOpens,    0);
+            InterlockedExchange(&RomeStatFileOpenHits, 0);
+            InterlockedExchange(&RomeStatSharedHits,   0);
+            InterlockedExchange(&RomeStatSharedSaves,  0);
+            InterlockedExchange(&RomeStatTemplateHits, 0);
+        }
+
+        const UINT nLen = sJson.GetLength() + 1;
+        if (pBuf && nLen <= nBufLen)
+            memcpy(pBuf, (LPCSTR)sJson, nLen);
+        return (RT_INT)nLen;
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,                    "RomeGetStats: exception.");
+    }
+}
+
+
+//! Count the attrs of an object and of its embedded subobjects, for RomeGetMemoryStats().
+//! Files it points to aren't counted, since they are counted as open files themselves.
+//! @param pObj     The file or subobject.
+//! @param nObjs    Incremented for this object and each embedded subobject.
+//! @param nAttrs   Incremented for each attr.
+//! @param nValues  Incremented by the size of each attr.
+//!
+LOCAL void MemCountObj(CSubObj* pObj, int& nObjs, int& nAttrs, int& nValues)
+{
+    nObjs++;
+    POSITION pos = pObj->m_params.GetStartPosition();
+    while (pos)
+    {
+        CAttr* pAttr = pObj->m_params.GetNextValue(pos);
+        const int nSize = pAttr->GetSize();
+        nAttrs++;
+        nValues += nSize;
+
+        CListing* pListing = pAttr->GetListing();
+        if (!pListing || pListing->GetType() != ATTR_SUB)
+            continue;
+        for (int i = 0; i < nSize; i++)
+        {
+            CSubObj* pSub = pAttr->GetPtr(i);
+            if (pSub && !pSub->IsFile())
+                MemCountObj(pSub, nObjs, nAttrs, nValues);
+        }
+    }
+}
+
+
+//! Get a breakdown of the memory used by a Rome core and the API caches, as JSON text.
+//! This is meant for long-lived processes, to see what grows between RomeFilesOpen()
+//!   and RomeFilesCloseAll() cycles. The text is an object with these members:
+//! - "process"       The "workingSet", "peakWorkingSet" and "privateBytes" of the process.
+//! - "files"         The number of files "open" in the core, and the "objects" (files and
+//!                     embedded subobjects), "attrs" and attr "values" they hold. Attrs created
+//!                     by FindOrCreate() stay in their file until it is closed, so they
+//!                     are counted here; RomeGetStats() counts how many were created.
+//! - "resultCache"   The "entries" and approximate string "bytes" of the results saved by
+//!                     RomeFileRunCached(), and its "limit" (see RomeResultCacheSetLimit()).
+//! - "arenas"        The "bytes" allocated for the string arenas of all threads (see RomeArenaReset()).
+//!
+//! The undo history and the database cache are kept by CFileSys and the database,
+//!   which don't report their size, so they are only part of the process totals.
+//!   #RX_PRAGMA_TRIM clears the database cache, and batch mode (#RX_PRAGMA_BATCH_MODE)
+//!   stops undo information being recorded.
+//!
+//! @param pApp     The Rome interface pointer obtained from RomeInit().
+//! @param[out] pBuf  The buffer to return the NUL-terminated text in. This may be NULL to get the length needed.
+//! @param nBufLen  The length of @p pBuf.
+//! @return  The length needed for the text, including the NUL, or #RX_FAILURE (-1) on error.
+//!   If this is more than @p nBufLen, the text was not copied.
+//!
+//! @see RomeGetStats(), RomeFilesPragma()
+//! @RomeAPI
+//!
+ROME_API RT_INT RomeGetMemoryStats(RT_App* pApp, RT_PCHAR pBuf, RT_UINT nBufLen)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pApp,                 "RomeGetMemoryStats: NULL Rome app pointer.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,            "RomeGetMemoryStats: invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,             "RomeGetMemoryStats: RomeExit() has already been called.");
+
+        // Nothing is changed, so the counting shares the core's API gate.
+        ROME_API_READLOCK(pApp, APIGATE_SHARED);
+
+        int nFiles = 0, nObjs = 0, nAttrs = 0, nValues = 0;
+        {
+            CSingleLock ReadLock(ApiGate.GetReadLock(), TRUE);
+            CFileSys* pFiles = &pApp->Files;
+            nFiles = pFiles->GetFileCount();
+            for (int i = 0; i < nFiles; i++)
+            {
+                RT_FileObj* pFile = pFiles->GetFile(i);
+                if (pFile)
+                    MemCountObj(pFile, nObjs, nAttrs, nValues);
+            }
+        }
+
+        int nCacheEntries = 0, nCacheLimit = 0;
+        ULONGLONG nCacheBytes = 0;
+        {
+            RFX_CRITICAL_SECTION();
+            nCacheEntries = (int)ResultCacheList.GetCount();
+            nCacheLimit = ResultCacheLimit;
+            POSITION pos = ResultCacheList.GetHeadPosition();
+            while (pos)
+            {
+                const RESULTCACHEENTRY* pEntry = ResultCacheList.GetNext(pos);
+                nCacheBytes += pEntry->sKey.GetLength() + 1 + pEntry->aFound.GetSize();
+                for (int i = 0; i < pEntry->aValues.GetSize(); i++)
+                    nCacheBytes += pEntry->aValues[i].GetLength() + 1;
+            }
+        }
+
+        PROCESS_MEMORY_COUNTERS_EX Mem;
+        ZeroMemory(&Mem, sizeof(Mem));
+        Mem.cb = sizeof(Mem);
+        GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&Mem, sizeof(Mem));
+
+        CString sJson;
+        sJson.Format("{\"process\":{\"workingSet\":%I64u,\"peakWorkingSet\":%I64u,\"privateBytes\":%I64u},"
+                     "\"files\":{\"open\":%d,\"objects\":%d,\"attrs\":%d,\"values\":%d},"
+                     "\"resultCache\":{\"entries\":%d,\"bytes\":%I64u,\"limit\":%d},\"arenas\":{\"bytes\":%d}}",
+                     (ULONGLONG)Mem.WorkingSetSize, (ULONGLONG)Mem.PeakWorkingSetSize, (ULONGLONG)Mem.PrivateUsage,
+                     nFiles, nObjs, nAttrs, nValues,
+                     nCacheEntries, nCacheBytes, nCacheLimit, ArenaBytes);
+
+        const UINT nLen = sJson.GetLength() + 1;
+        if (pBuf && nLen <= nBufLen)
+            memcpy(pBuf, (LPCSTR)sJson, nLen);
+        return (RT_INT)nLen;
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,                    "RomeGetMemoryStats: exception.");
+    }
+}
+
+
+//! Reset the string arena of the calling thread, enabling it if needed.
+//! While the arena is enabled, the strings returned by every API function which returns one
+//!   are copied into it, so each stays valid until the next reset,
+//!   instead of until the next call of the same function. These are:
+//!   RomeFileGetAttrValue(), RomeFileGetAttrValueAux(), RomeAttrHandleGetValue(), RomeGetTitle(),
+//!   RomeDatabaseFileInfo(), RomeDatabaseFindInfo(), RomeFileGetFullname(), RomeGetDirectory(),
+//!   RomeGetPropertyStr() and RomeGetLastError().
+//!   RomeCatalogGetAttrTag() returns a constant string, which is always valid, so it isn't copied.
+//!   The Fortran versions (e.g. RomeFileGetAttrValueF()) copy into the caller's buffer instead.
+//!   A batch of reads can then keep all of its results without copying them.
+//! The arena is made of large blocks, which are reused after a reset,
+//!   so a steady batch size needs no allocation after the first batch.
+//!
+//! @param pApp    The Rome interface pointer obtained from RomeInit().
+//! @param nFlags  #RX_ARENA_RESET to start (or restart) the arena,
+//!                or #RX_ARENA_RELEASE to free it and return to the thread-local result strings.
+//! @return  The number of bytes the arena was using before the reset, or #RX_FAILURE (-1) on error.
+//!
+//! @warning All pointers returned while the arena was enabled are invalid after this call.
+//! @note The arena belongs to the calling thread. A thread which enables it should
+//!   release it before the thread ends, or its blocks are leaked.
+//! @RomeAPI
+//!
+ROME_API RT_INT RomeArenaReset(RT_App* pApp, RT_UINT nFlags)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pApp,                 "RomeArenaReset: NULL Rome app pointer.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,            "RomeArenaReset: invalid Rome app pointer.");
+        BOOL bValidFlags = ((nFlags & ~RX_ARENA_RELEASE) == 0);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFlags,          "RomeArenaReset: invalid flags.");
+
+        // Only this thread's arena is touched, so no lock is needed.
+        int nUsed = 0;
+        for (ARENABLOCK* pBlock = ArenaFirst; pBlock; pBlock = pBlock->pNext)
+            nUsed += pBlock->nUsed;
+
+        if (nFlags & RX_ARENA_RELEASE)
+        {
+            while (ArenaFirst)
+            {
+                ARENABLOCK* pNext = ArenaFirst->pNext;
+                InterlockedExchangeAdd(&ArenaBytes, -(LONG)(sizeof(ARENABLOCK) + ArenaFirst->nSize));
+                free(ArenaFirst);
+                ArenaFirst = pNext;
+            }
+            ArenaCurrent = NULL;
+            return nUsed;
+        }
+
+        if (ArenaFirst == NULL)
+        {
+            ArenaFirst = (ARENABLOCK*)malloc(sizeof(ARENABLOCK) + RX_ARENA_BLOCKSIZE);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(ArenaFirst,       "RomeArenaReset: out of memory.");
+            InterlockedExchangeAdd(&ArenaBytes, (LONG)(sizeof(ARENABLOCK) + RX_ARENA_BLOCKSIZE));
+            ArenaFirst->pNext = NULL;
+            ArenaFirst->nSize = RX_ARENA_BLOCKSIZE;
+        }
+        for (ARENABLOCK* pBlock = ArenaFirst; pBlock; pBlock = pBlock->pNext)
+            pBlock->nUsed = 0;
+        ArenaCurrent = ArenaFirst;
+        return nUsed;
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,                    "RomeArenaReset: exception.");
+    }
+}
+
+
+//! Get error information set by the API.
+//! This function may be called when an API function returns an error value.
+//! This may return additional information in text format.
+//! The information string is currently thread-local.
+//! @param pApp  The Rome interface pointer obtained from RomeInit().
+//! @return  An error information string, or NULL on failure.
+//!
+//! @see RomeSetLastError().
+//! @RomeAPI
+//!
+ROME_API RT_CSTR RomeGetLastError(RT_App* pApp)
+{
+    try
+    {
+        // Switch to the app's MFC module state while in this scope.
+        // This is required for many MFC functions to work correctly.
+        AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        // Can't use Get/SetLastError macros insIde this function!
+        BOOL bValidApp = (pApp == NULL) || RomeCoreIsValid(pApp);
+        ASSERT_OR_RETURN_NULL(bValidApp);
+		BOOL bExited = (pApp? pApp: &App)->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_RETURN_NULL(!bExited);
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (App.m_nThreadId = nCurThreadId);
+        ASSERT_OR_RETURN_VALUE(!bSameThread, "RomeGetLastError: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_NOLOCK();
+
+        // Does not require command logging.
+
+        // Get a thread-local error information string.
+        CString& sInfo = RomeThreadGetNamedString("RomeGetLastError");
+        return ArenaResult(sInfo);
+    }
+    catch (...)
+    {
+        ASSERT(FALSE);
+        // Note: don't try to use RomeGet/SetLastError() here if this code isn't working!
+        return NULL; // failure
+    }
+}
+
+
+//! Set additional error information for a Rome API error.
+//! This information is retrieved by RomeGetLastError().
+//! Note that it may be overwritten if not retrieved directly after it is set.
+//! This information string is currently thread-local.
+//! @param pApp    The Rome interface pointer obtained from RomeInit().
+//! @param pszInfo The text error description.<br>
+//!   If this is NULL the error information will be cleared.<br>
+//!   If the string starts with a special character, then<br>
+//!   '+'  the text will be @em appended  to the current string as a new line.<br>
+//!   '-'  the text will be @em prepended to the current string as a new line.<br>
+//!   '='  the text will @em replace the current string.<br>
+//!   If the string doesn't start with a special character, then whether the string replaces the old
+//!     one or is affixed in some way depends on compile-time settings of this function.
+//! @return  RX_TRUE on success, RX_FALSE on failure or error.
+//!
+//! @see RomeGetLastError().
+//! @RomeAPI
+//!
+ROME_API RT_BOOL RomeSetLastError(RT_App* pApp, RT_CSTR pszInfo)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        // Can't use Get/SetLastError macros insIde this function!
+		if (pApp)
+		{
+			BOOL bValidApp = RomeCoreIsValid(pApp);
+			ASSERT_OR_RETURN_FALSE(bValidApp);
+			BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+			ASSERT_OR_RETURN_FALSE(!bExited);
+#if USE_ROMEAPI_THREADIdS
+            THREADId nCurThreadId = GetCurrentThreadId();
+            BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+            ASSERT_OR_RETURN_FALSE(!bSameThread); // RomeSetLastError: Rome API function called on different thread from RomeInit().
+#endif
+		}
+
+        ROME_API_NOLOCK();
+
+	    // Does not require command logging.
+
+        //! @todo Require an interface pointer to use this function.
+//      ASSERT_OR_RETURN_FALSE(pApp);
+
+#if defined(_DEBUG) && !defined(BUILD_MOSES)
+        // If we are setting a new error message, we don't want to wipe out an old one.
+        // Using the '+' and '-' prefixes allows us to maintain a 'call stack' of error messages.
+        // NOTE: Another way to do this would be to just change this function to always
+        //   concatenate the new error info.
+        CArenaBypass NoArena;
+        RT_CSTR pszOldError = RomeGetLastError(pApp);
+        ASSERT(strempty(pszOldError) || strempty(pszInfo) || streq(pszOldError, pszInfo) || *pszInfo == '-' || *pszInfo == '+' || *pszInfo == '=');
+#endif
+
+        // Get the thread-local error information string.
+        CString sInfo = RomeThreadGetNamedString("RomeGetLastError");
+
+        if (pszInfo == NULL)
+            sInfo = "";
+        else
+        if (*pszInfo == '+')
+        {
+            // Affix the new string to the end of the current string.
+            if (!strempty(sInfo))
+                sInfo = (sInfo + "\n") + (pszInfo+1);
+            else
+                sInfo = (pszInfo+1);
+        }
+        else
+        if (*pszInfo == '-')
+        {
+            // Prefix the new string to the start of the current string.
+            if (!strempty(sInfo))
+                sInfo = (pszInfo+1) + ("\n" + sInfo);
+            else
+                sInfo = (pszInfo+1);
+        }
+        else
+        if (*pszInfo == '=')
+        {
+            // Replace the new string as the current string.
+            sInfo = (pszInfo+1);
+        }
+        else
+        {
+#if 0
+            // *** Don't use this code for now. It is unsafe because it can
+            // ***   lead to unbounded strings when visuals code repeatedly asks for
+            // ***   obsolete parameters.
+            // Prefix the new string to the start of the current string.
+            if (!strempty(sInfo))
+                sInfo = pszInfo + ("\n" + sInfo);
+            else
+                sInfo = pszInfo;
+#else
+            // Replace the new string as the current string.
+            sInfo = pszInfo;
+#endif
+        }
+
+        RomeThreadSetNamedString("RomeGetLastError", sInfo);
+
+        return RX_TRUE; // success
+    }
+    catch (...)
+    {
+        ASSERT(FALSE);
+        // Note: don't try to use RomeGet/SetLastError() here if this code isn't working!
+        return RX_FALSE; // failure
+    }
+}
+
+
+//! Call when finished using the Rome interface.
+//!   This frees system resources allocated by the interface.
+//!   After this call it is forbIdden call any other Rome API functions 
+//!   or to use any data returned by Rome API functions during the session
+//!   that is owned by the Rome session.
+//! @param pApp  The Rome interface pointer obtained from RomeInit().
+//! @return RX_TRUE on succcess, RX_FALSE on failure.
+//!
+//! @warning After RomeExit() has been called, you may not call RomeInit() to create a new Rome session.
+//!   This does not apply to cores created with the "/NewCore" argument.
+//! @see RomeInit().
+//! @RomeAPI Wrapper for CRomeCore::Exit().
+//!
+ROME_API RT_BOOL RomeExit(RT_App* pApp)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pApp,            "RomeExit: NULL Rome app pointer.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,       "RomeExit: invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,        "RomeExit: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+        ASSERT(!bSameThread);
+#endif
+
+        RT_BOOL bExit = RX_FALSE;
+        {
+            ROME_API_WRITELOCK(pApp);
+
+	        ROME_API_LOGELEM(CLogFileElement0(LOGELEM_HIST, "user", "RomeExit", "/>\n"));
+#if USE_ROMESHELL_LOGGING
+            ROME_API_LOG(LogFilePrintf0(LOG_SHELL, "RomeExit\n"));
+#endif
+
+            AttrHandlesInvalidate(*pApp);
+            EngineGetSets(*pApp, TRUE);
+            ListenersRemoveCore(*pApp);
+            FileBaselinesPrune(*pApp, TRUE);
+            CoreSetBatch(*pApp, FALSE);
+            bExit = pApp->Exit();
+
+            // No new call can take the gate of a core which isn't valid.
+            if (pApp != &App)
+                RomeCoreRegister(pApp, FALSE);
+        }
+
+        //! @note A core created by RomeInit("/NewCore") is freed here, after its gate is released.
+        //!   The gate is part of the core, so it is freed with it.
+        //!   The pointer (and any engine, filesystem or file pointers obtained from it)
+        //!   may not be used after this call.
+        if (pApp != &App)
+            delete static_cast<CRomeApiCore*>(pApp);
+
+        return bExit;
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,               "RomeExit: exception.");
+    }
+}
+
+
+//! Initialize the Rome API for use.
+//! This function returns a Rome interface pointer required by most Rome API functions.
+//!   Call RomeExit() on this pointer when finished with it.
+//! @param pszArgs  A command-line argument string used to configure the DLL.
+//! - Arguments are separated by spaces. In order to contain spaces or
+//!     other special characters, arguments should be double-quoted.
+//! - This string may be NULL or empty.
+//! - The first argument is assumed to be the name of the calling app, and is ignored.
+//! - /DirRoot=...        The root directory ... to use for the all files.
+//! - /Path:(name)=(path) The file or folder (name) is redirected to the Win32 (path).
+//! - /UnitSystem=(name)  The system of units to use initially.
+//! - -  "US"               the English/British unit system
+//! - -  "SI"               the metric unit system
+//! - -                   If the (name) part is empty, it will use SI units.
+//! - /NewCore            Create a new Rome core, independent of all other cores.
+//! -                     It has its own engine, filesystem and open files, and is freed by RomeExit().
+//! -                     Separate cores may be used concurrently from separate threads.
+//! -                     Their calls only wait for each other while each log entry is written,
+//! -                     and while a core is being created by RomeInit().
+//! - /BatchMode          Start the core in batch mode (see #RX_PRAGMA_BATCH_MODE).
+//! @since 2007-10-08 If no unit system is specified, it will default to SI units.<br>
+//!   Note: in the past this was incorrectly documented as using default US units.<br>
+//!   An unrecognized unit system name is now ignored.
+//! @return  A pointer to the Rome interface, or NULL on failure.
+//!
+//! @warning After RomeExit() has been called, you may not call RomeInit() to create a new Rome session.
+//!   This does not apply to cores created with the "/NewCore" argument.
+//! @see CRomeCore::Init(), CRomeCore::ParseArgs(LPCSTR, ...), ParseArgs(RMapStringToString&, ...), RomeExit().
+//! @RomeAPI Wrapper for CRomeCore::Init().
+//!
+ROME_API RT_App* RomeInit(RT_CSTR pszArgs)
+{
+    // A new core which hasn't been returned yet, to free if its initialization throws.
+    CRomeCore* pNewCore = NULL;
+    try
+    {
+        // Switch to the app's MFC module state while in this scope.
+        // This is required for many MFC functions to work correctly.
+        AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+	    // Because this function can get called simultaneously from
+	    //   separate threads, make sure this doesn't happen.
+	    RFX_CRITICAL_SECTION();
+        CRomeInitScope InitScope;
+
+        CStringArray aCommandLine;
+        BOOL bParsed = CRomeCore::ParseArgs(pszArgs, aCommandLine);
+        // Note: the DLLSTATE_INITARGS flag will only be set when the flags are handled in CRomeCore::Init().
+    	ASSERT_OR_SETERROR_AND_RETURN_NULL(bParsed, "-RomeInit: failed to parse command line arguments.");
+
+        // The "/NewCore" switch is handled here, not by CRomeCore::Init().
+        BOOL bNewCore = ArgsRemoveSwitch(aCommandLine, "/NewCore");
+        BOOL bBatch   = ArgsRemoveSwitch(aCommandLine, "/BatchMode");
+
+        // Get a pointer to the app instance.
+        CRomeCore* pApp = &App;
+
+        if (!bNewCore)
+        {
+		    BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,            "RomeInit: RomeExit() has already been called.");
+
+            //! @note RomeInit() may be called multiple times safely.
+            //! Later calls will return the same Rome app instance as the first call.
+            //! The @p pszArgs argument will be ignored on all calls after the first.
+            //! Initialization is only done on the first call to RomeInit().
+	        if (pApp->HasFlag(DLLSTATE_INITROME))
+		        return &App;
+        }
+        else
+        {
+            // Dynamically create a new CRomeCore instance, which is then freed by RomeExit().
+            // It is registered before Init() so that calls made during initialization validate.
+            pApp = new CRomeApiCore;
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(pApp,                "RomeInit: failed to create a new Rome core.");
+            RomeCoreRegister(pApp, TRUE);
+            pNewCore = pApp;
+        }
+
+        RT_App* pInit = NULL;
+        {
+            ROME_API_WRITELOCK(pApp);
+
+            ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeInit", "args='%s'>\n", (CString)XMLEncode(pszArgs)));
+#if USE_ROMESHELL_LOGGING
+            if (!strempty(pszArgs))
+                ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeInit %s\n", pszArgs));
+            else
+                ROME_API_LOG(LogFilePrintf0(LOG_SHELL, "RomeInit\n"));
+#endif
+
+            // Set the Rome notification callback.
+            // Currently this is passed into the CRomeCore constructor.
+            // TODO: Generalize to register a window/thread handle or IP address to send messages to.
+
+            // HACK: add a place to stop execution and wait for the user to continue.
+            // This alows using menu item Build > Start Debug. > Attach to Process...
+            //   to attach to the calling executable, and then continue running.
+        //	MessageBox(NULL, "Waiting to attach to calling process", "RomeDLL", MB_OK);
+
+            // Store a copy of the command line this was invoked with.
+            pApp->m_sCommandLine = pszArgs;
+
+            const int argc = aCommandLine.GetSize();
+            CArray<LPCSTR, LPCSTR> vCommandLine;
+            for (int i=0; i<argc; i++)
+                vCommandLine.Add(aCommandLine[i]);
+            const char** argv = vCommandLine.GetData();
+            const char** envp = NULL;
+
+#if USE_ROMEAPI_THREADIdS
+            //! @note If #USE_ROMEAPI_THREADIdS is set, store the thread Id of this thread.
+            //! This will be checked in subsequent Rome API calls to check that it matches.
+            pApp->m_nThreadId = GetCurrentThreadId();
+#endif
+
+            //////////////////////////////////
+
+            pInit = pApp->Init(argc, argv, envp);
+
+            if (bNewCore && pInit == NULL)
+                RomeCoreRegister(pApp, FALSE);
+            else
+            if (bBatch && pInit)
+                CoreSetBatch(*pInit, TRUE);
+        }
+
+        // Free a new core that failed to initialize, once its gate is released.
+        if (bNewCore && pInit == NULL)
+            delete static_cast<CRomeApiCore*>(pApp);
+
+	    return pInit;
+    }
+    catch (...)
+    {
+        try
+        {
+            // The core's gate was released by the unwinding, so it can be freed as RomeExit() does.
+            if (pNewCore)
+            {
+                RomeCoreRegister(pNewCore, FALSE);
+                delete static_cast<CRomeApiCore*>(pNewCore);
+            }
+            CString sInfo; sInfo.Format("RomeInit: exception for Args = '%s'.", CString(pszArgs));
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeInit: exception in catch block.");
+        }
+    }
+}
+
+
+//! Manage adding and removing listeners on various Rome objects.
+//! @param nAction    The action to perform, and the target type.<br>
+//!   Example: #RX_LISTENER_ADD | #RX_LISTENER_TARGET_FILE.
+//! @param pTarget    The Rome object that is being observed.
+//! @param pObserver  An opaque pointer to or Id of the observer.
+//! @param pEventHandler  The event callback function to invoke.
+//!
+//! @return  Non-zero on success, zero on failure.
+//! @see RomeListenerCoalesced().
+//! @RomeAPI
+//!
+ROME_API RT_BOOL Rome_Listener(RT_UINT nAction, RT_void* pTarget, RT_void* pObserver, RT_EventHandler pEventHandler)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        const UINT nTargetType = nAction & RX_LISTENER_TARGET_MASK;
+        ASSERT_OR_RETURN_NULL(nTargetType != RX_LISTENER_TARGET_NONE);
+        const UINT nActionType = nAction & RX_LISTENER_ACTION_MASK;
+
+        // Currently all arguments are required to be non-NULL.
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(pTarget,         "Rome_Listener: NULL target argument.");
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(pObserver,       "Rome_Listener: NULL observer argument.");
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(pEventHandler,   "Rome_Listener: NULL event handler.");
+        //
+		BOOL bExited = App.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bExited,        "Rome_Listener: RomeExit() has already been called.");
+
+        // RomeFile_Listener() and RomeObj_Listener() take the API lock of the target's core.
+        ROME_API_NOLOCK();
+
+        RT_BOOL bRet = RX_FALSE;
+
+        switch (nTargetType)
+        {
+            case RX_LISTENER_TARGET_FILE:
+            {
+                // @todo Add USE_ROMEAPI_THREADIdS check.
+                bRet = RomeFile_Listener((CFileObj*)pTarget, nActionType, pObserver, pEventHandler);
+                break;
+            }
+
+            case RX_LISTENER_TARGET_OBJ:
+            {
+                // @todo Add USE_ROMEAPI_THREADIdS check.
+                bRet = RomeObj_Listener((RT_SubObj*)pTarget, nActionType, pObserver, pEventHandler);
+                break;
+            }
+/*
+            case RX_LISTENER_TARGET_TASK:
+            {
+                bRet = ===((CEngineTask*)pTarget, nActionType, pObserver, pEventHandler);
+                break;
+            }
+*/
+            default:
+                ASSERT(false);
+                break;
+        }
+
+        return bRet;
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("Rome_Listener: exception for Action = %d.", nAction);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "Rome_Listener: exception in catch block.");
+        }
+    }
+}
+
+
+//! Manage listeners which get the changes to a file or object in batches.
+//! Instead of a callback for each change, the changes made through the API
+//!   (values set, and attrs resized, including by RomeFileSetDimRows()) are collected,
+//!   one #RT_ChangeEvent for each attr with the range of indexes changed, and delivered
+//!   as one #RX_EVENT_CHANGES event when the engine finishes: in RomeEngineRun(),
+//!   RomeEngineRunEx(), RomeEngineFinishUpdates() and RomeFileRunCached().
+//! @param nAction    The action to perform, and the target type.<br>
+//!   Example: #RX_LISTENER_ADD | #RX_LISTENER_TARGET_FILE.
+//!   #RX_LISTENER_REMOVEALL removes all of the observer's coalesced listeners in the target's core.
+//! @param pTarget    The file or object that is being observed.
+//!   A file listener gets the changes made through that file, including to "#RD:" chained attrs.
+//!   An object listener gets the changes to that object's own attrs.
+//! @param pObserver  An opaque pointer to or Id of the observer.
+//!   There is one listener for each target and observer; adding it again replaces the event handler.
+//!   The listeners of an observer with the same event handler get one batch between them,
+//!   listing each attr once (see ListenersDeliver()).
+//! @param pEventHandler  The event callback function to invoke. This isn't used for removes.
+//!
+//! @return  Non-zero on success, zero on failure.
+//!
+//! @note Changes made by the engine's calc functions aren't listed, only the inputs which caused them.
+//! @note Remove a listener before closing its target. Listeners are removed by RomeExit().
+//! @see Rome_Listener().
+//! @RomeAPI
+//!
+ROME_API RT_BOOL RomeListenerCoalesced(RT_UINT nAction, RT_void* pTarget, RT_void* pObserver, RT_EventHandler pEventHandler)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        const UINT nTargetType = nAction & RX_LISTENER_TARGET_MASK;
+        const UINT nActionType = nAction & RX_LISTENER_ACTION_MASK;
+        const BOOL bValidTarget = (nTargetType == RX_LISTENER_TARGET_FILE || nTargetType == RX_LISTENER_TARGET_OBJ);
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(bValidTarget,    "RomeListenerCoalesced: unsupported target type.");
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(pTarget,         "RomeListenerCoalesced: NULL target argument.");
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(pObserver,       "RomeListenerCoalesced: NULL observer argument.");
+        const BOOL bHandler = (pEventHandler != NULL || nActionType != RX_LISTENER_ADD);
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(bHandler,        "RomeListenerCoalesced: NULL event handler.");
+        if (nTargetType == RX_LISTENER_TARGET_FILE)
+        {
+            BOOL bValidFile = CFileObj::IsValid((CFileObj*)pTarget);
+            ASSERT_OR_SETERROR_AND_RETURN_ZERO(bValidFile,  "RomeListenerCoalesced: invalid file pointer.");
+        }
+        CRomeCore* pCore = (nTargetType == RX_LISTENER_TARGET_FILE)? &((CFileObj*)pTarget)->Core: &((RT_SubObj*)pTarget)->Core;
+        BOOL bValidApp = RomeCoreIsValid(pCore);
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(bValidApp,       "RomeListenerCoalesced: invalid target pointer.");
+		BOOL bExited = pCore->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bExited,        "RomeListenerCoalesced: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pCore->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bSameThread,    "RomeListenerCoalesced: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(pCore);
+
+	    ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST, "user", "RomeListenerCoalesced", "action='%d' target='0x%p'/>\n", nAction, pTarget));
+
+        COALESCEDLISTENERS& Listeners = CoreApi(*pCore).Listeners;
+        POSITION pos = Listeners.GetHeadPosition();
+        switch (nActionType)
+        {
+            case RX_LISTENER_ADD:
+            {
+                while (pos)
+                {
+                    COALESCEDLISTENER* pListener = Listeners.GetNext(pos);
+                    if (pListener->pTarget == pTarget && pListener->pObserver == pObserver)
+                    {
+                        pListener->pEventHandler = pEventHandler;
+                        return RX_TRUE;
+                    }
+                }
+                COALESCEDLISTENER* pListener = new COALESCEDLISTENER;
+                pListener->nTargetType   = nTargetType;
+                pListener->pTarget       = pTarget;
+                pListener->pObserver     = pObserver;
+                pListener->pEventHandler = pEventHandler;
+                Listeners.AddTail(pListener);
+                return RX_TRUE;
+            }
+
+            case RX_LISTENER_REMOVE:
+            case RX_LISTENER_REMOVEALL:
+            {
+                BOOL bRemoved = FALSE;
+                while (pos)
+                {
+                    POSITION posAt = pos;
+                    COALESCEDLISTENER* pListener = Listeners.GetNext(pos);
+                    if (pListener->pObserver != pObserver)
+                        continue;
+                    if (nActionType == RX_LISTENER_REMOVE && pListener->pTarget != pTarget)
+                        continue;
+                    Listeners.RemoveAt(posAt);
+                    delete pListener;
+                    bRemoved = TRUE;
+                }
+                return bRemoved;
+            }
+
+            default:
+                ASSERT_OR_SETERROR_AND_RETURN_ZERO(0,       "RomeListenerCoalesced: unsupported action.");
+        }
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("RomeListenerCoalesced: exception for Action = %d.", nAction);
+            ASSERT_OR_SETERROR_AND_RETURN_ZERO(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_ZERO(0,    "RomeListenerCoalesced: exception in catch block.");
+        }
+    }
+}
+
+
+//! Add or remove a coalesced listener on a file.
+//! This is RomeListenerCoalesced() with #RX_LISTENER_TARGET_FILE, for callers which
+//!   don't have the #RX_LISTENER_ADD and #RX_LISTENER_REMOVE values (e.g. .NET).
+//! @param pFile      The file that is being observed.
+//! @param bAdd       RX_TRUE to add the listener, RX_FALSE to remove it.
+//! @param pObserver  An opaque pointer to or Id of the observer.
+//! @param pEventHandler  The event callback function to invoke. This isn't used for removes.
+//!
+//! @return  Non-zero on success, zero on failure.
+//! @see RomeListenerCoalesced(), RomeFile_Listener().
+//! @RomeAPI Wrapper for RomeListenerCoalesced().
+//!
+ROME_API RT_BOOL RomeFileListenerCoalesced(RT_FileObj* pFile, RT_BOOL bAdd, RT_void* pObserver, RT_EventHandler pEventHandler)
+{
+    // Does not require AFX_MANAGE_STATE() macro, resource locking or command logging.
+    const RT_UINT nAction = (bAdd? RX_LISTENER_ADD: RX_LISTENER_REMOVE) | RX_LISTENER_TARGET_FILE;
+    return RomeListenerCoalesced(nAction, pFile, pObserver, pEventHandler);
+}
+
+//! @} // Rome session functions
+/////////////////////////////////////////////////////////////////////////////
+//! @name Rome Catalog functions
+//! @{
+
+//! Get the number of dimensions an attr has.
+//! @param pApp    The Rome interface pointer obtained from RomeInit().
+//! @param pszAttr  The parameter name used by the catalog (e.g. "CLAY").
+//!   This can be a 'long' attr name with a remote prefix (e.g. "#RD:SOIL_PTR:CLAY").
+//! @return  The attr's number of dimensions, or #RX_FAILURE (-1) on error.
+//!
+//! @see RomeFileGetAttrDimSize(), RomeFileGetAttrSizeEx().
+//! @RomeAPI
+//!
+ROME_API RT_INT RomeCatalogGetAttrDimCount(RT_App* pApp, RT_CNAME pszAttr)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pApp,               "RomeCatalogGetAttrDimCount: NULL Rome app pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszAttr), "RomeCatalogGetAttrDimCount: empty attr name.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,          "RomeCatalogGetAttrDimCount: invalid Rome pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeCatalogGetAttrDimCount: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeCatalogGetAttrDimCount: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_NOLOCK();
+
+        // Note: There is no need to finish running the stack since this doesn't require access to the file or attr instance.
+
+	    // Does not require command logging.
+//#if USE_ROMESHELL_LOGGING
+//        LogShellActivate(sFile);
+//        LogFilePrintf1(LOG_SHELL, "RomeCatalogGetAttrDimCount \"%s\"\n", pszAttr);
+//#endif
+
+        // Find the catalog listing for this parameter.
+        CListing* pListing = pApp->AttrCatalog.GetListing(pszAttr);
+        TEST_OR_SETERROR_AND_RETURN_FAILURE(pListing,            "RomeCatalogGetAttrDimCount: Parameter not found.");
+
+        // Get the number of dimensions from the catalog listing.
+        LPCNAME dim0 = pListing->GetDim(0);
+        LPCNAME dim1 = pListing->GetDim(1);
+        int nDims = (!strempty(dim0) && !streq(dim0, "1")) +
+                    (!strempty(dim1) && !streq(dim1, "1"));
+        ASSERT(0 <= nDims && nDims <= CDimensions::MAXDIMNUM);
+
+        return nDims;
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("RomeFileGetAttrDimCount: exception for Attr = '%s'.", (CString)pszAttr);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileGetAttrDimCount: exception in catch block.");
+        }
+    }
+}
+
+
+//! Get the tag (type string) for a parameter.
+//! @param pApp    The Rome interface pointer obtained from RomeInit().
+//! @param pszAttr  The parameter name used by the catalog (e.g. "CLAY").
+//!   This can be a 'long' attr name with a remote prefix.
+//! @return The type string on success, or empty on failure or error.
+//!
+//! @see RomeCatalogGetAttrType(), GetParamTag().
+//! @RomeAPI Wrapper for CListing::GetTag().
+//!
+ROME_API RT_CSTR RomeCatalogGetAttrTag(RT_App* pApp, RT_CNAME pszAttr)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pApp,                  "RomeCatalogGetAttrType: NULL Rome app pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!strempty(pszAttr),    "RomeCatalogGetAttrType: empty attr name.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,             "RomeCatalogGetAttrType: invalid Rome pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,              "RomeCatalogGetAttrType: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,          "RomeFileGetAttrDimCount: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_NOLOCK();
+
+        ParamType nType = (ParamType)RomeCatalogGetAttrType(pApp, pszAttr);
+
+        RT_CSTR pszTag = GetParamTag(nType);
+
+        return pszTag; // success
+    }
+    catch (...)
+    {
+        ASSERT(FALSE);
+        return ""; // failure
+    }
+}
+
+//! Get the integer type of a parameter.
+//! These are values of type enum #ParamType, which are exposed in "imoses.h".
+//! @param pApp    The Rome interface pointer obtained from RomeInit().
+//! @param pszAttr  The parameter name used by the catalog (e.g. "CLAY").
+//!   This can be a 'long' attr name with a remote prefix.
+//! @return The parameter integer type on success, or 0 (#RX_ATTR_NUL) on failure or error.
+//!
+//! @see RomeCatalogGetAttrTag(), enum ParamType.
+//! @RomeAPI Wrapper for CListing::GetType().
+//!
+ROME_API RT_UINT RomeCatalogGetAttrType(RT_App* pApp, RT_CNAME pszAttr)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(pApp,              "RomeCatalogGetAttrType: NULL Rome app pointer.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(bValidApp,         "RomeCatalogGetAttrType: Invalid Rome app pointer.");
+		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bExited,          "RomeCatalogGetAttrType: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(pszAttr,           "RomeCatalogGetAttrType: NULL attr name.");
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!strempty(pszAttr),"RomeCatalogGetAttrType: Empty attr name.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bSameThread,      "RomeCatalogGetAttrType: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_NOLOCK();
+
+	    // Does not require command logging.
+
+        // Find the catalog listing for this parameter.
+        CListing* pListing = pApp->AttrCatalog.GetListing(pszAttr);
+        TEST_OR_SETERROR_AND_RETURN_ZERO(pListing,            "RomeCatalogGetAttrType: Parameter not found.");
+
+        // Get the type from the catalog listing.
+        ParamType nType = pListing->GetType();
+
+        // Handle case of a float which is really an integer.
+        if (nType == RX_ATTR_FLT && pListing->GetFlag(ACF_INTEGRAL))
+            nType = ATTR_INT;
+
+        return nType; // success
+    }
+    catch (...)
+    {
+        ASSERT(FALSE);
+        return RX_ATTR_NUL; // failure
+    }
+}
+
+
+//! @} // Rome Catalog functions
+/////////////////////////////////////////////////////////////////////////////
+//! @name Rome Database functions
+//! @{
+
+// Verify that RX_ and DBFIND_ flags match each other.
+#if (RX_DBFILEINFO_QUERY   != DBFIND_INFO_QUERY)
+  #error "error: compile-time test failed: (RX_DBFILEINFO_QUERY   != DBFIND_INFO_QUERY)"
+#endif
+#if (RX_DBFILEINFO_NAME    != DBFIND_INFO_NAME )
+  #error "error: compile-time test failed: (RX_DBFILEINFO_NAME    != DBFIND_INFO_NAME )"
+#endif
+#if (RX_DBFILEINFO_PATH    != DBFIND_INFO_PATH )
+  #error "error: compile-time test failed: (RX_DBFILEINFO_PATH    != DBFIND_INFO_PATH )"
+#endif
+#if (RX_DBFILEINFO_RIGHT   != DBFIND_INFO_RIGHT)
+  #error "error: compile-time test failed: (RX_DBFILEINFO_RIGHT   != DBFIND_INFO_RIGHT)"
+#endif
+#if (RX_DBFILEINFO_TABLE   != DBFIND_INFO_TABLE)
+  #error "error: compile-time test failed: (RX_DBFILEINFO_TABLE   != DBFIND_INFO_TABLE)"
+#endif
+#if (RX_DBFILEINFO_OUTER   != DBFIND_INFO_OUTER)
+  #error "error: compile-time test failed: (RX_DBFILEINFO_OUTER   != DBFIND_INFO_OUTER)"
+#endif
+#if (RX_DBFILEINFO_LEFT    != DBFIND_INFO_LEFT )
+  #error "error: compile-time test failed: (RX_DBFILEINFO_LEFT    != DBFIND_INFO_LEFT )"
+#endif
+#if (RX_DBFILEINFO_FULL    != DBFIND_INFO_FULL )
+  #error "error: compile-time test failed: (RX_DBFILEINFO_FULL    != DBFIND_INFO_FULL )"
+#endif
+#if (RX_DBFILEINFO_OWNER   != DBFIND_INFO_OWNER)
+  #error "error: compile-time test failed: (RX_DBFILEINFO_OWNER   != DBFIND_INFO_OWNER)"
+#endif
+#if (RX_DBFILEINFO_GROUP   != DBFIND_INFO_GROUP)
+  #error "error: compile-time test failed: (RX_DBFILEINFO_GROUP   != DBFIND_INFO_GROUP)"
+#endif
+#if (RX_DBFILEINFO_PERMS   != DBFIND_INFO_PERMS)
+  #error "error: compile-time test failed: (RX_DBFILEINFO_PERMS   != DBFIND_INFO_PERMS)"
+#endif
+#if (RX_DBFILEINFO_DATE    != DBFIND_INFO_DATE )
+  #error "error: compile-time test failed: (RX_DBFILEINFO_DATE    != DBFIND_INFO_DATE )"
+#endif
+#if (RX_DBFILEINFO_DATA    != DBFIND_INFO_DATA )
+  #error "error: compile-time test failed: (RX_DBFILEINFO_DATA    != DBFIND_INFO_DATA )"
+#endif
+#if (RX_DBFILEINFO_FOLDER   != DBFIND_INFO_FOLDER)
+  #error "error: compile-time test failed: (RX_DBFILEINFO_FOLDERS   != DBFIND_INFO_FOLDERS)"
+#endif
+
+
+//! Close a named database.
+//! @param pDatabase  The Rome database interface pointer obtained from RomeGetDatabase().
+//! @param pszDatabase  The name of the database file to close.
+//!   Currently this argument is ignored. It will be used when the Rome filesystem has the ability
+//!   to open multiple database simultaneously.
+//! @return  RX_TRUE on success, RX_FALSE on failure.
+//!
+//! @warning This will fail if there are files open that need to be closed first.
+//! @see RomeDatabaseOpen().
+//! @RomeAPI Wrapper for CFileSys::CloseDatabase().
+//!
+ROME_API RT_BOOL RomeDatabaseClose(RT_Database* pDatabase, RT_CSTR pszDatabase /*= NULL*/)
+{
+    try
+    {
+        // Switch to the app's MFC module state while in this scope.
+        // This is required for many MFC functions to work correctly.
+        AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pDatabase,      "RomeDatabaseClose: null database pointer.");
+        BOOL bValidApp = RomeCoreIsValid(&pDatabase->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,      "RomeDatabaseClose: invalid database pointer.");
+		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,       "RomeDatabaseClose: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,   "RomeDatabaseClose: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(&pDatabase->Core);
+
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeDatabaseClose", "file='%s'/>\n", (CString)XMLEncode(pszDatabase)));
+#if USE_ROMESHELL_LOGGING
+        if (!strempty(pszDatabase))
+            ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeDatabaseClose \"%s\"\n", pszDatabase));
+        else
+            ROME_API_LOG(LogFilePrintf0(LOG_SHELL, "RomeDatabaseClose\n"));
+#endif
+
+        AttrHandlesInvalidate(pDatabase->Core);
+        pDatabase->CloseFiles(CVF_CloseTempFiles | CVF_CloseComboFiles |CVF_CloseLazyFiles);
+	    if (pDatabase->FilesToClose(false))
+		    return RX_FALSE; // handle this error
+
+        // A shared cache belongs to the database it was set for.
+        CoreApi(pDatabase->Core).sSharedCacheDir.Empty();
+
+	    // Close the current database.
+	    RT_BOOL bClosed = pDatabase->CloseDatabase();
+	    return bClosed;
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("RomeDatabaseClose: exception for Database = '%s'.", CString(pszDatabase));
+            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,   sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,   "RomeDatabaseClose: exception in catch block.");
+        }
+    }
+}
+
+
+//! Delete a file record from the database.
+//! @param pDatabase  The Rome database interface pointer obtained from RomeGetDatabase().
+//! @param pszPathname  The name of the file to delete. (e.g. "soils\default")
+//! @param nFlags  Flags which affect its behavior.
+//!   This argument is currently ignored (unimplemented).
+//!
+//! @return RX_TRUE on success, RX_FALSE on failure.
+//! @RomeAPI Wrapper for CFileSys::RemoveRecordFromDatabase().
+//!
+ROME_API RT_BOOL RomeDatabaseFileDelete(RT_Database* pDatabase, RT_CSTR pszPathname, RT_UINT nFlags)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        UNUSED(nFlags);
+
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pDatabase,              "RomeDatabaseFileDelete: NULL database pointer.");
+        BOOL bValidApp = RomeCoreIsValid(&pDatabase->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,				"RomeDatabaseFileDelete: invalid database pointer.");
+		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,				"RomeDatabaseFileDelete: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!strempty(pszPathname), "RomeDatabaseFileDelete: empty path name.");
+		ASSERT(nFlags == 0);	// This argument is unused
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,           "RomeDatabaseFileDelete: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(&pDatabase->Core);
+
+	    ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST, "user", "RomeDatabaseFileDelete", "file='%s' flags='%d'/>\n", (CString)XMLEncode(pszPathname), nFlags));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "RomeDatabaseFileDelete \"%s\" %d\n", pszPathname, nFlags));
+#endif
+
+	    // Delete the record.
+	    RT_BOOL bDeleted = pDatabase->RemoveRecordFromDatabase(pszPathname);
+	    return bDeleted;
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("RomeDatabaseFileDelete: exception for Pathname = '%s', Flags = 0x%X.", CString(pszPathname), nFlags);
+            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,   sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,   "RomeDatabaseFileDelete: exception in catch block.");
+        }
+    }
+}
+
+
+//! Retrieve information about a file in the database.
+//! @param pDatabase    The Rome database interface pointer obtained from RomeGetDatabase().
+//! @param pszFilename  The name of the file. (e.g. "soils\default")
+//! @param nInfoType    The type of information to retrieve:
+//! - #RX_DBFILEINFO_QUERY	 0 // info: (string result of query)
+//! - #RX_DBFILEINFO_NAME	 1 // info:                name
+//! - #RX_DBFILEINFO_PATH	 2 // info:         path
+//! - #RX_DBFILEINFO_RIGHT	 3 // info:         path \ name
+//! - #RX_DBFILEINFO_TABLE	 4 // info: table
+//! - #RX_DBFILEINFO_OUTER	 5 // info: table \        name
+//! - #RX_DBFILEINFO_LEFT	 6 // info: table \ path
+//! - #RX_DBFILEINFO_FULL	 7 // info: table \ path \ name
+//! - #RX_DBFILEINFO_OWNER	 8 // info: owner field
+//! - #RX_DBFILEINFO_GROUP	 9 // info: group field
+//! - #RX_DBFILEINFO_PERMS	10 // info: perms field
+//! - #RX_DBFILEINFO_DATE	11 // info: date  field
+//! - #RX_DBFILEINFO_DATA	12 // info: data  field
+//! - #RX_DBFILEINFO_FOLDER	13 // info: is this a folder? return "0" or "1".
+//!
+//! @return  The information as a string, or NULL on failure.
+//! @RomeAPI Wrapper for DbFindInfo().
+//!
+ROME_API RT_CSTR RomeDatabaseFileInfo(RT_Database* pDatabase, RT_CSTR pszFilename, RT_UINT nInfoType)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pDatabase,              "RomeDatabaseFileInfo: NULL database pointer.");
+        BOOL bValidApp = RomeCoreIsValid(&pDatabase->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,              "RomeDatabaseFileInfo: invalid database pointer.");
+		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,               "RomeDatabaseFileInfo: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!strempty(pszFilename), "RomeDatabaseFileInfo: empty file name.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pDatabase->IsOpen(),    "RomeDatabaseFileInfo: database not open.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,           "RomeDatabaseFileInfo: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(&pDatabase->Core);
+
+	    ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST, "user", "RomeDatabaseFileInfo", "file='%s' type='%d'/>\n", (CString)XMLEncode(pszFilename), nInfoType));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "RomeDatabaseFileInfo \"%s\" %d\n", pszFilename, nInfoType));
+#endif
+
+	    DBFIND* pFind = DbFindOpen(pDatabase->GetDatalink(), pszFilename, DBSYS_FIND_BOTH | DBSYS_FIND_EXACT);
+	    ASSERT_OR_RETURN_NULL(pFind);
+
+	    LPCSTR pszInfo = ArenaResult(DbFindInfo(pFind, nInfoType));
+	    DbFindClose(pFind);
+
+	    return pszInfo;
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("RomeDatabaseFileInfo: exception for Filename = '%s', Type = %d.", CString(pszFilename), nInfoType);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeDatabaseFileInfo: exception in catch block.");
+        }
+    }
+}
+
+
+//! Retrieve information about a file in the database.
+//! See RomeDatabaseFileInfo() [above] for full documentation.
+//!
+//! This version is required for use by Intel Fortran, which can't use functions
+//!   which return a string pointer. Instead it must have its first 2 arguments
+//!   be a pointer to a buffer and its length, to return the string in.
+//!   The function must have a return type of void.
+//! @param pBuf       The pointer to a buffer to return a NUL-terminated string in.
+//! @param nBufLen    The length of the buffer to return a NUL-terminated string in.
+//! @param pDatabase  The Rome database interface pointer obtained from RomeGetDatabase().
+//! @param pszFilename  The name of the file. (e.g. "soils\default")
+//! @param nInfoType    The type of information to retrieve.
+//!
+//! @RomeAPI Wrapper for RomeDatabaseFileInfo().
+//! @FortranAPI This function allows calling RomeDatabaseFileInfo() from Fortran.
+//!
+ROME_API RT_void RomeDatabaseFileInfoF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_Database* pDatabase, RT_CSTR pszFilename, RT_UINT nInfoType)
+{
+    try
+    {
+        // Does not require AFX_MANAGE_STATE() macro.
+
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+		// Validate arguments unique to the Fortran function version.
+		// The remaining arguments will be validated in the normal Rome API call.
+        ASSERT_OR_SETERROR_AND_RETURN(pBuf,           "RomeDatabaseFileInfoF: NULL buffer pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN(nBufLen > 0,    "RomeDatabaseFileInfoF: non-positive buffer length.");
+
+        ROME_API_WRITELOCK(CFileSys::IsValid(pDatabase)? &pDatabase->Core: NULL);
+
+        // Does not require command logging.
+
+        CArenaBypass NoArena;
+        LPCSTR pszInfo = RomeDatabaseFileInfo(pDatabase, pszFilename, nInfoType);
+        CopyStrF(pBuf, nBufLen, pszInfo);
+    }
+    catch (...)
+    {
+        try
+        {
+            if (pBuf && nBufLen > 0)
+                *pBuf = 0;
+            CString sInfo; sInfo.Format("RomeDatabaseFileInfoF: exception for Buffer = '0x%08X', Length = %d, Filename = '%s', Type = %d.", pBuf, nBufLen, CString(pszFilename), nInfoType);
+            ASSERT_OR_SETERROR_AND_RETURN(0,         sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN(0,         "RomeGetPropertyStr: exception in catch block.");
+        }
+    }
+}
+
+
+//! Get a pointer to the Rome interface from the database interface.
+//! @param pDatabase  The Rome database interface pointer obtained from RomeGetDatabase().
+//! @return the interface pointer, or NULL on failure.
+//!
+ROME_API RT_App* RomeDatabaseGetApp(RT_Database* pDatabase)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pDatabase,              "RomeDatabaseGetApp: NULL database pointer.");
+        BOOL bValidApp = RomeCoreIsValid(&pDatabase->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,              "RomeDatabaseGetApp: invalid database pointer.");
+		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,               "RomeDatabaseGetApp: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,           "RomeDatabaseGetApp: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(&pDatabase->Core);
+
+        // Does not require command logging.
+
+        CRomeCore* pRomeCore = &pDatabase->Core;
+        return pRomeCore;
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(0,        "RomeDatabaseGetApp: exception.");
+    }
+}
+
+
+//! Get the read-only state of the database.
+//! A database may be read-only for many reasons:
+//! - The database file is read-only.
+//! - The database file is on a read-only filesystem.
+//! - The user only has read access to the database.
+//! - The connection has been set to read-only programmatically.
+//!
+//! @param pDatabase  The Rome database interface pointer obtained from RomeGetDatabase().
+//!
+//! @return RX_TRUE if read-only, RX_FALSE if writeable, and #RX_FAILURE on error.
+//!   Returns RX_TRUE for a null @p pDatabase argument.
+//! @RomeAPI Wrapper for CFileSys::IsReadOnly().
+//!
+ROME_API RT_BOOL RomeDatabaseGetReadOnly(RT_Database* pDatabase)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_VALUE(pDatabase,				"RomeDatabaseGetReadOnly: NULL database pointer.", RX_TRUE);
+        BOOL bValidApp = RomeCoreIsValid(&pDatabase->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,            "RomeDatabaseGetReadOnly: invalid database pointer.");
+		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,             "RomeDatabaseGetReadOnly: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,         "RomeDatabaseGetReadOnly: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(&pDatabase->Core);
+
+	    ROME_API_LOGELEM(CLogFileElement0(LOGELEM_HIST, "user", "RomeDatabaseGetReadOnly", "/>\n"));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf0(LOG_SHELL, "RomeDatabaseGetReadOnly\n"));
+#endif
+
+	    RT_BOOL bReadOnly = pDatabase->IsReadOnly();
+	    return bReadOnly;
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("RomeDatabaseGetReadOnly: exception for Database = 0x08%X.", pDatabase);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeDatabaseGetReadOnly: exception in catch block.");
+        }
+    }
+}
+
+
+//! Open a new database for use by Rome.
+//! @param pDatabase    The Rome database interface pointer obtained from RomeGetDatabase().
+//! @param pszDatabase  The fullname of the database file to open on disk.
+//!   The argument "#DefaultDatabase" (case-insensitive)
+//!     will open the default database (usually "moses.gdb").
+//! @return RX_TRUE on success, RX_FALSE / #RX_FAILURE on failure.
+//!
+//! @warning  This will fail if there are files open that need to be closed first.
+//! @see RomeDatabaseClose().
+//! @RomeAPI Wrapper for CFileSys::Open().
+//!
+ROME_API RT_BOOL RomeDatabaseOpen(RT_Database* pDatabase, RT_CSTR pszDatabase)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pDatabase,            "RomeDatabaseOpen: NULL database pointer.");
+        BOOL bValidApp = RomeCoreIsValid(&pDatabase->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,            "RomeDatabaseOpen: invalid database pointer.");
+		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,             "RomeDatabaseOpen: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,         "RomeDatabaseOpen: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(&pDatabase->Core);
+
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeDatabaseOpen", "file='%s'>\n", (CString)XMLEncode(pszDatabase)));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeDatabaseOpen \"%s\"\n", (CString)pszDatabase));
+#endif
+
+	    pDatabase->CloseFiles(CVF_CloseTempFiles | CVF_CloseComboFiles | CVF_CloseLazyFiles);
+        BOOL bOpenFiles = pDatabase->FilesToClose(false);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bOpenFiles,            "RomeDatabaseOpen: files still remaining open.");
+
+	    // Close the current database.
+        BOOL bClosed = pDatabase->CloseDatabase();
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bClosed,                "RomeDatabaseOpen: failed to close database.");
+
+        // A shared cache belongs to the database it was set for.
+        CoreApi(pDatabase->Core).sSharedCacheDir.Empty();
+
+	    RT_BOOL bOpened = pDatabase->Open(pszDatabase);
+	    return bOpened;
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("RomeDatabaseOpen: exception for Database = '%s'.", CString(pszDatabase));
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeDatabaseOpen: exception in catch block.");
+        }
+    }
+}
+
+
+//! Load database files ahead of time, so that the first runs which use them aren't slower than later ones.
+//! Files are normally read from the database and parsed the first time they are opened.
+//!   This opens every file matched by a search into the filesystem, where later calls
+//!   to RomeFilesOpen() (and files pointing to them) find them already loaded.
+//! @param pDatabase   The Rome database interface pointer obtained from RomeGetDatabase().
+//! @param pszPattern  The pattern to search with, as for RomeDatabaseFindOpen().
+//!   Example: "climates\USA\Wisconsin".
+//! @param nFindFlags  Flags that control the search, as for RomeDatabaseFindOpen().
+//!   Example: #RX_DBFIND_FILES | #RX_DBFIND_RECURSE.
+//!   Folders found are skipped. #RX_DBFIND_TABLES and #RX_DBFIND_QUERY aren't allowed,
+//!   since they don't find files.
+//! @return  The number of files loaded (including those already open), or #RX_FAILURE (-1) on error.
+//!
+//! @note Loaded files hold no Rome API reference, so they don't need to be closed by RomeFileClose().
+//!   They stay loaded until they are closed by RomeFilesCloseAll() or RomeDatabaseClose().
+//! @note Files are parsed into a single filesystem, which isn't thread-safe, so they are loaded one at a time.
+//!   Separate cores (see RomeInit() "/NewCore") can each be preloaded on their own thread.
+//! @note With a shared cache (see RomeDatabaseSetSharedCache()), files already decoded by
+//!   another core or process are opened from its snapshots instead.
+//! @see RomeDatabaseFindOpen(), RomeFilesOpen().
+//! @RomeAPI Wrapper for DbFindOpen(), CFileSys::OpenOrCreateFile().
+//!
+ROME_API RT_INT RomeDatabasePreload(RT_Database* pDatabase, RT_CSTR pszPattern, RT_UINT nFindFlags)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pDatabase,            "RomeDatabasePreload: NULL database pointer.");
+        BOOL bValidApp = RomeCoreIsValid(&pDatabase->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,            "RomeDatabasePreload: invalid database pointer.");
+		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,             "RomeDatabasePreload: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pDatabase->IsOpen(),  "RomeDatabasePreload: database not open.");
+        BOOL bFindFiles = ((nFindFlags & (RX_DBFIND_TABLES | RX_DBFIND_QUERY)) == 0);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bFindFiles,           "RomeDatabasePreload: flags don't find files.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,         "RomeDatabasePreload: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(&pDatabase->Core);
+
+	    // pszPattern is allowed to be NULL or empty.
+        RX_DBFIND_ASSERT_LEGAL_FLAGS(nFindFlags)
+
+	    ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeDatabasePreload", "args='%s' flags='%d'>\n", (CString)XMLEncode(pszPattern), nFindFlags));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "RomeDatabasePreload \"%s\" %d\n", (CString)pszPattern, nFindFlags));
+#endif
+
+        // Get all the names before opening any files, which also read from the database.
+	    DBFIND* pFind = DbFindOpen(pDatabase->GetDatalink(), pszPattern, nFindFlags);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFind,                "RomeDatabasePreload: NULL find context pointer.");
+
+        CStringArray aFiles;
+        const int nCount = DbFindCount(pFind);
+        aFiles.SetSize(0, nCount);
+        for (int i = 0; i < nCount; i++)
+        {
+            if (DbFindSeek(pFind, i) < 0)
+                continue;
+            LPCSTR pszFolder = DbFindInfo(pFind, RX_DBFILEINFO_FOLDER);
+            if (pszFolder && strcmp(pszFolder, "1") == 0)
+                continue;
+            LPCSTR pszFile = DbFindInfo(pFind, RX_DBFILEINFO_FULL);
+            if (!strempty(pszFile))
+                aFiles.Add(pszFile);
+        }
+	    DbFindClose(pFind);
+
+	    FILESYS_WRITELOCK();
+
+        // These aren't user commands, so they aren't logged individually.
+        RT_INT nLoaded = 0;
+        for (int i = 0; i < aFiles.GetSize(); i++)
+        {
+            CFileObj* pFile = NULL;
+            if (!SharedCacheOpen(pDatabase, aFiles[i], OMF_USE_OPEN | OMF_NO_CREATE, pFile))
+                pFile = pDatabase->OpenOrCreateFile(aFiles[i], OMF_USE_OPEN | OMF_NO_CREATE);
+            if (pFile)
+                nLoaded++;
+        }
+
+	    return nLoaded;
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("RomeDatabasePreload: exception for Pattern = '%s', nFlags = 0x%X.", CString(pszPattern), nFindFlags);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeDatabasePreload: exception in catch block.");
+        }
+    }
+}
+
+
+//! Keep a cache of serialized snapshots of the files of a read-only database, for the other
+//!   cores and processes using it.
+//! Normally each core reads and parses every database file it opens, so many workers using
+//!   the same database each pay for it.
+//!   With a snapshot cache, the first core to open a database file also saves it as a binary
+//!   snapshot in the cache folder, and every later open of it (by RomeFilesOpen() or
+//!   RomeDatabasePreload(), in any core or process) sets its values from that snapshot instead,
+//!   which skips the database read and the XML parse.
+//! This is a cache of serialized files on disk, not of decoded records: the values in a snapshot
+//!   are strings, which are set into the file as usual, and each core builds its own copy of
+//!   every file it opens. So warm-up is shortened, but memory still grows with the number of cores.
+//! Files pointed to by other files are opened as usual, unless they were preloaded.
+//! The cache is dropped when the database is closed or another one is opened.
+//! @param pDatabase    The Rome database interface pointer obtained from RomeGetDatabase().
+//! @param pszCacheDir  The folder for the snapshots, which is created if needed.
+//!   All users of the cache must open the same database. NULL or empty stops using a cache.
+//! @return  RX_TRUE on success, RX_FALSE on failure, #RX_FAILURE on error.
+//!
+//! @warning The database must be read-only (see RomeDatabaseGetReadOnly()), since snapshots
+//!   are only checked against the date of each record.
+//! @note Snapshots can only be opened by the same science version, and are named by it.
+//! @see RomeDatabasePreload(), RomeFilesOpen(), RomeFileSaveAsEx() #RX_FILE_SAVEASEX_BINARY.
+//! @RomeAPI
+//!
+ROME_API RT_BOOL RomeDatabaseSetSharedCache(RT_Database* pDatabase, RT_CSTR pszCacheDir)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pDatabase,            "RomeDatabaseSetSharedCache: NULL database pointer.");
+        BOOL bValidApp = RomeCoreIsValid(&pDatabase->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,            "RomeDatabaseSetSharedCache: invalid database pointer.");
+		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,             "RomeDatabaseSetSharedCache: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pDatabase->IsOpen(),  "RomeDatabaseSetSharedCache: database not open.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,         "RomeDatabaseSetSharedCache: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(&pDatabase->Core);
+
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeDatabaseSetSharedCache", "dir='%s'/>\n", (CString)XMLEncode(pszCacheDir)));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeDatabaseSetSharedCache \"%s\"\n", (CString)pszCacheDir));
+#endif
+
+        if (strempty(pszCacheDir))
+        {
+            CoreApi(pDatabase->Core).sSharedCacheDir.Empty();
+            return RX_TRUE;
+        }
+
+        BOOL bReadOnly = pDatabase->IsReadOnly();
+        TEST_OR_SETERROR_AND_RETURN_FALSE(bReadOnly,                "RomeDatabaseSetSharedCache: database is not read-only.");
+
+        CString sDir = pszCacheDir;
+        sDir.TrimRight("\\/");
+        if (!CreateDirectory(sDir, NULL))
+        {
+            DWORD nAttribs = GetFileAttributes(sDir);
+            BOOL bDir = (nAttribs != INVALID_FILE_ATTRIBUTES) && (nAttribs & FILE_ATTRIBUTE_DIRECTORY);
+            TEST_OR_SETERROR_AND_RETURN_FALSE(bDir,                 "RomeDatabaseSetSharedCache: can't create the cache folder.");
+        }
+
+        CoreApi(pDatabase->Core).sSharedCacheDir = sDir;
+        return RX_TRUE;
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("RomeDatabaseSetSharedCache: exception for CacheDir = '%s'.", CString(pszCacheDir));
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeDatabaseSetSharedCache: exception in catch block.");
+        }
+    }
+}
+
+//! @} // Rome Database functions
+/////////////////////////////////////////////////////////////////////////////
+//! @name Rome Database search functions
+//! @{
+
+// Verify that RX_ and DBSYS_ flags match each other.
+#if (RX_DBFIND_FILES   != DBSYS_FIND_FILES)
+  #error "error: compile-time test failed: (RX_DBFIND_FILES   != DBSYS_FIND_FILES)"
+#endif
+#if (RX_DBFIND_FOLDERS != DBSYS_FIND_FOLDERS)
+  #error "error: compile-time test failed: (RX_DBFIND_FOLDERS != DBSYS_FIND_FOLDERS)"
+#endif
+#if (RX_DBFIND_RECURSE != DBSYS_FIND_RECURSE)
+  #error "error: compile-time test failed: (RX_DBFIND_RECURSE != DBSYS_FIND_RECURSE)"
+#endif
+#if (RX_DBFIND_ADDROOT != DBSYS_FIND_ADDROOT)
+  #error "error: compile-time test failed: (RX_DBFIND_ADDROOT != DBSYS_FIND_ADDROOT)"
+#endif
+#if (RX_DBFIND_EXACT != DBSYS_FIND_EXACT)
+  #error "error: compile-time test failed: (RX_DBFIND_EXACT != DBSYS_FIND_EXACT)"
+#endif
+#if (RX_DBFIND_TABLES  != DBSYS_FIND_TABLES)
+  #error "error: compile-time test failed: (RX_DBFIND_TABLES != DBSYS_FIND_TABLES)"
+#endif
+#if (RX_DBFIND_QUERY   != DBSYS_FIND_QUERY)
+  #error "error: compile-time test failed: (RX_DBFIND_QUERY != DBSYS_FIND_QUERY)"
+#endif
+#if (RX_DBFIND_FLAGBITS   != DBSYS_FIND_FLAGBITS)
+  #error "error: compile-time test failed: (RX_DBFIND_FLAGBITS   != DBSYS_FIND_FLAGBITS)"
+#endif
+#if (RX_DBFIND_FLAGMASK   != DBSYS_FIND_FLAGMASK)
+  #error "error: compile-time test failed: (RX_DBFIND_FLAGMASK   != DBSYS_FIND_FLAGMASK)"
+#endif
+
+#if (RX_DBFIND_QUERY   != DBSYS_FIND_QUERY)
+  #error "error: compile-time test failed: (RX_DBFIND_QUERY != DBSYS_FIND_QUERY)"
+#endif
+
+
+//! Start a new search and return a pointer to the find result set.
+//! The results are accessed using RomeDatabaseFindInfo().
+//! The result set must be closed using RomeDatabaseFindClose() when
+//!   you are finished with it.
+//! @param pDatabase  The Rome database interface pointer obtained from RomeGetDatabase().
+//! @param pszPattern is the pattern to search with. Its meaning varies
+//!   depending on @a nFindFlags. It generally is the table or folder
+//!   to search in. If it is NULL or empty, it means all tables.
+//! @param nFindFlags are flags that control the search type.
+//! - #RX_DBFIND_FILES		1<<0	// Match file names
+//! - #RX_DBFIND_FOLDERS	1<<1	// Match folder names
+//! - #RX_DBFIND_RECURSE	1<<2	// Recurse into subdirectories.
+//! - #RX_DBFIND_ADDROOT	1<<3	// Add the root to the search results
+//! - #RX_DBFIND_EXACT		1<<4	// Find single record matching argument string
+//! - #RX_DBFIND_TABLES		1<<10	// Find all tables in the database
+//! - #RX_DBFIND_QUERY		2<<10	// The pattern string is a SQL query.
+//!
+//! @return a result set pointer, or NULL on failure.
+//!
+//! Example to find the number of soils files:
+//! @code
+//!     RT_DBFIND* pDbFind = RomeDatabaseFindOpen(pDatabase, "soils", RX_DBFIND_FILES | RX_DBFIND_RECURSE);
+//!     int nSoils = RomeDatabaseFindCount(pDbFind);
+//!     RomeDatabaseFindClose(pDbFind);
+//! @endcode
+//!
+//! @warning Failing to close the find result may leak memory or other program resources.
+//! @see RomeDatabaseFindClose(), RomeDatabaseFindCount(), RomeDatabaseFindInfo().
+//! @RomeAPI Wrapper for DbFindOpen().
+//!
+ROME_API RT_DBFIND* RomeDatabaseFindOpen(RT_Database* pDatabase, RT_CSTR pszPattern, RT_UINT nFindFlags)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pDatabase,              "RomeDatabaseFindOpen: NULL database pointer.");
+        BOOL bValidApp = RomeCoreIsValid(&pDatabase->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,              "RomeDatabaseFindOpen: invalid database pointer.");
+		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,               "RomeDatabaseFindOpen: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pDatabase->IsOpen(),    "RomeDatabaseFindOpen: database not open.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,           "RomeDatabaseFindOpen: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(&pDatabase->Core);
+
+	    // pszPattern is allowed to be NULL or empty.
+        RX_DBFIND_ASSERT_LEGAL_FLAGS(nFindFlags)
+
+#if USE_LOG_FILES
+	    ROME_API_LOGELEM(CLogFileElement log(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeDatabaseFindOpen", "args='%s' flags='%d'>\n", (CString)XMLEncode(pszPattern), nFindFlags));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "RomeDatabaseFindOpen \"%s\" %d\n", (CString)pszPattern, nFindFlags));
+#endif
+#endif // USE_LOG_FILES
+
+	    DBFIND* pFind = DbFindOpen(pDatabase->GetDatalink(), pszPattern, nFindFlags);
+#if USE_LOG_FILES
+	    if (log.Logged()) ROME_API_LOG(LogFilePrintf1(LOG_HIST, "<output find='0x%08X'/>\n", (UINT)pFind));
+#endif
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pFind,                  "RomeDatabaseFindOpen: NULL find context pointer.");
+        FindSetRegister(pFind, &pDatabase->Core);
+	    return pFind;
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("RomeDatabaseFindOpen: exception for Pattern = '%s', nFlags = 0x%X.", CString(pszPattern), nFindFlags);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeDatabaseFindOpen: exception in catch block.");
+        }
+    }
+}
+
+
+//! Close a find result set returned by RomeDatabaseFindOpen().
+//! Result sets are dynamic objects that must be closed when you are finished using them.
+//! @param pDbFind is the result set returned by RomeDatabaseFindOpen().
+//!
+//! @warning Failing to close the find result may leak memory or other program resources.
+//! @see RomeDatabaseFindOpen().
+//! @RomeAPI Wrapper for DbFindClose().
+//!
+ROME_API RT_void RomeDatabaseFindClose(RT_DBFIND* pDbFind)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN(pDbFind,              "RomeDatabaseFindClose: NULL find pointer.");
+        CRomeCore* pCore = FindSetGetCore(pDbFind);
+        ASSERT_OR_SETERROR_AND_RETURN(pCore,                "RomeDatabaseFindClose: invalid find pointer.");
+		BOOL bExited = pCore->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN(!bExited,             "RomeDatabaseFindClose: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pCore->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN(!bSameThread,         "RomeDatabaseFindClose: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(pCore);
+
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeDatabaseFindClose", "find='0x%08X'/>\n", (UINT)pDbFind));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeDatabaseFindClose %d\n", (UINT)pDbFind));
+#endif
+
+	    DbFindClose(pDbFind);
+        FindSetRegister(pDbFind, NULL);
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sInfo; sInfo.Format("RomeDatabaseFindClose: exception for Find = 0x%X.", pDbFind);
+            ASSERT_OR_SETERROR_AND_RETURN(0,        sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN(0,        "RomeDatabaseFindClose: exception in catch block.");
+        }
+    }
+}
+
+
+//! Return the number of items in the find result set.
+//! @param pDbFind  The find result set returned by RomeDatabaseFindOpen().
+//! @return  0 on error or if none found.
 //!
-//! @RomeAPI Wrapper for CRomeCore::Files.
+//! @see RomeDatabaseFindOpen(), RomeDatabaseFindClose().
+//! @RomeAPI Wrapper for DbFindCount().
 //!
-ROME_API RT_Files* RomeGetFiles(RT_App* pApp)
+ROME_API RT_INT RomeDatabaseFindCount(RT_DBFIND* pDbFind)
 {
     try
     {
@@ -354,61 +4712,69 @@ ROME_API RT_Files* RomeGetFiles(RT_App* pApp)
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pApp,             "RomeGetFiles: NULL Rome app pointer.");
-        BOOL bValidApp = (pApp == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,        "RomeGetFiles: invalid Rome app pointer.");
-		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,         "RomeGetFiles: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(pDbFind,         "RomeDatabaseFindCount: NULL find pointer.");
+        CRomeCore* pCore = FindSetGetCore(pDbFind);
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(pCore,           "RomeDatabaseFindCount: invalid find pointer.");
+		BOOL bExited = pCore->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bExited,        "RomeDatabaseFindCount: RomeExit() has already been called.");
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,     "RomeGetFiles: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pCore->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bSameThread,    "RomeDatabaseFindCount: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(pCore);
 
-	    // Does not require command logging.
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeDatabaseFindCount", "find='0x%08X'/>\n", (UINT)pDbFind));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeDatabaseFindCount %d\n", (UINT)pDbFind));
+#endif
 
-	    return &pApp->Files;
+	    int nCount = DbFindCount(pDbFind);
+	    return nCount;
     }
     catch (...)
     {
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(0,                "RomeGetFiles: exception.");
+        try
+        {
+            CString sInfo; sInfo.Format("RomeDatabaseFindCount: exception for Find = 0x%X.", pDbFind);
+            ASSERT_OR_SETERROR_AND_RETURN_ZERO(0, sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_ZERO(0, "RomeDatabaseFindCount: exception in catch block.");
+        }
     }
 }
 
 
-//! Get string properties of the app.
-//! @param pApp  The Rome interface pointer obtained from RomeInit().
-//! @param nProp The property to get.
-//! - #RX_PROPERTYSTR_APPFULLNAME
-//!     Return the full filename of the application executable, including path.
-//!     Example: "C:\Program Files\Rusle2\Binaries\Rusle2.exe".
-//! - #RX_PROPERTYSTR_APPNAME
-//!     Return the English name (title) of the application.
-//!     Example: "Rusle2".
-//! - #RX_PROPERTYSTR_APPPATH
-//!     Return the path to the application executable.
-//!     Example: "C:\Program Files\Rusle2\Binaries".
-//! - #RX_PROPERTYSTR_DBAUTHOR
-//!     Return the global "owner" field of the database.
-//! - #RX_PROPERTYSTR_DBCOMMENTS
-//!     Return the global "info" field of the database.
-//! - #RX_PROPERTYSTR_DBDATE
-//!     Return the global "date" field of the database.
-//! - #RX_PROPERTYSTR_DBFULLNAME
-//!     Get the full filename of the database, including directory.
-//! - #RX_PROPERTYSTR_DBNAME
-//!     Get the short filename of the database.
-//!     Example: "moses.gdb".
-//! - #RX_PROPERTYSTR_DBPATH
-//!     Get the full path of the database.
-//!     Example: "C:\Program Files\Rusle2".
+//! Access indivIdual results in a find result set.
+//! @param pDbFind    The find result set returned by RomeDatabaseFindOpen().
+//! @param nIndex     The index of the result to access.
+//! @param nInfoType  The type of information to get from the result.
+//! - #RX_DBFILEINFO_QUERY	 0 // info: String result of the SQL query.
+//!                            // (For internal / testing use only.)
+//! - #RX_DBFILEINFO_NAME	 1 // info:                name
+//! - #RX_DBFILEINFO_PATH	 2 // info:         path
+//! - #RX_DBFILEINFO_RIGHT	 3 // info:         path \ name
+//! - #RX_DBFILEINFO_TABLE	 4 // info: table
+//! - #RX_DBFILEINFO_OUTER	 5 // info: table \        name
+//! - #RX_DBFILEINFO_LEFT	 6 // info: table \ path
+//! - #RX_DBFILEINFO_FULL	 7 // info: table \ path \ name
+//! - #RX_DBFILEINFO_OWNER	 8 // info: owner field
+//! - #RX_DBFILEINFO_GROUP	 9 // info: group field
+//! - #RX_DBFILEINFO_PERMS	10 // info: perms field
+//! - #RX_DBFILEINFO_DATE	11 // info: date  field
+//! - #RX_DBFILEINFO_DATA	12 // info: data  field
+//! - #RX_DBFILEINFO_FOLDER	13 // info: is this a folder? return "0" or "1".
 //!
-//! @return NULL on failure.
-//! @RomeAPI
+//! @return  A value which depends on the type of information asked for.
+//!   Returns NULL on error.
 //!
-ROME_API RT_CSTR RomeGetPropertyStr(RT_App* pApp, RT_UINT nProp)
+//! @see RomeDatabaseFindOpen(), RomeDatabaseFindClose().
+//! @RomeAPI Wrapper for DbFindInfo().
+//!
+ROME_API RT_CSTR RomeDatabaseFindInfo(RT_DBFIND* pDbFind, RT_INT nIndex, RT_UINT nInfoType)
 {
     try
     {
@@ -416,149 +4782,71 @@ ROME_API RT_CSTR RomeGetPropertyStr(RT_App* pApp, RT_UINT nProp)
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pApp,             "RomeGetPropertyStr: NULL Rome app pointer.");
-        BOOL bValidApp = (pApp == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,        "RomeGetPropertyStr: invalid Rome app pointer.");
-		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,         "RomeGetPropertyStr: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pDbFind,            "RomeDatabaseFindInfo: NULL find pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(nIndex >= 0,        "RomeDatabaseFindInfo: negative index.");
+        CRomeCore* pCore = FindSetGetCore(pDbFind);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pCore,              "RomeDatabaseFindInfo: invalid find pointer.");
+		BOOL bExited = pCore->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,           "RomeDatabaseFindInfo: RomeExit() has already been called.");
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,     "RomeGetPropertyStr: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pCore->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,       "RomeDatabaseFindInfo: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        // Find result sets don't depend on the engine, so reading them shares the API gate.
+        // Seeking changes the position of the result set, so threads must not share one.
+        ROME_API_READLOCK(pCore, APIGATE_SHARED);
 
-	    CLogFileElement1(LOGELEM_HIST, "user", "RomeGetPropertyStr", "type='%d'/>\n", nProp);
+	    ROME_API_LOGELEM(CLogFileElement3(LOGELEM_HIST, "user", "RomeDatabaseFindInfo", "find='0x%08X' index='%d' type='%d'/>\n", (UINT)pDbFind, nIndex, nInfoType));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf1(LOG_SHELL, "RomeGetPropertyStr %d\n", nProp);
+        ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "RomeDatabaseFindInfo %d %d %d\n", (UINT)pDbFind, nIndex, nInfoType));
 #endif
 
-	    CString& sResult = RomeThreadGetNamedString("RomeGetPropertyStr");
-
-	    switch (nProp)
-	    {
-		    // Return the full filename of the application executable, including path.
-		    // Example: "C:\Program Files\Rusle2\Binaries\Rusle2.exe".
-		    case RX_PROPERTYSTR_APPFULLNAME:
-		    {
-			    CString sExeName = (LPCSTR)pApp->RomeNotificationSend(RX_NOTIFY_APP_EXENAME, NULL);
-			    if (strempty(sExeName))
-				    return NULL;
-
-                CString sLocal = "Binaries\\" + sExeName + ".exe";
-                sResult = RomeGetDirectory(pApp, sLocal);
-			    return sResult;
-		    }
-
-		    // Return the English name (title) of the application.
-		    // Example: "Rusle2".
-		    case RX_PROPERTYSTR_APPNAME:
-		    {
-			    sResult = (LPCSTR)pApp->RomeNotificationSend(RX_NOTIFY_APP_APPNAME, NULL);
-			    if (!strempty(sResult))
-				    return sResult;
-			    else
-				    return NULL;
-		    }
-
-		    // Return the path to the application executable.
-		    // Example: "C:\Program Files\Rusle2\Binaries".
-		    case RX_PROPERTYSTR_APPPATH:
-		    {
-			    sResult = pApp->User.GetPath("Binaries");
-			    return sResult;
-		    }
-
-		    case RX_PROPERTYSTR_DBAUTHOR:
-		    {
-			    sResult = DbSysGetInfo(pApp->Files.GetDatalink(), "owner");
-			    return sResult;
-		    }
-
-		    case RX_PROPERTYSTR_DBCOMMENTS:
-		    {
-			    sResult = DbSysGetInfo(pApp->Files.GetDatalink(), "info");
-			    return sResult;
-		    }
-
-		    case RX_PROPERTYSTR_DBDATE:
-		    {
-			    sResult = DbSysGetInfo(pApp->Files.GetDatalink(), "date");
-			    return sResult;
-		    }
-
-		    // Get the full filename of the database, including directory.
-		    case RX_PROPERTYSTR_DBFULLNAME:
-		    {
-			    sResult =  pApp->Files.m_sCurrentDatabase;
-                // todo: validate "sResult" as a URL.
-//              ASSERT(DiskFilePathValidEx(sResult, RX_PATHValid_PATH | RX_PATHValid_EMPTY));
-                sResult.Replace("\\\\", "\\"); // Hack: fix double backslashes.
-			    return sResult;
-		    }
-
-		    // Get the short filename of the database.
-		    // Example: "moses.gdb".
-		    case RX_PROPERTYSTR_DBNAME:
-		    {
-			    sResult = FullnameGetFilename(pApp->Files.m_sCurrentDatabase);
-                // todo: validate "sResult" as a URL.
-//               ASSERT(DiskFilePathValid(sResult));
-                sResult.Replace("\\\\", "\\"); // Hack: fix double backslashes.
-			    return sResult;
-		    }
-
-		    // Get the full path of the database.
-		    // Example: "C:\Program Files\Rusle2".
-		    case RX_PROPERTYSTR_DBPATH:
-		    {
-			    sResult = FullnameGetPath(pApp->Files.m_sCurrentDatabase);
-                // todo: validate "sResult" as a URL.
-//              ASSERT(DiskFilePathValid(sResult));
-                sResult.Replace("\\\\", "\\"); // Hack: fix double backslashes.
-			    return sResult;
-		    }
+        CSingleLock ReadLock(ApiGate.GetReadLock(), TRUE);
+	    long nItem = DbFindSeek(pDbFind, nIndex);
+	    if (nItem < 0)
+		    return NULL;
 
-		    default:
-                ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeGetPropertyStr: unknown property value.");
-	    }
+	    LPCSTR pszInfo = ArenaResult(DbFindInfo(pDbFind, nInfoType));
+	    return pszInfo;
     }
     catch (...)
     {
         try
         {
-            CString sInfo; sInfo.Format("RomeGetPropertyStr: exception for Property = '%d'.", nProp);
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
+            CString sInfo; sInfo.Format("RomeDatabaseFindInfo: exception for Find = 0x%X, Index = %d, Type = %d.", pDbFind, nIndex, nInfoType);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0, sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeGetPropertyStr: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0, "RomeDatabaseFindInfo: exception in catch block.");
         }
     }
 }
 
 
-//! Get string properties of the app.
-//! See RomeGetPropertyStr() [above] for full documentation.
+//! Access indivIdual results in a find result set.
+//! See RomeDatabaseFindInfo() [above] for full documentation.
 //!
 //! This version is required for use by Intel Fortran, which can't use functions
 //!   which return a string pointer. Instead it must have its first 2 arguments
 //!   be a pointer to a buffer and its length, to return the string in.
 //!   The function must have a return type of void.
-//! @param[out] pBuf  The pointer to a buffer to return a NUL-terminated string in.
-//! @param nBufLen    The length of the buffer to return a NUL-terminated string in.
-//! @param pApp       The Rome interface pointer obtained from RomeInit().
-//! @param nProp      The property to get.
+//! @param[out] pBuf The pointer to a buffer to return a NUL-terminated string in.
+//! @param nBufLen   The length of the buffer to return a NUL-terminated string in.
+//! @param pDbFind   The find result set returned by RomeDatabaseFindOpen().
+//! @param nIndex    The index of the result to access.
+//! @param nInfoType The type of information to get from the result.
 //!
-//! @RomeAPI Wrapper for RomeGetPropertyStr().
-//! @FortranAPI This function allows calling RomeGetPropertyStr() from Fortran.
+//! @RomeAPI Wrapper for RomeDatabaseFindInfo().
+//! @FortranAPI This function allows calling RomeDatabaseFindInfo() from Fortran.
 //!
-ROME_API RT_void RomeGetPropertyStrF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_App* pApp, RT_UINT nProp)
+ROME_API RT_void RomeDatabaseFindInfoF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_DBFIND* pDbFind, RT_INT nIndex, RT_UINT nInfoType)
 {
     try
     {
-        // Does not require AFX_MANAGE_STATE() macro.
+    	// Does not require AFX_MANAGE_STATE() macro.
 
 	    // Switch to the app's MFC module state while in this scope.
 	    // This is required for many MFC functions to work correctly.
@@ -566,15 +4854,17 @@ ROME_API RT_void RomeGetPropertyStrF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_App* pAp
 
 		// Validate arguments unique to the Fortran function version.
 		// The remaining arguments will be validated in the normal Rome API call.
-        ASSERT_OR_SETERROR_AND_RETURN(pBuf,           "RomeGetPropertyStrF: NULL buffer pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN(nBufLen > 0,    "RomeGetPropertyStrF: non-positive buffer length.");
+        ASSERT_OR_SETERROR_AND_RETURN(pBuf,           "RomeDatabaseFindInfoF: NULL buffer pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN(nBufLen > 0,    "RomeDatabaseFindInfoF: non-positive buffer length.");
 
-        ROME_API_LOCK();
+        // Find result sets don't depend on the engine, so reading them shares the gate of the core which opened it.
+        ROME_API_READLOCK(FindSetGetCore(pDbFind), APIGATE_SHARED);
 
         // Does not require command logging.
 
-        LPCSTR pszProp = RomeGetPropertyStr(pApp, nProp);
-        CopyStrF(pBuf, nBufLen, pszProp);
+        CArenaBypass NoArena;
+        LPCSTR pszInfo = RomeDatabaseFindInfo(pDbFind, nIndex, nInfoType);
+        CopyStrF(pBuf, nBufLen, pszInfo);
     }
     catch (...)
     {
@@ -582,67 +4872,118 @@ ROME_API RT_void RomeGetPropertyStrF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_App* pAp
         {
             if (pBuf && nBufLen > 0)
                 *pBuf = 0;
-            CString sInfo; sInfo.Format("RomeGetPropertyStrF: exception for Buffer = '0x%08X', Length = %d, Property = %d.", pBuf, nBufLen, nProp);
-            ASSERT_OR_SETERROR_AND_RETURN(0,    sInfo);
+            CString sInfo; sInfo.Format("RomeDatabaseFindInfoF: exception for Buffer = '0x%08X', Length = %d, Index = %d, Type = %d.", pBuf, nBufLen, nIndex, nInfoType);
+            ASSERT_OR_SETERROR_AND_RETURN(0,     sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN(0,    "RomeGetPropertyStrF: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN(0,     "RomeDatabaseFindInfoF: exception in catch block.");
         }
     }
 }
 
 
-//! Get the #SCIENCEVERSION of the Rome instance.
-//! @copydoc SCIENCEVERSION
-//! @param pApp  The Rome interface pointer obtained from RomeInit().
-//!
-//! @return  The science version, or zero (0) on error.
-//! @RomeAPI Wrapper for CRomeCore::GetScienceVersion().
+//! Open the next folder listing (or the query result) of a search cursor, when the current one is used up.
+//! The caller must hold the API lock.
+//! @param pCursor  The cursor.
+//! @return TRUE if @c pCursor->pFind has a row at @c pCursor->nNext, FALSE if the search is finished.
 //!
-ROME_API RT_UINT RomeGetScienceVersion(RT_App* pApp)
+LOCAL BOOL DbCursorFill(RT_DBCursor* pCursor)
 {
-    try
+    while (pCursor->pFind == NULL || pCursor->nNext >= DbFindCount(pCursor->pFind))
     {
-	    // Switch to the app's MFC module state while in this scope.
-	    // This is required for many MFC functions to work correctly.
-	    AFX_MANAGE_STATE(AfxGetAppModuleState());
-
-	    ASSERT_OR_SETERROR_AND_RETURN_ZERO(pApp,             "RomeGetScienceVersion: NULL Rome app pointer.");
-        BOOL bValidApp = (pApp == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_ZERO(bValidApp,        "RomeGetScienceVersion: invalid Rome app pointer.");
-		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bExited,         "RomeGetScienceVersion: RomeExit() has already been called.");
-#if USE_ROMEAPI_THREADIdS
-        THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bSameThread,     "RomeGetScienceVersion: Rome API function called on different thread from RomeInit().");
-#endif
+        if (pCursor->pFind)
+        {
+            DbFindClose(pCursor->pFind);
+            pCursor->pFind = NULL;
+            pCursor->nNext = 0;
+        }
 
-        ROME_API_LOCK();
+        const UINT nFlags = pCursor->nFlags;
+        CString sPattern;
+        UINT nListFlags = nFlags;
+        if (nFlags & RX_DBFIND_RECURSE)
+        {
+            // List one folder at a time, its subfolders being listed after it.
+            if (pCursor->Folders.IsEmpty())
+                return FALSE;
+            sPattern = pCursor->Folders.RemoveHead();
+            nListFlags = (nFlags & ~RX_DBFIND_RECURSE) | RX_DBFIND_FOLDERS;
+            // Only the search root is added (when asked for), not the root of each folder.
+            // Here bDone is set once the search root has been listed.
+            if (pCursor->bDone)
+                nListFlags &= ~RX_DBFIND_ADDROOT;
+            pCursor->bDone = TRUE;
+        }
+        else
+        {
+            // Other searches, including queries, are a single listing.
+            // A query is run once, and its rows are returned from that result: paging it with
+            //   "LIMIT" and "OFFSET" would run it again for each page, and without an "ORDER BY"
+            //   the pages needn't even be consistent.
+            if (pCursor->bDone)
+                return FALSE;
+            sPattern = pCursor->sPattern;
+            pCursor->bDone = TRUE;
+        }
 
-	    CLogFileElement0(LOGELEM_HIST, "user", "RomeGetScienceVersion", "/>\n");
-#if USE_ROMESHELL_LOGGING
-        LogFilePrintf0(LOG_SHELL, "RomeGetScienceVersion\n");
-#endif
+        pCursor->pFind = DbFindOpen(pCursor->pDatabase->GetDatalink(), sPattern, nListFlags);
+        if (pCursor->pFind == NULL)
+            continue;
 
-	    return pApp->GetScienceVersion();
-    }
-    catch (...)
-    {
-        ASSERT_OR_SETERROR_AND_RETURN_ZERO(0,                "RomeGetScienceVersion: exception.");
+        if (nFlags & RX_DBFIND_RECURSE)
+        {
+            // Queue the subfolders, in their listed order, ahead of the folders already queued.
+            POSITION posInsert = NULL;
+            const long nCount = DbFindCount(pCursor->pFind);
+            for (long i = 0; i < nCount; i++)
+            {
+                if (DbFindSeek(pCursor->pFind, i) < 0)
+                    continue;
+                LPCSTR pszFolder = DbFindInfo(pCursor->pFind, RX_DBFILEINFO_FOLDER);
+                LPCSTR pszFull   = DbFindInfo(pCursor->pFind, RX_DBFILEINFO_FULL);
+                if (!pszFolder || strcmp(pszFolder, "1") != 0 || strempty(pszFull) || sPattern.CompareNoCase(pszFull) == 0)
+                    continue;
+                posInsert = posInsert? pCursor->Folders.InsertAfter(posInsert, pszFull): pCursor->Folders.AddHead(pszFull);
+            }
+        }
     }
+    return TRUE;
 }
 
 
-//! Get a pointer to the Rome statusbar interface.
-//! This pointer does not need to be freed or released when finished using it.
-//! @param pApp  The Rome interface pointer obtained from RomeInit().
+//! Check whether the current row of a search cursor is one the caller asked for.
+//! A recursive search lists folders to find their contents, which are skipped
+//!   unless #RX_DBFIND_FOLDERS was passed.
 //!
-//! @return  The interface pointer, or NULL on failure.
-//! @RomeAPI Wrapper for CMainFrame::StatusBar.
+LOCAL BOOL DbCursorWanted(RT_DBCursor* pCursor)
+{
+    if ((pCursor->nFlags & RX_DBFIND_QUERY) || !(pCursor->nFlags & RX_DBFIND_RECURSE) || (pCursor->nFlags & RX_DBFIND_FOLDERS))
+        return TRUE;
+    LPCSTR pszFolder = DbFindInfo(pCursor->pFind, RX_DBFILEINFO_FOLDER);
+    return !(pszFolder && strcmp(pszFolder, "1") == 0);
+}
+
+
+//! Start a search which is read a batch of rows at a time by RomeDatabaseFindNextBatch().
+//! Unlike RomeDatabaseFindOpen(), which reads the whole result set before it returns,
+//!   this only holds one folder listing at a time (for #RX_DBFIND_RECURSE searches).
+//!   Other searches, including #RX_DBFIND_QUERY searches, are read as one result set when the
+//!   first batch is asked for, and returned from it a batch at a time.
+//! @param pDatabase  The Rome database interface pointer obtained from RomeGetDatabase().
+//! @param pszPattern  The pattern to search with, as for RomeDatabaseFindOpen().
+//!   For #RX_DBFIND_QUERY this must not be empty.
+//! @param nFindFlags  Flags that control the search, as for RomeDatabaseFindOpen().
+//!   Example: #RX_DBFIND_FILES | #RX_DBFIND_RECURSE.
+//! @return a cursor pointer, or NULL on failure.
+//!
+//! @note Results are in the order the folders are listed: each folder's own results,
+//!   then those of its subfolders. There is no count, since the results aren't read ahead.
+//! @warning The cursor must be closed by RomeDatabaseFindCloseStream().
+//! @see RomeDatabaseFindNextBatch(), RomeDatabaseFindCloseStream(), RomeDatabaseFindOpen().
+//! @RomeAPI Wrapper for DbFindOpen().
 //!
-ROME_API RT_Statusbar* RomeGetStatusbar(RT_App* pApp)
+ROME_API RT_DBCursor* RomeDatabaseFindOpenStream(RT_Database* pDatabase, RT_CSTR pszPattern, RT_UINT nFindFlags)
 {
     try
     {
@@ -650,70 +4991,80 @@ ROME_API RT_Statusbar* RomeGetStatusbar(RT_App* pApp)
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-#ifdef BUILD_MOSES // ROMEDLL_IGNORE
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pApp,             "RomeGetStatusbar: NULL Rome app pointer.");
-        BOOL bValidApp = (pApp == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,        "RomeGetStatusbar: invalid Rome app pointer.");
-		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,         "RomeGetStatusbar: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pDatabase,              "RomeDatabaseFindOpenStream: NULL database pointer.");
+        BOOL bValidApp = RomeCoreIsValid(&pDatabase->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,              "RomeDatabaseFindOpenStream: invalid database pointer.");
+		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,               "RomeDatabaseFindOpenStream: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pDatabase->IsOpen(),    "RomeDatabaseFindOpenStream: database not open.");
+        BOOL bValidQuery = !(nFindFlags & RX_DBFIND_QUERY) || !strempty(pszPattern);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidQuery,            "RomeDatabaseFindOpenStream: empty query.");
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,     "RomeGetStatusbar: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,           "RomeDatabaseFindOpenStream: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&pDatabase->Core);
 
-	    // Does not require command logging.
+	    // pszPattern is allowed to be NULL or empty.
+        RX_DBFIND_ASSERT_LEGAL_FLAGS(nFindFlags)
 
-	    CMainFrame* pFrame = GetMainFrame();
-	    if (!pFrame)
-		    return NULL;
+	    ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST, "user", "RomeDatabaseFindOpenStream", "args='%s' flags='%d'/>\n", (CString)XMLEncode(pszPattern), nFindFlags));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "RomeDatabaseFindOpenStream \"%s\" %d\n", (CString)pszPattern, nFindFlags));
+#endif
 
-	    return &(pFrame->StatusBar);
-#else // ROMEDLL_IGNORE
-	UNUSED(pApp);
-	    return NULL;
-#endif // ROMEDLL_IGNORE
+        // Exact and table searches find few rows, so they are read as a single listing.
+        if (nFindFlags & (RX_DBFIND_EXACT | RX_DBFIND_TABLES))
+            nFindFlags &= ~RX_DBFIND_RECURSE;
+
+        RT_DBCursor* pCursor = new RT_DBCursor;
+        pCursor->pCore     = &pDatabase->Core;
+        pCursor->pDatabase = pDatabase;
+        pCursor->sPattern  = pszPattern? pszPattern: "";
+        pCursor->nFlags    = nFindFlags;
+        pCursor->pFind     = NULL;
+        pCursor->nNext     = 0;
+        pCursor->bDone     = FALSE;
+        if (nFindFlags & RX_DBFIND_RECURSE)
+            pCursor->Folders.AddTail(pCursor->sPattern);
+	    return pCursor;
     }
     catch (...)
     {
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(0,                "RomeGetStatusbar: exception.");
+        try
+        {
+            CString sInfo; sInfo.Format("RomeDatabaseFindOpenStream: exception for Pattern = '%s', nFlags = 0x%X.", CString(pszPattern), nFindFlags);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeDatabaseFindOpenStream: exception in catch block.");
+        }
     }
 }
 
 
-//! Get a title string mapped to a title key.
-//! @param pApp   The Rome interface pointer obtained from RomeInit().
-//! @param pszKey The key to lookup.
-//!   There are special values that can be used:
-//! - "#APPVERSION"       - The version of the calling application.
-//! - "#APPNAME"          - The name of the calling application.
-//! - "#BUILDDATE"        - The date the core [science] code was compiled.
-//! - "#BUILDTIME"        - The time the core [science] code was compiled.
-//! - "#COMPILER_OPTIONS" - The options used to compile the project.
-//! - "#ROMEVERSION"      - The version of the core Rome code (may be EXE or DLL)
-//! - "#ROMENAME"         - The name of the core Rome module (may be EXE or DLL)
-//! - "#SCIENCEVERSION"   - The version of the core Rome model, in format YYYYMMDD
-//! - "#STARTTIME"        - The startup time of the current run.
-//! - "#VERSION_TOMCRYPT" - The version of the TOMCRYPT library used (as DLL or compiled in)
-//! - "#VERSION_ZLIB"     - The version of the ZLIB library used (as DLL or compiled in)
-//! @return  The title string if found, or NULL on failure.
-//!
-//! @see Document "Rusle2 Translation Titles.rtf" for more information.
-//! @note This function is also used as a backdoor to add functions to the Rome API
-//!   without having to add new exported functions.
-//!   Special keys handled:
-//! - "Filename1:Filename2:#XML_FILE_COMPARE"<br>
-//!     Do a diff between 2 XML files.
-//! - "AttrName:#ATTR_UNITS"<br>
-//!     Return the title of the current template unit for this parameter.
-//!     The parameter name can be a "remote name" (e.g. "#RD:CLIMATE_PTR:EI_10YEAR").
-//! - "UnitTestCanRun:TestName"<br>
-//!     Return "1" if UnitTestCanRun(TestName) is TRUE, otherwise NULL.
-//! @RomeAPI  Wrapper for TitleGet().
+//! Get the next rows of a search started by RomeDatabaseFindOpenStream(), with several fields of each.
+//! This takes the API lock once for the batch, instead of once for each field of each row
+//!   as RomeDatabaseFindInfo() does.
+//! @param pCursor     The cursor returned by RomeDatabaseFindOpenStream().
+//! @param nMax        The largest number of rows to return.
+//! @param pInfoTypes  The fields to get for each row, as for RomeDatabaseFindInfo()
+//!   (e.g. { #RX_DBFILEINFO_FULL, #RX_DBFILEINFO_DATE }).
+//! @param nInfoTypes  The number of elements of @p pInfoTypes.
+//! @param[out] pBuf   The caller-owned buffer to return the fields in, as NUL-terminated strings:
+//!   the @p nInfoTypes fields of the first row, then those of the next row, and so on.
+//! @param nBufLen     The length of @p pBuf.
+//! @return  The number of rows returned, 0 when the search is finished, or #RX_FAILURE (-1) on error.
+//!   Rows which don't fit in @p pBuf are returned by the next call. It is an error if the
+//!   first row doesn't fit.
+//!
+//! @see RomeDatabaseFindOpenStream(), RomeDatabaseFindCloseStream().
+//! @RomeAPI Wrapper for DbFindInfo().
 //!
-ROME_API RT_CSTR RomeGetTitle(RT_App* pApp, RT_CSTR pszKey)
+ROME_API RT_INT RomeDatabaseFindNextBatch(RT_DBCursor* pCursor, RT_INT nMax, const RT_UINT* pInfoTypes, RT_INT nInfoTypes, RT_PCHAR pBuf, RT_UINT nBufLen)
 {
     try
     {
@@ -721,166 +5072,151 @@ ROME_API RT_CSTR RomeGetTitle(RT_App* pApp, RT_CSTR pszKey)
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-	    CLogFileElement1(LOGELEM_HIST, "user", "RomeGetTitle", "key='%s'/>\n", (CString)XMLEncode(pszKey));
-#if USE_ROMESHELL_LOGGING
-        LogFilePrintf1(LOG_SHELL, "RomeGetTitle \"%s\"\n", (CString)pszKey);
-#endif
-
-		if (pApp)
-		{
-            BOOL bValidApp = (pApp == &App);
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,        "RomeGetTitle: invalid Rome app pointer.");
-            BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,         "RomeGetTitle: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pCursor,                 "RomeDatabaseFindNextBatch: NULL cursor pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nMax > 0,                "RomeDatabaseFindNextBatch: non-positive row count.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pInfoTypes,              "RomeDatabaseFindNextBatch: NULL info types pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nInfoTypes > 0,          "RomeDatabaseFindNextBatch: non-positive info type count.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pBuf && nBufLen > 0,     "RomeDatabaseFindNextBatch: NULL buffer pointer.");
+        // The database is freed with its core, so the core is checked first.
+        BOOL bValidApp = RomeCoreIsValid(pCursor->pCore);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,               "RomeDatabaseFindNextBatch: invalid database pointer.");
+        RT_Database* pDatabase = pCursor->pDatabase;
+		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,                "RomeDatabaseFindNextBatch: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pDatabase->IsOpen(),     "RomeDatabaseFindNextBatch: database not open.");
 #if USE_ROMEAPI_THREADIdS
-            THREADId nCurThreadId = GetCurrentThreadId();
-            BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,     "RomeGetTitle: Rome API function called on different thread from RomeInit().");
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,            "RomeDatabaseFindNextBatch: Rome API function called on different thread from RomeInit().");
 #endif
-        }
-
-        ////////////////////////////////////////
-        // Handle special string arguments first.
-
-		// @todo require a non-NULL Rome interface pointer.
-        RT_App& Core = pApp? *pApp: App;
 
-	    int location = 0;
-#ifdef USE_XML_ARCHIVES
-	    // Run the xml file comparison used for the test suite.  Looking for an argument of the form
-	    // "[LPCSTR]xmlFilename1:[LPCSTR]xmlFilename2:#XML_FILE_COMPARE"
-	    if (pszKey && (location = ((CString)pszKey).Find(":#XML_FILE_COMPARE")) > -1)
-	    {
-		    RT_BOOL bDiff = (RT_BOOL)Core.RomeNotificationSend(RX_NOTIFY_XML_FILE_COMPARE, pszKey);
-		    return Bool2Str(bDiff);
-	    }
-#endif // USE_XML_ARCHIVES
+        ROME_API_WRITELOCK(&pDatabase->Core);
 
-	    // #ATTR_UNITS: return the title of the unit for this parameter, not the parameter title
-	    location = 0;
-	    if (pszKey && (location = ((CString)pszKey).Find(":#ATTR_UNITS")) > -1)
-	    {
-		    CString sAttrName = ((CString)pszKey).Left(location);
-#if USE_USER_TEMPLATES
-		    LPCNAME pszUnit = Core.pPreferences->GetPrefUnit(sAttrName);
-#else
-			CListing* pAttrL = Core.AttrCatalog.GetListing(sAttrName);
-			LPCNAME pszUnit = pAttrL? pAttrL->GetUnit(): "";
+	    ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST, "user", "RomeDatabaseFindNextBatch", "cursor='0x%08X' max='%d'/>\n", (UINT)pCursor, nMax));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "RomeDatabaseFindNextBatch %d %d\n", (UINT)pCursor, nMax));
 #endif
-		    pszKey = pszUnit;
-	    }
 
-        if (pszKey && strncmp(pszKey, "UnitTestCanRun:", 15)==0)
+        RT_INT nRows = 0;
+        UINT   nUsed = 0;
+        while (nRows < nMax && DbCursorFill(pCursor))
         {
-#if RUN_UNIT_TESTS
-            LPCSTR pszTestName = pszKey + 15;
-            BOOL bCanRun = UnitTestCanRun(pszTestName);
-            return bCanRun? "1": NULL;
-#else
-            return NULL;
-#endif
-        }
-
-        ////////////////////////////////////////
-
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pApp,             "RomeGetTitle: NULL Rome app pointer.");
-
-        ROME_API_LOCK();
+            if (DbFindSeek(pCursor->pFind, pCursor->nNext) < 0 || !DbCursorWanted(pCursor))
+            {
+                pCursor->nNext++;
+                continue;
+            }
 
-	    return pApp->Titles.FindAux(pszKey, TITLES_AppGetTitle);
+            // Copy the whole row, or leave it for the next call.
+            UINT nRowLen = 0;
+            for (int f = 0; f < nInfoTypes; f++)
+            {
+                LPCSTR pszInfo = DbFindInfo(pCursor->pFind, pInfoTypes[f]);
+                const UINT nLen = (pszInfo? strlen(pszInfo): 0) + 1;
+                if (nUsed + nRowLen + nLen <= nBufLen)
+                {
+                    if (pszInfo)
+                        memcpy(pBuf + nUsed + nRowLen, pszInfo, nLen);
+                    else
+                        pBuf[nUsed + nRowLen] = 0;
+                }
+                nRowLen += nLen;
+            }
+            if (nUsed + nRowLen > nBufLen)
+                break;
+            nUsed += nRowLen;
+            nRows++;
+            pCursor->nNext++;
+        }
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nRows > 0 || pCursor->pFind == NULL || pCursor->nNext >= DbFindCount(pCursor->pFind),
+                                                                       "RomeDatabaseFindNextBatch: buffer too small for one row.");
+        return nRows;
     }
     catch (...)
     {
         try
         {
-            CString sInfo; sInfo.Format("RomeGetTitle: exception for key = '%s'.", (CString)pszKey);
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
+            CString sInfo; sInfo.Format("RomeDatabaseFindNextBatch: exception for Cursor = 0x%X, Max = %d.", pCursor, nMax);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeGetTitle: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeDatabaseFindNextBatch: exception in catch block.");
         }
     }
 }
 
 
-//! Get a title string mapped to a title key.
-//! See RomeGetTitle() [above] for full documentation.
-//!
-//! This version is required for use by Intel Fortran, which can't use functions
-//!   which return a string pointer. Instead it must have its first 2 arguments
-//!   be a pointer to a buffer and its length, to return the string in.
-//!   The function must have a return type of void.
-//! @param[out] pBuf The pointer to a buffer to return a NUL-terminated string in.
-//! @param nBufLen   The length of the buffer to return a NUL-terminated string in.
-//! @param pApp      The Rome interface pointer obtained from RomeInit().
-//! @param pszKey    The key to lookup.
+//! Close a search cursor returned by RomeDatabaseFindOpenStream().
+//! This may be called before all of its rows have been read.
+//! @param pCursor  The cursor returned by RomeDatabaseFindOpenStream().
 //!
-//! @RomeAPI Wrapper for RomeGetTitle().
-//! @FortranAPI This function allows calling RomeGetTitle() from Fortran.
+//! @see RomeDatabaseFindOpenStream().
+//! @RomeAPI Wrapper for DbFindClose().
 //!
-ROME_API RT_void RomeGetTitleF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_App* pApp, RT_CSTR pszKey)
+ROME_API RT_void RomeDatabaseFindCloseStream(RT_DBCursor* pCursor)
 {
     try
     {
-        // Does not require AFX_MANAGE_STATE() macro.
-
 	    // Switch to the app's MFC module state while in this scope.
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-		// Validate arguments unique to the Fortran function version.
-		// The remaining arguments will be validated in the normal Rome API call.
-        ASSERT_OR_SETERROR_AND_RETURN(pBuf,           "RomeGetTitleF: NULL buffer pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN(nBufLen > 0,    "RomeGetTitleF: non-positive buffer length.");
+        ASSERT_OR_SETERROR_AND_RETURN(pCursor,              "RomeDatabaseFindCloseStream: NULL cursor pointer.");
+        // The database is freed with its core, so the core is checked first.
+        CRomeCore* pCore = pCursor->pCore;
+        BOOL bValidApp = RomeCoreIsValid(pCore);
+        ASSERT_OR_SETERROR_AND_RETURN(bValidApp,            "RomeDatabaseFindCloseStream: invalid database pointer.");
+		BOOL bExited = pCore->HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN(!bExited,             "RomeDatabaseFindCloseStream: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pCore->m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN(!bSameThread,         "RomeDatabaseFindCloseStream: Rome API function called on different thread from RomeInit().");
+#endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(pCore);
 
-        // Does not require command logging.
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeDatabaseFindCloseStream", "cursor='0x%08X'/>\n", (UINT)pCursor));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeDatabaseFindCloseStream %d\n", (UINT)pCursor));
+#endif
 
-        LPCSTR pszTitle = RomeGetTitle(pApp, pszKey);
-        CopyStrF(pBuf, nBufLen, pszTitle);
+        if (pCursor->pFind)
+	        DbFindClose(pCursor->pFind);
+        delete pCursor;
     }
     catch (...)
     {
         try
         {
-            if (pBuf && nBufLen > 0)
-                *pBuf = 0;
-            CString sInfo; sInfo.Format("RomeGetPropertyStrF: exception for Buffer = '0x%08X', Length = %d, Key = '%s'.", pBuf, nBufLen, CString(pszKey));
-            ASSERT_OR_SETERROR_AND_RETURN(0,    sInfo);
+            CString sInfo; sInfo.Format("RomeDatabaseFindCloseStream: exception for Cursor = 0x%X.", pCursor);
+            ASSERT_OR_SETERROR_AND_RETURN(0,        sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN(0,    "RomeGetPropertyStrF: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN(0,        "RomeDatabaseFindCloseStream: exception in catch block.");
         }
     }
 }
 
 
-//! Create a new (key, title) translation pair and add it to the titles map.
-//! @param pApp      The Rome interface pointer obtained from RomeInit().
-//! @param pszKey    The key string.
-//! @param pszTitle  The string to map to the key.
-//!   If this is NULL, the title will be removed.
-//! @param nFlags    Flags used by titles functions
-//!   (not all flag combinations are legal)
-//! - #RX_TITLES_USER     Add to user  titles
-//! - #RX_TITLES_FIXED    Add to fixed titles
-//! - #RX_TITLES_INTERNAL Add to internal titles
-//! - #RX_TITLES_NODUP    Don't set a duplicate title
-//!
-//! This makes use of the order INTERNAL < FIXED < USER.
-//! Don't set a title in a level when it duplicates
-//!   an existing title with a key at a lower level.
-//! Do set the title if a different title is mapped
-//!   to the same key at the same or a lower level.
-//! @return TRUE on success.
+//! @} // Rome Database search functions
+/////////////////////////////////////////////////////////////////////////////
+//! @name Rome Engine functions
+//! @{
+
+//! Finish running the update stack until it is empty.
+//! This should occur regardless of whether AutoUpdate is on,
+//!   and should leave the AutoUpdate state unchanged.
+//! This is especially important when reloading files.
+//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
+//! @return  RX_TRUE on success, RX_FALSE on failure.
 //!
-//! @see Document "Rusle2 Translation Titles.rtf" for more information.
-//! @RomeAPI  Wrapper for CRomeTitles::TitleSet().
+//! @see RomeEngineRun(), RomeEngineLockUpdate(), RomeEngineSetAutorun().
+//! @RomeAPI Wrapper for CEngineBase::FinishUpdates().
 //!
-ROME_API RT_BOOL RomeSetTitle(RT_App* pApp, RT_CSTR pszKey, RT_CSTR pszTitle, RT_UINT nFlags)
+ROME_API RT_BOOL RomeEngineFinishUpdates(RT_Engine* pEngine)
 {
     try
     {
@@ -888,164 +5224,137 @@ ROME_API RT_BOOL RomeSetTitle(RT_App* pApp, RT_CSTR pszKey, RT_CSTR pszTitle, RT
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pApp,             "RomeSetTitle: NULL Rome app pointer.");
-        BOOL bValidApp = (pApp == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,        "RomeSetTitle: invalid Rome app pointer.");
-		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,         "RomeSetTitle: RomeExit() has already been called.");
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pszKey,           "RomeSetTitle: NULL key string.");
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!strempty(pszKey),"RomeSetTitle: empty key string.");
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pEngine,            "RomeEngineFinishUpdates: NULL engine pointer.");
+        BOOL bValidEngine = RomeCoreIsValid(&pEngine->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidEngine,       "RomeEngineFinishUpdates: invalid Rome engine pointer.");
+		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,           "RomeEngineFinishUpdates: RomeExit() has already been called.");
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,     "RomeSetTitle: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,       "RomeEngineFinishUpdates: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&pEngine->Core);
 
-	    CLogFileElement3(LOGELEM_HIST, "user", "RomeSetTitle", "key='%s' text='%d' flags='%d'/>\n", (CString)XMLEncode(pszKey), pszTitle, nFlags);
+	    ROME_API_LOGELEM(CLogFileElement0(LOGELEM_HIST, "user", "RomeEngineFinishUpdates", "/>\n"));
 #if USE_ROMESHELL_LOGGING
-        LPCSTR pszCmdTitle = pszTitle? pszTitle: "#NULL";
-        LogFilePrintf3(LOG_SHELL, "RomeSetTitle \"%s\" \"%s\" %d\n", pszKey, pszCmdTitle, nFlags);
+        ROME_API_LOG(LogFilePrintf0(LOG_SHELL, "RomeEngineFinishUpdates\n"));
 #endif
 
-	    return pApp->Titles.TitleSet(pszKey, pszTitle, nFlags);
+	    StatFinishUpdates(*pEngine);
+        EngineGetSets(pEngine->Core, TRUE);
+        ListenersDeliver(pEngine->Core);
+
+	    return RX_TRUE;
     }
     catch (...)
     {
-        try
-        {
-            CString sInfo; sInfo.Format("RomeSetTitle: exception for key = '%s' title = '%s' flags='%d'.", (CString)pszKey, (CString)pszTitle, nFlags);
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
-        }
-        catch (...)
-        {
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeSetTitle: exception in catch block.");
-        }
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(0, "RomeEngineFinishUpdates: exception.");
     }
 }
 
 
-//! Load a user template file.
-//! @param pApp   The Rome interface pointer obtained from RomeInit().
-//! @param pszFilename The name of the disk template file.
-//!   This can be a short filename, in which case the full path to the
-//!   "Users" directory will be prepended. If the "Users" directory has been
-//!   remapped by configuration setting, that directory will be used.
-//! @return RX_TRUE on success, RX_FALSE on failure or error.
+//! Get the Autorun state for the Rome engine.
+//! When the autorun flag is set, after each value changes the engine will recalculate
+//!   the outputs, leading to much slower performance.
+//! Note that you can also avoid autoupdating in some cases by changing
+//!   the values in an "auxiliary" file like a SOIL, and then changing
+//!   the main PROFILE's ptr to use that SOIL file after all changes have
+//!   been made, which only then causes the updating to happen.
+//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
+//! @return  The autorun state (RX_TRUE or RX_FALSE), or #RX_FAILURE on error.
 //!
-//! @see RomeTemplateSave().
-//! @RomeAPI Wrapper for CRomeCore::LoadTemplate().
+//! @see  RomeEngineFinishUpdates(), RomeEngineRun(), RomeEngineSetAutorun().
+//! @RomeAPI Wrapper for CEngineBase::IsUpdating().
 //!
-ROME_API RT_BOOL RomeTemplateLoad(RT_App* pApp, RT_CSTR pszFilename)
+ROME_API RT_BOOL RomeEngineGetAutorun(RT_Engine* pEngine)
 {
-#if USE_USER_TEMPLATES
     try
     {
-	    // Switch to the app's MFC module state while in this scope.
-	    // This is required for many MFC functions to work correctly.
-	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+        // Switch to the app's MFC module state while in this scope.
+        // This is required for many MFC functions to work correctly.
+        AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pApp,                   "RomeTemplateLoad: NULL Rome app pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!strempty(pszFilename), "RomeTemplateLoad: empty path name.");
-        BOOL bValidApp = (pApp == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,              "RomeTemplateLoad: invalid Rome app pointer.");
-		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,               "RomeTemplateLoad: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pEngine,            "RomeEngineGetAutorun: NULL engine pointer.");
+        BOOL bValidEngine = RomeCoreIsValid(&pEngine->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidEngine,       "RomeEngineGetAutorun: invalid Rome engine pointer.");
+		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeEngineGetAutorun: RomeExit() has already been called.");
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,           "RomeTemplateLoad: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeEngineGetAutorun: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&pEngine->Core);
 
-	    CLogFileElement1(LOGELEM_HIST, "user", "RomeTemplateLoad", "file='%s'/>\n", XMLEncode(pszFilename));
+        ROME_API_LOGELEM(CLogFileElement0(LOGELEM_HIST, "user", "RomeEngineGetAutorun", "/>\n"));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf1(LOG_SHELL, "RomeTemplateLoad \"%s\"\n", pszFilename);
+        ROME_API_LOG(LogFilePrintf0(LOG_SHELL, "RomeEngineGetAutorun\n"));
 #endif
 
-	    BOOL bLoaded = pApp->LoadTemplate(pszFilename);
-	    return bLoaded;
+        return pEngine->IsUpdating();
     }
     catch (...)
     {
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,                      "RomeTemplateLoad: exception.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeEngineGetAutorun: exception.");
     }
-#else
-	UNUSED2(pApp, pszFilename);
-	return RX_FALSE;
-#endif // USE_USER_TEMPLATES
 }
 
 
-//! Save the active user template.
-//! @param pApp  The Rome interface pointer obtained from RomeInit().
-//! @param pszFilename  The filename to save the template as.
-//!   This can be a short filename, in which case the full path to the
-//!   "Users" directory will be prepended. If the "Users" directory has been
-//!   remapped by configuration setting, that directory will be used.
-//!   If this is NULL, the current name will be used.
-//! @return  RX_TRUE on success, RX_FALSE on failure or error.
+//! Get the number of attr values changed through the API since the engine last ran.
+//! This counts values set by RomeFileSetAttrValue() and related functions, attr handles,
+//!   and resizes by RomeFileSetAttrSize(), which changed a value.
+//! It is reset by RomeEngineRun(), RomeEngineRunEx() and RomeEngineFinishUpdates().
+//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
+//! @return  The number of changed values, or #RX_FAILURE (-1) on error.
 //!
-//! @see RomeTemplateLoad().
-//! @RomeAPI Wrapper for CRomeCore::SaveTemplate().
+//! @note This only counts API calls. It isn't the number of attrs the engine has to recalculate,
+//!   which the engine doesn't report.
+//! @note Getting a value also recalculates anything it depends on, without resetting this count.
+//! @see RomeEngineRunEx().
 //!
-ROME_API RT_BOOL RomeTemplateSave(RT_App* pApp, RT_CSTR pszFilename /*= NULL*/)
+ROME_API RT_INT RomeEngineGetSetCount(RT_Engine* pEngine)
 {
-#if USE_USER_TEMPLATES
     try
     {
-	    // Switch to the app's MFC module state while in this scope.
-	    // This is required for many MFC functions to work correctly.
-	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+        // Switch to the app's MFC module state while in this scope.
+        // This is required for many MFC functions to work correctly.
+        AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pApp,                   "RomeTemplateSave: NULL Rome app pointer.");
-        BOOL bValidApp = (pApp == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,              "RomeTemplateSave: invalid Rome app pointer.");
-		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,               "RomeTemplateSave: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pEngine,            "RomeEngineGetSetCount: NULL engine pointer.");
+        BOOL bValidEngine = RomeCoreIsValid(&pEngine->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidEngine,       "RomeEngineGetSetCount: invalid Rome engine pointer.");
+		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeEngineGetSetCount: RomeExit() has already been called.");
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,           "RomeTemplateSave: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeEngineGetSetCount: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&pEngine->Core);
 
-	    CLogFileElement1(LOGELEM_HIST, "user", "RomeTemplateSave", "file='%s'/>\n", XMLEncode(pszFilename));
-#if USE_ROMESHELL_LOGGING
-        if (pszFilename)
-            LogFilePrintf1(LOG_SHELL, "RomeTemplateSave \"%s\"\n", pszFilename);
-        else
-            LogFilePrintf0(LOG_SHELL, "RomeTemplateSave\n");
-#endif
+        // Don't log this function - it is a query which may be called after each run.
 
-	    BOOL bSaved = pApp->SaveTemplate(pszFilename);
-	    return bSaved;
+        return EngineGetSets(pEngine->Core, FALSE);
     }
     catch (...)
     {
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,                      "RomeTemplateSave: exception.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeEngineGetSetCount: exception.");
     }
-#else
-	UNUSED2(pApp, pszFilename);
-	return RX_FALSE;
-#endif // USE_USER_TEMPLATES
 }
 
 
-//! Get error information set by the API.
-//! This function may be called when an API function returns an error value.
-//! This may return additional information in text format.
-//! The information string is currently thread-local.
-//! @param pApp  The Rome interface pointer obtained from RomeInit().
-//! @return  An error information string, or NULL on failure.
+//! Is the engine locked?
+//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
+//! @return  #RX_FAILURE on error.
 //!
-//! @see RomeSetLastError().
-//! @RomeAPI
+//! @see RomeEngineLockUpdate(), RomeEngineUnlockUpdate().
+//! @RomeAPI Wrapper for CEngineBase::IsLocked().
 //!
-ROME_API RT_CSTR RomeGetLastError(RT_App* pApp)
+ROME_API RT_BOOL RomeEngineIsLocked(RT_Engine* pEngine)
 {
     try
     {
@@ -1053,53 +5362,41 @@ ROME_API RT_CSTR RomeGetLastError(RT_App* pApp)
         // This is required for many MFC functions to work correctly.
         AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        // Can't use Get/SetLastError macros insIde this function!
-        BOOL bValidApp = (pApp == NULL) || (pApp == &App);
-        ASSERT_OR_RETURN_NULL(bValidApp);
-		BOOL bExited = App.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_RETURN_NULL(!bExited);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pEngine,            "RomeEngineIsLocked: NULL engine pointer.");
+        BOOL bValidEngine = RomeCoreIsValid(&pEngine->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidEngine,       "RomeEngineIsLocked: invalid Rome engine pointer.");
+		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeEngineIsLocked: RomeExit() has already been called.");
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (App.m_nThreadId = nCurThreadId);
-        ASSERT_OR_RETURN_VALUE(!bSameThread, "RomeGetLastError: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeEngineIsLocked: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_NOLOCK();
+        ROME_API_WRITELOCK(&pEngine->Core);
 
-        // Does not require command logging.
+        // Don't log this function - it gets called too many times and floods the log file.
+//    	CLogFileElement0(LOGELEM_HIST, "user", "RomeEngineIsLocked", "/>\n");
 
-        // Get a thread-local error information string.
-        CString& sInfo = RomeThreadGetNamedString("RomeGetLastError");
-        return sInfo;
+	    return pEngine->IsLocked();
     }
     catch (...)
     {
-        ASSERT(FALSE);
-        // Note: don't try to use RomeGet/SetLastError() here if this code isn't working!
-        return NULL; // failure
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeEngineIsLocked: exception.");
     }
 }
 
 
-//! Set additional error information for a Rome API error.
-//! This information is retrieved by RomeGetLastError().
-//! Note that it may be overwritten if not retrieved directly after it is set.
-//! This information string is currently thread-local.
-//! @param pApp    The Rome interface pointer obtained from RomeInit().
-//! @param pszInfo The text error description.<br>
-//!   If this is NULL the error information will be cleared.<br>
-//!   If the string starts with a special character, then<br>
-//!   '+'  the text will be @em appended  to the current string as a new line.<br>
-//!   '-'  the text will be @em prepended to the current string as a new line.<br>
-//!   '='  the text will @em replace the current string.<br>
-//!   If the string doesn't start with a special character, then whether the string replaces the old
-//!     one or is affixed in some way depends on compile-time settings of this function.
-//! @return  RX_TRUE on success, RX_FALSE on failure or error.
+//! Lock the engine from running.
+//! This increments a lock count.
+//! The new lock count is returned.
+//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
+//! @return #RX_FAILURE on error.
 //!
-//! @see RomeGetLastError().
-//! @RomeAPI
+//! @see RomeEngineIsLocked(), RomeEngineUnlockUpdate().
+//! @RomeAPI Wrapper for CEngineBase::LockUpdate().
 //!
-ROME_API RT_BOOL RomeSetLastError(RT_App* pApp, RT_CSTR pszInfo)
+ROME_API RT_INT RomeEngineLockUpdate(RT_Engine* pEngine)
 {
     try
     {
@@ -1107,108 +5404,81 @@ ROME_API RT_BOOL RomeSetLastError(RT_App* pApp, RT_CSTR pszInfo)
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        // Can't use Get/SetLastError macros insIde this function!
-		if (pApp)
-		{
-			BOOL bValidApp = (pApp == &App);
-			ASSERT_OR_RETURN_FALSE(bValidApp);
-			BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
-			ASSERT_OR_RETURN_FALSE(!bExited);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pEngine,            "RomeEngineLockUpdate: NULL engine pointer.");
+        BOOL bValidEngine = RomeCoreIsValid(&pEngine->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidEngine,       "RomeEngineLockUpdate: invalid Rome engine pointer.");
+		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeEngineLockUpdate: RomeExit() has already been called.");
 #if USE_ROMEAPI_THREADIdS
-            THREADId nCurThreadId = GetCurrentThreadId();
-            BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
-            ASSERT_OR_RETURN_FALSE(!bSameThread); // RomeSetLastError: Rome API function called on different thread from RomeInit().
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeEngineLockUpdate: Rome API function called on different thread from RomeInit().");
 #endif
-		}
 
-        ROME_API_NOLOCK();
+        ROME_API_WRITELOCK(&pEngine->Core);
 
-	    // Does not require command logging.
+        // Don't log this function - it gets called too many times and floods the log file.
+//      CLogFileElement0(LOGELEM_HIST, "user", "RomeEngineLockUpdate", "/>\n");
 
-        //! @todo Require an interface pointer to use this function.
-//      ASSERT_OR_RETURN_FALSE(pApp);
+	    return pEngine->LockUpdate();
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeEngineLockUpdate: exception.");
+    }
+}
 
-#if defined(_DEBUG) && !defined(BUILD_MOSES)
-        // If we are setting a new error message, we don't want to wipe out an old one.
-        // Using the '+' and '-' prefixes allows us to maintain a 'call stack' of error messages.
-        // NOTE: Another way to do this would be to just change this function to always
-        //   concatenate the new error info.
-        RT_CSTR pszOldError = RomeGetLastError(pApp);
-        ASSERT(strempty(pszOldError) || strempty(pszInfo) || streq(pszOldError, pszInfo) || *pszInfo == '-' || *pszInfo == '+' || *pszInfo == '=');
-#endif
 
-        // Get the thread-local error information string.
-        CString sInfo = RomeThreadGetNamedString("RomeGetLastError");
+//! Unlock the engine to allow running.
+//! This decrements the lock count. The engine will not run if more locks remain.
+//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
+//! @return  The new lock count, or #RX_FAILURE (-1) on error.
+//!
+//! @see RomeEngineIsLocked(), RomeEngineLockUpdate().
+//! @RomeAPI Wrapper for CEngineBase::UnlockUpdate().
+//!
+ROME_API RT_INT RomeEngineUnlockUpdate(RT_Engine* pEngine)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        if (pszInfo == NULL)
-            sInfo = "";
-        else
-        if (*pszInfo == '+')
-        {
-            // Affix the new string to the end of the current string.
-            if (!strempty(sInfo))
-                sInfo = (sInfo + "\n") + (pszInfo+1);
-            else
-                sInfo = (pszInfo+1);
-        }
-        else
-        if (*pszInfo == '-')
-        {
-            // Prefix the new string to the start of the current string.
-            if (!strempty(sInfo))
-                sInfo = (pszInfo+1) + ("\n" + sInfo);
-            else
-                sInfo = (pszInfo+1);
-        }
-        else
-        if (*pszInfo == '=')
-        {
-            // Replace the new string as the current string.
-            sInfo = (pszInfo+1);
-        }
-        else
-        {
-#if 0
-            // *** Don't use this code for now. It is unsafe because it can
-            // ***   lead to unbounded strings when visuals code repeatedly asks for
-            // ***   obsolete parameters.
-            // Prefix the new string to the start of the current string.
-            if (!strempty(sInfo))
-                sInfo = pszInfo + ("\n" + sInfo);
-            else
-                sInfo = pszInfo;
-#else
-            // Replace the new string as the current string.
-            sInfo = pszInfo;
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pEngine,            "RomeEngineUnlockUpdate: NULL engine pointer.");
+        BOOL bValidEngine = RomeCoreIsValid(&pEngine->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidEngine,       "RomeEngineUnlockUpdate: invalid Rome engine pointer.");
+		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeEngineUnlockUpdate: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeEngineUnlockUpdate: Rome API function called on different thread from RomeInit().");
 #endif
-        }
 
-        RomeThreadSetNamedString("RomeGetLastError", sInfo);
+        ROME_API_WRITELOCK(&pEngine->Core);
 
-        return RX_TRUE; // success
+        // Don't log this function - it gets called too many times and floods the log file.
+//    	CLogFileElement0(LOGELEM_HIST, "user", "RomeEngineUnlockUpdate", "/>\n");
+
+	    return pEngine->UnlockUpdate();
     }
     catch (...)
     {
-        ASSERT(FALSE);
-        // Note: don't try to use RomeGet/SetLastError() here if this code isn't working!
-        return RX_FALSE; // failure
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeEngineUnlockUpdate: exception.");
     }
 }
 
 
-//! Call when finished using the Rome interface.
-//!   This frees system resources allocated by the interface.
-//!   After this call it is forbIdden call any other Rome API functions 
-//!   or to use any data returned by Rome API functions during the session
-//!   that is owned by the Rome session.
-//! @param pApp  The Rome interface pointer obtained from RomeInit().
-//! @return RX_TRUE on succcess, RX_FALSE on failure.
+//! Run the engine until done.
+//! This may not produce any change if autocalc is already on.
+//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
+//! @return #RX_FAILURE (-1) on error.
 //!
-//! @warning After RomeExit() has been called, you may not call RomeInit() to create a new Rome session.
-//! @see RomeInit().
-//! @RomeAPI Wrapper for CRomeCore::Exit().
+//! @see RomeEngineLockUpdate(), RomeEngineSetAutorun().
+//! @RomeAPI Wrapper for CEngineBase::Run().
 //!
-ROME_API RT_BOOL RomeExit(RT_App* pApp)
+ROME_API RT_BOOL RomeEngineRun(RT_Engine* pEngine)
 {
     try
     {
@@ -1216,233 +5486,183 @@ ROME_API RT_BOOL RomeExit(RT_App* pApp)
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pApp,            "RomeExit: NULL Rome app pointer.");
-        BOOL bValidApp = (pApp == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,       "RomeExit: invalid Rome app pointer.");
-		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,        "RomeExit: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pEngine,            "RomeEngineRun: NULL engine pointer.");
+        BOOL bValidEngine = RomeCoreIsValid(&pEngine->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidEngine,       "RomeEngineRun: invalid Rome engine pointer.");
+		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeEngineRun: RomeExit() has already been called.");
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
-        ASSERT(!bSameThread);
+        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeEngineRun: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&pEngine->Core);
 
-	    CLogFileElement0(LOGELEM_HIST, "user", "RomeExit", "/>\n");
+        BATCHCORE* pBatch = CoreGetBatch(pEngine->Core);
+        if (!pBatch)
+        {
+	        ROME_API_LOGELEM(CLogFileElement0(LOGELEM_HIST, "user", "RomeEngineRun", "/>\n"));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf0(LOG_SHELL, "RomeExit\n");
+            ROME_API_LOG(LogFilePrintf0(LOG_SHELL, "RomeEngineRun\n"));
 #endif
+        }
 
-        return pApp->Exit();
+	    RT_BOOL bRun = StatEngineRun(*pEngine);
+        EngineGetSets(pEngine->Core, TRUE);
+        ListenersDeliver(pEngine->Core);
+        if (pBatch)
+            BatchLog(pBatch, "RomeEngineRun", NULL, 0, bRun? RX_TRUE: RX_FALSE);
+        return bRun;
     }
     catch (...)
     {
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,               "RomeExit: exception.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeEngineRun: exception.");
     }
 }
 
 
-//! Initialize the Rome API for use.
-//! This function returns a Rome interface pointer required by most Rome API functions.
-//!   Call RomeExit() on this pointer when finished with it.
-//! @param pszArgs  A command-line argument string used to configure the DLL.
-//! - Arguments are separated by spaces. In order to contain spaces or
-//!     other special characters, arguments should be double-quoted.
-//! - This string may be NULL or empty.
-//! - The first argument is assumed to be the name of the calling app, and is ignored.
-//! - /DirRoot=...        The root directory ... to use for the all files.
-//! - /Path:(name)=(path) The file or folder (name) is redirected to the Win32 (path).
-//! - /UnitSystem=(name)  The system of units to use initially.
-//! - -  "US"               the English/British unit system
-//! - -  "SI"               the metric unit system
-//! - -                   If the (name) part is empty, it will use SI units.
-//! @since 2007-10-08 If no unit system is specified, it will default to SI units.<br>
-//!   Note: in the past this was incorrectly documented as using default US units.<br>
-//!   An unrecognized unit system name is now ignored.
-//! @return  A pointer to the Rome interface, or NULL on failure.
+//! Run the engine until done, as RomeEngineRun() does, and get the number of values changed before it.
+//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
+//! @param nFlags   Flags which modify running behavior. None are defined yet, so this must be 0.
+//! @return  The number of values changed through the API since the last run
+//!   (see RomeEngineGetSetCount()), or #RX_FAILURE (-1) on error.
+//!   Unlike RomeEngineRun(), this is a count and not #RX_TRUE / #RX_FALSE: 0 is a successful run
+//!   with nothing changed since the last one, and a failed run returns #RX_FAILURE.
 //!
-//! @warning After RomeExit() has been called, you may not call RomeInit() to create a new Rome session.
-//! @see CRomeCore::Init(), CRomeCore::ParseArgs(LPCSTR, ...), ParseArgs(RMapStringToString&, ...), RomeExit().
-//! @RomeAPI Wrapper for CRomeCore::Init().
+//! @see RomeEngineRun(), RomeEngineGetSetCount(), RomeEngineFinishUpdates().
+//! @RomeAPI Wrapper for CEngineBase::Run(), CEngineBase::FinishUpdates().
 //!
-ROME_API RT_App* RomeInit(RT_CSTR pszArgs)
+ROME_API RT_INT RomeEngineRunEx(RT_Engine* pEngine, RT_UINT nFlags)
 {
     try
     {
-        // Switch to the app's MFC module state while in this scope.
-        // This is required for many MFC functions to work correctly.
-        AFX_MANAGE_STATE(AfxGetAppModuleState());
-
-	    // Because this function can get called simultaneously from
-	    //   separate threads, make sure this doesn't happen.
-	    RFX_CRITICAL_SECTION();
-
-        // Get a pointer to the app instance.
-        // @todo Dynamically create a new CRomeCore instance, which is then freed by RomeExit().
-        CRomeCore* pApp = &App;
-
-		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,                "RomeInit: RomeExit() has already been called.");
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        //! @note RomeInit() may be called multiple times safely.
-        //! Later calls will return the same Rome app instance as the first call.
-        //! The @p pszArgs argument will be ignored on all calls after the first.
-        //! Initialization is only done on the first call to RomeInit().
-	    if (pApp->HasFlag(DLLSTATE_INITROME))
-		    return &App;
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pEngine,            "RomeEngineRunEx: NULL engine pointer.");
+        BOOL bValidFlags = ((nFlags & ~RX_ENGINE_RUN_FLAGMASK) == 0);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFlags,        "RomeEngineRunEx: unknown flags argument.");
+        BOOL bValidEngine = RomeCoreIsValid(&pEngine->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidEngine,       "RomeEngineRunEx: invalid Rome engine pointer.");
+		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeEngineRunEx: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeEngineRunEx: Rome API function called on different thread from RomeInit().");
+#endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&pEngine->Core);
 
-	    CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeInit", "args='%s'>\n", (CString)XMLEncode(pszArgs));
+        BATCHCORE* pBatch = CoreGetBatch(pEngine->Core);
+        if (!pBatch)
+        {
+	        ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeEngineRunEx", "flags='%d'/>\n", nFlags));
 #if USE_ROMESHELL_LOGGING
-        if (!strempty(pszArgs))
-            LogFilePrintf1(LOG_SHELL, "RomeInit %s\n", pszArgs);
-        else
-            LogFilePrintf0(LOG_SHELL, "RomeInit\n");
+            ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeEngineRunEx %d\n", nFlags));
 #endif
+        }
 
-        // Set the Rome notification callback.
-        // Currently this is passed into the CRomeCore constructor.
-        // TODO: Generalize to register a window/thread handle or IP address to send messages to.
-
-        // HACK: add a place to stop execution and wait for the user to continue.
-	    // This alows using menu item Build > Start Debug. > Attach to Process...
-	    //   to attach to the calling executable, and then continue running.
-    //	MessageBox(NULL, "Waiting to attach to calling process", "RomeDLL", MB_OK);
-
-	    // Store a copy of the command line this was invoked with.
-	    pApp->m_sCommandLine = pszArgs;
-
-        CStringArray aCommandLine;
-        BOOL bParsed = CRomeCore::ParseArgs(pszArgs, aCommandLine);
-        // Note: the DLLSTATE_INITARGS flag will only be set when the flags are handled in CRomeCore::Init().
-    	ASSERT_OR_SETERROR_AND_RETURN_NULL(bParsed, "-RomeInit: failed to parse command line arguments.");
-
-	    const int argc = aCommandLine.GetSize();
-	    CArray<LPCSTR, LPCSTR> vCommandLine;
-	    for (int i=0; i<argc; i++)
-		    vCommandLine.Add(aCommandLine[i]);
-	    const char** argv = vCommandLine.GetData();
-	    const char** envp = NULL;
-
-#if USE_ROMEAPI_THREADIdS
-        //! @note If #USE_ROMEAPI_THREADIdS is set, store the thread Id of this thread.
-        //! This will be checked in subsequent Rome API calls to check that it matches.
-        pApp->m_nThreadId = GetCurrentThreadId();
-#endif
+        const int nApiSets = EngineGetSets(pEngine->Core, TRUE);
 
-        //////////////////////////////////
+	    RT_BOOL bRun = StatEngineRun(*pEngine);
+        ListenersDeliver(pEngine->Core);
 
-	    return pApp->Init(argc, argv, envp);
+        // The ring gets the result of the run, as for RomeEngineRun().
+        if (pBatch)
+            BatchLog(pBatch, "RomeEngineRunEx", NULL, nFlags, bRun? RX_TRUE: RX_FALSE);
+        return bRun? nApiSets: RX_FAILURE;
     }
     catch (...)
     {
-        try
-        {
-            CString sInfo; sInfo.Format("RomeInit: exception for Args = '%s'.", CString(pszArgs));
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
-        }
-        catch (...)
-        {
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeInit: exception in catch block.");
-        }
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeEngineRunEx: exception.");
     }
 }
 
 
-//! Manage adding and removing listeners on various Rome objects.
-//! @param nAction    The action to perform, and the target type.<br>
-//!   Example: #RX_LISTENER_ADD | #RX_LISTENER_TARGET_FILE.
-//! @param pTarget    The Rome object that is being observed.
-//! @param pObserver  An opaque pointer to or Id of the observer.
-//! @param pEventHandler  The event callback function to invoke.
-//!
-//! @return  Non-zero on success, zero on failure.
-//! @RomeAPI
-//!
-ROME_API RT_BOOL Rome_Listener(RT_UINT nAction, RT_void* pTarget, RT_void* pObserver, RT_EventHandler pEventHandler)
+//! The argument passed to the thread of a RomeEngineRunAsync() call.
+//! This is allocated by RomeEngineRunAsync() and freed by its thread.
+typedef struct ENGINEASYNC
 {
+    RT_Engine*       pEngine;
+    RT_UINT          nFlags;        //!< Passed through to RomeEngineRunEx().
+    RT_void*         pObserver;     //!< Passed through to @c pEventHandler.
+    RT_EventHandler  pEventHandler; //!< Invoked when the run finishes, or NULL.
+    CEvent* volatile pStarted;      //!< Set once the thread holds the core's API gate, then cleared.
+} ENGINEASYNC;
+
+
+//! The thread procedure of a RomeEngineRunAsync() call.
+//! The thread takes the core's API gate before letting RomeEngineRunAsync() return, so API calls
+//!   for the core made meanwhile wait for the run. The gate is released when the run is done,
+//!   before the event handler is called.
+//! @param pParam  The call's #ENGINEASYNC.
+//! @return 0 always. The result is reported to the event handler.
+//!
+LOCAL UINT AFX_CDECL EngineRunAsyncProc(LPVOID pParam)
+{
+    ENGINEASYNC* pAsync = (ENGINEASYNC*)pParam;
+    BOOL bNotified = FALSE;
     try
     {
 	    // Switch to the app's MFC module state while in this scope.
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        const UINT nTargetType = nAction & RX_LISTENER_TARGET_MASK;
-        ASSERT_OR_RETURN_NULL(nTargetType != RX_LISTENER_TARGET_NONE);
-        const UINT nActionType = nAction & RX_LISTENER_ACTION_MASK;
-
-        // Currently all arguments are required to be non-NULL.
-        ASSERT_OR_SETERROR_AND_RETURN_ZERO(pTarget,         "Rome_Listener: NULL target argument.");
-        ASSERT_OR_SETERROR_AND_RETURN_ZERO(pObserver,       "Rome_Listener: NULL observer argument.");
-        ASSERT_OR_SETERROR_AND_RETURN_ZERO(pEventHandler,   "Rome_Listener: NULL event handler.");
-        //
-		BOOL bExited = App.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bExited,        "Rome_Listener: RomeExit() has already been called.");
-
-        ROME_API_LOCK();
-
-        RT_BOOL bRet = RX_FALSE;
-
-        switch (nTargetType)
+        RT_INT nResult = RX_FAILURE;
         {
-            case RX_LISTENER_TARGET_FILE:
-            {
-                // @todo Add USE_ROMEAPI_THREADIdS check.
-                bRet = RomeFile_Listener((CFileObj*)pTarget, nActionType, pObserver, pEventHandler);
-                break;
-            }
+            // RomeEngineRunEx() is nested in this hold, so it sees that this thread owns the gate.
+            CApiGateLock ApiGate(&pAsync->pEngine->Core, APIGATE_EXCLUSIVE);
+            pAsync->pStarted->SetEvent();
+            pAsync->pStarted = NULL;
 
-            case RX_LISTENER_TARGET_OBJ:
-            {
-                // @todo Add USE_ROMEAPI_THREADIdS check.
-                bRet = RomeObj_Listener((RT_SubObj*)pTarget, nActionType, pObserver, pEventHandler);
-                break;
-            }
-/*
-            case RX_LISTENER_TARGET_TASK:
-            {
-                bRet = ===((CEngineTask*)pTarget, nActionType, pObserver, pEventHandler);
-                break;
-            }
-*/
-            default:
-                ASSERT(false);
-                break;
+            nResult = RomeEngineRunEx(pAsync->pEngine, pAsync->nFlags);
         }
 
-        return bRet;
+        // The handler takes the gate like any other caller, so it doesn't hold up the core's other threads.
+        bNotified = TRUE;
+        if (pAsync->pEventHandler)
+            pAsync->pEventHandler(pAsync->pObserver, RX_EVENT_ENGINE_RUN_DONE, (RT_void*)(INT_PTR)nResult);
     }
     catch (...)
     {
-        try
-        {
-            CString sInfo; sInfo.Format("Rome_Listener: exception for Action = %d.", nAction);
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
-        }
-        catch (...)
-        {
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "Rome_Listener: exception in catch block.");
-        }
+        // The caller may be waiting on the handler, so report the failure to it.
+        if (pAsync->pStarted)
+            pAsync->pStarted->SetEvent();
+        if (!bNotified && pAsync->pEventHandler)
+            pAsync->pEventHandler(pAsync->pObserver, RX_EVENT_ENGINE_RUN_DONE, (RT_void*)(INT_PTR)RX_FAILURE);
     }
+    delete pAsync;
+    return 0;
 }
 
-//! @} // Rome session functions
-/////////////////////////////////////////////////////////////////////////////
-//! @name Rome Catalog functions
-//! @{
 
-//! Get the number of dimensions an attr has.
-//! @param pApp    The Rome interface pointer obtained from RomeInit().
-//! @param pszAttr  The parameter name used by the catalog (e.g. "CLAY").
-//!   This can be a 'long' attr name with a remote prefix (e.g. "#RD:SOIL_PTR:CLAY").
-//! @return  The attr's number of dimensions, or #RX_FAILURE (-1) on error.
-//!
-//! @see RomeFileGetAttrDimSize(), RomeFileGetAttrSizeEx().
+//! Run the engine until done on a thread of its own, returning at once.
+//! While the run is in flight:
+//! - API calls for other cores run as usual, concurrently with the run (e.g. opening the next
+//!     scenario's files and setting its inputs in another core).
+//! - API calls for this core, from any thread, wait for the run to finish, as if the engine
+//!     were running on the calling thread, so a getter called afterwards returns the new results.
+//!     Only the run holds the core's lock; the event handler doesn't.
+//! - RomeExit() for this core waits for the run too, but the handler may then be called
+//!     after the core is freed, so its pointers mustn't be used by the handler.
+//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
+//! @param nFlags   Flags which modify running behavior, as for RomeEngineRunEx().
+//! @param pObserver      An opaque pointer passed back to @p pEventHandler.
+//! @param pEventHandler  The event callback function to invoke when the run finishes, or NULL.
+//!   This is invoked on the run's thread with event #RX_EVENT_ENGINE_RUN_DONE and the result
+//!   of RomeEngineRunEx() as event data, after the run has released the core's lock.
+//!   The handler may call the API for this core (e.g. to get the outputs) like any other caller,
+//!   so calls made by other threads between the run and the handler may come first.
+//! @return RX_TRUE if the run was started, or #RX_FAILURE (-1) on error.
+//!   If a run (or any other API call) for this core is in progress, this waits for it first.
+//!
+//! @see RomeEngineRunEx(), Rome_Listener().
 //! @RomeAPI
 //!
-ROME_API RT_INT RomeCatalogGetAttrDimCount(RT_App* pApp, RT_CNAME pszAttr)
+ROME_API RT_BOOL RomeEngineRunAsync(RT_Engine* pEngine, RT_UINT nFlags, RT_void* pObserver, RT_EventHandler pEventHandler)
 {
     try
     {
@@ -1450,111 +5670,298 @@ ROME_API RT_INT RomeCatalogGetAttrDimCount(RT_App* pApp, RT_CNAME pszAttr)
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pApp,               "RomeCatalogGetAttrDimCount: NULL Rome app pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszAttr), "RomeCatalogGetAttrDimCount: empty attr name.");
-        BOOL bValidApp = (pApp == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,          "RomeCatalogGetAttrDimCount: invalid Rome pointer.");
-		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeCatalogGetAttrDimCount: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pEngine,            "RomeEngineRunAsync: NULL engine pointer.");
+        BOOL bValidFlags = ((nFlags & ~RX_ENGINE_RUN_FLAGMASK) == 0);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFlags,        "RomeEngineRunAsync: unknown flags argument.");
+        BOOL bValidEngine = RomeCoreIsValid(&pEngine->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidEngine,       "RomeEngineRunAsync: invalid Rome engine pointer.");
+		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeEngineRunAsync: RomeExit() has already been called.");
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeCatalogGetAttrDimCount: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeEngineRunAsync: Rome API function called on different thread from RomeInit().");
 #endif
+        // The run's thread would wait for this thread, which would be waiting for it.
+        BOOL bGateHeld = ApiGateIsHeld(&CoreApi(pEngine->Core).Gate);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bGateHeld,         "RomeEngineRunAsync: called from inside another API call for the core.");
 
-        ROME_API_NOLOCK();
+        // The run itself is logged by RomeEngineRunEx().
+        ROME_API_STAT();
 
-        // Note: There is no need to finish running the stack since this doesn't require access to the file or attr instance.
+        CEvent Started(FALSE, TRUE);
+        ENGINEASYNC* pAsync = new ENGINEASYNC;
+        pAsync->pEngine       = pEngine;
+        pAsync->nFlags        = nFlags;
+        pAsync->pObserver     = pObserver;
+        pAsync->pEventHandler = pEventHandler;
+        pAsync->pStarted      = &Started;
 
-	    // Does not require command logging.
-//#if USE_ROMESHELL_LOGGING
-//        LogShellActivate(sFile);
-//        LogFilePrintf1(LOG_SHELL, "RomeCatalogGetAttrDimCount \"%s\"\n", pszAttr);
-//#endif
+        CWinThread* pThread = AfxBeginThread(EngineRunAsyncProc, pAsync);
+        if (pThread == NULL)
+        {
+            // Run on this thread instead, so the handler is still called.
+            EngineRunAsyncProc(pAsync);
+            return RX_TRUE;
+        }
 
-        // Find the catalog listing for this parameter.
-        CListing* pListing = pApp->AttrCatalog.GetListing(pszAttr);
-        TEST_OR_SETERROR_AND_RETURN_FAILURE(pListing,            "RomeCatalogGetAttrDimCount: Parameter not found.");
+        WaitForSingleObject(Started, INFINITE);
+        return RX_TRUE;
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeEngineRunAsync: exception.");
+    }
+}
 
-        // Get the number of dimensions from the catalog listing.
-        LPCNAME dim0 = pListing->GetDim(0);
-        LPCNAME dim1 = pListing->GetDim(1);
-        int nDims = (!strempty(dim0) && !streq(dim0, "1")) +
-                    (!strempty(dim1) && !streq(dim1, "1"));
-        ASSERT(0 <= nDims && nDims <= CDimensions::MAXDIMNUM);
 
-        return nDims;
+//! The range of items not yet taken from one worker's queue in RomeEngineRunBatch().
+//! The owning worker takes items from the front, and idle workers steal from the back.
+typedef struct BATCHQUEUE
+{
+    CCriticalSection Lock;      //!< Guards @c nHead and @c nTail.
+    int              nHead;     //!< The index of the next item the owner will run.
+    int              nTail;     //!< One past the index of the last item in this queue.
+} BATCHQUEUE;
+
+//! The state shared by the workers of one RomeEngineRunBatch() call.
+typedef struct BATCHRUN
+{
+    RT_BatchItem*    pItems;        //!< The caller's items.
+    int              nWorkers;      //!< The number of workers (and elements of @c pQueues).
+    BATCHQUEUE*      pQueues;       //!< One queue per worker.
+    CString          sArgs;         //!< The RomeInit() arguments for each worker's core.
+    CString          sDatabase;     //!< The database each worker's core opens.
+    RT_void*         pObserver;     //!< Passed through to @c pEventHandler.
+    RT_EventHandler  pEventHandler; //!< Invoked as each item finishes, or NULL.
+    CCriticalSection EventLock;     //!< Serializes calls to @c pEventHandler.
+    volatile LONG    nSucceeded;    //!< The number of items run without error.
+} BATCHRUN;
+
+//! The argument passed to each RomeEngineRunBatch() worker thread.
+typedef struct BATCHWORKER
+{
+    BATCHRUN*   pRun;       //!< The batch this worker belongs to.
+    int         nWorker;    //!< The index of this worker's queue in @c pRun->pQueues.
+} BATCHWORKER;
+
+
+//! Take the next item for a RomeEngineRunBatch() worker to run.
+//! Items come from the front of the worker's own queue, and when that is empty
+//!   they are stolen from the back of the queue with the most items left.
+//! @param Run      The batch being run.
+//! @param nWorker  The worker asking for an item.
+//! @param nItem    Returns the index of the item to run.
+//! @return TRUE if an item was taken, FALSE if no items are left in any queue.
+//!
+LOCAL BOOL BatchTakeItem(BATCHRUN& Run, int nWorker, int& nItem)
+{
+    {
+        BATCHQUEUE& Own = Run.pQueues[nWorker];
+        CSingleLock Lock(&Own.Lock, TRUE);
+        if (Own.nHead < Own.nTail)
+        {
+            nItem = Own.nHead++;
+            return TRUE;
+        }
     }
-    catch (...)
+
+    // Items are never added to a queue, so once every queue is empty the batch is done.
+    for (;;)
     {
-        try
+        int nVictim = -1;
+        int nMost = 0;
+        for (int i = 0; i < Run.nWorkers; i++)
         {
-            CString sInfo; sInfo.Format("RomeFileGetAttrDimCount: exception for Attr = '%s'.", (CString)pszAttr);
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
+            if (i == nWorker)
+                continue;
+            BATCHQUEUE& Other = Run.pQueues[i];
+            CSingleLock Lock(&Other.Lock, TRUE);
+            const int nLeft = Other.nTail - Other.nHead;
+            if (nLeft > nMost)
+            {
+                nMost = nLeft;
+                nVictim = i;
+            }
         }
-        catch (...)
+        if (nVictim < 0)
+            return FALSE;
+
+        // The victim may have emptied its queue since it was counted, so look again.
+        BATCHQUEUE& Victim = Run.pQueues[nVictim];
+        CSingleLock Lock(&Victim.Lock, TRUE);
+        if (Victim.nHead < Victim.nTail)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileGetAttrDimCount: exception in catch block.");
+            nItem = --Victim.nTail;
+            return TRUE;
         }
     }
 }
 
 
-//! Get the tag (type string) for a parameter.
-//! @param pApp    The Rome interface pointer obtained from RomeInit().
-//! @param pszAttr  The parameter name used by the catalog (e.g. "CLAY").
-//!   This can be a 'long' attr name with a remote prefix.
-//! @return The type string on success, or empty on failure or error.
-//!
-//! @see RomeCatalogGetAttrType(), GetParamTag().
-//! @RomeAPI Wrapper for CListing::GetTag().
+//! Run one RomeEngineRunBatch() item in a worker's core.
+//! @param pCore  The worker's core, with the batch database open.
+//! @param Item   The item to run.
+//! @return RX_TRUE on success, RX_FALSE if the outputs didn't fit in the item's buffer,
+//!   or #RX_FAILURE (-1) on error.
 //!
-ROME_API RT_CSTR RomeCatalogGetAttrTag(RT_App* pApp, RT_CNAME pszAttr)
+LOCAL RT_INT BatchRunItem(RT_App* pCore, RT_BatchItem& Item)
 {
-    try
+    RT_Files* pFiles = RomeGetFiles(pCore);
+    RT_FileObj* pFile = RomeFilesOpen(pFiles, Item.pszFile, 0);
+    if (pFile == NULL)
+        return RX_FAILURE;
+
+    RT_INT nResult = RX_TRUE;
+    if (Item.nInputs > 0)
     {
-	    // Switch to the app's MFC module state while in this scope.
-	    // This is required for many MFC functions to work correctly.
-	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+        RT_INT nSet = RomeFileSetAttrValues(pFile, Item.pInputs, Item.nInputs, RX_VARIANT_CATALOG);
+        if (nSet != Item.nInputs)
+            nResult = RX_FAILURE;
+    }
 
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pApp,                  "RomeCatalogGetAttrType: NULL Rome app pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!strempty(pszAttr),    "RomeCatalogGetAttrType: empty attr name.");
-        BOOL bValidApp = (pApp == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,             "RomeCatalogGetAttrType: invalid Rome pointer.");
-		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,              "RomeCatalogGetAttrType: RomeExit() has already been called.");
-#if USE_ROMEAPI_THREADIdS
-        THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,          "RomeFileGetAttrDimCount: Rome API function called on different thread from RomeInit().");
-#endif
+    if (nResult == RX_TRUE)
+    {
+        RT_BOOL bRun = RomeEngineRun(RomeGetEngine(pCore));
+        if (bRun != RX_TRUE)
+            nResult = RX_FAILURE;
+    }
+
+    if (nResult == RX_TRUE && Item.nOutputs > 0)
+    {
+        RT_INT nNeeded = RomeFileGetAttrValues(pFile, Item.pOutputs, Item.nOutputs, RX_VARIANT_CATALOG, Item.pOutBuf, Item.nOutBufLen);
+        if (nNeeded < 0)
+            nResult = RX_FAILURE;
+        else if ((RT_UINT)nNeeded > Item.nOutBufLen)
+            nResult = RX_FALSE;
+    }
+
+    // A file with inputs set would otherwise be returned, modified, when the next item opens it.
+    // Find the files which inputs chained through a pointer (e.g. "#RD:MAN_BASE_PTR:OP_DATE") went into,
+    //   since those were changed too. A chain of more than one pointer isn't followed; it closes every file.
+    CStringList Chained;
+    BOOL bCloseAll = FALSE;
+    for (int i = 0; i < Item.nInputs && !bCloseAll; i++)
+    {
+        CString sAttr = Item.pInputs[i].pszAttr;
+        if (sAttr.Left(4) != "#RD:")
+            continue;
+        int nColon = sAttr.Find(':', 4);
+        bCloseAll = (nColon < 0 || sAttr.Find("#RD:", nColon) >= 0);
+        if (bCloseAll)
+            break;
+        RT_CSTR pszTarget = RomeFileGetAttrValue(pFile, sAttr.Mid(4, nColon - 4), 0);
+        if (!strempty(pszTarget) && !Chained.Find(pszTarget))
+            Chained.AddTail(pszTarget);
+    }
+
+    RomeFileClose(pFile);
+    if (bCloseAll)
+        RomeFilesCloseAll(pFiles, 0);
+    else if (!Chained.IsEmpty())
+    {
+        // Other files (climates, soils, operations) weren't changed, so they stay open for the next item.
+        // A pointer to one of the file's own subobjects names no open file, and was closed with it.
+        // Only this worker's thread uses its core, so the names can be read without the API lock.
+        for (int i = RomeFilesGetCount(pFiles) - 1; i >= 0; i--)
+        {
+            RT_FileObj* pOpen = pFiles->GetFile(i);
+            if (pOpen == NULL || Chained.Find(pOpen->GetFileName()) == NULL)
+                continue;
+            pOpen = RomeFilesGetItem(pFiles, i);
+            if (pOpen)
+                RomeFileClose(pOpen);
+        }
+    }
 
-        ROME_API_NOLOCK();
+    return nResult;
+}
 
-        ParamType nType = (ParamType)RomeCatalogGetAttrType(pApp, pszAttr);
 
-        RT_CSTR pszTag = GetParamTag(nType);
+//! The thread procedure of a RomeEngineRunBatch() worker.
+//! Each worker runs its items in its own batch-mode core, so workers never wait on each other's API lock
+//!   while running items. Starting the core in RomeInit() is serialized with the other workers.
+//! @param pParam  The worker's #BATCHWORKER.
+//! @return 0 always. Results are reported in the items.
+//!
+LOCAL UINT AFX_CDECL BatchWorkerProc(LPVOID pParam)
+{
+    BATCHWORKER& Worker = *(BATCHWORKER*)pParam;
+    BATCHRUN& Run = *Worker.pRun;
 
-        return pszTag; // success
+    RT_App* pCore = RomeInit(Run.sArgs);
+    if (pCore && RomeDatabaseOpen(RomeGetDatabase(pCore), Run.sDatabase) != RX_TRUE)
+    {
+        RomeExit(pCore);
+        pCore = NULL;
     }
-    catch (...)
+
+    // A worker whose core failed to start still takes items, which fail,
+    //   so that every item is reported to the event handler.
+    int nItem;
+    while (BatchTakeItem(Run, Worker.nWorker, nItem))
     {
-        ASSERT(FALSE);
-        return ""; // failure
+        RT_BatchItem& Item = Run.pItems[nItem];
+        Item.nWorker = Worker.nWorker;
+        Item.nResult = pCore? BatchRunItem(pCore, Item): RX_FAILURE;
+        if (Item.nResult != RX_FAILURE)
+            InterlockedIncrement(&Run.nSucceeded);
+
+        if (Run.pEventHandler)
+        {
+            CSingleLock Lock(&Run.EventLock, TRUE);
+            Run.pEventHandler(Run.pObserver, RX_EVENT_BATCH_ITEM_DONE, &Item);
+        }
     }
+
+    if (pCore)
+        RomeExit(pCore);
+
+    return 0;
 }
 
-//! Get the integer type of a parameter.
-//! These are values of type enum #ParamType, which are exposed in "imoses.h".
-//! @param pApp    The Rome interface pointer obtained from RomeInit().
-//! @param pszAttr  The parameter name used by the catalog (e.g. "CLAY").
-//!   This can be a 'long' attr name with a remote prefix.
-//! @return The parameter integer type on success, or 0 (#RX_ATTR_NUL) on failure or error.
-//!
-//! @see RomeCatalogGetAttrTag(), enum ParamType.
-//! @RomeAPI Wrapper for CListing::GetType().
+
+//! Run many files at once, spread over a pool of worker threads.
+//! This replaces a loop which opens, sets, runs and reads each file in turn.
+//! Each worker creates its own core (see RomeInit() "/NewCore" and "/BatchMode") with the same arguments
+//!   and database as @p pApp, and runs its items in it without taking any other core's API lock.
+//!   Each worker does a full RomeInit(), which holds the process-wide init lock,
+//!   so the cores start one at a time. This costs one RomeInit() and RomeDatabaseOpen() per worker,
+//!   and only pays off when there are many more items than workers.
+//! Within a worker, files which no input changed (e.g. the climates and soils) stay open from one item to the next.
+//!   Files changed by an input chained through a pointer (e.g. "#RD:MAN_BASE_PTR:OP_DATE") are closed after the item.
+//! Items are split into one contiguous range per worker, and a worker which finishes
+//!   its range steals items from the end of the largest remaining range (work stealing),
+//!   since run times vary widely (e.g. with rotation length).
+//! @param pApp     The Rome interface pointer obtained from RomeInit().
+//!                 Its database must be open. It isn't otherwise used, and its open files are unaffected.
+//! @param[in,out] pItems  The items to run. For each item the worker:
+//! - Opens @c pszFile, as for RomeFilesOpen().
+//! - Sets its @c pInputs values, as for RomeFileSetAttrValues().
+//! - Runs the engine, as for RomeEngineRun().
+//! - Gets its @c pOutputs values into @c pOutBuf, as for RomeFileGetAttrValues().
+//! - Sets @c nWorker, and @c nResult to RX_TRUE on success, RX_FALSE if the outputs
+//!     didn't fit in @c pOutBuf, or #RX_FAILURE (-1) on error.
+//! @param nItems   The number of elements in @p pItems.
+//! @param nWorkers The number of worker threads to use, or 0 to use one per processor.
+//!                 This is limited to @p nItems and #RX_BATCH_MAXWORKERS.
+//! @param pObserver      An opaque pointer passed back to @p pEventHandler.
+//! @param pEventHandler  The event callback function to invoke as each item finishes, or NULL.
+//!   This is invoked on the worker's thread with event #RX_EVENT_BATCH_ITEM_DONE and the item
+//!   as event data. Calls are serialized, so the handler needn't be thread-safe, but it
+//!   holds up one worker and should return quickly.
+//! @return  The number of items which ran without error, or #RX_FAILURE (-1) on error.
+//!   This function returns when all items have finished.
+//!
+//! @note Files opened by name are run as saved in the database. To run an open file
+//!   with unsaved changes, pass its changes as @c pInputs, or save it first.
+//! @note This may be nested in another API call, e.g. from a listener (which holds the API lock of its core)
+//!   or a batch event handler. The workers take no lock which the caller may hold, except the init lock,
+//!   so within RomeInit() the items are run on this thread instead.
+//! @see RomeEngineRun(), RomeFileSetAttrValues(), RomeFileGetAttrValues(), RomeInit().
+//! @RomeAPI
 //!
-ROME_API RT_UINT RomeCatalogGetAttrType(RT_App* pApp, RT_CNAME pszAttr)
+ROME_API RT_INT RomeEngineRunBatch(RT_App* pApp, RT_BatchItem* pItems, RT_INT nItems, RT_INT nWorkers, RT_void* pObserver, RT_EventHandler pEventHandler)
 {
     try
     {
@@ -1562,167 +5969,124 @@ ROME_API RT_UINT RomeCatalogGetAttrType(RT_App* pApp, RT_CNAME pszAttr)
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_ZERO(pApp,              "RomeCatalogGetAttrType: NULL Rome app pointer.");
-        BOOL bValidApp = (pApp == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_ZERO(bValidApp,         "RomeCatalogGetAttrType: Invalid Rome app pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pApp,               "RomeEngineRunBatch: NULL Rome app pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nItems >= 0,        "RomeEngineRunBatch: negative item count.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pItems || !nItems,  "RomeEngineRunBatch: NULL items pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nWorkers >= 0,      "RomeEngineRunBatch: negative worker count.");
+        BOOL bValidApp = RomeCoreIsValid(pApp);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,          "RomeEngineRunBatch: invalid Rome app pointer.");
 		BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bExited,          "RomeCatalogGetAttrType: RomeExit() has already been called.");
-        ASSERT_OR_SETERROR_AND_RETURN_ZERO(pszAttr,           "RomeCatalogGetAttrType: NULL attr name.");
-        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!strempty(pszAttr),"RomeCatalogGetAttrType: Empty attr name.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeEngineRunBatch: RomeExit() has already been called.");
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
         BOOL bSameThread = (pApp->m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bSameThread,      "RomeCatalogGetAttrType: Rome API function called on different thread from RomeInit().");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeEngineRunBatch: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_NOLOCK();
-
-	    // Does not require command logging.
-
-        // Find the catalog listing for this parameter.
-        CListing* pListing = pApp->AttrCatalog.GetListing(pszAttr);
-        TEST_OR_SETERROR_AND_RETURN_ZERO(pListing,            "RomeCatalogGetAttrType: Parameter not found.");
-
-        // Get the type from the catalog listing.
-        ParamType nType = pListing->GetType();
-
-        // Handle case of a float which is really an integer.
-        if (nType == RX_ATTR_FLT && pListing->GetFlag(ACF_INTEGRAL))
-            nType = ATTR_INT;
+        BATCHRUN Run;
+        Run.pItems = pItems;
+        Run.pObserver = pObserver;
+        Run.pEventHandler = pEventHandler;
+        Run.nSucceeded = 0;
 
-        return nType; // success
-    }
-    catch (...)
-    {
-        ASSERT(FALSE);
-        return RX_ATTR_NUL; // failure
-    }
-}
+        {
+            // Only hold the app's lock while reading its settings.
+            // The workers use their own cores, so the app stays usable while the batch runs.
+            ROME_API_WRITELOCK(pApp);
 
+	        ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST, "user", "RomeEngineRunBatch", "items='%d' workers='%d'/>\n", nItems, nWorkers));
 
-//! @} // Rome Catalog functions
-/////////////////////////////////////////////////////////////////////////////
-//! @name Rome Database functions
-//! @{
+            Run.sDatabase = pApp->Files.m_sCurrentDatabase;
+            Run.sArgs = pApp->m_sCommandLine;
+        }
 
-// Verify that RX_ and DBFIND_ flags match each other.
-#if (RX_DBFILEINFO_QUERY   != DBFIND_INFO_QUERY)
-  #error "error: compile-time test failed: (RX_DBFILEINFO_QUERY   != DBFIND_INFO_QUERY)"
-#endif
-#if (RX_DBFILEINFO_NAME    != DBFIND_INFO_NAME )
-  #error "error: compile-time test failed: (RX_DBFILEINFO_NAME    != DBFIND_INFO_NAME )"
-#endif
-#if (RX_DBFILEINFO_PATH    != DBFIND_INFO_PATH )
-  #error "error: compile-time test failed: (RX_DBFILEINFO_PATH    != DBFIND_INFO_PATH )"
-#endif
-#if (RX_DBFILEINFO_RIGHT   != DBFIND_INFO_RIGHT)
-  #error "error: compile-time test failed: (RX_DBFILEINFO_RIGHT   != DBFIND_INFO_RIGHT)"
-#endif
-#if (RX_DBFILEINFO_TABLE   != DBFIND_INFO_TABLE)
-  #error "error: compile-time test failed: (RX_DBFILEINFO_TABLE   != DBFIND_INFO_TABLE)"
-#endif
-#if (RX_DBFILEINFO_OUTER   != DBFIND_INFO_OUTER)
-  #error "error: compile-time test failed: (RX_DBFILEINFO_OUTER   != DBFIND_INFO_OUTER)"
-#endif
-#if (RX_DBFILEINFO_LEFT    != DBFIND_INFO_LEFT )
-  #error "error: compile-time test failed: (RX_DBFILEINFO_LEFT    != DBFIND_INFO_LEFT )"
-#endif
-#if (RX_DBFILEINFO_FULL    != DBFIND_INFO_FULL )
-  #error "error: compile-time test failed: (RX_DBFILEINFO_FULL    != DBFIND_INFO_FULL )"
-#endif
-#if (RX_DBFILEINFO_OWNER   != DBFIND_INFO_OWNER)
-  #error "error: compile-time test failed: (RX_DBFILEINFO_OWNER   != DBFIND_INFO_OWNER)"
-#endif
-#if (RX_DBFILEINFO_GROUP   != DBFIND_INFO_GROUP)
-  #error "error: compile-time test failed: (RX_DBFILEINFO_GROUP   != DBFIND_INFO_GROUP)"
-#endif
-#if (RX_DBFILEINFO_PERMS   != DBFIND_INFO_PERMS)
-  #error "error: compile-time test failed: (RX_DBFILEINFO_PERMS   != DBFIND_INFO_PERMS)"
-#endif
-#if (RX_DBFILEINFO_DATE    != DBFIND_INFO_DATE )
-  #error "error: compile-time test failed: (RX_DBFILEINFO_DATE    != DBFIND_INFO_DATE )"
-#endif
-#if (RX_DBFILEINFO_DATA    != DBFIND_INFO_DATA )
-  #error "error: compile-time test failed: (RX_DBFILEINFO_DATA    != DBFIND_INFO_DATA )"
-#endif
-#if (RX_DBFILEINFO_FOLDER   != DBFIND_INFO_FOLDER)
-  #error "error: compile-time test failed: (RX_DBFILEINFO_FOLDERS   != DBFIND_INFO_FOLDERS)"
-#endif
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!Run.sDatabase.IsEmpty(), "RomeEngineRunBatch: no database is open.");
 
+        // The first argument is the name of the calling app, which RomeInit() ignores.
+        if (Run.sArgs.IsEmpty())
+            Run.sArgs = "RomeDLL";
+        Run.sArgs += " /NewCore /BatchMode";
 
-//! Close a named database.
-//! @param pDatabase  The Rome database interface pointer obtained from RomeGetDatabase().
-//! @param pszDatabase  The name of the database file to close.
-//!   Currently this argument is ignored. It will be used when the Rome filesystem has the ability
-//!   to open multiple database simultaneously.
-//! @return  RX_TRUE on success, RX_FALSE on failure.
-//!
-//! @warning This will fail if there are files open that need to be closed first.
-//! @see RomeDatabaseOpen().
-//! @RomeAPI Wrapper for CFileSys::CloseDatabase().
-//!
-ROME_API RT_BOOL RomeDatabaseClose(RT_Database* pDatabase, RT_CSTR pszDatabase /*= NULL*/)
-{
-    try
-    {
-        // Switch to the app's MFC module state while in this scope.
-        // This is required for many MFC functions to work correctly.
-        AFX_MANAGE_STATE(AfxGetAppModuleState());
+        if (nItems == 0)
+            return 0;
 
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pDatabase,      "RomeDatabaseClose: null database pointer.");
-        BOOL bValidApp = (&pDatabase->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,      "RomeDatabaseClose: invalid database pointer.");
-		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,       "RomeDatabaseClose: RomeExit() has already been called.");
-#if USE_ROMEAPI_THREADIdS
-        THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,   "RomeDatabaseClose: Rome API function called on different thread from RomeInit().");
-#endif
+        if (nWorkers == 0)
+        {
+            SYSTEM_INFO SysInfo;
+            GetSystemInfo(&SysInfo);
+            nWorkers = SysInfo.dwNumberOfProcessors;
+        }
+        nWorkers = min(nWorkers, min(nItems, RX_BATCH_MAXWORKERS));
+        nWorkers = max(nWorkers, 1);
+        Run.nWorkers = nWorkers;
+
+        // Give each worker an equal contiguous range of the items to start with.
+        BATCHQUEUE aQueues[RX_BATCH_MAXWORKERS];
+        BATCHWORKER aWorkers[RX_BATCH_MAXWORKERS];
+        CWinThread* aThreads[RX_BATCH_MAXWORKERS];
+        Run.pQueues = aQueues;
+        for (int i = 0; i < nWorkers; i++)
+        {
+            aQueues[i].nHead = (int)(((__int64)nItems * i) / nWorkers);
+            aQueues[i].nTail = (int)(((__int64)nItems * (i+1)) / nWorkers);
+            aWorkers[i].pRun = &Run;
+            aWorkers[i].nWorker = i;
+        }
+        for (int i = 0; i < nItems; i++)
+        {
+            pItems[i].nWorker = -1;
+            pItems[i].nResult = RX_FAILURE;
+        }
 
-        ROME_API_LOCK();
+        // Within RomeInit() a worker couldn't create its core, so no workers are started.
+        int nThreads = 0;
+        for (int i = 0; i < nWorkers && RomeInitDepth == 0; i++)
+        {
+            CWinThread* pThread = AfxBeginThread(BatchWorkerProc, &aWorkers[i], THREAD_PRIORITY_NORMAL, 0, CREATE_SUSPENDED);
+            if (pThread == NULL)
+                continue;   // The other workers will steal this worker's items.
+            pThread->m_bAutoDelete = FALSE;
+            pThread->ResumeThread();
+            aThreads[nThreads++] = pThread;
+        }
 
-	    CLogFileElement1(LOGELEM_HIST, "user", "RomeDatabaseClose", "file='%s'/>\n", (CString)XMLEncode(pszDatabase));
-#if USE_ROMESHELL_LOGGING
-        if (!strempty(pszDatabase))
-            LogFilePrintf1(LOG_SHELL, "RomeDatabaseClose \"%s\"\n", pszDatabase);
-        else
-            LogFilePrintf0(LOG_SHELL, "RomeDatabaseClose\n");
-#endif
+        // If no threads were started, run the items on this thread instead.
+        if (nThreads == 0)
+            BatchWorkerProc(&aWorkers[0]);
 
-        pDatabase->CloseFiles(CVF_CloseTempFiles | CVF_CloseComboFiles |CVF_CloseLazyFiles);
-	    if (pDatabase->FilesToClose(false))
-		    return RX_FALSE; // handle this error
+        for (int i = 0; i < nThreads; i++)
+        {
+            WaitForSingleObject(aThreads[i]->m_hThread, INFINITE);
+            delete aThreads[i];
+        }
 
-	    // Close the current database.
-	    RT_BOOL bClosed = pDatabase->CloseDatabase();
-	    return bClosed;
+        return Run.nSucceeded;
     }
     catch (...)
     {
         try
         {
-            CString sInfo; sInfo.Format("RomeDatabaseClose: exception for Database = '%s'.", CString(pszDatabase));
-            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,   sInfo);
+            CString sInfo; sInfo.Format("RomeEngineRunBatch: exception for %d items.", nItems);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,   "RomeDatabaseClose: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeEngineRunBatch: exception in catch block.");
         }
     }
 }
 
 
-//! Delete a file record from the database.
-//! @param pDatabase  The Rome database interface pointer obtained from RomeGetDatabase().
-//! @param pszPathname  The name of the file to delete. (e.g. "soils\default")
-//! @param nFlags  Flags which affect its behavior.
-//!   This argument is currently ignored (unimplemented).
+//! Set the Autorun flag in Rusle2.
+//! When the autorun flag is set, after each value changes it will recalculate
+//!   the outputs, leading to much slower performance.
+//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
+//! @param bAutorun The new autorun state to set.
 //!
-//! @return RX_TRUE on success, RX_FALSE on failure.
-//! @RomeAPI Wrapper for CFileSys::RemoveRecordFromDatabase().
+//! @see RomeEngineGetAutorun(), RomeEngineRun().
+//! @RomeAPI Wrapper for CEngineBase::SetUpdating().
 //!
-ROME_API RT_BOOL RomeDatabaseFileDelete(RT_Database* pDatabase, RT_CSTR pszPathname, RT_UINT nFlags)
+ROME_API RT_void RomeEngineSetAutorun(RT_Engine* pEngine, RT_BOOL bAutorun)
 {
     try
     {
@@ -1730,70 +6094,108 @@ ROME_API RT_BOOL RomeDatabaseFileDelete(RT_Database* pDatabase, RT_CSTR pszPathn
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        UNUSED(nFlags);
-
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pDatabase,              "RomeDatabaseFileDelete: NULL database pointer.");
-        BOOL bValidApp = (&pDatabase->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,				"RomeDatabaseFileDelete: invalid database pointer.");
-		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,				"RomeDatabaseFileDelete: RomeExit() has already been called.");
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!strempty(pszPathname), "RomeDatabaseFileDelete: empty path name.");
-		ASSERT(nFlags == 0);	// This argument is unused
+        ASSERT_OR_SETERROR_AND_RETURN(pEngine,                    "RomeEngineSetAutorun: NULL engine pointer.");
+        BOOL bValidEngine = RomeCoreIsValid(&pEngine->Core);
+        ASSERT_OR_SETERROR_AND_RETURN(bValidEngine,               "RomeEngineSetAutorun: invalid Rome engine pointer.");
+		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN(!bExited,                   "RomeEngineSetAutorun: RomeExit() has already been called.");
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,           "RomeDatabaseFileDelete: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN(!bSameThread,               "RomeEngineSetAutorun: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&pEngine->Core);
 
-	    CLogFileElement2(LOGELEM_HIST, "user", "RomeDatabaseFileDelete", "file='%s' flags='%d'/>\n", (CString)XMLEncode(pszPathname), nFlags);
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeEngineSetAutorun", "flags='%d'/>\n", bAutorun));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf2(LOG_SHELL, "RomeDatabaseFileDelete \"%s\" %d\n", pszPathname, nFlags);
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeEngineSetAutorun %d\n", bAutorun));
 #endif
 
-	    // Delete the record.
-	    RT_BOOL bDeleted = pDatabase->RemoveRecordFromDatabase(pszPathname);
-	    return bDeleted;
+	    const UINT nFlags = (bAutorun? UPDATE_ON: UPDATE_OFF) | UPDATE_SHOW | UPDATE_USER;
+	    pEngine->SetUpdating(nFlags);
     }
     catch (...)
     {
-        try
-        {
-            CString sInfo; sInfo.Format("RomeDatabaseFileDelete: exception for Pathname = '%s', Flags = 0x%X.", CString(pszPathname), nFlags);
-            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,   sInfo);
-        }
-        catch (...)
-        {
-            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,   "RomeDatabaseFileDelete: exception in catch block.");
-        }
+        ASSERT_OR_SETERROR_AND_RETURN(0, "RomeEngineSetAutorun: exception.");
     }
 }
 
 
-//! Retrieve information about a file in the database.
-//! @param pDatabase    The Rome database interface pointer obtained from RomeGetDatabase().
-//! @param pszFilename  The name of the file. (e.g. "soils\default")
-//! @param nInfoType    The type of information to retrieve:
-//! - #RX_DBFILEINFO_QUERY	 0 // info: (string result of query)
-//! - #RX_DBFILEINFO_NAME	 1 // info:                name
-//! - #RX_DBFILEINFO_PATH	 2 // info:         path
-//! - #RX_DBFILEINFO_RIGHT	 3 // info:         path \ name
-//! - #RX_DBFILEINFO_TABLE	 4 // info: table
-//! - #RX_DBFILEINFO_OUTER	 5 // info: table \        name
-//! - #RX_DBFILEINFO_LEFT	 6 // info: table \ path
-//! - #RX_DBFILEINFO_FULL	 7 // info: table \ path \ name
-//! - #RX_DBFILEINFO_OWNER	 8 // info: owner field
-//! - #RX_DBFILEINFO_GROUP	 9 // info: group field
-//! - #RX_DBFILEINFO_PERMS	10 // info: perms field
-//! - #RX_DBFILEINFO_DATE	11 // info: date  field
-//! - #RX_DBFILEINFO_DATA	12 // info: data  field
-//! - #RX_DBFILEINFO_FOLDER	13 // info: is this a folder? return "0" or "1".
+//! Set whether the computational engine should display the calc function
+//!   names in the status bar.
+//! @note Messages are now locked using a locked count, so unlocking
+//!   must be done at least as many times as locking in order to show messages.
+//! This function may still be called as if the lock state was a simple
+//!   boolean, and should still work the same if calls aren't nested.
+//! @note Changed to lock messages with a FALSE argument, which matches
+//!   the old behavior in the import DLLs.
+//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
+//! @param bShowMessages Boolean value for whether to lock showing messages (FALSE)
+//!    or unlock showing messages (TRUE).
 //!
-//! @return  The information as a string, or NULL on failure.
-//! @RomeAPI Wrapper for DbFindInfo().
+//! @return  The old locked state, or #RX_FAILURE on error.
+//! @RomeAPI Wrapper for CEngineBase::ShowStatus().
 //!
-ROME_API RT_CSTR RomeDatabaseFileInfo(RT_Database* pDatabase, RT_CSTR pszFilename, RT_UINT nInfoType)
+ROME_API RT_BOOL RomeEngineShowStatus(RT_Engine* pEngine, RT_BOOL bShowMessages)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pEngine,            "RomeEngineShowStatus: NULL engine pointer.");
+        BOOL bValidEngine = RomeCoreIsValid(&pEngine->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidEngine,       "RomeEngineShowStatus: invalid Rome engine pointer.");
+		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeEngineShowStatus: RomeExit() has already been called.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeEngineShowStatus: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(&pEngine->Core);
+
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeEngineShowStatus", "flags='%d'/>\n", bShowMessages));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "//RomeEngineShowStatus %d\n", bShowMessages));
+#endif
+
+	    return pEngine->ShowStatus(bShowMessages);
+    }
+    catch (...)
+    {
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeEngineShowStatus: exception.");
+    }
+}
+
+
+//! @} // Rome Engine functions
+/////////////////////////////////////////////////////////////////////////////
+//! @name Rome File functions
+//! @{
+
+//! Make a copy of an open file, for running variations of it (e.g. parameter sweeps).
+//! The copy is opened under a new name with its own parameter values, and
+//!   the source file is unchanged. Nothing is written to the database.
+//! This is a full copy: the file is saved to a private file under the new name and opened
+//!   from it, so all its own values (and those of its embedded subobjects) are copied,
+//!   and the copy is calculated from scratch when it is opened, as any opened file is.
+//!   It costs about as much as saving the file and opening it again.
+//! Only the files it points to (climate, soil, management, etc.) aren't copied:
+//!   the copy's pointer parameters resolve to the same open files as the source's.
+//! @param pFile       The Rome file to copy.
+//! @param pszNewName  The fullname to give the copy (e.g. "profiles\sweep\1"),
+//!   or NULL / empty to generate a unique name from the source's name.
+//! @return  A pointer to the opened copy, or NULL on failure.
+//!
+//! @note The copy must be released by calling RomeFileClose().
+//! @see RomeFileClose(), RomeFileSaveAsEx(), RomeFilesOpen().
+//! @RomeAPI Wrapper for CFileSys::Save(), CFileSys::OpenOrCreateFile().
+//!
+ROME_API RT_FileObj* RomeFileClone(RT_FileObj* pFile, RT_CSTR pszNewName)
 {
     try
     {
@@ -1801,109 +6203,180 @@ ROME_API RT_CSTR RomeDatabaseFileInfo(RT_Database* pDatabase, RT_CSTR pszFilenam
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pDatabase,              "RomeDatabaseFileInfo: NULL database pointer.");
-        BOOL bValidApp = (&pDatabase->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,              "RomeDatabaseFileInfo: invalid database pointer.");
-		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,               "RomeDatabaseFileInfo: RomeExit() has already been called.");
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!strempty(pszFilename), "RomeDatabaseFileInfo: empty file name.");
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pDatabase->IsOpen(),    "RomeDatabaseFileInfo: database not open.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pFile,              "RomeFileClone: NULL file pointer.");
+        CRomeCore& Core = pFile->Core;
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,          "RomeFileClone: invalid file pointer.");
+		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,           "RomeFileClone: RomeExit() has already been called.");
+        BOOL bValidFile = CFileObj::IsValid(pFile);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidFile,         "RomeFileClone: invalid file pointer.");
+#ifdef USE_ROMEAPI_REFCOUNT
+        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidRefs,         "RomeFileClone: invalid file reference count.");
+#endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,           "RomeDatabaseFileInfo: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,       "RomeFileClone: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&Core);
+
+        // Wait for the stack to finish.
+        // This makes sure that changes that would be made by functions on the stack
+        //   are in the copy.
+	    StatFinishUpdates(Core.Engine);
+
+        CString sFile = pFile->GetFileName();
+        CString sNewName = pszNewName;
+        if (sNewName.IsEmpty())
+        {
+            // Generate a name which isn't in use yet.
+            for (int nClone = 1; sNewName.IsEmpty() || Core.Files.FileExists(sNewName); nClone++)
+                sNewName.Format("%s (%d)", sFile, nClone);
+        }
+        TEST_OR_SETERROR_AND_RETURN_NULL(!Core.Files.FileExists(sNewName), "RomeFileClone: a file of that name already exists.");
 
-	    CLogFileElement2(LOGELEM_HIST, "user", "RomeDatabaseFileInfo", "file='%s' type='%d'/>\n", (CString)XMLEncode(pszFilename), nInfoType);
+        ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileClone", "file='%s' new='%s'>\n", XMLEncode(sFile), XMLEncode(sNewName)));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf2(LOG_SHELL, "RomeDatabaseFileInfo \"%s\" %d\n", pszFilename, nInfoType);
+        ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "RomeFileClone \"%s\" \"%s\"\n", sFile, sNewName));
 #endif
 
-	    DBFIND* pFind = DbFindOpen(pDatabase->GetDatalink(), pszFilename, DBSYS_FIND_BOTH | DBSYS_FIND_EXACT);
-	    ASSERT_OR_RETURN_NULL(pFind);
+        {
+	        FILEOBJ_READLOCK(pFile);
+            Core.SetActiveObj(pFile);
 
-	    LPCSTR pszInfo = DbFindInfo(pFind, nInfoType);
-	    DbFindClose(pFind);
+            // Save a private copy under the new name.
+            // This doesn't write the database or mark the source file clean.
+            BOOL bSaved = Core.Files.Save(pFile, sNewName, FSF_PRIVATE);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(bSaved,         "RomeFileClone: failed to copy file.");
+        }
 
-	    return pszInfo;
+	    FILESYS_WRITELOCK();
+
+        // Open the private copy. It must not be created if the save above didn't make it.
+        CFileObj* pClone = Core.Files.OpenOrCreateFile(sNewName, RX_FILESOPEN_PRIVATE | OMF_NO_CREATE | OMF_LOG_HIST | OMF_CMD_USER);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pClone,             "RomeFileClone: failed to open copy.");
+
+#ifdef USE_ROMEAPI_REFCOUNT
+        //! @note This increments the reference count of times this pointer is returned by the Rome API.
+        //! The file will be closed when this count drops to 0.
+        VERIFY(pClone->m_nRomeRefs++ >= 0);
+#endif
+
+	    return pClone;
     }
     catch (...)
     {
         try
         {
-            CString sInfo; sInfo.Format("RomeDatabaseFileInfo: exception for Filename = '%s', Type = %d.", CString(pszFilename), nInfoType);
+            CString sInfo; sInfo.Format("RomeFileClone: exception for File = '0x%08X', NewName = '%s'.", pFile, (CString)pszNewName);
             ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeDatabaseFileInfo: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeFileClone: exception in catch block.");
         }
     }
 }
 
 
-//! Retrieve information about a file in the database.
-//! See RomeDatabaseFileInfo() [above] for full documentation.
+//! Close a file, for RomeFileClose().
+//! The caller must have validated its argument, released its reference and hold the API lock.
+//! @return  RX_TRUE if the file was closed/reloaded, otherwise RX_FALSE.
 //!
-//! This version is required for use by Intel Fortran, which can't use functions
-//!   which return a string pointer. Instead it must have its first 2 arguments
-//!   be a pointer to a buffer and its length, to return the string in.
-//!   The function must have a return type of void.
-//! @param pBuf       The pointer to a buffer to return a NUL-terminated string in.
-//! @param nBufLen    The length of the buffer to return a NUL-terminated string in.
-//! @param pDatabase  The Rome database interface pointer obtained from RomeGetDatabase().
-//! @param pszFilename  The name of the file. (e.g. "soils\default")
-//! @param nInfoType    The type of information to retrieve.
+LOCAL RT_BOOL FileClose(CFileObj* pFile)
+{
+    CRomeCore& Core = pFile->Core;
+
+    // Verify that the engine is finished before we alter the filesystem.
+    ASSERT(Core.Engine.IsFinished());
+
+    // Close the file without saving, if it has no open references..
+    AttrHandlesInvalidate(pFile->Core);
+    RT_BOOL bClosed = pFile->CloseView(CVF_NOSAVE);
+    FileBaselinesPrune(Core, FALSE);
+    return bClosed;
+}
+
+
+//! Close an open file in the Rome filesystem.
+//! This also deletes a top-level file itself unless it is of type #OBJT_NOCLOSE or #OBJT_NOCLOSE_LAZY,
+//!   or it is a temporary file.
+//! @param pFile pointer to a Rome file.
+//! @return  RX_TRUE if the file was closed/reloaded, otherwise RX_FALSE.
+//!   Returns #RX_FAILURE on error.
 //!
-//! @RomeAPI Wrapper for RomeDatabaseFileInfo().
-//! @FortranAPI This function allows calling RomeDatabaseFileInfo() from Fortran.
+//! @see RomeFilesGetItem(), RomeFilesOpen(), RomeFilesCloseAll().
+//! @RomeAPI Wrapper for CFileObj::CloseView().
 //!
-ROME_API RT_void RomeDatabaseFileInfoF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_Database* pDatabase, RT_CSTR pszFilename, RT_UINT nInfoType)
+ROME_API RT_BOOL RomeFileClose(CFileObj* pFile)
 {
     try
     {
-        // Does not require AFX_MANAGE_STATE() macro.
+        // Switch to the app's MFC module state while in this scope.
+        // This is required for many MFC functions to work correctly.
+        AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-	    // Switch to the app's MFC module state while in this scope.
-	    // This is required for many MFC functions to work correctly.
-	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,            "RomeFileClose: NULL file pointer.");
+        CRomeCore& Core = pFile->Core;
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,        "RomeFileClose: invalid file system pointer.");
+		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,         "RomeFileClose: RomeExit() has already been called.");
+        BOOL bValidFile = CFileObj::IsValid(pFile);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,       "RomeFileClose: invalid file pointer.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,     "RomeFileClose: Rome API function called on different thread from RomeInit().");
+#endif
 
-		// Validate arguments unique to the Fortran function version.
-		// The remaining arguments will be validated in the normal Rome API call.
-        ASSERT_OR_SETERROR_AND_RETURN(pBuf,           "RomeDatabaseFileInfoF: NULL buffer pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN(nBufLen > 0,    "RomeDatabaseFileInfoF: non-positive buffer length.");
+#ifdef USE_ROMEAPI_REFCOUNT
+        //! @note This decrements the reference count of times this pointer is returned by the Rome API.
+        //! The file will not actually be closed until this count drops to 0.
+        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,       "RomeFileClose: invalid file reference count.");
+        VERIFY(pFile->m_nRomeRefs-- >= 1);
+#endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&Core);
 
-        // Does not require command logging.
+        // In batch mode, only record the call in the diagnostic ring.
+        BATCHCORE* pBatch = CoreGetBatch(Core);
+        if (pBatch)
+        {
+            RT_BOOL bClosed = FileClose(pFile);
+            BatchLog(pBatch, "RomeFileClose", NULL, 0, bClosed);
+            return bClosed;
+        }
 
-        LPCSTR pszInfo = RomeDatabaseFileInfo(pDatabase, pszFilename, nInfoType);
-        CopyStrF(pBuf, nBufLen, pszInfo);
+        CString sFile = pFile->GetFileName();
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileClose", "file='%s'>\n", XMLEncode(sFile)));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeFileClose \"%s\"\n", sFile));
+#endif
+
+        return FileClose(pFile);
     }
     catch (...)
     {
-        try
-        {
-            if (pBuf && nBufLen > 0)
-                *pBuf = 0;
-            CString sInfo; sInfo.Format("RomeDatabaseFileInfoF: exception for Buffer = '0x%08X', Length = %d, Filename = '%s', Type = %d.", pBuf, nBufLen, CString(pszFilename), nInfoType);
-            ASSERT_OR_SETERROR_AND_RETURN(0,         sInfo);
-        }
-        catch (...)
-        {
-            ASSERT_OR_SETERROR_AND_RETURN(0,         "RomeGetPropertyStr: exception in catch block.");
-        }
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeFileClose: exception.");
     }
 }
 
 
-//! Get a pointer to the Rome interface from the database interface.
-//! @param pDatabase  The Rome database interface pointer obtained from RomeGetDatabase().
-//! @return the interface pointer, or NULL on failure.
+//! @deprecated This function should not be used.
+//!   Use RomeFileClose() instead.
 //!
-ROME_API RT_App* RomeDatabaseGetApp(RT_Database* pDatabase)
+//! Delete a Rome file from memory.
+//! @param pFile pointer to a Rome file.
+//! @return #RX_FAILURE on error.
+//!
+//! @RomeAPI Wrapper for CFileSys::DeleteFile().
+//!
+ROME_API RT_BOOL RomeFileDelete(CFileObj* pFile)
 {
     try
     {
@@ -1911,45 +6384,63 @@ ROME_API RT_App* RomeDatabaseGetApp(RT_Database* pDatabase)
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pDatabase,              "RomeDatabaseGetApp: NULL database pointer.");
-        BOOL bValidApp = (&pDatabase->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,              "RomeDatabaseGetApp: invalid database pointer.");
-		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,               "RomeDatabaseGetApp: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,            "RomeFileDelete: NULL file pointer.");
+        BOOL bValidApp = RomeCoreIsValid(&pFile->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,        "RomeFileDelete: invalid file system pointer.");
+		BOOL bExited = pFile->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,         "RomeFileDelete: RomeExit() has already been called.");
+        BOOL bValidFile = CFileObj::IsValid(pFile);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,       "RomeFileDelete: invalid file pointer.");
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,           "RomeDatabaseGetApp: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,     "RomeFileDelete: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+#ifdef USE_ROMEAPI_REFCOUNT
+        //! @note This bypasses the reference count of times this pointer is returned by the Rome API.
+        //! Normally the file would not be closed until this count drops to 0. However, this function forces the file to close.
+        VERIFY(pFile->m_nRomeRefs-- >= 1);
+#endif
 
-        // Does not require command logging.
+        ROME_API_WRITELOCK(&pFile->Core);
 
-        CRomeCore* pRomeCore = &pDatabase->Core;
-        return pRomeCore;
+        CString sFile = pFile->GetFileName();
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeFileDelete", "file='%s'/>\n", XMLEncode(sFile)));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeFileDelete \"%s\"\n", sFile));
+#endif
+
+        AttrHandlesInvalidate(pFile->Core);
+	    pFile->Core.Files.DeleteFile(pFile);
+	    return RX_TRUE;
     }
     catch (...)
     {
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(0,        "RomeDatabaseGetApp: exception.");
+        try
+        {
+            CString sFile = pFile? pFile->GetFileName(): "NULL";
+            CString sInfo; sInfo.Format("RomeFileDelete: exception for File = '%s'.", sFile);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,     sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,     "RomeFileDelete: exception in catch block.");
+        }
     }
 }
 
 
-//! Get the read-only state of the database.
-//! A database may be read-only for many reasons:
-//! - The database file is read-only.
-//! - The database file is on a read-only filesystem.
-//! - The user only has read access to the database.
-//! - The connection has been set to read-only programmatically.
-//!
-//! @param pDatabase  The Rome database interface pointer obtained from RomeGetDatabase().
+//! Return the [unique] instance of a named parameter in a given object.
+//! This will return an existing instance if there already is one.
+//! @param pFile    The Rome file to get the attr in.
+//! @param pszAttr  The parameter name used by the catalog (e.g. "CLAY").
+//!   This can be a 'long' attr name with a remote prefix.
 //!
-//! @return RX_TRUE if read-only, RX_FALSE if writeable, and #RX_FAILURE on error.
-//!   Returns RX_TRUE for a null @p pDatabase argument.
-//! @RomeAPI Wrapper for CFileSys::IsReadOnly().
+//! @return  A pointer to the attr in the given file, or NULL on failure.
+//! @RomeAPI Wrapper for FindOrCreate().
 //!
-ROME_API RT_BOOL RomeDatabaseGetReadOnly(RT_Database* pDatabase)
+ROME_API RT_Attr* RomeFileGetAttr(CFileObj* pFile, RT_CNAME pszAttr)
 {
     try
     {
@@ -1957,54 +6448,63 @@ ROME_API RT_BOOL RomeDatabaseGetReadOnly(RT_Database* pDatabase)
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_VALUE(pDatabase,				"RomeDatabaseGetReadOnly: NULL database pointer.", RX_TRUE);
-        BOOL bValidApp = (&pDatabase->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,            "RomeDatabaseGetReadOnly: invalid database pointer.");
-		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,             "RomeDatabaseGetReadOnly: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pFile,             "RomeFileGetAttr: NULL file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!strempty(pszAttr),"RomeFileGetAttr: empty attr name.");
+        BOOL bValidApp = RomeCoreIsValid(&pFile->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,         "RomeFileGetAttr: invalid file pointer.");
+		BOOL bExited = pFile->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,          "RomeFileGetAttr: RomeExit() has already been called.");
+        BOOL bValidFile = CFileObj::IsValid(pFile);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidFile,        "RomeFileGetAttr: invalid file pointer.");
+#ifdef USE_ROMEAPI_REFCOUNT
+        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidRefs,        "RomeFileGetAttr: invalid file reference count.");
+#endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,         "RomeDatabaseGetReadOnly: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,      "RomeFileGetAttr: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&pFile->Core);
 
-	    CLogFileElement0(LOGELEM_HIST, "user", "RomeDatabaseGetReadOnly", "/>\n");
+        CString sFile = pFile->GetFileName();
+	    ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileGetAttr", "file='%s' attr='%s'>\n", XMLEncode(sFile), pszAttr));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf0(LOG_SHELL, "RomeDatabaseGetReadOnly\n");
+        ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "//RomeFileGetAttr \"%s\" \"%s\"\n", sFile, pszAttr));
 #endif
 
-	    RT_BOOL bReadOnly = pDatabase->IsReadOnly();
-	    return bReadOnly;
+        FILEOBJ_READLOCK(pFile);
+	    return StatFindOrCreate(pszAttr, pFile);
     }
     catch (...)
     {
         try
         {
-            CString sInfo; sInfo.Format("RomeDatabaseGetReadOnly: exception for Database = 0x08%X.", pDatabase);
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, sInfo);
+            CString sInfo; sInfo.Format("RomeFileGetAttr: exception for File = '0x%08X', Attr = '%s'.", pFile, (CString)pszAttr);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,     sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeDatabaseGetReadOnly: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,     "RomeFileGetAttr: exception in catch block.");
         }
     }
 }
 
 
-//! Open a new database for use by Rome.
-//! @param pDatabase    The Rome database interface pointer obtained from RomeGetDatabase().
-//! @param pszDatabase  The fullname of the database file to open on disk.
-//!   The argument "#DefaultDatabase" (case-insensitive)
-//!     will open the default database (usually "moses.gdb").
-//! @return RX_TRUE on success, RX_FALSE / #RX_FAILURE on failure.
+//! Get the size of an attribute's dimension.
+//! This will create an attr that doesn't exist yet.
+//! The attr must be requested in the correct file type.
+//! @param pFile    The Rome file to get the attr in.
+//! @param pszAttr  The parameter name used by the catalog (e.g. "CLAY").
+//! @param nDim     The 0-based index of the dimension (in [0, #MAXDIMNUM]).
+//! @return  The attr's dimension size, or #RX_FAILURE (-1) on error.
 //!
-//! @warning  This will fail if there are files open that need to be closed first.
-//! @see RomeDatabaseClose().
-//! @RomeAPI Wrapper for CFileSys::Open().
+//! @note This will accept a long attr name (with remote prefix - e.g. "#RD:SOIL_PTR:CLAY")
+//! @see RomeCatalogGetAttrDimCount(), RomeFileGetAttrSizeEx().
+//! @RomeAPI Wrapper for CDimensions::GetSize().
 //!
-ROME_API RT_BOOL RomeDatabaseOpen(RT_Database* pDatabase, RT_CSTR pszDatabase)
+ROME_API RT_INT RomeFileGetAttrDimSize(CFileObj* pFile, RT_CNAME pszAttr, RT_INT nDim)
 {
     try
     {
@@ -2012,119 +6512,85 @@ ROME_API RT_BOOL RomeDatabaseOpen(RT_Database* pDatabase, RT_CSTR pszDatabase)
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pDatabase,            "RomeDatabaseOpen: NULL database pointer.");
-        BOOL bValidApp = (&pDatabase->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,            "RomeDatabaseOpen: invalid database pointer.");
-		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,             "RomeDatabaseOpen: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,              "RomeFileGetAttrDimSize: NULL file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszAttr), "RomeFileGetAttrDimSize: empty attr name.");
+        CRomeCore& Core = pFile->Core;
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,             "RomeFileGetAttrDimSize: invalid file pointer.");
+		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,              "RomeFileGetAttrDimSize: RomeExit() has already been called.");
+        BOOL bValidFile = CFileObj::IsValid(pFile);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,         "RomeFileGetAttrDimSize: invalid file pointer.");
+#ifdef USE_ROMEAPI_REFCOUNT
+        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,         "RomeFileGetAttrDimSize: invalid file reference count.");
+#endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,         "RomeDatabaseOpen: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeFileGetAttrDimSize: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&Core);
 
-	    CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeDatabaseOpen", "file='%s'>\n", (CString)XMLEncode(pszDatabase));
+	    // Wait for the stack to finish.
+        // This makes sure that a size retrieved below won't get changed by functions on the stack.
+	    StatFinishUpdates(Core.Engine);
+
+	    FILEOBJ_READLOCK(pFile);
+
+        CString sFile = pFile->GetFileName();
+	    ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileGetAttrDimSize", "file='%s' attr='%s'>\n", XMLEncode(sFile), pszAttr));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf1(LOG_SHELL, "RomeDatabaseOpen \"%s\"\n", (CString)pszDatabase);
+        LogShellActivate(sFile);
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeFileGetAttrDimSize \"%s\"\n", pszAttr));
 #endif
 
-	    pDatabase->CloseFiles(CVF_CloseTempFiles | CVF_CloseComboFiles | CVF_CloseLazyFiles);
-        BOOL bOpenFiles = pDatabase->FilesToClose(false);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bOpenFiles,            "RomeDatabaseOpen: files still remaining open.");
+	    // Find the attribute in the file.
+	    CAttr* pAttr = StatFindOrCreate(pszAttr, pFile);
+	    ATTR_READLOCK(pAttr);
 
-	    // Close the current database.
-        BOOL bClosed = pDatabase->CloseDatabase();
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bClosed,                "RomeDatabaseOpen: failed to close database.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr,              "+RomeFileGetAttrDimSize: failed to create attr.");
 
-	    RT_BOOL bOpened = pDatabase->Open(pszDatabase);
-	    return bOpened;
+		// Verify that the engine is finished before we get information back from the model.
+	    StatFinishUpdates(Core.Engine);
+
+        int nSize = pAttr->dimensions.GetSize(nDim);
+
+        return nSize;
     }
     catch (...)
     {
         try
         {
-            CString sInfo; sInfo.Format("RomeDatabaseOpen: exception for Database = '%s'.", CString(pszDatabase));
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, sInfo);
+            CString sInfo; sInfo.Format("RomeFileGetAttrDimSize: exception for File = '0x%08X', Attr = '%s'.", pFile, (CString)pszAttr);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeDatabaseOpen: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileGetAttrDimSize: exception in catch block.");
         }
     }
 }
 
-//! @} // Rome Database functions
-/////////////////////////////////////////////////////////////////////////////
-//! @name Rome Database search functions
-//! @{
-
-// Verify that RX_ and DBSYS_ flags match each other.
-#if (RX_DBFIND_FILES   != DBSYS_FIND_FILES)
-  #error "error: compile-time test failed: (RX_DBFIND_FILES   != DBSYS_FIND_FILES)"
-#endif
-#if (RX_DBFIND_FOLDERS != DBSYS_FIND_FOLDERS)
-  #error "error: compile-time test failed: (RX_DBFIND_FOLDERS != DBSYS_FIND_FOLDERS)"
-#endif
-#if (RX_DBFIND_RECURSE != DBSYS_FIND_RECURSE)
-  #error "error: compile-time test failed: (RX_DBFIND_RECURSE != DBSYS_FIND_RECURSE)"
-#endif
-#if (RX_DBFIND_ADDROOT != DBSYS_FIND_ADDROOT)
-  #error "error: compile-time test failed: (RX_DBFIND_ADDROOT != DBSYS_FIND_ADDROOT)"
-#endif
-#if (RX_DBFIND_EXACT != DBSYS_FIND_EXACT)
-  #error "error: compile-time test failed: (RX_DBFIND_EXACT != DBSYS_FIND_EXACT)"
-#endif
-#if (RX_DBFIND_TABLES  != DBSYS_FIND_TABLES)
-  #error "error: compile-time test failed: (RX_DBFIND_TABLES != DBSYS_FIND_TABLES)"
-#endif
-#if (RX_DBFIND_QUERY   != DBSYS_FIND_QUERY)
-  #error "error: compile-time test failed: (RX_DBFIND_QUERY != DBSYS_FIND_QUERY)"
-#endif
-#if (RX_DBFIND_FLAGBITS   != DBSYS_FIND_FLAGBITS)
-  #error "error: compile-time test failed: (RX_DBFIND_FLAGBITS   != DBSYS_FIND_FLAGBITS)"
-#endif
-#if (RX_DBFIND_FLAGMASK   != DBSYS_FIND_FLAGMASK)
-  #error "error: compile-time test failed: (RX_DBFIND_FLAGMASK   != DBSYS_FIND_FLAGMASK)"
-#endif
-
-#if (RX_DBFIND_QUERY   != DBSYS_FIND_QUERY)
-  #error "error: compile-time test failed: (RX_DBFIND_QUERY != DBSYS_FIND_QUERY)"
-#endif
-
 
-//! Start a new search and return a pointer to the find result set.
-//! The results are accessed using RomeDatabaseFindInfo().
-//! The result set must be closed using RomeDatabaseFindClose() when
-//!   you are finished with it.
-//! @param pDatabase  The Rome database interface pointer obtained from RomeGetDatabase().
-//! @param pszPattern is the pattern to search with. Its meaning varies
-//!   depending on @a nFindFlags. It generally is the table or folder
-//!   to search in. If it is NULL or empty, it means all tables.
-//! @param nFindFlags are flags that control the search type.
-//! - #RX_DBFIND_FILES		1<<0	// Match file names
-//! - #RX_DBFIND_FOLDERS	1<<1	// Match folder names
-//! - #RX_DBFIND_RECURSE	1<<2	// Recurse into subdirectories.
-//! - #RX_DBFIND_ADDROOT	1<<3	// Add the root to the search results
-//! - #RX_DBFIND_EXACT		1<<4	// Find single record matching argument string
-//! - #RX_DBFIND_TABLES		1<<10	// Find all tables in the database
-//! - #RX_DBFIND_QUERY		2<<10	// The pattern string is a SQL query.
-//!
-//! @return a result set pointer, or NULL on failure.
+//! @deprecated Use RomeFileGetAttrSizeEx() instead.
 //!
-//! Example to find the number of soils files:
-//! @code
-//!     RT_DBFIND* pDbFind = RomeDatabaseFindOpen(pDatabase, "soils", RX_DBFIND_FILES | RX_DBFIND_RECURSE);
-//!     int nSoils = RomeDatabaseFindCount(pDbFind);
-//!     RomeDatabaseFindClose(pDbFind);
-//! @endcode
+//! Get the size of an attribute, returned as a @b short integer.
+//! This will create an attr that doesn't exist yet.
+//! The attr must be requested in the correct file type.
+//! @param pFile    The Rome file to get the attr in.
+//! @param pszAttr  The parameter name used by the catalog (e.g. "CLAY").
+//! @return  The attr size, or #RX_FAILURE (-1) on error.
 //!
-//! @warning Failing to close the find result may leak memory or other program resources.
-//! @see RomeDatabaseFindClose(), RomeDatabaseFindCount(), RomeDatabaseFindInfo().
-//! @RomeAPI Wrapper for DbFindOpen().
+//! @warning this function cannot return a size greater than 32767.
+//!   For attrs which might exceed that size, use RomeFileGetAttrSizeEx().
+//!   If the size is greater than 32767, this function will return #RX_FAILURE
+//!   instead and set an error message which can be retrieved by RomeGetLastError().
+//! @see RomeFileGetAttrSizeEx(), RomeFileSetAttrSize().
+//! @RomeAPI Wrapper for CAttr::GetSize().
 //!
-ROME_API RT_DBFIND* RomeDatabaseFindOpen(RT_Database* pDatabase, RT_CSTR pszPattern, RT_UINT nFindFlags)
+ROME_API RT_SHORT RomeFileGetAttrSize(CFileObj* pFile, RT_CNAME pszAttr)
 {
     try
     {
@@ -2132,61 +6598,92 @@ ROME_API RT_DBFIND* RomeDatabaseFindOpen(RT_Database* pDatabase, RT_CSTR pszPatt
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pDatabase,              "RomeDatabaseFindOpen: NULL database pointer.");
-        BOOL bValidApp = (&pDatabase->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,              "RomeDatabaseFindOpen: invalid database pointer.");
-		BOOL bExited = pDatabase->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,               "RomeDatabaseFindOpen: RomeExit() has already been called.");
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pDatabase->IsOpen(),    "RomeDatabaseFindOpen: database not open.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,              "RomeFileGetAttrSize: NULL file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszAttr), "RomeFileGetAttrSize: empty attr name.");
+        CRomeCore& Core = pFile->Core;
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,             "RomeFileGetAttrSize: invalid file pointer.");
+		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,              "RomeFileGetAttrSize: RomeExit() has already been called.");
+        BOOL bValidFile = CFileObj::IsValid(pFile);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,         "RomeFileGetAttrSize: invalid file pointer.");
+#ifdef USE_ROMEAPI_REFCOUNT
+        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,         "RomeFileGetAttrSize: invalid file reference count.");
+#endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pDatabase->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,           "RomeDatabaseFindOpen: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeFileGetAttrSize: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&Core);
 
-	    // pszPattern is allowed to be NULL or empty.
-        RX_DBFIND_ASSERT_LEGAL_FLAGS(nFindFlags)
+	    // Wait for the stack to finish.
+        // This makes sure that a size retrieved below won't get changed by functions on the stack.
+	    StatFinishUpdates(Core.Engine);
 
-#if USE_LOG_FILES
-	    CLogFileElement log(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeDatabaseFindOpen", "args='%s' flags='%d'>\n", (CString)XMLEncode(pszPattern), nFindFlags);
+	    FILEOBJ_READLOCK(pFile);
+
+        CString sFile = pFile->GetFileName();
+	    ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileGetAttrSize", "file='%s' attr='%s'>\n", XMLEncode(sFile), pszAttr));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf2(LOG_SHELL, "RomeDatabaseFindOpen \"%s\" %d\n", (CString)pszPattern, nFindFlags);
+        LogShellActivate(sFile);
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeFileGetAttrSize \"%s\"\n", pszAttr));
 #endif
-#endif // USE_LOG_FILES
 
-	    DBFIND* pFind = DbFindOpen(pDatabase->GetDatalink(), pszPattern, nFindFlags);
-#if USE_LOG_FILES
-	    if (log.Logged()) LogFilePrintf1(LOG_HIST, "<output find='0x%08X'/>\n", (UINT)pFind);
+	    // Find the attribute in the file.
+	    CAttr* pAttr = StatFindOrCreate(pszAttr, pFile);
+#if USE_ROMEAPI_ZEROATTRSIZE
+        //! @note If symbol #USE_ROMEAPI_ZEROATTRSIZE is defined, and the attr is not found,
+        //!   return 0 if this is a legal parameter name.
+        //! This allows gracefully handling asking for a parameter in a "polymorphic" object type,
+        //!   when that object type is empty (e.g. "OP_PROCESS_NO_EFFECT").
+        //! The size of an attr that exists will never be 0.
+        if (pAttr == NULL && pFile->IsEmpty() && Core.AttrCatalog.GetListing(pszAttr))
+            return 0;
 #endif
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pFind,                  "RomeDatabaseFindOpen: NULL find context pointer.");
-	    return pFind;
+	    ATTR_READLOCK(pAttr);
+
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr,              "+RomeFileGetAttrSize: failed to create attr.");
+
+		// Verify that the engine is finished before we get information back from the model.
+	    StatFinishUpdates(Core.Engine);
+
+        int nSize = pAttr->GetSize();
+
+        RT_SHORT xSize = (RT_SHORT)nSize;
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nSize == (int)xSize, "RomeFileGetAttrSize: size is too large to cast to short.");
+
+        return (RT_SHORT)nSize;
     }
     catch (...)
     {
         try
         {
-            CString sInfo; sInfo.Format("RomeDatabaseFindOpen: exception for Pattern = '%s', nFlags = 0x%X.", CString(pszPattern), nFindFlags);
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
+            CString sInfo; sInfo.Format("RomeFileGetAttrSize: exception for File = '0x%08X', Attr = '%s'.", pFile, (CString)pszAttr);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeDatabaseFindOpen: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileGetAttrSize: exception in catch block.");
         }
     }
 }
 
 
-//! Close a find result set returned by RomeDatabaseFindOpen().
-//! Result sets are dynamic objects that must be closed when you are finished using them.
-//! @param pDbFind is the result set returned by RomeDatabaseFindOpen().
+//! Get the size of an attribute, returned as a @b long integer.
+//! This will create an attr that doesn't exist yet.
+//! The attr must be requested in the correct file type.
+//! @param pFile    The Rome file to get the attr in.
+//! @param pszAttr  The parameter name used by the catalog (e.g. "CLAY").
+//! @return  The attr size, or #RX_FAILURE (-1) on error.
 //!
-//! @warning Failing to close the find result may leak memory or other program resources.
-//! @see RomeDatabaseFindOpen().
-//! @RomeAPI Wrapper for DbFindClose().
+//! @warning this function is required when the size will exceed 32767.
+//! @see RomeFileGetAttrSize(), RomeFileSetAttrSize()
+//! @RomeAPI Wrapper for CAttr::GetSize().
 //!
-ROME_API RT_void RomeDatabaseFindClose(RT_DBFIND* pDbFind)
+ROME_API RT_INT RomeFileGetAttrSizeEx(CFileObj* pFile, RT_CNAME pszAttr)
 {
     try
     {
@@ -2194,119 +6691,292 @@ ROME_API RT_void RomeDatabaseFindClose(RT_DBFIND* pDbFind)
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN(pDbFind,              "RomeDatabaseFindClose: NULL find pointer.");
-//		BOOL bValidApp = (&pApp == &App);
-//      ASSERT_OR_SETERROR_AND_RETURN(bValidApp,            "RomeDatabaseFindClose: invalid database pointer.");
-		BOOL bExited = App.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN(!bExited,             "RomeDatabaseFindClose: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,              "RomeFileGetAttrSizeEx: NULL file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszAttr), "RomeFileGetAttrSizeEx: empty attr name.");
+        CRomeCore& Core = pFile->Core;
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,          "RomeFileGetAttrSizeEx: invalid file pointer.");
+		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeFileGetAttrSizeEx: RomeExit() has already been called.");
+        BOOL bValidFile = CFileObj::IsValid(pFile);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,         "RomeFileGetAttrSizeEx: invalid file pointer.");
+#ifdef USE_ROMEAPI_REFCOUNT
+        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,         "RomeFileGetAttrSizeEx: invalid file reference count.");
+#endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (App.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN(!bSameThread,         "RomeDatabaseFindClose: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeFileGetAttrSizeEx: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(&Core);
+
+	    // Wait for the stack to finish.
+        // This makes sure that a size retrieved below won't get changed by functions on the stack.
+	    StatFinishUpdates(Core.Engine);
+
+	    FILEOBJ_READLOCK(pFile);
+
+        CString sFile = pFile->GetFileName();
+#if USE_LOG_FILES
+	    ROME_API_LOGELEM(CLogFileElement log(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileGetAttrSizeEx", "file='%s' attr='%s'>\n", XMLEncode(sFile), pszAttr));
+#if USE_ROMESHELL_LOGGING
+        LogShellActivate(sFile);
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeFileGetAttrSizeEx \"%s\"\n", pszAttr));
+#endif
+#endif // USE_LOG_FILES
+
+	    // Find the attribute in the file.
+	    CAttr* pAttr = StatFindOrCreate(pszAttr, pFile);
+#if USE_ROMEAPI_ZEROATTRSIZE
+        //! @note If symbol #USE_ROMEAPI_ZEROATTRSIZE is defined, and the attr is not found,
+        //!   return 0 if this is a legal parameter name.
+        //! This allows gracefully handling asking for a parameter in a "polymorphic" object type,
+        //!   when that object type is empty (e.g. "OP_PROCESS_NO_EFFECT").
+        //! The size of an attr that exists will never be 0.
+        if (pAttr == NULL && pFile->IsEmpty() && Core.AttrCatalog.GetListing(pszAttr))
+            return 0;
 #endif
+	    ATTR_READLOCK(pAttr);
 
-        ROME_API_LOCK();
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr,              "RomeFileGetAttrSizeEx: failed to create attr.");
 
-	    CLogFileElement1(LOGELEM_HIST, "user", "RomeDatabaseFindClose", "find='0x%08X'/>\n", (UINT)pDbFind);
-#if USE_ROMESHELL_LOGGING
-        LogFilePrintf1(LOG_SHELL, "RomeDatabaseFindClose %d\n", (UINT)pDbFind);
+		// Verify that the engine is finished before we get information back from the model.
+	    StatFinishUpdates(Core.Engine);
+
+        int nSize = pAttr->GetSize();
+
+#if USE_LOG_FILES
+        // Log this size if it's not the default.
+        if (nSize != 1 && log.Logged())
+	        ROME_API_LOG(LogFilePrintf1(LOG_HIST, "<value s='%d'/>", nSize));
 #endif
 
-	    DbFindClose(pDbFind);
+        return nSize;
     }
     catch (...)
     {
         try
         {
-            CString sInfo; sInfo.Format("RomeDatabaseFindClose: exception for Find = 0x%X.", pDbFind);
-            ASSERT_OR_SETERROR_AND_RETURN(0,        sInfo);
+            CString sInfo; sInfo.Format("RomeFileGetAttrSizeEx: exception for File = '0x%08X', Attr = '%s'.", pFile, (CString)pszAttr);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN(0,        "RomeDatabaseFindClose: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileGetAttrSizeEx: exception in catch block.");
         }
     }
 }
 
 
-//! Return the number of items in the find result set.
-//! @param pDbFind  The find result set returned by RomeDatabaseFindOpen().
-//! @return  0 on error or if none found.
+//! Get the "value" string for a resolved attribute.
+//! This is the shared implementation of FileGetAttrStr() and RomeAttrHandleGetValue().
+//! The caller must have validated its arguments and must hold the API lock.
+//! @param Core      The Rome core the attr belongs to.
+//! @param pAttr     The attr to get the value of.
+//! @param nIndex    The "flat" index, or -1 for the "current" index of the parameter.
+//! @param nVariant  The variant to get the value in.
+//! @param pszUnit   The unit to get the value in. An empty string will use the template unit.
+//! @return  A string pointer for the value at the given index, or NULL on error.
 //!
-//! @see RomeDatabaseFindOpen(), RomeDatabaseFindClose().
-//! @RomeAPI Wrapper for DbFindCount().
-//!
-ROME_API RT_INT RomeDatabaseFindCount(RT_DBFIND* pDbFind)
+LOCAL RT_CSTR AttrGetValueStr(CRomeCore& Core, CAttr* pAttr, RT_INT nIndex, RT_UINT nVariant, RT_CNAME pszUnit)
 {
-    try
+    // Set the active object for debugging purposes.
+    Core.SetActiveObj(pAttr->GetObj());
+
+    // Get the current index for the attribute.
+    if (nIndex == -1)
     {
-	    // Switch to the app's MFC module state while in this scope.
-	    // This is required for many MFC functions to work correctly.
-	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+        int      nCurrent = AttrGetIndex(pAttr, 0);
+        CString& sCurrent = RomeThreadGetNamedString("RomeFileGetAttrValue");
+        sCurrent = Int2Str(nCurrent);
+        return sCurrent;
+    }
 
-        ASSERT_OR_SETERROR_AND_RETURN_ZERO(pDbFind,         "RomeDatabaseFindCount: NULL find pointer.");
-//		BOOL bValidApp = (&pApp == &App);
-//      ASSERT_OR_SETERROR_AND_RETURN_ZERO(bValidApp,       "RomeDatabaseFindCount: invalid database pointer.");
-		BOOL bExited = App.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bExited,        "RomeDatabaseFindCount: RomeExit() has already been called.");
-#if USE_ROMEAPI_THREADIdS
-        THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (App.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bSameThread,    "RomeDatabaseFindCount: Rome API function called on different thread from RomeInit().");
-#endif
+    // Verify that the engine is finished before we get information back from the model.
+    // The stack was drained by the caller, so this only has work to do
+    //   when creating the attr put calc functions on the stack.
+    if (!Core.Engine.IsFinished())
+        StatFinishUpdates(Core.Engine);
 
-        ROME_API_LOCK();
+    ASSERT_OR_RETURN_NULL(pAttr->IsValidUnits(pszUnit));
+    if (strlen(pszUnit) == 0) // need to use the default
+        pszUnit = "#U_TEMPLATE";
 
-	    CLogFileElement1(LOGELEM_HIST, "user", "RomeDatabaseFindCount", "find='0x%08X'/>\n", (UINT)pDbFind);
-#if USE_ROMESHELL_LOGGING
-        LogFilePrintf1(LOG_SHELL, "RomeDatabaseFindCount %d\n", (UINT)pDbFind);
+    // Get the "value" string from the attribute.
+    LPCSTR pszValue = AttrGetStr(pAttr, nIndex, nVariant, pszUnit);
+    if (pszValue == NULL)
+        pszValue = "NULL";
+
+    // Log this for debugging purposes, unless the core is in batch mode.
+    if (!CoreGetBatch(Core))
+    {
+        CString sIndex;
+        if (nIndex > 0) sIndex.Format(" index='%d'", nIndex);
+        CString sUnit;
+#if USE_USER_TEMPLATES
+        LPCSTR pszPrefUnit = pAttr->GetPrefUnit();
+        LPCSTR pszDefUnit  = pAttr->GetDefUnit();
+        if (!streq(pszPrefUnit, pszDefUnit))
+            sUnit.Format(" unit='%s'", pszPrefUnit);
 #endif
+        ROME_API_LOGELEM(CLogFileElement4(LOGELEM_HIST, "user", "AttrGetStr", "attr='%s'%s><value s='%s'%s/></user>\n",
+                            pAttr->GetName(), sIndex, pszValue, sUnit));
+    }
 
-	    int nCount = DbFindCount(pDbFind);
-	    return nCount;
+    ASSERT(MAX_SETSTR_SIZE < 0 || strlen(pszValue) <= MAX_SETSTR_SIZE);
+    return pszValue;
+}
+
+
+//! Get the "value" string for an attribute in a file.
+//! This is the shared implementation of RomeFileGetAttrValueAux() and RomeFileGetAttrValues().
+//! The caller must have validated its arguments and must hold the API lock.
+//! @param pFile     The Rome file to get the attr in.
+//! @param pszAttr   The parameter name used by the catalog (e.g. "CLAY").
+//! @param nIndex    The "flat" index, or -1 for the "current" index of the parameter.
+//! @param nVariant  The variant to get the value in.
+//! @param pszUnit   The unit to get the value in. An empty string will use the template unit.
+//! @return  A string pointer for the value at the given index, or NULL on error.
+//!
+LOCAL RT_CSTR FileGetAttrStr(CFileObj* pFile, RT_CNAME pszAttr, RT_INT nIndex, RT_UINT nVariant, RT_CNAME pszUnit)
+{
+    CRomeCore& Core = pFile->Core;
+
+    // Find the attribute in the file.
+    CAttr* pAttr = StatFindOrCreate(pszAttr, pFile);
+
+    if (!pAttr)
+    {
+        // The attr name must be listed in the catalog.
+        CListing* pAttrListing = Core.AttrCatalog.GetListing(pszAttr);
+        BOOL bValidAttrName = (pAttrListing != NULL);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidAttrName,     "RomeFileGetAttrValue: no Rusle2 parameter of that name.");
+
+        // The attr must be asked for in the correct object type.
+        LPCSTR pszObjName = pFile->GetObjType()->GetName();
+        BOOL bValidObjType = pAttrListing->IsValidObject(pszObjName);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidObjType,      "RomeFileGetAttrValue: Rusle2 parameter asked for in wrong object type.");
+
+        // If not handled above, give a generic error message.
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pAttr,              "RomeFileGetAttrValue: failed to create attr.");
     }
-    catch (...)
+
+    return AttrGetValueStr(Core, pAttr, nIndex, nVariant, pszUnit);
+}
+
+
+//! Find an attr which already exists in an object, without creating it as FindOrCreate() would.
+//! A remote prefix ("#RD:<pointer attr>:") is followed through the first pointer of its attr.
+//! The caller must hold the API gate, and its read lock if the gate is shared.
+//! @param pObj     The object to find the attr in.
+//! @param pszAttr  The parameter name, which may have remote prefixes (e.g. "#RD:SOIL_PTR:CLAY").
+//! @return  The attr, or NULL if it (or an object on its chain) doesn't exist yet,
+//!   or the name has some other '#' prefix.
+//!
+LOCAL CAttr* AttrFindExisting(CSubObj* pObj, LPCSTR pszAttr)
+{
+    CAttr* pAttr = NULL;
+    while (pObj && strncmp(pszAttr, "#RD:", 4) == 0)
     {
-        try
-        {
-            CString sInfo; sInfo.Format("RomeDatabaseFindCount: exception for Find = 0x%X.", pDbFind);
-            ASSERT_OR_SETERROR_AND_RETURN_ZERO(0, sInfo);
-        }
-        catch (...)
+        LPCSTR pszPtr   = pszAttr + 4;
+        LPCSTR pszColon = strchr(pszPtr, ':');
+        if (pszColon == NULL)
+            return NULL;
+        if (!pObj->m_params.Lookup(CString(pszPtr, (int)(pszColon - pszPtr)), pAttr) || pAttr->GetSize() < 1)
+            return NULL;
+        pObj    = pAttr->GetPtr(0);
+        pszAttr = pszColon + 1;
+    }
+    if (pObj == NULL || *pszAttr == '#')
+        return NULL;
+    return pObj->m_params.Lookup(pszAttr, pAttr)? pAttr: NULL;
+}
+
+
+//! Get the "value" string for an attribute in a file, while sharing the core's API gate.
+//! This is the shared-gate path of RomeFileGetAttrValueAux(), which only reads the model:
+//!   it is taken when the attr already exists and the engine is finished.
+//! Otherwise nothing is logged, and the caller has to take the gate exclusively
+//!   (see CApiGateLock::Escalate()) and get the value as usual.
+//! The attr is found, read and copied under the read lock, and the call is logged after it is
+//!   released, so that the readers of the core only wait for each other's reads.
+//! The history log element has no nested elements, so that elements written by
+//!   other threads reading at the same time don't end up inside it.
+//! @param ApiGate   The API gate, held shared by the caller.
+//! @param[out] pszResult  A thread-local (or string arena) copy of the value string, or NULL on error.
+//!   The copy is needed since the attr's own string may be reused by another thread.
+//! @return  TRUE if the value was got (or failed) here, FALSE if the gate has to be taken exclusively.
+//!
+LOCAL BOOL FileGetAttrValueShared(CFileObj* pFile, RT_CNAME pszAttr, RT_INT nIndex, RT_UINT nVariant, RT_CNAME pszUnit, const CApiGateLock& ApiGate, RT_CSTR& pszResult)
+{
+    CRomeCore& Core = pFile->Core;
+    BATCHCORE* pBatch = CoreGetBatch(Core);
+
+    RT_CSTR pszValue = NULL;
+    CString sFile;
+    {
+        CSingleLock ReadLock(ApiGate.GetReadLock(), TRUE);
+        CAttr* pAttr = AttrFindExisting(pFile, pszAttr);
+        if (pAttr == NULL || !Core.Engine.IsFinished())
+            return FALSE;
+        InterlockedIncrement(&RomeStatAttrFinds);
+        if (!pBatch)
+            sFile = pFile->GetFileName();
+
+        pszValue = AttrGetValueStr(Core, pAttr, nIndex, nVariant, pszUnit);
+        if (pszValue == NULL)
+            pszResult = NULL;
+        else
+        if (ArenaIsActive())
+            pszResult = ArenaResult(pszValue);
+        else
         {
-            ASSERT_OR_SETERROR_AND_RETURN_ZERO(0, "RomeDatabaseFindCount: exception in catch block.");
+            CString& sValue = RomeThreadGetNamedString("RomeFileGetAttrValue");
+            sValue = pszValue;
+            pszResult = sValue;
         }
     }
+
+    if (pBatch)
+        BatchLog(pBatch, "RomeFileGetAttrValue", pszAttr, nIndex, pszValue? RX_TRUE: RX_FAILURE);
+    else
+    {
+	    ROME_API_LOGELEM(CLogFileElement3(LOGELEM_HIST, "user", "RomeFileGetAttrValue", "file='%s' attr='%s' index='%d'/>\n", XMLEncode(sFile), pszAttr, nIndex));
+#if USE_ROMESHELL_LOGGING
+        LogShellActivate(sFile);
+        ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "RomeFileGetAttrValue \"%s\" %d\n", pszAttr, nIndex));
+#endif
+    }
+    return TRUE;
 }
 
 
-//! Access indivIdual results in a find result set.
-//! @param pDbFind    The find result set returned by RomeDatabaseFindOpen().
-//! @param nIndex     The index of the result to access.
-//! @param nInfoType  The type of information to get from the result.
-//! - #RX_DBFILEINFO_QUERY	 0 // info: String result of the SQL query.
-//!                            // (For internal / testing use only.)
-//! - #RX_DBFILEINFO_NAME	 1 // info:                name
-//! - #RX_DBFILEINFO_PATH	 2 // info:         path
-//! - #RX_DBFILEINFO_RIGHT	 3 // info:         path \ name
-//! - #RX_DBFILEINFO_TABLE	 4 // info: table
-//! - #RX_DBFILEINFO_OUTER	 5 // info: table \        name
-//! - #RX_DBFILEINFO_LEFT	 6 // info: table \ path
-//! - #RX_DBFILEINFO_FULL	 7 // info: table \ path \ name
-//! - #RX_DBFILEINFO_OWNER	 8 // info: owner field
-//! - #RX_DBFILEINFO_GROUP	 9 // info: group field
-//! - #RX_DBFILEINFO_PERMS	10 // info: perms field
-//! - #RX_DBFILEINFO_DATE	11 // info: date  field
-//! - #RX_DBFILEINFO_DATA	12 // info: data  field
-//! - #RX_DBFILEINFO_FOLDER	13 // info: is this a folder? return "0" or "1".
-//!
-//! @return  A value which depends on the type of information asked for.
-//!   Returns NULL on error.
+//! Get the "value" string for an attribute, not the "display" string.
+//!   Note: this string should not exceed #MAX_SETSTR_SIZE in length.
+//! @note This will create an attr that doesn't exist yet.
+//! @note The attr must be requested in the correct file type.
+//! @note This function will use the unit and variant from the current template.
+//! @param pFile   The Rome file to get the attr in.
+//! @param pszAttr The parameter name used by the catalog (e.g. "CLAY").
+//! @param nIndex  The "flat" index (use 0 for a 1x1 attr).
+//! @return  A string pointer for the value at the given index.
+//!   Returns NULL on error, including out-of-range index.
 //!
-//! @see RomeDatabaseFindOpen(), RomeDatabaseFindClose().
-//! @RomeAPI Wrapper for DbFindInfo().
+//! @warning This function cannot handle an index greater than 32767.
+//! @since 2007-08-10  -1 returns the "current" index of the parameter.
+//! @see RomeFileSetAttrValue().
+//! @RomeAPI Wrapper for AttrGetStr().
 //!
-ROME_API RT_CSTR RomeDatabaseFindInfo(RT_DBFIND* pDbFind, RT_INT nIndex, RT_UINT nInfoType)
+ROME_API RT_CSTR RomeFileGetAttrValue(CFileObj* pFile, RT_CNAME pszAttr, RT_INT nIndex)
+{
+	RT_CSTR retVal = RomeFileGetAttrValueAux(pFile, pszAttr, nIndex, RX_VARIANT_CATALOG, "#U_TEMPLATE");
+	return retVal;
+}
+
+
+ROME_API RT_CSTR RomeFileGetAttrValueAux(CFileObj* pFile, RT_CNAME pszAttr, RT_INT nIndex, RT_UINT nVariant, RT_CNAME pszUnit)
 {
     try
     {
@@ -2314,64 +6984,93 @@ ROME_API RT_CSTR RomeDatabaseFindInfo(RT_DBFIND* pDbFind, RT_INT nIndex, RT_UINT
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pDbFind,            "RomeDatabaseFindInfo: NULL find pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(nIndex >= 0,        "RomeDatabaseFindInfo: negative index.");
-//		BOOL bValidApp = (&pApp == &App);
-//      ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,          "RomeDatabaseFindInfo: invalid database pointer.");
-		BOOL bExited = App.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,           "RomeDatabaseFindInfo: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pFile,              "RomeFileGetAttrValue: NULL file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!strempty(pszAttr), "RomeFileGetAttrValue: empty attr name.");
+        BOOL bValidIndex = ((nIndex >= 0) || (nIndex == -1));
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidIndex,        "RomeFileGetAttrValue: invalid index.");
+        CRomeCore& Core = pFile->Core;
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,          "RomeFileGetAttrValue: invalid file pointer.");
+		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,           "RomeFileGetAttrValue: RomeExit() has already been called.");
+        BOOL bValidFile = CFileObj::IsValid(pFile);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidFile,         "RomeFileGetAttrValue: invalid file pointer.");
+#ifdef USE_ROMEAPI_REFCOUNT
+        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidRefs,         "RomeFileGetAttrValue: invalid file reference count.");
+#endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (App.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,       "RomeDatabaseFindInfo: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,       "RomeFileGetAttrValue: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        // Reads of existing attrs from a settled engine share the core's API gate with each other.
+        ROME_API_READLOCK(&Core, APIGATE_SETTLED);
+        if (ApiGate.IsShared())
+        {
+            RT_CSTR pszValue = NULL;
+            if (FileGetAttrValueShared(pFile, pszAttr, nIndex, nVariant, pszUnit, ApiGate, pszValue))
+                return pszValue;
+            ApiGate.Escalate(&Core);
+        }
+
+	    // Wait for the stack to finish.
+        // This makes sure that a value retrieved below won't get changed by functions on the stack.
+	    StatFinishUpdates(Core.Engine);
+
+        // In batch mode, only record the call in the diagnostic ring.
+        BATCHCORE* pBatch = CoreGetBatch(Core);
+        if (pBatch)
+        {
+            RT_CSTR pszValue = FileGetAttrStr(pFile, pszAttr, nIndex, nVariant, pszUnit);
+            BatchLog(pBatch, "RomeFileGetAttrValue", pszAttr, nIndex, pszValue? RX_TRUE: RX_FAILURE);
+            return ArenaResult(pszValue);
+        }
 
-	    CLogFileElement3(LOGELEM_HIST, "user", "RomeDatabaseFindInfo", "find='0x%08X' index='%d' type='%d'/>\n", (UINT)pDbFind, nIndex, nInfoType);
+        CString sFile = pFile->GetFileName();
+	    ROME_API_LOGELEM(CLogFileElement3(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileGetAttrValue", "file='%s' attr='%s' index='%d'>\n", XMLEncode(sFile), pszAttr, nIndex));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf2(LOG_SHELL, "RomeDatabaseFindInfo %d %d %d\n", (UINT)pDbFind, nIndex, nInfoType);
+        LogShellActivate(sFile);
+        ROME_API_LOG(LogFilePrintf4(LOG_SHELL, "RomeFileGetAttrValue \"%s\" %d\n", pszAttr, nIndex));
 #endif
 
-	    long nItem = DbFindSeek(pDbFind, nIndex);
-	    if (nItem < 0)
-		    return NULL;
-
-	    LPCSTR pszInfo = DbFindInfo(pDbFind, nInfoType);
-	    return pszInfo;
+        return ArenaResult(FileGetAttrStr(pFile, pszAttr, nIndex, nVariant, pszUnit));
     }
     catch (...)
     {
         try
         {
-            CString sInfo; sInfo.Format("RomeDatabaseFindInfo: exception for Find = 0x%X, Index = %d, Type = %d.", pDbFind, nIndex, nInfoType);
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0, sInfo);
+            CString sInfo; sInfo.Format("RomeFileGetAttrValue: exception for File = '0x%08X', Attr = '%s', Index = %d.", pFile, (CString)pszAttr, (int)nIndex);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0, "RomeDatabaseFindInfo: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeFileGetAttrValue: exception in catch block.");
         }
     }
 }
 
 
-//! Access indivIdual results in a find result set.
-//! See RomeDatabaseFindInfo() [above] for full documentation.
+//! Get the "value" string for an attribute, not display text.
+//! See RomeFileGetAttrValue() [above] for full documentation.
 //!
 //! This version is required for use by Intel Fortran, which can't use functions
 //!   which return a string pointer. Instead it must have its first 2 arguments
 //!   be a pointer to a buffer and its length, to return the string in.
 //!   The function must have a return type of void.
-//! @param[out] pBuf The pointer to a buffer to return a NUL-terminated string in.
-//! @param nBufLen   The length of the buffer to return a NUL-terminated string in.
-//! @param pDbFind   The find result set returned by RomeDatabaseFindOpen().
-//! @param nIndex    The index of the result to access.
-//! @param nInfoType The type of information to get from the result.
+//! @param[out] pBuf  The pointer to a buffer to return a NUL-terminated string in.
+//! @param nBufLen    The length of the buffer to return a NUL-terminated string in.
+//! @param pFile      The pointer to a Rome file.
+//! @param pszAttr    The name of the parameter to get the value for.
+//! @param nIndex     The "flat" index (use 0 for a 1x1 attr).
 //!
-//! @RomeAPI Wrapper for RomeDatabaseFindInfo().
-//! @FortranAPI This function allows calling RomeDatabaseFindInfo() from Fortran.
+//! @warning This function cannot handle an index greater than 32767.
+//! @since 2007-08-10  -1 returns the "current" index of the parameter.
+//! @RomeAPI Wrapper for RomeFileGetAttrValue().
+//! @FortranAPI This function allows calling RomeFileGetAttrValue() from Fortran.
 //!
-ROME_API RT_void RomeDatabaseFindInfoF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_DBFIND* pDbFind, RT_INT nIndex, RT_UINT nInfoType)
+ROME_API RT_void RomeFileGetAttrValueF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_FileObj* pFile, RT_CNAME pszAttr, RT_SHORT nIndex)
 {
     try
     {
@@ -2383,15 +7082,17 @@ ROME_API RT_void RomeDatabaseFindInfoF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_DBFIND
 
 		// Validate arguments unique to the Fortran function version.
 		// The remaining arguments will be validated in the normal Rome API call.
-        ASSERT_OR_SETERROR_AND_RETURN(pBuf,           "RomeDatabaseFindInfoF: NULL buffer pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN(nBufLen > 0,    "RomeDatabaseFindInfoF: non-positive buffer length.");
+        ASSERT_OR_SETERROR_AND_RETURN(pBuf,           "RomeFileGetAttrValueF: NULL buffer pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN(nBufLen > 0,    "RomeFileGetAttrValueF: non-positive buffer length.");
 
-        ROME_API_LOCK();
+        // Does not require resource locking: RomeFileGetAttrValue() takes the core's gate,
+        //   which it may have to take exclusively.
 
         // Does not require command logging.
 
-        LPCSTR pszInfo = RomeDatabaseFindInfo(pDbFind, nIndex, nInfoType);
-        CopyStrF(pBuf, nBufLen, pszInfo);
+        CArenaBypass NoArena;
+        LPCSTR pszValue = RomeFileGetAttrValue(pFile, pszAttr, nIndex);
+        CopyStrF(pBuf, nBufLen, pszValue);
     }
     catch (...)
     {
@@ -2399,167 +7100,202 @@ ROME_API RT_void RomeDatabaseFindInfoF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_DBFIND
         {
             if (pBuf && nBufLen > 0)
                 *pBuf = 0;
-            CString sInfo; sInfo.Format("RomeDatabaseFindInfoF: exception for Buffer = '0x%08X', Length = %d, Index = %d, Type = %d.", pBuf, nBufLen, nIndex, nInfoType);
-            ASSERT_OR_SETERROR_AND_RETURN(0,     sInfo);
+            CString sInfo; sInfo.Format("RomeFileGetAttrValueF: exception for Buffer = '0x%08X', Length = %d, Attr = '%s', Index = %d.", pBuf, nBufLen, (CString)pszAttr, (int)nIndex);
+            ASSERT_OR_SETERROR_AND_RETURN(0,         sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN(0,     "RomeDatabaseFindInfoF: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN(0,         "RomeFileGetAttrValueF: exception in catch block.");
         }
     }
 }
 
 
-//! @} // Rome Database search functions
-/////////////////////////////////////////////////////////////////////////////
-//! @name Rome Engine functions
-//! @{
-
-//! Finish running the update stack until it is empty.
-//! This should occur regardless of whether AutoUpdate is on,
-//!   and should leave the AutoUpdate state unchanged.
-//! This is especially important when reloading files.
-//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
-//! @return  RX_TRUE on success, RX_FALSE on failure.
+//! Get the "value" strings for many attributes in a file, for RomeFileGetAttrValues().
+//! The caller must have validated its arguments, hold the API lock and have drained the engine.
+//! @param pBatch  The batch mode state of the file's core, which the failed values are recorded in,
+//!   or NULL if the core isn't in batch mode, in which case the values are logged to the RomeShell log.
+//! @return  The buffer length required to hold all values (including NULs).
+//! @see RomeFileGetAttrValues() for the other arguments.
 //!
-//! @see RomeEngineRun(), RomeEngineLockUpdate(), RomeEngineSetAutorun().
-//! @RomeAPI Wrapper for CEngineBase::FinishUpdates().
-//!
-ROME_API RT_BOOL RomeEngineFinishUpdates(RT_Engine* pEngine)
+LOCAL RT_INT FileGetAttrValues(CFileObj* pFile, RT_AttrValue* pValues, RT_INT nValues, RT_UINT nVariant, RT_PCHAR pBuf, RT_UINT nBufLen, BATCHCORE* pBatch)
 {
-    try
-    {
-	    // Switch to the app's MFC module state while in this scope.
-	    // This is required for many MFC functions to work correctly.
-	    AFX_MANAGE_STATE(AfxGetAppModuleState());
-
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pEngine,            "RomeEngineFinishUpdates: NULL engine pointer.");
-        BOOL bValidEngine = (&pEngine->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidEngine,       "RomeEngineFinishUpdates: invalid Rome engine pointer.");
-		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,           "RomeEngineFinishUpdates: RomeExit() has already been called.");
-#if USE_ROMEAPI_THREADIdS
-        THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,       "RomeEngineFinishUpdates: Rome API function called on different thread from RomeInit().");
-#endif
-
-        ROME_API_LOCK();
-
-	    CLogFileElement0(LOGELEM_HIST, "user", "RomeEngineFinishUpdates", "/>\n");
+    UINT nUsed = 0;
+    for (int i = 0; i < nValues; i++)
+    {
+        RT_AttrValue& value = pValues[i];
+        value.pszValue = NULL;
+        value.nResult  = RX_FAILURE;
+        if (strempty(value.pszAttr) || value.nIndex < -1)
+            continue;
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf0(LOG_SHELL, "RomeEngineFinishUpdates\n");
+        if (!pBatch)
+            ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "RomeFileGetAttrValue \"%s\" %d\n", value.pszAttr, value.nIndex));
 #endif
 
-	    pEngine->FinishUpdates();
+        LPCSTR pszUnit  = value.pszUnit? value.pszUnit: "";
+        LPCSTR pszValue = FileGetAttrStr(pFile, value.pszAttr, value.nIndex, nVariant, pszUnit);
+        if (pszValue == NULL)
+        {
+            if (pBatch)
+                BatchLog(pBatch, "RomeFileGetAttrValues", value.pszAttr, value.nIndex, RX_FAILURE);
+            continue;
+        }
 
-	    return RX_TRUE;
-    }
-    catch (...)
-    {
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(0, "RomeEngineFinishUpdates: exception.");
+        // Copy the value into the caller's buffer, because the attr's own string may be
+        //   reused by the next value retrieved.
+        const UINT nLen = strlen(pszValue) + 1;
+        if (nUsed + nLen <= nBufLen)
+        {
+            memcpy(pBuf + nUsed, pszValue, nLen);
+            value.pszValue = pBuf + nUsed;
+            value.nResult  = RX_TRUE;
+        }
+        else
+            value.nResult  = RX_FALSE;
+        nUsed += nLen;
     }
+
+    return (RT_INT)nUsed;
 }
 
 
-//! Get the Autorun state for the Rome engine.
-//! When the autorun flag is set, after each value changes the engine will recalculate
-//!   the outputs, leading to much slower performance.
-//! Note that you can also avoid autoupdating in some cases by changing
-//!   the values in an "auxiliary" file like a SOIL, and then changing
-//!   the main PROFILE's ptr to use that SOIL file after all changes have
-//!   been made, which only then causes the updating to happen.
-//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
-//! @return  The autorun state (RX_TRUE or RX_FALSE), or #RX_FAILURE on error.
-//!
-//! @see  RomeEngineFinishUpdates(), RomeEngineRun(), RomeEngineSetAutorun().
-//! @RomeAPI Wrapper for CEngineBase::IsUpdating().
+//! Get the "value" strings for many attributes in a file in a single call.
+//! This is equivalent to calling RomeFileGetAttrValueAux() for each element of @p pValues,
+//!   but it takes the API lock, drains the engine stack and writes the history log once for the batch.
+//! @param pFile     The Rome file to get the attrs in.
+//! @param[in,out] pValues  The values to get.
+//!   On input @c pszAttr, @c nIndex and @c pszUnit of each element must be set
+//!   (@c pszUnit may be NULL or empty for the template unit).
+//!   On output @c pszValue points to the value string in @p pBuf (or is NULL), and
+//!   @c nResult is RX_TRUE on success, RX_FALSE if the value didn't fit in @p pBuf
+//!   or #RX_FAILURE (-1) on error.
+//! @param nValues   The number of elements in @p pValues.
+//! @param nVariant  The variant to get all values in (e.g. #RX_VARIANT_CATALOG).
+//! @param[out] pBuf The caller-owned buffer to return the NUL-terminated value strings in.
+//!   This may be NULL if @p nBufLen is 0, to query the size required.
+//! @param nBufLen   The length of @p pBuf.
+//! @return  The buffer length required to hold all values (including NULs), or #RX_FAILURE (-1) on error.
+//!   All values were returned if this is not larger than @p nBufLen.
+//!
+//! @note Strings returned in @p pBuf remain valid until the caller reuses the buffer.
+//! @see RomeFileGetAttrValueAux(), RomeFileSetAttrValues().
+//! @RomeAPI Wrapper for AttrGetStr().
 //!
-ROME_API RT_BOOL RomeEngineGetAutorun(RT_Engine* pEngine)
+ROME_API RT_INT RomeFileGetAttrValues(RT_FileObj* pFile, RT_AttrValue* pValues, RT_INT nValues, RT_UINT nVariant, RT_PCHAR pBuf, RT_UINT nBufLen)
 {
     try
     {
-        // Switch to the app's MFC module state while in this scope.
-        // This is required for many MFC functions to work correctly.
-        AFX_MANAGE_STATE(AfxGetAppModuleState());
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pEngine,            "RomeEngineGetAutorun: NULL engine pointer.");
-        BOOL bValidEngine = (&pEngine->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidEngine,       "RomeEngineGetAutorun: invalid Rome engine pointer.");
-		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeEngineGetAutorun: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,                 "RomeFileGetAttrValues: NULL file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pValues,               "RomeFileGetAttrValues: NULL values pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nValues >= 0,          "RomeFileGetAttrValues: negative value count.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pBuf || nBufLen == 0,  "RomeFileGetAttrValues: NULL buffer pointer.");
+        CRomeCore& Core = pFile->Core;
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,             "RomeFileGetAttrValues: invalid file pointer.");
+		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,              "RomeFileGetAttrValues: RomeExit() has already been called.");
+        BOOL bValidFile = CFileObj::IsValid(pFile);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,            "RomeFileGetAttrValues: invalid file pointer.");
+#ifdef USE_ROMEAPI_REFCOUNT
+        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,            "RomeFileGetAttrValues: invalid file reference count.");
+#endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeEngineGetAutorun: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,          "RomeFileGetAttrValues: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&Core);
+
+	    // Wait for the stack to finish.
+        // This makes sure that the values retrieved below won't get changed by functions on the stack.
+	    StatFinishUpdates(Core.Engine);
+
+        // In batch mode, only record the failed values in the diagnostic ring.
+        BATCHCORE* pBatch = CoreGetBatch(Core);
+        if (pBatch)
+            return FileGetAttrValues(pFile, pValues, nValues, nVariant, pBuf, nBufLen, pBatch);
 
-        CLogFileElement0(LOGELEM_HIST, "user", "RomeEngineGetAutorun", "/>\n");
+        CString sFile = pFile->GetFileName();
+	    ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileGetAttrValues", "file='%s' count='%d'>\n", XMLEncode(sFile), nValues));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf0(LOG_SHELL, "RomeEngineGetAutorun\n");
+        LogShellActivate(sFile);
 #endif
 
-        return pEngine->IsUpdating();
+        return FileGetAttrValues(pFile, pValues, nValues, nVariant, pBuf, nBufLen, NULL);
     }
     catch (...)
     {
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeEngineGetAutorun: exception.");
+        try
+        {
+            CString sInfo; sInfo.Format("RomeFileGetAttrValues: exception for File = '0x%08X', Count = %d.", pFile, (int)nValues);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileGetAttrValues: exception in catch block.");
+        }
     }
 }
 
 
-//! Is the engine locked?
-//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
-//! @return  #RX_FAILURE on error.
-//!
-//! @see RomeEngineLockUpdate(), RomeEngineUnlockUpdate().
-//! @RomeAPI Wrapper for CEngineBase::IsLocked().
+//! Get an array of floating point values, for RomeFileGetFloatArray().
+//! The caller must have validated its arguments, hold the API lock and have drained the engine.
+//! @return  RX_TRUE on success, RX_FALSE on failure.
+//! @see RomeFileGetFloatArray() for the arguments.
 //!
-ROME_API RT_BOOL RomeEngineIsLocked(RT_Engine* pEngine)
+LOCAL RT_BOOL FileGetFloatArray(CFileObj* pFile, RT_CNAME pszAttr, RT_REAL* pArray, RT_INT* pSize, RT_UINT nVariant, RT_CNAME pszUnit)
 {
-    try
-    {
-        // Switch to the app's MFC module state while in this scope.
-        // This is required for many MFC functions to work correctly.
-        AFX_MANAGE_STATE(AfxGetAppModuleState());
+    CRomeCore& Core = pFile->Core;
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pEngine,            "RomeEngineIsLocked: NULL engine pointer.");
-        BOOL bValidEngine = (&pEngine->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidEngine,       "RomeEngineIsLocked: invalid Rome engine pointer.");
-		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeEngineIsLocked: RomeExit() has already been called.");
-#if USE_ROMEAPI_THREADIdS
-        THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeEngineIsLocked: Rome API function called on different thread from RomeInit().");
-#endif
+    // Find the attribute in the file.
+    CAttr* pAttr = StatFindOrCreate(pszAttr, pFile);
+    if (!pAttr)
+        return RX_FALSE;
 
-        ROME_API_LOCK();
+    // Set the active object for debugging purposes.
+    Core.SetActiveObj(pAttr->GetObj());
 
-        // Don't log this function - it gets called too many times and floods the log file.
-//    	CLogFileElement0(LOGELEM_HIST, "user", "RomeEngineIsLocked", "/>\n");
+    // Verify that the engine is finished before we get information back from the model.
+    ASSERT(Core.Engine.IsFinished());
 
-	    return pEngine->IsLocked();
-    }
-    catch (...)
-    {
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeEngineIsLocked: exception.");
-    }
+    RT_BOOL bSet = AttrGetFloatArray(pAttr, pArray, pSize, nVariant, pszUnit);
+    return bSet;
 }
 
 
-//! Lock the engine from running.
-//! This increments a lock count.
-//! The new lock count is returned.
-//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
-//! @return #RX_FAILURE on error.
+//! Get an array of floating point values.
+//! @param pFile          The pointer to a Rome file.
+//! @param pszAttr        The name of the parameter to get the values for.
+//! @param[out] pArray    The array to place the values in. This must be at least as large as the size in @p pSize.
+//! @param[in,out] pSize  (in)The size of the array to hold the values.
+//!                       If this size is too small, the size required will be set and this will return FALSE.
+//!                       (out) The number of data values returned in @p pArray.
+//! @param nVariant       The variant to get the values in.
+//! - #RX_VARIANT_INTERVAL      Represents the value stored at an index.
+//!                             This is the default variant (#RX_VARIANT_DEFAULT) for all parameters.
+//! - #RX_VARIANT_CUMULATIVE    Represents the sum of all values up to and including that index.
+//!                             This is currently the only other supported variant.
+//! - #RX_VARIANT_TEMPLATE (-1) Used in API functions to mean the variant specified
+//!                             by the current user template.
+//! - #RX_VARIANT_CATALOG  (-2) Used in API functions to mean the variant specified
+//!                             by the catalog. Currently this is always #RX_VARIANT_INTERVAL.
+//! @param pszUnit        The unit to retrieve the values in. Allowable values depend on the actual parameter.
+//!                       An empty string will use the catalog unit.
+//! @return RX_TRUE on success, RX_FALSE on failure.
 //!
-//! @see RomeEngineIsLocked(), RomeEngineUnlockUpdate().
-//! @RomeAPI Wrapper for CEngineBase::LockUpdate().
+//! @note This will create an attr that doesn't exist yet.
+//! @note The attr must be requested in the correct file type.
+//! @see RomeFileGetAttrValue(), RomeFileGetAttrSizeEx(), RomeFileSetFloatArray().
+//! @RomeAPI Wrapper for AttrGetFloatArray().
 //!
-ROME_API RT_INT RomeEngineLockUpdate(RT_Engine* pEngine)
+ROME_API RT_BOOL RomeFileGetFloatArray(RT_FileObj* pFile, RT_CNAME pszAttr, RT_REAL* pArray, RT_INT* pSize, RT_UINT nVariant /*= RX_VARIANT_CATALOG*/, RT_CNAME pszUnit /*= ""*/)
 {
     try
     {
@@ -2567,40 +7303,170 @@ ROME_API RT_INT RomeEngineLockUpdate(RT_Engine* pEngine)
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pEngine,            "RomeEngineLockUpdate: NULL engine pointer.");
-        BOOL bValidEngine = (&pEngine->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidEngine,       "RomeEngineLockUpdate: invalid Rome engine pointer.");
-		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeEngineLockUpdate: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pFile,              "RomeFileGetFloatArray: NULL file pointer.");
+        CRomeCore& Core = pFile->Core;
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,          "RomeFileGetFloatArray: invalid file pointer.");
+		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,           "RomeFileGetFloatArray: RomeExit() has already been called.");
+        BOOL bValidFile = CFileObj::IsValid(pFile);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidFile,         "RomeFileGetFloatArray: invalid file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!strempty(pszAttr), "RomeFileGetFloatArray: empty attr name.");
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pArray,             "RomeFileGetFloatArray: NULL array pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pSize,              "RomeFileGetFloatArray: NULL size pointer.");
+        const int nArraySize = *pSize;
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(nArraySize,         "RomeFileGetFloatArray: non-positive size.");
+        BOOL bValidVariant = VariantIsValid(nVariant, TRUE);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidVariant,      "RomeFileGetFloatArray: invalid variant.");
+#ifdef USE_ROMEAPI_REFCOUNT
+        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidRefs,         "RomeFileGetFloatArray: invalid file reference count.");
+#endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeEngineLockUpdate: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,       "RomeFileGetFloatArray: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&Core);
 
-        // Don't log this function - it gets called too many times and floods the log file.
-//      CLogFileElement0(LOGELEM_HIST, "user", "RomeEngineLockUpdate", "/>\n");
+	    // Wait for the stack to finish.
+        // This makes sure that a value retrieved below won't get changed by functions on the stack.
+	    StatFinishUpdates(Core.Engine);
 
-	    return pEngine->LockUpdate();
+        // In batch mode, only record the call in the diagnostic ring.
+        BATCHCORE* pBatch = CoreGetBatch(Core);
+        if (pBatch)
+        {
+            RT_BOOL bGot = FileGetFloatArray(pFile, pszAttr, pArray, pSize, nVariant, pszUnit);
+            BatchLog(pBatch, "RomeFileGetFloatArray", pszAttr, 0, bGot? RX_TRUE: RX_FALSE);
+            return bGot;
+        }
+
+        CString sFile = pFile->GetFileName();
+	    ROME_API_LOGELEM(CLogFileElement3(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileGetFloatArray", "file='%s' attr='%s' size='%d'>\n", XMLEncode(sFile), pszAttr, *pSize));
+#if USE_ROMESHELL_LOGGING
+        LogShellActivate(sFile);
+        ROME_API_LOG(LogFilePrintf4(LOG_SHELL, "//RomeFileGetFloatArray \"%s\" %d %d \"%s\"\n", pszAttr, *pSize, nVariant, (CString)pszUnit));
+#endif
+
+        return FileGetFloatArray(pFile, pszAttr, pArray, pSize, nVariant, pszUnit);
     }
     catch (...)
     {
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeEngineLockUpdate: exception.");
+        try
+        {
+            CString sInfo; sInfo.Format("RomeFileGetFloatArray: exception for File = '0x%08X', Attr = '%s', Size = %d.", pFile, (CString)pszAttr, (int)*pSize);
+            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,    "RomeFileGetFloatArray: exception in catch block.");
+        }
     }
 }
 
 
-//! Unlock the engine to allow running.
-//! This decrements the lock count. The engine will not run if more locks remain.
-//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
-//! @return  The new lock count, or #RX_FAILURE (-1) on error.
+//! Get several arrays of floating point values, for RomeFileGetFloatArrays().
+//! The caller must have validated its arguments, hold the API lock and have drained the engine.
+//! @param pBatch  The batch mode state of the file's core, which the failed arrays are recorded in,
+//!   or NULL if the core isn't in batch mode, in which case the arrays are logged to the RomeShell log.
+//! @return  The number of elements required in @p pBuf to hold all arrays.
+//! @see RomeFileGetFloatArrays() for the other arguments.
 //!
-//! @see RomeEngineIsLocked(), RomeEngineLockUpdate().
-//! @RomeAPI Wrapper for CEngineBase::UnlockUpdate().
+LOCAL RT_INT FileGetFloatArrays(CFileObj* pFile, RT_FloatArray* pArrays, RT_INT nArrays, RT_REAL* pBuf, RT_INT nBufLen, BATCHCORE* pBatch)
+{
+    CRomeCore& Core = pFile->Core;
+
+    int nUsed = 0;
+    for (int i = 0; i < nArrays; i++)
+    {
+        RT_FloatArray& array = pArrays[i];
+        array.nOffset = nUsed;
+        array.nSize   = 0;
+        array.nResult = RX_FAILURE;
+        if (strempty(array.pszAttr))
+            continue;
+#if USE_ROMESHELL_LOGGING
+        if (!pBatch)
+            ROME_API_LOG(LogFilePrintf3(LOG_SHELL, "//RomeFileGetFloatArray \"%s\" %d \"%s\"\n", array.pszAttr, array.nVariant, (CString)array.pszUnit));
+#endif
+
+        // Find the attribute in the file.
+        CAttr* pAttr = StatFindOrCreate(array.pszAttr, pFile);
+        if (!pAttr)
+        {
+            if (pBatch)
+                BatchLog(pBatch, "RomeFileGetFloatArrays", array.pszAttr, 0, RX_FAILURE);
+            continue;
+        }
+
+        // Set the active object for debugging purposes.
+        Core.SetActiveObj(pAttr->GetObj());
+
+        // Creating the attr above may have put calc functions on the stack.
+        if (!Core.Engine.IsFinished())
+            StatFinishUpdates(Core.Engine);
+
+        // Lay out the arrays by their sizes, so a size query doesn't need to convert any values.
+        const int nSize = pAttr->GetSize();
+        array.nSize = nSize;
+        if (nUsed + nSize <= nBufLen)
+        {
+            RT_INT nGot = nSize;
+            LPCSTR pszUnit = array.pszUnit? array.pszUnit: "";
+            BOOL bGot = AttrGetFloatArray(pAttr, pBuf + nUsed, &nGot, array.nVariant, pszUnit);
+            ASSERT(!bGot || nGot == nSize);
+            array.nResult = bGot? RX_TRUE: RX_FAILURE;
+            if (!bGot)
+                array.nSize = 0;
+            if (!bGot && pBatch)
+                BatchLog(pBatch, "RomeFileGetFloatArrays", array.pszAttr, 0, RX_FAILURE);
+        }
+        else
+            array.nResult = RX_FALSE;
+        nUsed += array.nSize;
+    }
+
+    return nUsed;
+}
+
+
+//! Get several arrays of floating point values in a single call.
+//! The arrays are written one after another into a caller-owned contiguous buffer
+//!   (a "struct of arrays"), without formatting values as strings.
+//! This is equivalent to calling RomeFileGetFloatArray() for each element of @p pArrays,
+//!   but it takes the API lock and drains the engine stack once for the batch,
+//!   and sizes the buffer for the caller.
+//! @param pFile          The pointer to a Rome file.
+//! @param[in,out] pArrays  The arrays to get.
+//!   On input @c pszAttr, @c nVariant and @c pszUnit of each element must be set
+//!   (see RomeFileGetFloatArray() for their values; @c pszUnit may be NULL for the catalog unit).
+//!   On output @c nOffset is the index in @p pBuf of the first value, @c nSize is the
+//!   number of values, and @c nResult is RX_TRUE on success, RX_FALSE if the buffer was
+//!   too small, or #RX_FAILURE (-1) on error (with @c nSize set to 0).
+//! @param nArrays        The number of elements in @p pArrays.
+//! @param[out] pBuf      The buffer to place the values in.
+//!   This may be NULL if @p nBufLen is 0, to query the size required.
+//! @param nBufLen        The number of values @p pBuf can hold.
+//! @return  The number of values required to hold all arrays, or #RX_FAILURE (-1) on error.
+//!   All arrays were returned if this is not larger than @p nBufLen.
+//!
+//! Example to get two daily time series:
+//! @code
+//!     RT_FloatArray aArrays[2] = { { "SLOPE_DEGRAD", RX_VARIANT_CATALOG, "" },
+//!                                  { "NET_C_FACTOR", RX_VARIANT_CATALOG, "" } };
+//!     int nValues = RomeFileGetFloatArrays(pFile, aArrays, 2, NULL, 0);
+//!     RT_REAL* pValues = new RT_REAL[nValues];
+//!     RomeFileGetFloatArrays(pFile, aArrays, 2, pValues, nValues);
+//! @endcode
 //!
-ROME_API RT_INT RomeEngineUnlockUpdate(RT_Engine* pEngine)
+//! @note This will create an attr that doesn't exist yet.
+//! @note The attrs must be requested in the correct file type.
+//! @see RomeFileGetFloatArray(), RomeFileGetAttrValues().
+//! @RomeAPI Wrapper for AttrGetFloatArray().
+//!
+ROME_API RT_INT RomeFileGetFloatArrays(RT_FileObj* pFile, RT_FloatArray* pArrays, RT_INT nArrays, RT_REAL* pBuf, RT_INT nBufLen)
 {
     try
     {
@@ -2608,136 +7474,181 @@ ROME_API RT_INT RomeEngineUnlockUpdate(RT_Engine* pEngine)
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pEngine,            "RomeEngineUnlockUpdate: NULL engine pointer.");
-        BOOL bValidEngine = (&pEngine->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidEngine,       "RomeEngineUnlockUpdate: invalid Rome engine pointer.");
-		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeEngineUnlockUpdate: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,                 "RomeFileGetFloatArrays: NULL file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pArrays,               "RomeFileGetFloatArrays: NULL arrays pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nArrays >= 0,          "RomeFileGetFloatArrays: negative array count.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nBufLen >= 0,          "RomeFileGetFloatArrays: negative buffer length.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pBuf || nBufLen == 0,  "RomeFileGetFloatArrays: NULL buffer pointer.");
+        CRomeCore& Core = pFile->Core;
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,             "RomeFileGetFloatArrays: invalid file pointer.");
+		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,              "RomeFileGetFloatArrays: RomeExit() has already been called.");
+        BOOL bValidFile = CFileObj::IsValid(pFile);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,            "RomeFileGetFloatArrays: invalid file pointer.");
+#ifdef USE_ROMEAPI_REFCOUNT
+        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,            "RomeFileGetFloatArrays: invalid file reference count.");
+#endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeEngineUnlockUpdate: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,          "RomeFileGetFloatArrays: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&Core);
 
-        // Don't log this function - it gets called too many times and floods the log file.
-//    	CLogFileElement0(LOGELEM_HIST, "user", "RomeEngineUnlockUpdate", "/>\n");
+	    // Wait for the stack to finish.
+        // This makes sure that the values retrieved below won't get changed by functions on the stack.
+	    StatFinishUpdates(Core.Engine);
 
-	    return pEngine->UnlockUpdate();
+        // In batch mode, only record the failed arrays in the diagnostic ring.
+        BATCHCORE* pBatch = CoreGetBatch(Core);
+        if (pBatch)
+            return FileGetFloatArrays(pFile, pArrays, nArrays, pBuf, nBufLen, pBatch);
+
+        CString sFile = pFile->GetFileName();
+	    ROME_API_LOGELEM(CLogFileElement3(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileGetFloatArrays", "file='%s' count='%d' size='%d'>\n", XMLEncode(sFile), nArrays, nBufLen));
+#if USE_ROMESHELL_LOGGING
+        LogShellActivate(sFile);
+#endif
+
+        return FileGetFloatArrays(pFile, pArrays, nArrays, pBuf, nBufLen, NULL);
     }
     catch (...)
     {
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeEngineUnlockUpdate: exception.");
+        try
+        {
+            CString sInfo; sInfo.Format("RomeFileGetFloatArrays: exception for File = '0x%08X', Count = %d, Size = %d.", pFile, (int)nArrays, (int)nBufLen);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileGetFloatArrays: exception in catch block.");
+        }
     }
 }
 
 
-//! Run the engine until done.
-//! This may not produce any change if autocalc is already on.
-//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
-//! @return #RX_FAILURE (-1) on error.
+//! Get the full filename of a file object.
+//! This will include the table prefix.
+//!   Example: "climates\default".
+//! @param pFile  A pointer to a Rome file.
+//! @return A pointer to the filename, or NULL on failure.
 //!
-//! @see RomeEngineLockUpdate(), RomeEngineSetAutorun().
-//! @RomeAPI Wrapper for CEngineBase::Run().
+//! @RomeAPI Wrapper for CFileObj::GetFileName().
 //!
-ROME_API RT_BOOL RomeEngineRun(RT_Engine* pEngine)
+ROME_API RT_CSTR RomeFileGetFullname(CFileObj* pFile)
 {
     try
     {
-	    // Switch to the app's MFC module state while in this scope.
-	    // This is required for many MFC functions to work correctly.
-	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+        // Switch to the app's MFC module state while in this scope.
+        // This is required for many MFC functions to work correctly.
+        AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pEngine,            "RomeEngineRun: NULL engine pointer.");
-        BOOL bValidEngine = (&pEngine->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidEngine,       "RomeEngineRun: invalid Rome engine pointer.");
-		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeEngineRun: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pFile,              "RomeFileGetFullname: NULL file pointer.");
+        BOOL bValidApp = RomeCoreIsValid(&pFile->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,          "RomeFileGetFullname: invalid file pointer.");
+		BOOL bExited = pFile->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,           "RomeFileGetFullname: RomeExit() has already been called.");
+        BOOL bValidFile = CFileObj::IsValid(pFile);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidFile,         "RomeFileGetFullname: invalid file pointer.");
+        LPCSTR pszFile = pFile->GetFileName();
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pszFile,            "RomeFileGetFullname: NULL filename pointer.");
+#ifdef USE_ROMEAPI_REFCOUNT
+        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidRefs,         "RomeFileGetFullname: invalid file reference count.");
+#endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeEngineRun: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,       "RomeFileGetFullname: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&pFile->Core);
 
-	    CLogFileElement0(LOGELEM_HIST, "user", "RomeEngineRun", "/>\n");
+        ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeFileGetFullname", "file='%s'/>\n", XMLEncode(pszFile)));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf0(LOG_SHELL, "RomeEngineRun\n");
+        LogShellActivate(pszFile);
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "//RomeFileGetFullname \"%s\"\n", pszFile));
 #endif
 
-	    RT_BOOL bRun = pEngine->Run();
-        return bRun;
+        return ArenaResult(pszFile);
     }
     catch (...)
     {
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeEngineRun: exception.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeFileGetFullname: exception.");
     }
 }
 
 
-//! Set the Autorun flag in Rusle2.
-//! When the autorun flag is set, after each value changes it will recalculate
-//!   the outputs, leading to much slower performance.
-//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
-//! @param bAutorun The new autorun state to set.
+//! Return the full filename of a file object.
+//! See RomeFileGetFullname() [above] for full documentation.
 //!
-//! @see RomeEngineGetAutorun(), RomeEngineRun().
-//! @RomeAPI Wrapper for CEngineBase::SetUpdating().
+//! This version is required for use by Intel Fortran, which can't use functions
+//!   which return a string pointer. Instead it must have its first 2 arguments
+//!   be a pointer to a buffer and its length, to return the string in.
+//!   The function must have a return type of void.
+//! @param[out] pBuf is the pointer to a buffer to return a NUL-terminated string in.
+//! @param nBufLen is the length of the buffer to return a NUL-terminated string in.
+//! @param pFile pointer to a Rome file.
 //!
-ROME_API RT_void RomeEngineSetAutorun(RT_Engine* pEngine, RT_BOOL bAutorun)
+//! @RomeAPI Wrapper for RomeFileGetFullname().
+//! @FortranAPI This function allows calling RomeFileGetFullname() from Fortran.
+//!
+ROME_API RT_void RomeFileGetFullnameF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_FileObj* pFile)
 {
     try
     {
-	    // Switch to the app's MFC module state while in this scope.
-	    // This is required for many MFC functions to work correctly.
-	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+        // Does not require AFX_MANAGE_STATE() macro.
 
-        ASSERT_OR_SETERROR_AND_RETURN(pEngine,                    "RomeEngineSetAutorun: NULL engine pointer.");
-        BOOL bValidEngine = (&pEngine->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN(bValidEngine,               "RomeEngineSetAutorun: invalid Rome engine pointer.");
-		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN(!bExited,                   "RomeEngineSetAutorun: RomeExit() has already been called.");
-#if USE_ROMEAPI_THREADIdS
-        THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN(!bSameThread,               "RomeEngineSetAutorun: Rome API function called on different thread from RomeInit().");
-#endif
+        // Switch to the app's MFC module state while in this scope.
+        // This is required for many MFC functions to work correctly.
+        AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+		// Validate arguments unique to the Fortran function version.
+		// The remaining arguments will be validated in the normal Rome API call.
+        ASSERT_OR_SETERROR_AND_RETURN(pBuf,           "RomeFileGetFullnameF: NULL buffer pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN(nBufLen > 0,    "RomeFileGetFullnameF: non-positive buffer length.");
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(CFileObj::IsValid(pFile)? &pFile->Core: NULL);
 
-	    CLogFileElement1(LOGELEM_HIST, "user", "RomeEngineSetAutorun", "flags='%d'/>\n", bAutorun);
-#if USE_ROMESHELL_LOGGING
-        LogFilePrintf1(LOG_SHELL, "RomeEngineSetAutorun %d\n", bAutorun);
-#endif
+        // Does not require command logging.
 
-	    const UINT nFlags = (bAutorun? UPDATE_ON: UPDATE_OFF) | UPDATE_SHOW | UPDATE_USER;
-	    pEngine->SetUpdating(nFlags);
+        CArenaBypass NoArena;
+        LPCSTR pszName = RomeFileGetFullname(pFile);
+        CString sName;
+        sName = pszName;
+        CopyStrF(pBuf, nBufLen, pszName);
     }
     catch (...)
     {
-        ASSERT_OR_SETERROR_AND_RETURN(0, "RomeEngineSetAutorun: exception.");
+        try
+        {
+            if (pBuf && nBufLen > 0)
+                *pBuf = 0;
+            CString sInfo; sInfo.Format("RomeFileGetFullnameF: exception for Buffer = '0x%08X', Length = %d, File = '0x%08X'.", pBuf, nBufLen, pFile);
+            ASSERT_OR_SETERROR_AND_RETURN(0,        sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN(0,        "RomeFileGetFullnameF: exception in catch block.");
+        }
     }
 }
 
 
-//! Set whether the computational engine should display the calc function
-//!   names in the status bar.
-//! @note Messages are now locked using a locked count, so unlocking
-//!   must be done at least as many times as locking in order to show messages.
-//! This function may still be called as if the lock state was a simple
-//!   boolean, and should still work the same if calls aren't nested.
-//! @note Changed to lock messages with a FALSE argument, which matches
-//!   the old behavior in the import DLLs.
-//! @param pEngine  The Rome engine interface pointer obtained from RomeGetEngine().
-//! @param bShowMessages Boolean value for whether to lock showing messages (FALSE)
-//!    or unlock showing messages (TRUE).
+//! Perform an action using the Rome listener interface.
+//! @param pFile         A pointer to a Rome file.
+//! @param nActionType   The action to perform (e.g. #RX_LISTENER_ADD).
+//! @param pObserver     The observer that will listen for the events.
+//! @param pEventHandler The function to invoke for the events being listened for.
 //!
-//! @return  The old locked state, or #RX_FAILURE on error.
-//! @RomeAPI Wrapper for CEngineBase::ShowStatus().
+//! @warning this is currently for internal use only.
+//! @return  RX_TRUE (success) or RX_FALSE (failure).
+//! @RomeAPI
 //!
-ROME_API RT_BOOL RomeEngineShowStatus(RT_Engine* pEngine, RT_BOOL bShowMessages)
+ROME_API RT_BOOL RomeFile_Listener(RT_FileObj* pFile, RT_UINT nActionType, RT_void* pObserver, RT_EventHandler pEventHandler)
 {
     try
     {
@@ -2745,109 +7656,324 @@ ROME_API RT_BOOL RomeEngineShowStatus(RT_Engine* pEngine, RT_BOOL bShowMessages)
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pEngine,            "RomeEngineShowStatus: NULL engine pointer.");
-        BOOL bValidEngine = (&pEngine->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidEngine,       "RomeEngineShowStatus: invalid Rome engine pointer.");
-		BOOL bExited = pEngine->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeEngineShowStatus: RomeExit() has already been called.");
+        ASSERT_OR_RETURN_FALSE(pFile);
+        BOOL bValidApp = RomeCoreIsValid(&pFile->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,        "RomeFile_Listener: invalid file pointer.");
+		BOOL bExited = pFile->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,         "RomeFile_Listener: RomeExit() has already been called.");
+        BOOL bValidFile = CFileObj::IsValid(pFile);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidFile,       "RomeFile_Listener: invalid file pointer.");
+#ifdef USE_ROMEAPI_REFCOUNT
+        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidRefs,       "RomeFile_Listener: invalid file reference count.");
+#endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pEngine->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeEngineShowStatus: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,     "RomeFile_Listener: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ASSERT((nActionType & RX_LISTENER_ACTION_MASK) == nActionType);
+        // TODO: test that this is the correct object type.
 
-	    CLogFileElement1(LOGELEM_HIST, "user", "RomeEngineShowStatus", "flags='%d'/>\n", bShowMessages);
-#if USE_ROMESHELL_LOGGING
-        LogFilePrintf1(LOG_SHELL, "//RomeEngineShowStatus %d\n", bShowMessages);
-#endif
+        ROME_API_WRITELOCK(&pFile->Core);
 
-	    return pEngine->ShowStatus(bShowMessages);
+        BOOL bRet = RX_FALSE;
+
+        switch (nActionType)
+        {
+            UNUSED2(pObserver, pEventHandler);
+/*
+            case RX_LISTENER_ADD:
+                bRet = pFile->RomeFilesSet.Add(pObserver, pEventHandler);
+                break;
+            case RX_LISTENER_REMOVE:
+                bRet = pFile->RomeFilesSet.Remove(pObserver);
+		        // Call OnFinalRelease to check if the file can be deleted.
+                pFile->OnFinalRelease();
+                break;
+            case RX_LISTENER_REMOVEALL:
+                bRet = pFile->RomeFilesSet.RemoveAll(pObserver);
+		        // Call OnFinalRelease to check if the file can be deleted.
+                pFile->OnFinalRelease();
+                break;
+*/
+            case RX_LISTENER_ADD:
+            case RX_LISTENER_REMOVE:
+            case RX_LISTENER_REMOVEALL:
+            default:
+                ASSERT(FALSE);
+                break;
+        }
+        return bRet;
     }
     catch (...)
     {
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeEngineShowStatus: exception.");
+        try
+        {
+            CString sFile = pFile? pFile->GetFileName(): "NULL";
+            CString sInfo; sInfo.Format("RomeFile_Listener: exception for File = '%s', Action = %d", sFile, nActionType);
+            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,   sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,   "RomeFile_Listener: exception in catch block.");
+        }
     }
 }
 
 
-//! @} // Rome Engine functions
-/////////////////////////////////////////////////////////////////////////////
-//! @name Rome File functions
-//! @{
+//! Get the attr for an attr handle, resolving its name again if the handle is stale.
+//! The caller must have validated the handle and must hold the API lock.
+//! @param pHandle  An attr handle created by RomeFileResolveAttr().
+//! @return  The attr, or NULL if the name doesn't resolve in the handle's file.
+//!
+LOCAL CAttr* AttrHandleResolve(RT_AttrHandle* pHandle)
+{
+    // Read the generation before resolving, so a concurrent invalidation isn't lost.
+    const LONG nGeneration = CoreApi(*pHandle->pCore).nAttrHandleGeneration;
+    if (pHandle->pAttr && pHandle->nGeneration == nGeneration)
+        return pHandle->pAttr;
 
-//! Close an open file in the Rome filesystem.
-//! This also deletes a top-level file itself unless it is of type #OBJT_NOCLOSE or #OBJT_NOCLOSE_LAZY,
-//!   or it is a temporary file.
-//! @param pFile pointer to a Rome file.
-//! @return  RX_TRUE if the file was closed/reloaded, otherwise RX_FALSE.
-//!   Returns #RX_FAILURE on error.
+    {
+        // @note Use CUpdateLock to lock the engine while we are creating the parameter.
+        // See FileSetAttrStr() for why.
+        CUpdateLock lock;
+
+        pHandle->pAttr = StatFindOrCreate(pHandle->sAttr, pHandle->pFile);
+    }
+    pHandle->nGeneration = nGeneration;
+    return pHandle->pAttr;
+}
+
+
+//! Resolve an attr name in a file to a new attr handle, for RomeFileResolveAttr().
+//! The caller must have validated its arguments, hold the API lock and have drained the engine.
+//! @return  The new attr handle, or NULL on failure.
+//! @see RomeFileResolveAttr() for the arguments.
 //!
-//! @see RomeFilesGetItem(), RomeFilesOpen(), RomeFilesCloseAll().
-//! @RomeAPI Wrapper for CFileObj::CloseView().
+LOCAL RT_AttrHandle* FileResolveAttr(RT_FileObj* pFile, RT_CNAME pszAttr)
+{
+    CRomeCore& Core = pFile->Core;
+
+    RT_AttrHandle* pHandle = new RT_AttrHandle;
+    pHandle->pCore       = &Core;
+    pHandle->pFile       = pFile;
+    pHandle->sAttr       = pszAttr;
+    pHandle->pAttr       = NULL;
+    pHandle->nGeneration = 0;
+
+    CAttr* pAttr = AttrHandleResolve(pHandle);
+    if (!pAttr)
+    {
+        delete pHandle;
+
+        // The attr name must be listed in the catalog.
+        CListing* pAttrListing = Core.AttrCatalog.GetListing(pszAttr);
+        BOOL bValidAttrName = (pAttrListing != NULL);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidAttrName, "RomeFileResolveAttr: no Rusle2 parameter of that name.");
+
+        // The attr must be asked for in the correct object type.
+        LPCSTR pszObjName = pFile->GetObjType()->GetName();
+        BOOL bValidObjType = pAttrListing->IsValidObject(pszObjName);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidObjType,  "RomeFileResolveAttr: Rusle2 parameter asked for in wrong object type.");
+
+        // If not handled above, give a generic error message.
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pAttr,          "RomeFileResolveAttr: failed to create attr.");
+    }
+    return pHandle;
+}
+
+
+//! Resolve an attr name in a file once, for repeated access through the returned handle.
+//! Use RomeAttrHandleGetValue(), RomeAttrHandleSetValue() and RomeAttrHandleGetSize()
+//!   to access the attr without parsing and looking up its name on each call.
+//! The handle must be closed using RomeAttrHandleClose() when you are finished with it.
+//! This will create an attr that doesn't exist yet.
+//! The attr must be requested in the correct file type.
+//! @param pFile    The Rome file to resolve the attr in.
+//! @param pszAttr  The parameter name used by the catalog (e.g. "CLAY").
+//!   This can be a 'long' attr name with a remote prefix (e.g. "#RD:MAN_BASE_PTR:OP_DATE").
+//! @return  An attr handle, or NULL on failure.
 //!
-ROME_API RT_BOOL RomeFileClose(CFileObj* pFile)
+//! Example to read the dates of all operations in a management:
+//! @code
+//!     RT_AttrHandle* pDate = RomeFileResolveAttr(pProfile, "#RD:MAN_BASE_PTR:OP_DATE");
+//!     int nOps = RomeAttrHandleGetSize(pDate);
+//!     for (int i = 0; i < nOps; i++)
+//!         LPCSTR pszDate = RomeAttrHandleGetValue(pDate, i, RX_VARIANT_CATALOG, "");
+//!     RomeAttrHandleClose(pDate);
+//! @endcode
+//!
+//! @note A handle stays valid while its file is open. Calls which may re-target a "#RD:" chained name
+//!   (closing files, resizing, or setting a pointer value) make the handle resolve its name again on next use.
+//! @warning Failing to close the handle will leak memory.
+//! @see RomeAttrHandleClose(), RomeFileGetAttr().
+//! @RomeAPI Wrapper for FindOrCreate().
+//!
+ROME_API RT_AttrHandle* RomeFileResolveAttr(RT_FileObj* pFile, RT_CNAME pszAttr)
 {
     try
     {
-        // Switch to the app's MFC module state while in this scope.
-        // This is required for many MFC functions to work correctly.
-        AFX_MANAGE_STATE(AfxGetAppModuleState());
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,            "RomeFileClose: NULL file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pFile,              "RomeFileResolveAttr: NULL file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!strempty(pszAttr), "RomeFileResolveAttr: empty attr name.");
         CRomeCore& Core = pFile->Core;
-        BOOL bValidApp = (&Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,        "RomeFileClose: invalid file system pointer.");
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,          "RomeFileResolveAttr: invalid file pointer.");
 		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,         "RomeFileClose: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,           "RomeFileResolveAttr: RomeExit() has already been called.");
         BOOL bValidFile = CFileObj::IsValid(pFile);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,       "RomeFileClose: invalid file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidFile,         "RomeFileResolveAttr: invalid file pointer.");
+#ifdef USE_ROMEAPI_REFCOUNT
+        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidRefs,         "RomeFileResolveAttr: invalid file reference count.");
+#endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
         BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,     "RomeFileClose: Rome API function called on different thread from RomeInit().");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,       "RomeFileResolveAttr: Rome API function called on different thread from RomeInit().");
 #endif
 
-#ifdef USE_ROMEAPI_REFCOUNT
-        //! @note This decrements the reference count of times this pointer is returned by the Rome API.
-        //! The file will not actually be closed until this count drops to 0.
-        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,       "RomeFileClose: invalid file reference count.");
-        VERIFY(pFile->m_nRomeRefs-- >= 1);
-#endif
+        ROME_API_WRITELOCK(&Core);
+
+	    // Wait for the stack to finish.
+        // This makes sure that a pointer followed below won't get changed by functions on the stack.
+	    StatFinishUpdates(Core.Engine);
 
-        ROME_API_LOCK();
+        // In batch mode, only record the call in the diagnostic ring.
+        BATCHCORE* pBatch = CoreGetBatch(Core);
+        if (pBatch)
+        {
+            RT_AttrHandle* pHandle = FileResolveAttr(pFile, pszAttr);
+            BatchLog(pBatch, "RomeFileResolveAttr", pszAttr, 0, pHandle? RX_TRUE: RX_FAILURE);
+            return pHandle;
+        }
 
         CString sFile = pFile->GetFileName();
-	    CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileClose", "file='%s'>\n", XMLEncode(sFile));
+#if USE_LOG_FILES
+	    ROME_API_LOGELEM(CLogFileElement log(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileResolveAttr", "file='%s' attr='%s'>\n", XMLEncode(sFile), pszAttr));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf1(LOG_SHELL, "RomeFileClose \"%s\"\n", sFile);
+        LogShellActivate(sFile);
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "//RomeFileResolveAttr \"%s\"\n", pszAttr));
 #endif
+#endif // USE_LOG_FILES
 
-		// Verify that the engine is finished before we alter the filesystem.
-		ASSERT(Core.Engine.IsFinished());
+        RT_AttrHandle* pHandle = FileResolveAttr(pFile, pszAttr);
+        if (!pHandle)
+            return NULL;
 
-        // Close the file without saving, if it has no open references..
-	    return pFile->CloseView(CVF_NOSAVE);
+#if USE_LOG_FILES
+	    if (log.Logged()) ROME_API_LOG(LogFilePrintf1(LOG_HIST, "<output handle='0x%08X'/>\n", (UINT)pHandle));
+#endif
+        return pHandle;
     }
     catch (...)
     {
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0, "RomeFileClose: exception.");
+        try
+        {
+            CString sInfo; sInfo.Format("RomeFileResolveAttr: exception for File = '0x%08X', Attr = '%s'.", pFile, (CString)pszAttr);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeFileResolveAttr: exception in catch block.");
+        }
+    }
+}
+
+
+//! Run a file and get some of its outputs using the result cache, for RomeFileRunCached().
+//! The caller must have validated its arguments, hold the API lock and have drained the engine.
+//! @return  The buffer length required to hold all values (including NULs), or #RX_FAILURE (-1) on error.
+//! @see RomeFileRunCached() for the arguments.
+//!
+LOCAL RT_INT FileRunCached(CFileObj* pFile, RT_AttrValue* pOutputs, RT_INT nOutputs, RT_UINT nVariant, RT_PCHAR pBuf, RT_UINT nBufLen)
+{
+    CRomeCore& Core = pFile->Core;
+
+    CStringArray aValues;
+    CByteArray aFound;
+    CString sKey;
+    BOOL bKey = ResultCacheKey(Core, pFile, pOutputs, nOutputs, nVariant, sKey);
+    if (!bKey || !ResultCacheFind(sKey, aValues, aFound))
+    {
+        RT_BOOL bRun = StatEngineRun(Core.Engine);
+        EngineGetSets(Core, TRUE);
+        ListenersDeliver(Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bRun,              "RomeFileRunCached: failed to run the engine.");
+
+        aValues.SetSize(nOutputs);
+        aFound.SetSize(nOutputs);
+        for (int i = 0; i < nOutputs; i++)
+        {
+            const RT_AttrValue& value = pOutputs[i];
+            LPCSTR pszValue = NULL;
+            if (!strempty(value.pszAttr) && value.nIndex >= -1)
+                pszValue = FileGetAttrStr(pFile, value.pszAttr, value.nIndex, nVariant, value.pszUnit? value.pszUnit: "");
+            aValues[i] = pszValue? pszValue: "";
+            aFound[i]  = (pszValue != NULL);
+        }
+
+        if (bKey)
+            ResultCacheAdd(sKey, aValues, aFound);
+    }
+
+    // Copy the values into the caller's buffer, as RomeFileGetAttrValues() does.
+    UINT nUsed = 0;
+    for (int i = 0; i < nOutputs; i++)
+    {
+        RT_AttrValue& value = pOutputs[i];
+        value.pszValue = NULL;
+        value.nResult  = RX_FAILURE;
+        if (!aFound[i])
+            continue;
+
+        const UINT nLen = aValues[i].GetLength() + 1;
+        if (nUsed + nLen <= nBufLen)
+        {
+            memcpy(pBuf + nUsed, (LPCSTR)aValues[i], nLen);
+            value.pszValue = pBuf + nUsed;
+            value.nResult  = RX_TRUE;
+        }
+        else
+            value.nResult  = RX_FALSE;
+        nUsed += nLen;
     }
+
+    return (RT_INT)nUsed;
 }
 
 
-//! @deprecated This function should not be used.
-//!   Use RomeFileClose() instead.
-//!
-//! Delete a Rome file from memory.
-//! @param pFile pointer to a Rome file.
-//! @return #RX_FAILURE on error.
-//!
-//! @RomeAPI Wrapper for CFileSys::DeleteFile().
-//!
-ROME_API RT_BOOL RomeFileDelete(CFileObj* pFile)
+//! Run a file and get some of its outputs, using a saved result when the same inputs have been run before.
+//! This is equivalent to calling RomeEngineRun() and then RomeFileGetAttrValues(),
+//!   except that when the file and the files it refers to (climate, soil, management, etc.)
+//!   have the same inputs as an earlier call for the same outputs, the saved outputs are
+//!   returned and the engine isn't run.
+//! The results are kept in memory, shared by all cores, limited by RomeResultCacheSetLimit(),
+//!   and may be saved to disk with RomeResultCacheSave() for use by later sessions.
+//! @param pFile     The Rome file to run and get the outputs of.
+//! @param[in,out] pOutputs  The outputs to get, as for RomeFileGetAttrValues().
+//! @param nOutputs  The number of elements in @p pOutputs.
+//! @param nVariant  The variant to get all outputs in (e.g. #RX_VARIANT_CATALOG).
+//! @param[out] pBuf The caller-owned buffer to return the NUL-terminated value strings in.
+//! @param nBufLen   The length of @p pBuf.
+//! @return  The buffer length required to hold all values (including NULs), or #RX_FAILURE (-1) on error.
+//!   All values were returned if this is not larger than @p nBufLen.
+//!
+//! @note When a saved result is used the engine doesn't run, so outputs not requested
+//!   keep their values from before the call.
+//! @note Computing the key hashes the inputs of the file and its dependencies in memory, which costs
+//!   much less than a run but isn't free. Don't use this for files that are never run twice with the same inputs.
+//! @note A file with an attr holding more than one embedded subobject gets no key (see BinSnapAddObj()),
+//!   so it is always run and its result isn't cached.
+//! @see RomeEngineRun(), RomeFileGetAttrValues(), RomeResultCacheSetLimit().
+//! @RomeAPI Wrapper for CEngineBase::Run(), AttrGetStr().
+//!
+ROME_API RT_INT RomeFileRunCached(RT_FileObj* pFile, RT_AttrValue* pOutputs, RT_INT nOutputs, RT_UINT nVariant, RT_PCHAR pBuf, RT_UINT nBufLen)
 {
     try
     {
@@ -2855,415 +7981,960 @@ ROME_API RT_BOOL RomeFileDelete(CFileObj* pFile)
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,            "RomeFileDelete: NULL file pointer.");
-        BOOL bValidApp = (&pFile->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,        "RomeFileDelete: invalid file system pointer.");
-		BOOL bExited = pFile->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,         "RomeFileDelete: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,                 "RomeFileRunCached: NULL file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pOutputs,              "RomeFileRunCached: NULL outputs pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nOutputs >= 0,         "RomeFileRunCached: negative output count.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pBuf || nBufLen == 0,  "RomeFileRunCached: NULL buffer pointer.");
+        CRomeCore& Core = pFile->Core;
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,             "RomeFileRunCached: invalid file pointer.");
+		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,              "RomeFileRunCached: RomeExit() has already been called.");
         BOOL bValidFile = CFileObj::IsValid(pFile);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,       "RomeFileDelete: invalid file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,            "RomeFileRunCached: invalid file pointer.");
+#ifdef USE_ROMEAPI_REFCOUNT
+        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,            "RomeFileRunCached: invalid file reference count.");
+#endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
         BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,     "RomeFileDelete: Rome API function called on different thread from RomeInit().");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,          "RomeFileRunCached: Rome API function called on different thread from RomeInit().");
 #endif
 
-#ifdef USE_ROMEAPI_REFCOUNT
-        //! @note This bypasses the reference count of times this pointer is returned by the Rome API.
-        //! Normally the file would not be closed until this count drops to 0. However, this function forces the file to close.
-        VERIFY(pFile->m_nRomeRefs-- >= 1);
-#endif
+        ROME_API_WRITELOCK(&Core);
+
+	    // Wait for the stack to finish.
+        // This makes sure that the inputs hashed below won't get changed by functions on the stack.
+	    StatFinishUpdates(Core.Engine);
 
-        ROME_API_LOCK();
+        // In batch mode, only record the call in the diagnostic ring.
+        BATCHCORE* pBatch = CoreGetBatch(Core);
+        if (pBatch)
+        {
+            RT_INT nNeeded = FileRunCached(pFile, pOutputs, nOutputs, nVariant, pBuf, nBufLen);
+            BatchLog(pBatch, "RomeFileRunCached", NULL, nOutputs, (nNeeded < 0)? RX_FAILURE: RX_TRUE);
+            return nNeeded;
+        }
 
         CString sFile = pFile->GetFileName();
-	    CLogFileElement1(LOGELEM_HIST, "user", "RomeFileDelete", "file='%s'/>\n", XMLEncode(sFile));
+	    ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileRunCached", "file='%s' count='%d'>\n", XMLEncode(sFile), nOutputs));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf1(LOG_SHELL, "RomeFileDelete \"%s\"\n", sFile);
+        LogShellActivate(sFile);
+        ROME_API_LOG(LogFilePrintf0(LOG_SHELL, "RomeEngineRun\n"));
 #endif
 
-	    pFile->Core.Files.DeleteFile(pFile);
-	    return RX_TRUE;
+        return FileRunCached(pFile, pOutputs, nOutputs, nVariant, pBuf, nBufLen);
     }
     catch (...)
     {
         try
         {
-            CString sFile = pFile? pFile->GetFileName(): "NULL";
-            CString sInfo; sInfo.Format("RomeFileDelete: exception for File = '%s'.", sFile);
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,     sInfo);
+            CString sInfo; sInfo.Format("RomeFileRunCached: exception for File = '0x%08X', Count = %d.", pFile, (int)nOutputs);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,     "RomeFileDelete: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileRunCached: exception in catch block.");
         }
     }
 }
 
 
-//! Return the [unique] instance of a named parameter in a given object.
-//! This will return an existing instance if there already is one.
-//! @param pFile    The Rome file to get the attr in.
-//! @param pszAttr  The parameter name used by the catalog (e.g. "CLAY").
-//!   This can be a 'long' attr name with a remote prefix.
+//! Save a file object to its current location.
+//! @param pFile  Apointer to a Rome file.
+//! @return  RX_TRUE on success, #RX_FAILURE (-1) on error.
 //!
-//! @return  A pointer to the attr in the given file, or NULL on failure.
-//! @RomeAPI Wrapper for FindOrCreate().
+//! @see RomeFilesOpen(), RomeFileSaveAs(), RomeFileSaveAsEx().
+//! @RomeAPI Wrapper for RomeFileSaveAs().
 //!
-ROME_API RT_Attr* RomeFileGetAttr(CFileObj* pFile, RT_CNAME pszAttr)
+ROME_API RT_INT RomeFileSave(CFileObj* pFile)
 {
     try
     {
+        // Note: this function doesn't require resource locking.
+
 	    // Switch to the app's MFC module state while in this scope.
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pFile,             "RomeFileGetAttr: NULL file pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!strempty(pszAttr),"RomeFileGetAttr: empty attr name.");
-        BOOL bValidApp = (&pFile->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,         "RomeFileGetAttr: invalid file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,          "RomeFileSave: NULL file pointer.");
+        BOOL bValidApp = RomeCoreIsValid(&pFile->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,      "RomeFileSave: invalid file pointer.");
 		BOOL bExited = pFile->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,          "RomeFileGetAttr: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,       "RomeFileSave: RomeExit() has already been called.");
         BOOL bValidFile = CFileObj::IsValid(pFile);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidFile,        "RomeFileGetAttr: invalid file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,     "RomeFileSave: invalid file pointer.");
 #ifdef USE_ROMEAPI_REFCOUNT
         BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidRefs,        "RomeFileGetAttr: invalid file reference count.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,     "RomeFileSave: invalid file reference count.");
 #endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
         BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,      "RomeFileGetAttr: Rome API function called on different thread from RomeInit().");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,   "RomeFileSave: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&pFile->Core);
 
         CString sFile = pFile->GetFileName();
-	    CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileGetAttr", "file='%s' attr='%s'>\n", XMLEncode(sFile), pszAttr);
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileSave", "file='%s'>\n", XMLEncode(sFile)));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf2(LOG_SHELL, "//RomeFileGetAttr \"%s\" \"%s\"\n", sFile, pszAttr);
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeFileSave \"%s\"\n", sFile));
 #endif
 
-        FILEOBJ_READLOCK(pFile);
-	    return FindOrCreate(pszAttr, pFile);
+        return RomeFileSaveAs(pFile, pFile->GetFileName());
     }
     catch (...)
     {
         try
         {
-            CString sInfo; sInfo.Format("RomeFileGetAttr: exception for File = '0x%08X', Attr = '%s'.", pFile, (CString)pszAttr);
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,     sInfo);
+            CString sFile = pFile? pFile->GetFileName(): "NULL";
+            CString sInfo; sInfo.Format("RomeFileSave: exception for File = '%s'", sFile);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,     "RomeFileGetAttr: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileSave: exception in catch block.");
         }
     }
 }
 
 
-//! Get the size of an attribute's dimension.
-//! This will create an attr that doesn't exist yet.
-//! The attr must be requested in the correct file type.
-//! @param pFile    The Rome file to get the attr in.
-//! @param pszAttr  The parameter name used by the catalog (e.g. "CLAY").
-//! @param nDim     The 0-based index of the dimension (in [0, #MAXDIMNUM]).
-//! @return  The attr's dimension size, or #RX_FAILURE (-1) on error.
+//! The tables of a binary snapshot while it is being built by BinSnapSave().
+typedef struct BINSNAPWRITER
+{
+    CArray<BINSNAPATTR, BINSNAPATTR&> aAttrs;
+    CDWordArray                       aValues;
+    CByteArray                        aPool;
+    CMapStringToPtr                   mapPool;  //!< The offset of each string in @c aPool.
+} BINSNAPWRITER;
+
+
+//! Add a string to the pool of a binary snapshot, unless it is already there.
+//! @return The offset of the string in the pool.
 //!
-//! @note This will accept a long attr name (with remote prefix - e.g. "#RD:SOIL_PTR:CLAY")
-//! @see RomeCatalogGetAttrDimCount(), RomeFileGetAttrSizeEx().
-//! @RomeAPI Wrapper for CDimensions::GetSize().
+LOCAL UINT BinSnapAddStr(BINSNAPWRITER& W, LPCSTR psz)
+{
+    if (psz == NULL)
+        psz = "";
+    void* pOffset = NULL;
+    if (W.mapPool.Lookup(psz, pOffset))
+        return (UINT)(UINT_PTR)pOffset;
+
+    const UINT nOffset = (UINT)W.aPool.GetSize();
+    const UINT nLen    = (UINT)strlen(psz) + 1;
+    W.aPool.SetSize(nOffset + nLen, 0x10000);
+    memcpy(W.aPool.GetData() + nOffset, psz, nLen);
+    W.mapPool.SetAt(psz, (void*)(UINT_PTR)nOffset);
+    return nOffset;
+}
+
+
+//! Add the record of one attr to a binary snapshot, with its values in its default unit.
+//! @param W       The snapshot being built.
+//! @param pAttr   The attr.
+//! @param sName   The name it is found by from the file, including any "#RD:" chain.
+//! @param nFlags  Its #BINSNAP_ATTR_PTR, #BINSNAP_ATTR_DIM and #BINSNAP_ATTR_CALC flags.
 //!
-ROME_API RT_INT RomeFileGetAttrDimSize(CFileObj* pFile, RT_CNAME pszAttr, RT_INT nDim)
+LOCAL void BinSnapAddAttr(BINSNAPWRITER& W, CAttr* pAttr, const CString& sName, UINT nFlags)
 {
-    try
-    {
-	    // Switch to the app's MFC module state while in this scope.
-	    // This is required for many MFC functions to work correctly.
-	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+    LPCSTR pszUnit = pAttr->GetDefUnit();
+    BINSNAPATTR Rec;
+    Rec.nName  = BinSnapAddStr(W, sName);
+    Rec.nUnit  = BinSnapAddStr(W, pszUnit);
+    Rec.nFlags = nFlags;
+    Rec.nFirst = (UINT)W.aValues.GetSize();
+    Rec.nCount = (UINT)pAttr->GetSize();
+    for (UINT i = 0; i < Rec.nCount; i++)
+    {
+        LPCSTR pszValue = AttrGetStr(pAttr, i, RX_VARIANT_INTERVAL, pszUnit);
+        W.aValues.Add(BinSnapAddStr(W, pszValue? pszValue: "NULL"));
+    }
+    W.aAttrs.Add(Rec);
+}
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,              "RomeFileGetAttrDimSize: NULL file pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszAttr), "RomeFileGetAttrDimSize: empty attr name.");
-        CRomeCore& Core = pFile->Core;
-        BOOL bValidApp = (&Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,             "RomeFileGetAttrDimSize: invalid file pointer.");
-		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,              "RomeFileGetAttrDimSize: RomeExit() has already been called.");
-        BOOL bValidFile = CFileObj::IsValid(pFile);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,         "RomeFileGetAttrDimSize: invalid file pointer.");
-#ifdef USE_ROMEAPI_REFCOUNT
-        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,         "RomeFileGetAttrDimSize: invalid file reference count.");
-#endif
-#if USE_ROMEAPI_THREADIdS
-        THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeFileGetAttrDimSize: Rome API function called on different thread from RomeInit().");
-#endif
 
-        ROME_API_LOCK();
+//! Add the attrs of an object to a binary snapshot, in the order BinSnapOpen() sets them:
+//!   pointers first, since they may set defaults in the others, then dimensions,
+//!   then values, and then the attrs of the object's embedded subobjects.
+//! @param W        The snapshot being built.
+//! @param pObj     The file, or an embedded subobject of it.
+//! @param sPrefix  The chain to the subobject (e.g. "#RD:SLOPE_ROT_BUILD_SUB_OBJ_PTR:"), or empty for the file.
+//! @param bCalc    TRUE to save calculated values too.
+//! @param sError   Returns the reason on failure.
+//! @return TRUE on success, FALSE if the object can't be held by a snapshot.
+//!
+LOCAL BOOL BinSnapAddObj(BINSNAPWRITER& W, CSubObj* pObj, const CString& sPrefix, BOOL bCalc, CString& sError)
+{
+    CList<CAttr*, CAttr*> aSubs;
+    for (int nPass = 0; nPass < 3; nPass++)
+    {
+        POSITION pos = pObj->m_params.GetStartPosition();
+        while (pos)
+        {
+            CAttr* pAttr = pObj->m_params.GetNextValue(pos);
+            CListing* pListing = pAttr->GetListing();
+            if (!pListing)
+                continue;
+
+            const ParamType attrType = pListing->GetType();
+            const BOOL bPtr  = (attrType == ATTR_PTR || attrType == ATTR_SUB);
+            const BOOL bDim  = !bPtr && pAttr->IsDimension();
+            const BOOL bIsCalc = pListing->GetFlag(ACF_NO_USER_EDIT);
+            if (nPass != (bPtr? 0: bDim? 1: 2))
+                continue;
+            if (bIsCalc && !bCalc)
+                continue;
+
+            // Embedded subobjects are saved through their own attrs, after this object's.
+            if (attrType == ATTR_SUB)
+            {
+                BOOL bEmbedded = FALSE;
+                for (int i = 0; i < pAttr->GetSize(); i++)
+                {
+                    CSubObj* pSub = pAttr->GetPtr(i);
+                    if (pSub && !pSub->IsFile())
+                        bEmbedded = TRUE;
+                }
+                if (bEmbedded && pAttr->GetSize() > 1)
+                {
+                    // A "#RD:" chained name only reaches the first subobject.
+                    sError.Format("BinSnapSave: attr '%s%s' holds more than one embedded subobject.", sPrefix, pAttr->GetName());
+                    return FALSE;
+                }
+                if (bEmbedded)
+                {
+                    aSubs.AddTail(pAttr);
+                    continue;
+                }
+            }
+
+            const UINT nFlags = (bPtr? BINSNAP_ATTR_PTR: 0) | (bDim? BINSNAP_ATTR_DIM: 0) | (bIsCalc? BINSNAP_ATTR_CALC: 0);
+            BinSnapAddAttr(W, pAttr, sPrefix + pAttr->GetName(), nFlags);
+        }
+    }
 
-	    // Wait for the stack to finish.
-        // This makes sure that a size retrieved below won't get changed by functions on the stack.
-	    Core.Engine.FinishUpdates();
+    POSITION pos = aSubs.GetHeadPosition();
+    while (pos)
+    {
+        CAttr* pAttr = aSubs.GetNext(pos);
+        if (!sPrefix.IsEmpty())
+        {
+            sError.Format("BinSnapSave: attr '%s%s' is an embedded subobject of an embedded subobject.", sPrefix, pAttr->GetName());
+            return FALSE;
+        }
+        CString sSubPrefix = "#RD:" + CString(pAttr->GetName()) + ":";
+        if (!BinSnapAddObj(W, pAttr->GetPtr(0), sSubPrefix, bCalc, sError))
+            return FALSE;
+    }
+    return TRUE;
+}
 
-	    FILEOBJ_READLOCK(pFile);
 
-        CString sFile = pFile->GetFileName();
-	    CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileGetAttrDimSize", "file='%s' attr='%s'>\n", XMLEncode(sFile), pszAttr);
-#if USE_ROMESHELL_LOGGING
-        LogShellActivate(sFile);
-        LogFilePrintf1(LOG_SHELL, "RomeFileGetAttrDimSize \"%s\"\n", pszAttr);
-#endif
+//! Save a file as a binary snapshot (the "#BIN:" prefix of RomeFileSaveAsEx()).
+//! The snapshot holds the file's own values and those of its embedded subobjects.
+//! As with "#XML:", the files it points to (climate, soil, management, etc.) are saved by name.
+//! The caller must hold the API lock, and have drained the engine.
+//! @param Core         The core the file belongs to.
+//! @param pFile        The file to save.
+//! @param pszDiskName  The path of the snapshot. An existing file is replaced.
+//! @param bCalc        TRUE to save calculated values too.
+//! @param sError       Returns the reason on failure.
+//! @return TRUE on success, FALSE on failure.
+//!
+LOCAL BOOL BinSnapSave(CRomeCore& Core, CFileObj* pFile, LPCSTR pszDiskName, BOOL bCalc, CString& sError)
+{
+    BINSNAPWRITER W;
+    W.mapPool.InitHashTable(4099);
+    BinSnapAddStr(W, "");
+
+    BINSNAPHEADER Head;
+    memset(&Head, 0, sizeof(Head));
+    memcpy(Head.szMagic, BINSNAP_MAGIC, sizeof(Head.szMagic));
+    Head.nVersion    = BINSNAP_VERSION;
+    Head.nHeaderSize = sizeof(Head);
+    Head.nScience    = Core.GetScienceVersion();
+    Head.nFlags      = bCalc? BINSNAP_CALC: 0;
+    Head.nObjType    = BinSnapAddStr(W, pFile->GetObjType()->GetName());
+    Head.nFileName   = BinSnapAddStr(W, pFile->GetFileName());
+
+    if (!BinSnapAddObj(W, pFile, "", bCalc, sError))
+        return FALSE;
+
+    // Pad the pool so a snapshot is always a whole number of 4-byte units.
+    while (W.aPool.GetSize() % 4)
+        W.aPool.Add(0);
+    Head.nAttrs    = (UINT)W.aAttrs.GetSize();
+    Head.nValues   = (UINT)W.aValues.GetSize();
+    Head.nPoolSize = (UINT)W.aPool.GetSize();
+
+    CFile File;
+    if (!File.Open(pszDiskName, CFile::modeCreate | CFile::modeWrite | CFile::shareExclusive))
+    {
+        sError.Format("BinSnapSave: failed to create file '%s'.", pszDiskName);
+        return FALSE;
+    }
+    File.Write(&Head, sizeof(Head));
+    File.Write(W.aAttrs.GetData(),  Head.nAttrs  * sizeof(BINSNAPATTR));
+    File.Write(W.aValues.GetData(), Head.nValues * sizeof(DWORD));
+    File.Write(W.aPool.GetData(),   Head.nPoolSize);
+    File.Close();
+    return TRUE;
+}
 
-	    // Find the attribute in the file.
-	    CAttr* pAttr = FindOrCreate(pszAttr, pFile);
-	    ATTR_READLOCK(pAttr);
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr,              "+RomeFileGetAttrDimSize: failed to create attr.");
+//! A read-only mapped view of a file, which is unmapped when this goes out of scope.
+class CBinSnapView
+{
+public:
+    CBinSnapView(): m_pData(NULL), m_nSize(0) {}
+    ~CBinSnapView() { if (m_pData) UnmapViewOfFile(m_pData); }
+
+    //! Map the whole of a file.
+    //! @return TRUE on success, FALSE if it couldn't be opened or is too large.
+    BOOL Open(LPCSTR pszPath)
+    {
+        HANDLE hFile = CreateFile(pszPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE)
+            return FALSE;
+        DWORD nSizeHigh = 0;
+        m_nSize = GetFileSize(hFile, &nSizeHigh);
+        // The view keeps the mapping (and the file) open after their handles are closed.
+        HANDLE hMap = (nSizeHigh == 0 && m_nSize > 0)? CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL): NULL;
+        CloseHandle(hFile);
+        if (hMap == NULL)
+            return FALSE;
+        m_pData = (const BYTE*)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(hMap);
+        return (m_pData != NULL);
+    }
+
+    const BYTE* m_pData;
+    DWORD       m_nSize;
+};
+
+
+//! Open a binary snapshot from a mapped view of it (see BinSnapOpen()).
+//! Its value strings are read from the view where they are, without the file being read into a buffer,
+//!   but each is still parsed into its attr by DoCmdSetStr(), as an XML file's values are.
+//! Only the XML parse is skipped: the records are flat, and already in the order they must be set in.
+//! Calculated values in the snapshot aren't restored: the engine calculates them again, as it
+//!   does for the \<Calc> values of an XML file.
+//! The caller must hold the API lock.
+//! @param pFiles       The filesystem to open the file in.
+//! @param View         The mapped snapshot.
+//! @param pszDiskName  The path of the snapshot, for error messages.
+//! @param pszFullname  The fullname the snapshot must have been saved with, or NULL for any.
+//! @param sError       Returns the reason on failure.
+//! @return  A pointer to the opened file, or NULL on failure.
+//!
+LOCAL CFileObj* BinSnapOpenView(RT_Files* pFiles, const CBinSnapView& View, LPCSTR pszDiskName, LPCSTR pszFullname, CString& sError)
+{
+    CRomeCore& Core = pFiles->Core;
 
-		// Verify that the engine is finished before we get information back from the model.
-	    Core.Engine.FinishUpdates();
+    // Validate the layout before using any offset in it.
+    const BINSNAPHEADER* pHead = (const BINSNAPHEADER*)View.m_pData;
+    BOOL bValid = (View.m_nSize >= sizeof(BINSNAPHEADER))
+               && (memcmp(pHead->szMagic, BINSNAP_MAGIC, sizeof(pHead->szMagic)) == 0)
+               && (pHead->nVersion == BINSNAP_VERSION)
+               && (pHead->nHeaderSize >= sizeof(BINSNAPHEADER) && pHead->nHeaderSize % 4 == 0);
+    ULONGLONG nExpected = bValid? (ULONGLONG)pHead->nHeaderSize
+                                + (ULONGLONG)pHead->nAttrs  * sizeof(BINSNAPATTR)
+                                + (ULONGLONG)pHead->nValues * sizeof(DWORD)
+                                + pHead->nPoolSize: 0;
+    bValid = bValid && (nExpected == View.m_nSize) && (pHead->nPoolSize > 0);
+    if (!bValid)
+    {
+        sError.Format("BinSnapOpen: '%s' is not a binary snapshot, or is from a different version.", pszDiskName);
+        return NULL;
+    }
+    const BINSNAPATTR* pAttrs  = (const BINSNAPATTR*)(View.m_pData + pHead->nHeaderSize);
+    const DWORD*       pValues = (const DWORD*)(pAttrs + pHead->nAttrs);
+    const char*        pPool   = (const char*)(pValues + pHead->nValues);
+    // The pool ends with the NUL of its last string, or with NUL padding,
+    //   so every offset into it is the start of a terminated string.
+    bValid = (pPool[pHead->nPoolSize - 1] == 0) && (pHead->nObjType < pHead->nPoolSize) && (pHead->nFileName < pHead->nPoolSize);
+    for (UINT a = 0; bValid && a < pHead->nAttrs; a++)
+    {
+        const BINSNAPATTR& Rec = pAttrs[a];
+        bValid = (Rec.nName < pHead->nPoolSize) && (Rec.nUnit < pHead->nPoolSize)
+              && ((ULONGLONG)Rec.nFirst + Rec.nCount <= pHead->nValues);
+    }
+    for (UINT v = 0; bValid && v < pHead->nValues; v++)
+        bValid = (pValues[v] < pHead->nPoolSize);
+    if (!bValid)
+    {
+        sError.Format("BinSnapOpen: '%s' is damaged.", pszDiskName);
+        return NULL;
+    }
 
-        int nSize = pAttr->dimensions.GetSize(nDim);
+    // Values depend on the science version, and there is no upgrade path for snapshots as there is for XML.
+    if (pHead->nScience != (UINT)Core.GetScienceVersion())
+    {
+        sError.Format("BinSnapOpen: '%s' was saved by science version %u, not %u.", pszDiskName, pHead->nScience, (UINT)Core.GetScienceVersion());
+        return NULL;
+    }
 
-        return nSize;
+    CString sObjType  = pPool + pHead->nObjType;
+    CString sFullname = pPool + pHead->nFileName;
+    if (pszFullname && sFullname.CompareNoCase(pszFullname) != 0)
+    {
+        sError.Format("BinSnapOpen: '%s' is a snapshot of '%s', not '%s'.", pszDiskName, (LPCSTR)sFullname, pszFullname);
+        return NULL;
     }
-    catch (...)
+    CFileObj* pFO = pFiles->NewFileObj(sObjType, sFullname);
+    if (!pFO)
     {
-        try
-        {
-            CString sInfo; sInfo.Format("RomeFileGetAttrDimSize: exception for File = '0x%08X', Attr = '%s'.", pFile, (CString)pszAttr);
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
-        }
-        catch (...)
+        sError.Format("BinSnapOpen: failed to create file '%s' of type '%s'.", sFullname, sObjType);
+        return NULL;
+    }
+    pFO->SetScienceVersion(pHead->nScience);
+    Core.SetActiveObj(pFO);
+
+    for (UINT a = 0; a < pHead->nAttrs; a++)
+    {
+        const BINSNAPATTR& Rec = pAttrs[a];
+        if (Rec.nFlags & BINSNAP_ATTR_CALC)
+            continue;
+
+        CAttr* pAttr = StatFindOrCreate(pPool + Rec.nName, pFO);
+        if (!pAttr)
+            continue;
+        if (Rec.nFlags & BINSNAP_ATTR_DIM)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileGetAttrDimSize: exception in catch block.");
+            if (pAttr->IsDimension() && Rec.nCount > 0 && pAttr->GetSize() != (int)Rec.nCount)
+                pAttr->SetRootSize(Rec.nCount);
+            continue;
         }
+
+        LPCSTR pszUnit = pPool + Rec.nUnit;
+        for (UINT i = 0; i < Rec.nCount; i++)
+            ::DoCmdSetStr(pAttr, pPool + pValues[Rec.nFirst + i], i, SIF_QUIET, RX_VARIANT_INTERVAL, pszUnit);
+
+        // Let a new pointer set its defaults before the values that follow it.
+        if (Rec.nFlags & BINSNAP_ATTR_PTR)
+            StatFinishUpdates(Core.Engine);
     }
+    StatFinishUpdates(Core.Engine);
+
+    AttrHandlesInvalidate(Core);
+    EngineCountSet(Core);
+    return pFO;
 }
 
 
-//! @deprecated Use RomeFileGetAttrSizeEx() instead.
+//! Open a binary snapshot saved by BinSnapSave() (the "#BIN:" prefix of RomeFilesOpen()).
+//! The snapshot is read in place from a mapped view (see BinSnapOpenView()).
+//! The caller must hold the API lock.
+//! @param pFiles       The filesystem to open the file in.
+//! @param pszDiskName  The path of the snapshot.
+//! @param sError       Returns the reason on failure.
+//! @return  A pointer to the opened file, or NULL on failure.
 //!
-//! Get the size of an attribute, returned as a @b short integer.
-//! This will create an attr that doesn't exist yet.
-//! The attr must be requested in the correct file type.
-//! @param pFile    The Rome file to get the attr in.
-//! @param pszAttr  The parameter name used by the catalog (e.g. "CLAY").
-//! @return  The attr size, or #RX_FAILURE (-1) on error.
+LOCAL CFileObj* BinSnapOpen(RT_Files* pFiles, LPCSTR pszDiskName, CString& sError)
+{
+    CBinSnapView View;
+    if (!View.Open(pszDiskName))
+    {
+        sError.Format("BinSnapOpen: failed to open file '%s'.", pszDiskName);
+        return NULL;
+    }
+    return BinSnapOpenView(pFiles, View, pszDiskName, NULL, sError);
+}
+
+
+//! Find the snapshot of a database file in the shared cache of its core (see RomeDatabaseSetSharedCache()).
+//! Snapshots are named by a hash of the file's name, its date in the database and the
+//!   science version, so a changed record gets a new snapshot instead of a stale one.
+//! The caller must hold the API lock.
+//! @param pFiles       The filesystem of the core.
+//! @param pszFullname  The fullname of the database file (e.g. "soils\default").
+//! @param sPath        Returns the path of the snapshot, which may not exist yet.
+//! @return  FALSE if the core has no shared cache, or the file isn't in the database.
 //!
-//! @warning this function cannot return a size greater than 32767.
-//!   For attrs which might exceed that size, use RomeFileGetAttrSizeEx().
-//!   If the size is greater than 32767, this function will return #RX_FAILURE
-//!   instead and set an error message which can be retrieved by RomeGetLastError().
-//! @see RomeFileGetAttrSizeEx(), RomeFileSetAttrSize().
-//! @RomeAPI Wrapper for CAttr::GetSize().
+LOCAL BOOL SharedCachePath(CFileSys* pFiles, LPCSTR pszFullname, CString& sPath)
+{
+    CRomeCore& Core = pFiles->Core;
+    const CString sDir = CoreApi(Core).sSharedCacheDir;
+    if (sDir.IsEmpty())
+        return FALSE;
+
+    DBFIND* pFind = DbFindOpen(pFiles->GetDatalink(), pszFullname, DBSYS_FIND_BOTH | DBSYS_FIND_EXACT);
+    if (!pFind)
+        return FALSE;
+    CString sDate, sFolder;
+    if (DbFindSeek(pFind, 0) >= 0)
+    {
+        sDate   = DbFindInfo(pFind, RX_DBFILEINFO_DATE);
+        sFolder = DbFindInfo(pFind, RX_DBFILEINFO_FOLDER);
+    }
+    DbFindClose(pFind);
+    if (sDate.IsEmpty() || sFolder == "1")
+        return FALSE;
+
+    CString sName = pszFullname;
+    sName.MakeLower();
+    const UINT nScience = Core.GetScienceVersion();
+    ULONGLONG nHash = FNV1A_64_INIT;
+    nHash = HashFnv1a(nHash, (LPCSTR)sName, sName.GetLength() + 1);
+    nHash = HashFnv1a(nHash, (LPCSTR)sDate, sDate.GetLength() + 1);
+    nHash = HashFnv1a(nHash, &nScience, sizeof(nScience));
+    sPath.Format("%s\\%016I64x.r2snap", (LPCSTR)sDir, nHash);
+    return TRUE;
+}
+
+
+//! Save an open database file to its snapshot in the shared cache, for the other cores and processes.
+//! The caller must hold the API lock.
+//! @param Core   The core the file belongs to.
+//! @param pFO    The file to save.
+//! @param sPath  The path of its snapshot, from SharedCachePath().
+//! @return  TRUE if the snapshot was saved. If another process saved it first, theirs is kept.
 //!
-ROME_API RT_SHORT RomeFileGetAttrSize(CFileObj* pFile, RT_CNAME pszAttr)
+LOCAL BOOL SharedCacheSave(CRomeCore& Core, CFileObj* pFO, const CString& sPath)
 {
-    try
+    // Write to a name of our own and then rename it, so no one maps a partial snapshot.
+    CString sError;
+    CString sTemp;
+    sTemp.Format("%s.%u.%u.tmp", (LPCSTR)sPath, GetCurrentProcessId(), GetCurrentThreadId());
+    if (BinSnapSave(Core, pFO, sTemp, FALSE, sError) && MoveFileEx(sTemp, sPath, MOVEFILE_WRITE_THROUGH))
     {
-	    // Switch to the app's MFC module state while in this scope.
-	    // This is required for many MFC functions to work correctly.
-	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+        InterlockedIncrement(&RomeStatSharedSaves);
+        return TRUE;
+    }
+    DeleteFile(sTemp);
+    return FALSE;
+}
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,              "RomeFileGetAttrSize: NULL file pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszAttr), "RomeFileGetAttrSize: empty attr name.");
-        CRomeCore& Core = pFile->Core;
-        BOOL bValidApp = (&Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,             "RomeFileGetAttrSize: invalid file pointer.");
-		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,              "RomeFileGetAttrSize: RomeExit() has already been called.");
-        BOOL bValidFile = CFileObj::IsValid(pFile);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,         "RomeFileGetAttrSize: invalid file pointer.");
-#ifdef USE_ROMEAPI_REFCOUNT
-        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,         "RomeFileGetAttrSize: invalid file reference count.");
-#endif
-#if USE_ROMEAPI_THREADIdS
-        THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeFileGetAttrSize: Rome API function called on different thread from RomeInit().");
-#endif
 
-        ROME_API_LOCK();
+//! Open a database file through the shared cache of its core (see RomeDatabaseSetSharedCache()).
+//! A file with a snapshot in the cache is opened from it. Any other file is read from
+//!   the database as usual, and then saved to the cache for the other cores and processes.
+//! A snapshot is only mapped while the file is opened from it, since its values are set into the file.
+//! The caller must hold the API lock and FILESYS_WRITELOCK().
+//! @param pFiles       The filesystem to open the file in.
+//! @param pszFullname  The fullname of the database file (e.g. "soils\default").
+//! @param nFlags       The flags to open it with, as for CFileSys::OpenOrCreateFile().
+//! @param pFO          Returns the opened file, or NULL on failure.
+//! @return  TRUE if the cache handled the open, or FALSE if the caller should open the
+//!   file as usual: the core has no shared cache, the flags aren't the default
+//!   #RX_FILESOPEN_USE_OPEN | #RX_FILESOPEN_NO_CREATE, the file is already open,
+//!   it isn't in the database, or its snapshot couldn't be used.
+//!
+LOCAL BOOL SharedCacheOpen(CFileSys* pFiles, LPCSTR pszFullname, UINT nFlags, CFileObj*& pFO)
+{
+    CRomeCore& Core = pFiles->Core;
+    pFO = NULL;
 
-	    // Wait for the stack to finish.
-        // This makes sure that a size retrieved below won't get changed by functions on the stack.
-	    Core.Engine.FinishUpdates();
+    if (CoreApi(Core).sSharedCacheDir.IsEmpty())
+        return FALSE;
+    if (!::HasFlag(nFlags, OMF_USE_OPEN) || !::HasFlag(nFlags, OMF_NO_CREATE))
+        return FALSE;
+
+    // An open file is left to CFileSys::OpenOrCreateFile(), so it isn't opened twice.
+    const int nFiles = pFiles->GetFileCount();
+    for (int i = 0; i < nFiles; i++)
+    {
+        RT_FileObj* pOpen = pFiles->GetFile(i);
+        if (pOpen && _stricmp(pOpen->GetFileName(), pszFullname) == 0)
+            return FALSE;
+    }
+
+    CString sPath;
+    if (!SharedCachePath(pFiles, pszFullname, sPath))
+        return FALSE;
+
+    CString sError;
+    CBinSnapView View;
+    if (View.Open(sPath))
+    {
+        pFO = BinSnapOpenView(pFiles, View, sPath, pszFullname, sError);
+        if (!pFO)
+            return FALSE;
+        InterlockedIncrement(&RomeStatSharedHits);
+        return TRUE;
+    }
+
+    pFO = pFiles->OpenOrCreateFile(pszFullname, nFlags);
+    if (pFO)
+        SharedCacheSave(Core, pFO, sPath);
+    return TRUE;
+}
+
+
+//! The baseline of a file captured by RomeFileReset(), which it restores the file to.
+//! It holds the tables of a binary snapshot (see BinSnapSave()) in memory, without calculated values.
+typedef struct FILEBASELINE
+{
+    BINSNAPWRITER   W;
+    CMapStringToPtr mapAttrs;   //!< The attr names recorded in @c W.
+} FILEBASELINE;
+
+
+//! Find the baseline of a file.
+//! The caller must hold the API lock of the file's core.
+//! @return The baseline, or NULL if none was captured.
+//!
+LOCAL FILEBASELINE* FileBaselineFind(CFileObj* pFile)
+{
+    CMapPtrToPtr& Baselines = CoreApi(pFile->Core).FileBaselines;
+    if (Baselines.IsEmpty())
+        return NULL;
+    void* pBase = NULL;
+    return Baselines.Lookup(pFile, pBase)? (FILEBASELINE*)pBase: NULL;
+}
+
+
+//! Set or free the baseline of a file, freeing any baseline it had.
+//! The caller must hold the API lock of the file's core.
+//! @param pFile  The file.
+//! @param pBase  The new baseline, which is owned by the core's API state from now on, or NULL.
+//!
+LOCAL void FileBaselineSet(CFileObj* pFile, FILEBASELINE* pBase)
+{
+    CMapPtrToPtr& Baselines = CoreApi(pFile->Core).FileBaselines;
+    void* pOld = NULL;
+    if (Baselines.Lookup(pFile, pOld))
+        Baselines.RemoveKey(pFile);
+    if (pBase)
+        Baselines.SetAt(pFile, pBase);
+    delete (FILEBASELINE*)pOld;
+}
+
+
+//! Free the baselines of the files of a core which have been closed, or of all its files.
+//! The API functions which close files call this, since a new file may be given a closed file's address.
+//! The caller must hold the API lock.
+//! @param Core  The core.
+//! @param bAll  TRUE to free the baselines of open files too (e.g. in RomeExit()).
+//!
+LOCAL void FileBaselinesPrune(CRomeCore& Core, BOOL bAll)
+{
+    CMapPtrToPtr& Baselines = CoreApi(Core).FileBaselines;
+    if (Baselines.IsEmpty())
+        return;
+
+    CList<void*, void*> aKeys;
+    POSITION pos = Baselines.GetStartPosition();
+    while (pos)
+    {
+        void* pKey  = NULL;
+        void* pBase = NULL;
+        Baselines.GetNextAssoc(pos, pKey, pBase);
+        BOOL bOpen = FALSE;
+        const int nFiles = bAll? 0: Core.Files.GetFileCount();
+        for (int i = 0; i < nFiles && !bOpen; i++)
+            bOpen = (Core.Files.GetFile(i) == (CFileObj*)pKey);
+        if (!bOpen)
+        {
+            aKeys.AddTail(pKey);
+            delete (FILEBASELINE*)pBase;
+        }
+    }
+    while (!aKeys.IsEmpty())
+        Baselines.RemoveKey(aKeys.RemoveHead());
+}
 
-	    FILEOBJ_READLOCK(pFile);
 
-        CString sFile = pFile->GetFileName();
-	    CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileGetAttrSize", "file='%s' attr='%s'>\n", XMLEncode(sFile), pszAttr);
-#if USE_ROMESHELL_LOGGING
-        LogShellActivate(sFile);
-        LogFilePrintf1(LOG_SHELL, "RomeFileGetAttrSize \"%s\"\n", pszAttr);
-#endif
+//! Capture the values of a file as a baseline for RomeFileReset().
+//! The caller must hold the API lock, and have drained the engine.
+//! @param Core    The core the file belongs to.
+//! @param pFile   The file.
+//! @param sError  Returns the reason on failure.
+//! @return The new baseline, or NULL if the file can't be held by a snapshot (see BinSnapAddObj()).
+//!
+LOCAL FILEBASELINE* FileBaselineCapture(CRomeCore& Core, CFileObj* pFile, CString& sError)
+{
+    FILEBASELINE* pBase = new FILEBASELINE;
+    pBase->W.mapPool.InitHashTable(4099);
+    BinSnapAddStr(pBase->W, "");
+    if (!BinSnapAddObj(pBase->W, pFile, "", FALSE, sError))
+    {
+        sError.Replace("BinSnapSave:", "RomeFileReset:");
+        delete pBase;
+        return NULL;
+    }
 
-	    // Find the attribute in the file.
-	    CAttr* pAttr = FindOrCreate(pszAttr, pFile);
-#if USE_ROMEAPI_ZEROATTRSIZE
-        //! @note If symbol #USE_ROMEAPI_ZEROATTRSIZE is defined, and the attr is not found,
-        //!   return 0 if this is a legal parameter name.
-        //! This allows gracefully handling asking for a parameter in a "polymorphic" object type,
-        //!   when that object type is empty (e.g. "OP_PROCESS_NO_EFFECT").
-        //! The size of an attr that exists will never be 0.
-        if (pAttr == NULL && pFile->IsEmpty() && Core.AttrCatalog.GetListing(pszAttr))
-            return 0;
-#endif
-	    ATTR_READLOCK(pAttr);
+    LPCSTR pPool = (LPCSTR)pBase->W.aPool.GetData();
+    pBase->mapAttrs.InitHashTable(1031);
+    for (int a = 0; a < pBase->W.aAttrs.GetSize(); a++)
+        pBase->mapAttrs.SetAt(pPool + pBase->W.aAttrs[a].nName, NULL);
+    return pBase;
+}
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr,              "+RomeFileGetAttrSize: failed to create attr.");
 
-		// Verify that the engine is finished before we get information back from the model.
-	    Core.Engine.FinishUpdates();
+//! Add an attr to the baseline of its file before it is first set through the API,
+//!   if it wasn't in the file when the baseline was captured (e.g. FindOrCreate() just created it).
+//!   RomeFileReset() then restores it to the value it had before it was first set.
+//! This does nothing if the file has no baseline.
+//! The caller must hold the API lock.
+//! @param pFile    The file the attr is set through.
+//! @param pszAttr  The attr name used to set it, including any "#RD:" chain.
+//! @param pAttr    The attr.
+//!
+LOCAL void FileBaselineNoteSet(CFileObj* pFile, LPCSTR pszAttr, CAttr* pAttr)
+{
+    FILEBASELINE* pBase = FileBaselineFind(pFile);
+    if (!pBase || !pAttr || !pszAttr)
+        return;
+    void* pUnused = NULL;
+    if (pBase->mapAttrs.Lookup(pszAttr, pUnused))
+        return;
+    CListing* pListing = pAttr->GetListing();
+    if (!pListing || pListing->GetFlag(ACF_NO_USER_EDIT))
+        return;
+
+    const ParamType attrType = pListing->GetType();
+    const BOOL bPtr = (attrType == ATTR_PTR || attrType == ATTR_SUB);
+    const BOOL bDim = !bPtr && pAttr->IsDimension();
+    BinSnapAddAttr(pBase->W, pAttr, pszAttr, (bPtr? BINSNAP_ATTR_PTR: 0) | (bDim? BINSNAP_ATTR_DIM: 0));
+    pBase->mapAttrs.SetAt(pszAttr, NULL);
+}
 
-        int nSize = pAttr->GetSize();
 
-        RT_SHORT xSize = (RT_SHORT)nSize;
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nSize == (int)xSize, "RomeFileGetAttrSize: size is too large to cast to short.");
+//! Restore a file to its baseline, setting only the values and sizes which differ from it.
+//! The records are restored in the order BinSnapOpenView() sets them: pointers, then
+//!   dimensions, then values. A pointer which is already the same is left alone,
+//!   so the files it points to aren't reloaded and its subobject keeps its defaults.
+//! The caller must hold the API lock, and have drained the engine.
+//! @param Core         The core the file belongs to.
+//! @param pFile        The file.
+//! @param Base         Its baseline.
+//! @param bPtrChanged  Returns TRUE if a pointer value was changed.
+//! @return The number of values and sizes which were changed.
+//!
+LOCAL int FileBaselineRestore(CRomeCore& Core, CFileObj* pFile, const FILEBASELINE& Base, BOOL& bPtrChanged)
+{
+    const BINSNAPATTR* pAttrs  = Base.W.aAttrs.GetData();
+    const int          nAttrs  = (int)Base.W.aAttrs.GetSize();
+    const DWORD*       pValues = Base.W.aValues.GetData();
+    LPCSTR             pPool   = (LPCSTR)Base.W.aPool.GetData();
 
-        return (RT_SHORT)nSize;
-    }
-    catch (...)
+    int nChanged = 0;
+    bPtrChanged = FALSE;
+    for (int nPass = 0; nPass < 3; nPass++)
     {
-        try
-        {
-            CString sInfo; sInfo.Format("RomeFileGetAttrSize: exception for File = '0x%08X', Attr = '%s'.", pFile, (CString)pszAttr);
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
-        }
-        catch (...)
+        for (int a = 0; a < nAttrs; a++)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileGetAttrSize: exception in catch block.");
+            const BINSNAPATTR& Rec = pAttrs[a];
+            const BOOL bPtr = (Rec.nFlags & BINSNAP_ATTR_PTR) != 0;
+            const BOOL bDim = (Rec.nFlags & BINSNAP_ATTR_DIM) != 0;
+            if (nPass != (bPtr? 0: bDim? 1: 2))
+                continue;
+
+            CAttr* pAttr = StatFindOrCreate(pPool + Rec.nName, pFile);
+            if (!pAttr)
+                continue;
+            if (bDim)
+            {
+                if (pAttr->IsDimension() && Rec.nCount > 0 && pAttr->GetSize() != (int)Rec.nCount)
+                {
+                    pAttr->SetRootSize(Rec.nCount);
+                    EngineCountSet(Core);
+                    ListenersAddChange(Core, pFile, pAttr, -1, RX_CHANGE_SIZE);
+                    nChanged++;
+                }
+                continue;
+            }
+
+            LPCSTR pszUnit = pPool + Rec.nUnit;
+            const UINT nCount = min(Rec.nCount, (UINT)pAttr->GetSize());
+            BOOL bSet = FALSE;
+            for (UINT i = 0; i < nCount; i++)
+            {
+                LPCSTR pszBase = pPool + pValues[Rec.nFirst + i];
+                LPCSTR pszCur  = AttrGetStr(pAttr, i, RX_VARIANT_INTERVAL, pszUnit);
+                if (strcmp(pszCur? pszCur: "NULL", pszBase) == 0)
+                    continue;
+                if (::DoCmdSetStr(pAttr, pszBase, i, SIF_EXTERNAL | SIF_QUIET, RX_VARIANT_INTERVAL, pszUnit) != RX_TRUE)
+                    continue;
+                EngineCountSet(Core);
+                ListenersAddChange(Core, pFile, pAttr, i, RX_CHANGE_VALUE);
+                nChanged++;
+                bSet = TRUE;
+            }
+
+            // Let a new pointer set its defaults before the values that follow it.
+            if (bPtr && bSet)
+            {
+                bPtrChanged = TRUE;
+                StatFinishUpdates(Core.Engine);
+            }
         }
+
+        // Settle the resizes before the values are compared.
+        if (nPass == 1)
+            StatFinishUpdates(Core.Engine);
     }
+    StatFinishUpdates(Core.Engine);
+    return nChanged;
 }
 
 
-//! Get the size of an attribute, returned as a @b long integer.
-//! This will create an attr that doesn't exist yet.
-//! The attr must be requested in the correct file type.
-//! @param pFile    The Rome file to get the attr in.
-//! @param pszAttr  The parameter name used by the catalog (e.g. "CLAY").
-//! @return  The attr size, or #RX_FAILURE (-1) on error.
-//!
-//! @warning this function is required when the size will exceed 32767.
-//! @see RomeFileGetAttrSize(), RomeFileSetAttrSize()
-//! @RomeAPI Wrapper for CAttr::GetSize().
+//! Restore a file to a baseline of its values, instead of closing and reopening it.
+//! Between the scenarios of a loop this is much cheaper than RomeFilesCloseAll() and
+//!   RomeFilesOpen(), since only the values which differ from the baseline are set:
+//!   a climate or soil pointer which is the same is left alone, so its files stay loaded,
+//!   and the attrs created by FindOrCreate() are kept.
+//! Capture the baseline once (usually just after opening the file), and then restore it before each scenario.
+//!
+//! @param pFile   A pointer to a Rome file.
+//! @param nFlags  What to do:
+//! - #RX_FILERESET_RESTORE  Restore the file to its baseline.
+//! - #RX_FILERESET_CAPTURE  Capture the file's current values as its baseline, replacing any earlier one.
+//!                          The file's own values and those of its embedded subobjects are captured,
+//!                          as for a binary snapshot (see RomeFileSaveAsEx()), but calculated values aren't.
+//! - #RX_FILERESET_RELEASE  Free the file's baseline. Closing the file frees it too.
+//! @return  For #RX_FILERESET_RESTORE, the number of values and sizes which were changed (0 if none differed).
+//!   For #RX_FILERESET_CAPTURE, the number of values captured.
+//!   For #RX_FILERESET_RELEASE, RX_TRUE if the file had a baseline, otherwise RX_FALSE.
+//!   Returns #RX_FAILURE (-1) on error, e.g. restoring a file without a baseline.
+//!
+//! @note Attrs which weren't in the file when the baseline was captured are added to it
+//!   just before they are first set by RomeFileSetAttrValue(), RomeFileSetAttrValues(),
+//!   RomeAttrHandleSetValue(), RomeFileSetAttrSize() or RomeFileSetDimRows(),
+//!   so they are restored to the value they were created with.
+//! @note The restore doesn't record undo information, and the engine is run until it is finished.
+//!   The changes are sent to coalesced listeners (see RomeListenerCoalesced()) as for other sets.
+//! @see RomeFilesOpen(), RomeFileClone()
+//! @RomeAPI
 //!
-ROME_API RT_INT RomeFileGetAttrSizeEx(CFileObj* pFile, RT_CNAME pszAttr)
+ROME_API RT_INT RomeFileReset(RT_FileObj* pFile, RT_UINT nFlags)
 {
     try
     {
-	    // Switch to the app's MFC module state while in this scope.
-	    // This is required for many MFC functions to work correctly.
-	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+        // Switch to the app's MFC module state while in this scope.
+        // This is required for many MFC functions to work correctly.
+        AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,              "RomeFileGetAttrSizeEx: NULL file pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszAttr), "RomeFileGetAttrSizeEx: empty attr name.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,            "RomeFileReset: NULL file pointer.");
         CRomeCore& Core = pFile->Core;
-        BOOL bValidApp = (&Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,          "RomeFileGetAttrSizeEx: invalid file pointer.");
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,        "RomeFileReset: invalid file system pointer.");
 		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeFileGetAttrSizeEx: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,         "RomeFileReset: RomeExit() has already been called.");
         BOOL bValidFile = CFileObj::IsValid(pFile);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,         "RomeFileGetAttrSizeEx: invalid file pointer.");
-#ifdef USE_ROMEAPI_REFCOUNT
-        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,         "RomeFileGetAttrSizeEx: invalid file reference count.");
-#endif
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,       "RomeFileReset: invalid file pointer.");
+        BOOL bValidFlags = (nFlags == RX_FILERESET_RESTORE || nFlags == RX_FILERESET_CAPTURE || nFlags == RX_FILERESET_RELEASE);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFlags,      "RomeFileReset: invalid flags.");
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
         BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeFileGetAttrSizeEx: Rome API function called on different thread from RomeInit().");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,     "RomeFileReset: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
-
-	    // Wait for the stack to finish.
-        // This makes sure that a size retrieved below won't get changed by functions on the stack.
-	    Core.Engine.FinishUpdates();
-
-	    FILEOBJ_READLOCK(pFile);
+        ROME_API_WRITELOCK(&Core);
 
-        CString sFile = pFile->GetFileName();
-#if USE_LOG_FILES
-	    CLogFileElement log(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileGetAttrSizeEx", "file='%s' attr='%s'>\n", XMLEncode(sFile), pszAttr);
+        if (!CoreGetBatch(Core))
+        {
+            CString sFile = pFile->GetFileName();
+            ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST, "user", "RomeFileReset", "file='%s' flags='%d'/>\n", (CString)XMLEncode(sFile), nFlags));
 #if USE_ROMESHELL_LOGGING
-        LogShellActivate(sFile);
-        LogFilePrintf1(LOG_SHELL, "RomeFileGetAttrSizeEx \"%s\"\n", pszAttr);
+            ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "//RomeFileReset \"%s\" %d\n", sFile, nFlags));
 #endif
-#endif // USE_LOG_FILES
+        }
 
-	    // Find the attribute in the file.
-	    CAttr* pAttr = FindOrCreate(pszAttr, pFile);
-#if USE_ROMEAPI_ZEROATTRSIZE
-        //! @note If symbol #USE_ROMEAPI_ZEROATTRSIZE is defined, and the attr is not found,
-        //!   return 0 if this is a legal parameter name.
-        //! This allows gracefully handling asking for a parameter in a "polymorphic" object type,
-        //!   when that object type is empty (e.g. "OP_PROCESS_NO_EFFECT").
-        //! The size of an attr that exists will never be 0.
-        if (pAttr == NULL && pFile->IsEmpty() && Core.AttrCatalog.GetListing(pszAttr))
-            return 0;
-#endif
-	    ATTR_READLOCK(pAttr);
+        if (nFlags == RX_FILERESET_RELEASE)
+        {
+            BOOL bHad = (FileBaselineFind(pFile) != NULL);
+            FileBaselineSet(pFile, NULL);
+            return bHad? RX_TRUE: RX_FALSE;
+        }
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr,              "RomeFileGetAttrSizeEx: failed to create attr.");
+        // Verify that the engine is finished before we read or alter the model.
+        StatFinishUpdates(Core.Engine);
+	    FILEOBJ_READLOCK(pFile);
 
-		// Verify that the engine is finished before we get information back from the model.
-	    Core.Engine.FinishUpdates();
+        if (nFlags == RX_FILERESET_CAPTURE)
+        {
+            CString sError;
+            FILEBASELINE* pBase = FileBaselineCapture(Core, pFile, sError);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pBase,        sError);
+            const int nValues = (int)pBase->W.aValues.GetSize();
+            FileBaselineSet(pFile, pBase);
+            return nValues;
+        }
 
-        int nSize = pAttr->GetSize();
+        FILEBASELINE* pBase = FileBaselineFind(pFile);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pBase,            "RomeFileReset: the file has no baseline (use RX_FILERESET_CAPTURE first).");
 
-#if USE_LOG_FILES
-        // Log this size if it's not the default.
-        if (nSize != 1 && log.Logged())
-	        LogFilePrintf1(LOG_HIST, "<value s='%d'/>", nSize);
-#endif
+        Core.SetActiveObj(pFile);
+        BOOL bPtrChanged = FALSE;
+        const int nChanged = FileBaselineRestore(Core, pFile, *pBase, bPtrChanged);
 
-        return nSize;
+        // A new pointer value re-targets "#RD:" chained attr names, which makes attr handles stale.
+        if (bPtrChanged)
+            AttrHandlesInvalidate(Core);
+        return nChanged;
     }
     catch (...)
     {
         try
         {
-            CString sInfo; sInfo.Format("RomeFileGetAttrSizeEx: exception for File = '0x%08X', Attr = '%s'.", pFile, (CString)pszAttr);
+            CString sInfo; sInfo.Format("RomeFileReset: exception for File = '0x%08X', Flags = %d.", pFile, nFlags);
             ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileGetAttrSizeEx: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileReset: exception in catch block.");
         }
     }
 }
 
 
-//! Get the "value" string for an attribute, not the "display" string.
-//!   Note: this string should not exceed #MAX_SETSTR_SIZE in length.
-//! @note This will create an attr that doesn't exist yet.
-//! @note The attr must be requested in the correct file type.
-//! @note This function will use the unit and variant from the current template.
-//! @param pFile   The Rome file to get the attr in.
-//! @param pszAttr The parameter name used by the catalog (e.g. "CLAY").
-//! @param nIndex  The "flat" index (use 0 for a 1x1 attr).
-//! @return  A string pointer for the value at the given index.
-//!   Returns NULL on error, including out-of-range index.
+//! Save this file to the database under a specific name.
+//! Mark the file as clean after saving to the database.
+//! @param pFile  A pointer to a Rome file.
+//! @param pszNewName  The fullname of the file to save as.
+//! - Example: "profiles\working\farm1".
+//! - This can be an external file if prefix "#XML:" is used.<br>
+//!     Example: "#XML:C:\Rusle2\Export\profile1.pro.xml".
+//! - This can be an external file if prefix "#SKEL:" is used.<br>
+//!     Example: "#SKEL:C:\Rusle2\Export\management1.man.skel".
+//! @return  RX_TRUE on success, RX_FALSE on failure, #RX_FAILURE on error.
 //!
-//! @warning This function cannot handle an index greater than 32767.
-//! @since 2007-08-10  -1 returns the "current" index of the parameter.
-//! @see RomeFileSetAttrValue().
-//! @RomeAPI Wrapper for AttrGetStr().
+//! @see RomeFilesOpen(), RomeFileSave(), RomeFileSaveAsEx().
+//! @RomeAPI Wrapper for RomeFileSaveAsEx().
 //!
-ROME_API RT_CSTR RomeFileGetAttrValue(CFileObj* pFile, RT_CNAME pszAttr, RT_INT nIndex)
+ROME_API RT_BOOL RomeFileSaveAs(CFileObj* pFile, RT_CSTR pszNewName)
 {
-	RT_CSTR retVal = RomeFileGetAttrValueAux(pFile, pszAttr, nIndex, RX_VARIANT_CATALOG, "#U_TEMPLATE");
-	return retVal;
+    // Note: this function doesn't require the AFX_MANAGE_STATE macro.
+    // Note: this function doesn't require exception handling.
+    // Note: this function doesn't require resource locking.
+    // Note: this function doesn't require command logging.
+
+	return RomeFileSaveAsEx(pFile, pszNewName, 0);
 }
 
 
-ROME_API RT_CSTR RomeFileGetAttrValueAux(CFileObj* pFile, RT_CNAME pszAttr, RT_INT nIndex, RT_UINT nVariant, RT_CNAME pszUnit)
+//! Save this file to the database under a specific name.
+//! Mark the file as clean after saving to the database.
+//! @param pFile  A pointer to a Rome file.
+//! @param pszNewName  The fullname of the file to save as.
+//! - Example: "profiles\working\farm1".
+//! - This can be an external file if prefix "#XML:" is used.<br>
+//!     Example: "#XML:C:\Rusle2\Export\profile1.pro.xml".
+//! - This can be an external file if prefix "#SKEL:" is used.<br>
+//!     Example: "#SKEL:C:\Rusle2\Export\management1.man.skel".
+//! - This can be an external fileset if prefix "#FILESET:" is used.<br>
+//!     Example: "#FILESET:C:\Rusle2\Export\profile1.fileset.xml".
+//! - This can be an external binary snapshot if prefix "#BIN:" is used.<br>
+//!     Example: "#BIN:C:\Rusle2\Export\profile1.pro.bin".<br>
+//!     A snapshot holds the same value strings as XML, without the markup, and can only be opened
+//!     by the same science version. Opening it skips the XML parse, but not the parsing of the
+//!     values or the engine run.
+//! @param nFlags  Flags which modify saving behavior.
+//! - #RX_FILE_SAVEASEX_CALC   Save calculated data in \<Calc> tags, or in a binary snapshot.
+//!                            Either way they are only for reading: opening the file calculates them again.
+//! - #RX_FILE_SAVEASEX_BINARY Save as a binary snapshot. The name is an external path, with or without prefix "#BIN:".
+//!
+//! @return  RX_TRUE on success, RX_FALSE on failure, #RX_FAILURE on error.
+//!
+//! @see RomeFilesOpen(), RomeFileSave(), RomeFileSaveAs().
+//! @RomeAPI Wrapper for CFileSys::Save().
+//!
+ROME_API RT_BOOL RomeFileSaveAsEx(CFileObj* pFile, RT_CSTR pszNewName, RT_UINT nFlags)
 {
     try
     {
@@ -3271,199 +8942,248 @@ ROME_API RT_CSTR RomeFileGetAttrValueAux(CFileObj* pFile, RT_CNAME pszAttr, RT_I
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pFile,              "RomeFileGetAttrValue: NULL file pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!strempty(pszAttr), "RomeFileGetAttrValue: empty attr name.");
-        BOOL bValidIndex = ((nIndex >= 0) || (nIndex == -1));
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidIndex,        "RomeFileGetAttrValue: invalid index.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,                 "RomeFileSaveAsEx: NULL file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszNewName), "RomeFileSaveAsEx: empty attr name.");
         CRomeCore& Core = pFile->Core;
-        BOOL bValidApp = (&Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,          "RomeFileGetAttrValue: invalid file pointer.");
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,             "RomeFileSaveAsEx: invalid file pointer.");
 		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,           "RomeFileGetAttrValue: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,              "RomeFileSaveAsEx: RomeExit() has already been called.");
         BOOL bValidFile = CFileObj::IsValid(pFile);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidFile,         "RomeFileGetAttrValue: invalid file pointer.");
-#ifdef USE_ROMEAPI_REFCOUNT
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,            "RomeFileSaveAsEx: invalid file pointer.");
+#if TARGET_ROMEDLL && defined(USE_ROMEAPI_REFCOUNT)
         BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidRefs,         "RomeFileGetAttrValue: invalid file reference count.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,            "RomeFileSaveAsEx: invalid file reference count.");
 #endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
         BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,       "RomeFileGetAttrValue: Rome API function called on different thread from RomeInit().");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,          "RomeFileSaveAsEx: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&Core);
 
-	    // Wait for the stack to finish.
-        // This makes sure that a value retrieved below won't get changed by functions on the stack.
-	    Core.Engine.FinishUpdates();
+        // Wait for the stack to finish.
+        // This makes sure that changes that would be made by functions on the stack
+        //   are done before the file is saved.
+	    StatFinishUpdates(Core.Engine);
+
+	    FILEOBJ_WRITELOCK(pFile);
 
         CString sFile = pFile->GetFileName();
-	    CLogFileElement3(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileGetAttrValue", "file='%s' attr='%s' index='%d'>\n", XMLEncode(sFile), pszAttr, nIndex);
+        ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileSaveAsEx", "file='%s' new='%s'>\n", XMLEncode(sFile), XMLEncode(pszNewName)));
 #if USE_ROMESHELL_LOGGING
-        LogShellActivate(sFile);
-        LogFilePrintf4(LOG_SHELL, "RomeFileGetAttrValue \"%s\" %d\n", pszAttr, nIndex);
+        ROME_API_LOG(LogFilePrintf3(LOG_SHELL, "RomeFileSaveAsEx \"%s\" \"%s\" %d\n", sFile, pszNewName, nFlags));
 #endif
 
-        // Find the attribute in the file.
-	    CAttr* pAttr = FindOrCreate(pszAttr, pFile);
+	    // The external filename, with any magic prefix stripped.
+	    LPCSTR pszDiskName = "";
+	    UINT   nExpFlags = 0;
 
-	    if (!pAttr)
+	    // Check for magic prefixes and strip them off:
+	    // "#BIN:"      export as a binary snapshot.
+	    // "#XML:"      export as Rusle2 XML format.
+	    // "#SKEL:"     export as NRCS management skeleton format.
+        // "#FILESET:"  export as Rusle2 full fileset XML format.
+        if (strncmp(pszNewName, "#BIN:", 5) == 0 || (nFlags & RX_FILE_SAVEASEX_BINARY))
         {
-            // The attr name must be listed in the catalog.
-            CListing* pAttrListing = Core.AttrCatalog.GetListing(pszAttr);
-            BOOL bValidAttrName = (pAttrListing != NULL);
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidAttrName,     "RomeFileGetAttrValue: no Rusle2 parameter of that name.");
-
-            // The attr must be asked for in the correct object type.
-            LPCSTR pszObjName = pFile->GetObjType()->GetName();
-            BOOL bValidObjType = pAttrListing->IsValidObject(pszObjName);
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidObjType,      "RomeFileGetAttrValue: Rusle2 parameter asked for in wrong object type.");
+		    // Get the external filename following the magic prefix.
+		    pszDiskName = (strncmp(pszNewName, "#BIN:", 5) == 0)? pszNewName + 5: pszNewName;
 
-            // If not handled above, give a generic error message.
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(pAttr,              "RomeFileGetAttrValue: failed to create attr.");
+            CString sError;
+            BOOL bSaved = BinSnapSave(Core, pFile, pszDiskName, (nFlags & RX_FILE_SAVEASEX_CALC) != 0, sError);
+            TEST_OR_SETERROR_AND_RETURN_FALSE(bSaved,              sError);
+            return RX_TRUE;
         }
+        else
+        if (strncmp(pszNewName, "#XML:", 5) == 0)
+	    {
+		    // Get the external filename following the magic prefix.
+		    pszDiskName = pszNewName + 5;
 
-        // Set the active object for debugging purposes.
-        Core.SetActiveObj(pAttr->GetObj());
+		    nExpFlags = EXPORTOBJECT_FORMAT_XML_NEW | EXPORTOBJECT_QUIET | ((nFlags & RX_FILE_SAVEASEX_CALC)? EXPORTOBJECT_CALC: 0);
+	    }
+#if USE_SKELETONS
+	    else
+	    if (strncmp(pszNewName, "#SKEL:", 6) == 0)
+	    {
+		    // Get the external filename following the magic prefix.
+		    pszDiskName = pszNewName + 6;
+
+		    nExpFlags = EXPORTOBJECT_FORMAT_MAN_CFF | EXPORTOBJECT_QUIET;
+	    }
+#endif // USE_SKELETONS
+#if USE_FILESETS
+	    else
+	    if (strncmp(pszNewName, "#FILELIST:", 10) == 0)
+	    {
+		    // Get the external filename following the magic prefix.
+		    pszDiskName = pszNewName + 10;
+
+            // Do the export.
+            UINT nFilesetFlags  = 0/*EXPORTFILESET_COUNTS*/  // Output counts (unsupported)
+                                | EXPORTFILESET_META_SET    // Output metadata for the fileset
+                                | EXPORTFILESET_META_FILE   // Output metadata for each file
+                                | EXPORTFILESET_LIST_DEPS   // Output dependent files
+                                ;
+            CString sBaseFile = pFile->GetFileName();
+            CString sFilesetArgs = "purpose=\"dependents\" basefile=\"" + sBaseFile + "\"";
+
+            RT_BOOL nRet = FilesetExport(Core, pszDiskName, nFilesetFlags, sFilesetArgs);
+            return nRet;
+	    }
+	    else
+	    if (strncmp(pszNewName, "#FILESET:", 9) == 0)
+	    {
+		    // Get the external filename following the magic prefix.
+		    pszDiskName = pszNewName + 9;
 
-        // Get the current index for the attribute.
-        if (nIndex == -1)
-        {
-            int      nCurrent = AttrGetIndex(pAttr, 0);
-            CString& sCurrent = RomeThreadGetNamedString("RomeFileGetAttrValue");
-            sCurrent = Int2Str(nCurrent);
-            return sCurrent;
-        }
+            // Do the export.
+            UINT nFilesetFlags  = 0/*EXPORTFILESET_COUNTS*/  // Output counts (unsupported)
+                                | EXPORTFILESET_META_SET    // Output metadata for the fileset
+                                | EXPORTFILESET_META_FILE   // Output metadata for each file
+                                | EXPORTFILESET_LIST_DEPS   // Output dependent files
+                                | EXPORTFILESET_DATA_OPEN   // Output XML data for open files
+                                | EXPORTFILESET_DATA_DB     // Output XML data for database files
+                                ;
+            if (nFlags & RX_FILE_SAVEASEX_CALC)
+                nFilesetFlags |= EXPORTFILESET_CALC_OPEN;
+            CString sBaseFile = pFile->GetFileName();
+            CString sFilesetArgs = "purpose=\"dependents\" basefile=\"" + sBaseFile + "\"";
 
-		// Verify that the engine is finished before we get information back from the model.
-	    Core.Engine.FinishUpdates();
+            RT_BOOL nRet = FilesetExport(Core, pszDiskName, nFilesetFlags, sFilesetArgs);
+            return nRet;
+	    }
+#endif // USE_FILESETS
+	    else
+	    {
+		    // Use a flag to signify saving INTO the database.
+		    nExpFlags = EXPORTOBJECT_FORMAT_XML_OLD;
+	    }
 
-		ASSERT_OR_RETURN_FALSE(pAttr->IsValidUnits(pszUnit));
-		if (strlen(pszUnit) == 0) // need to use the default
-			pszUnit = "#U_TEMPLATE";
+	    RT_BOOL nRet = RX_FALSE;
+        UINT nFormat = (nExpFlags & EXPORTOBJECT_FORMAT_MASK);
+	    switch (nFormat)
+	    {
+		    case EXPORTOBJECT_FORMAT_XML_NEW:
+			    nRet = ExportObject(Core, pFile, pszDiskName, nExpFlags);
+			    break;
+#if USE_SKELETONS
+		    case EXPORTOBJECT_FORMAT_MAN_CFF:
+			    nRet = ExportObject(Core, pFile, pszDiskName, nExpFlags);
+			    break;
+#endif // USE_SKELETONS
+		    case EXPORTOBJECT_FORMAT_XML_OLD:
+		    {
+			    LPCSTR pszOldName = pFile->GetFileName();
+                Core.SetActiveObj(pFile);
+			    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "FileSaveAs", "file='%s'>\n", XMLEncode(pszOldName)));
+//			    CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "SaveAs", "file='%s'>\n",   XMLEncode(pszNewName));
 
-	    // Get the "value" string from the attribute.
-	    LPCSTR pszValue = AttrGetStr(pAttr, nIndex, nVariant, pszUnit);
-//		LPCSTR pszValue = AttrGetStr(pAttr, nIndex, RX_VARIANT_TEMPLATE, "#U_TEMPLATE");
-		if (pszValue == NULL)
-            pszValue = "NULL";
+			    const UINT nSaveFlags = MoveFlag(~nFlags, RX_FILE_SAVEASEX_PRIVATE, FSF_MARKCLEAN | FSF_SAVE)
+                                      | MoveFlag( nFlags, RX_FILE_SAVEASEX_PRIVATE, FSF_PRIVATE)
+                                      | MoveFlag( nFlags, RX_FILE_SAVEASEX_CALC,    FSF_CALC)
+                                      ;
+			    nRet = Core.Files.Save(pFile, pszNewName, nSaveFlags);
 
-        // Log this for debugging purposes.
-        CString sIndex;
-        if (nIndex > 0) sIndex.Format(" index='%d'", nIndex);
-        CString sUnit;
-#if USE_USER_TEMPLATES
-        LPCSTR pszPrefUnit = pAttr->GetPrefUnit();
-        LPCSTR pszDefUnit  = pAttr->GetDefUnit();
-        if (!streq(pszPrefUnit, pszDefUnit))
-            sUnit.Format(" unit='%s'", pszPrefUnit);
-#endif
-        Core.SetActiveObj(pAttr->GetObj());
-        CLogFileElement4(LOGELEM_HIST, "user", "AttrGetStr", "attr='%s'%s><value s='%s'%s/></user>\n",
-                            pAttr->GetName(), sIndex, pszValue, sUnit);
+			    break;
+		    }
+		    default:
+                ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,    "RomeFileSaveAsEx: unknown flags argument.");
+			    break;
+	    }
+	    ASSERT(nRet);
 
-        ASSERT(MAX_SETSTR_SIZE < 0 || strlen(pszValue) <= MAX_SETSTR_SIZE);
-        return pszValue;
+	    return nRet;
     }
     catch (...)
     {
         try
         {
-            CString sInfo; sInfo.Format("RomeFileGetAttrValue: exception for File = '0x%08X', Attr = '%s', Index = %d.", pFile, (CString)pszAttr, (int)nIndex);
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
+            CString sInfo; sInfo.Format("RomeFileSaveAsEx: exception for File = '0x%08X', NewName = '%s', Flags = %d.", pFile, (CString)pszNewName, nFlags);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeFileGetAttrValue: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileSaveAsEx: exception in catch block.");
         }
     }
 }
 
 
-//! Get the "value" string for an attribute, not display text.
-//! See RomeFileGetAttrValue() [above] for full documentation.
-//!
-//! This version is required for use by Intel Fortran, which can't use functions
-//!   which return a string pointer. Instead it must have its first 2 arguments
-//!   be a pointer to a buffer and its length, to return the string in.
-//!   The function must have a return type of void.
-//! @param[out] pBuf  The pointer to a buffer to return a NUL-terminated string in.
-//! @param nBufLen    The length of the buffer to return a NUL-terminated string in.
-//! @param pFile      The pointer to a Rome file.
-//! @param pszAttr    The name of the parameter to get the value for.
-//! @param nIndex     The "flat" index (use 0 for a 1x1 attr).
-//!
-//! @warning This function cannot handle an index greater than 32767.
-//! @since 2007-08-10  -1 returns the "current" index of the parameter.
-//! @RomeAPI Wrapper for RomeFileGetAttrValue().
-//! @FortranAPI This function allows calling RomeFileGetAttrValue() from Fortran.
+//! Set the size of a dimension, for RomeFileSetAttrSize().
+//! The caller must have validated its arguments, hold the API lock and have drained the engine.
+//! @param pBatch  The batch mode state of the file's core, or NULL if it isn't in batch mode,
+//!   in which case the resize is logged to the history log.
+//! @return  RX_TRUE if the size changed, RX_FALSE if unchanged, #RX_FAILURE (-1) on error.
+//! @see RomeFileSetAttrSize() for the other arguments.
 //!
-ROME_API RT_void RomeFileGetAttrValueF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_FileObj* pFile, RT_CNAME pszAttr, RT_SHORT nIndex)
+LOCAL RT_SHORT FileSetAttrSize(CFileObj* pFile, RT_CNAME pszAttr, RT_INT nNewSize, BATCHCORE* pBatch)
 {
-    try
-    {
-    	// Does not require AFX_MANAGE_STATE() macro.
-
-	    // Switch to the app's MFC module state while in this scope.
-	    // This is required for many MFC functions to work correctly.
-	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+    CRomeCore& Core = pFile->Core;
 
-		// Validate arguments unique to the Fortran function version.
-		// The remaining arguments will be validated in the normal Rome API call.
-        ASSERT_OR_SETERROR_AND_RETURN(pBuf,           "RomeFileGetAttrValueF: NULL buffer pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN(nBufLen > 0,    "RomeFileGetAttrValueF: non-positive buffer length.");
+    // Find the attribute in the file.
+    CAttr* pAttr = StatFindOrCreate(pszAttr, pFile);
+    ATTR_WRITELOCK(pAttr);
 
-        ROME_API_LOCK();
+    ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr,                  "RomeFileSetAttrSize: failed to create attr.");
+    ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr->IsDimension(),   "RomeFileSetAttrSize: cannot resize a non-dimension attr.");
+    ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr->CanUserResize(), "RomeFileSetAttrSize: the attr cannot be resized.");
+    FileBaselineNoteSet(pFile, pszAttr, pAttr);
 
-        // Does not require command logging.
+    // Verify that the engine is finished before we get information back from the model.
+    StatFinishUpdates(Core.Engine);
 
-        LPCSTR pszValue = RomeFileGetAttrValue(pFile, pszAttr, nIndex);
-        CopyStrF(pBuf, nBufLen, pszValue);
+    const int nOldSize   = pAttr->GetSize();
+    const int nDeltaSize = nNewSize - nOldSize;
+#if 1
+    const BOOL bDelete   = (nDeltaSize < 0);
+    const int nNumRows   = abs(nDeltaSize);
+    //! @note If we are deleting, resize by repeatedly deleting the last index.
+    //! If we are inserting, resize by repeatedly inserting after the last index.
+    int nIndex = bDelete? nOldSize - 1: nOldSize;
+    for (int i = nNumRows; i > 0; i--)
+    {
+        UserCmdResizeDim(pAttr, "", nIndex, bDelete);
+        bDelete? nIndex--: nIndex++;
     }
-    catch (...)
+#else
+    pAttr->SetRootSize(nNewSize);
+#endif
+    if (nOldSize != nNewSize)
     {
-        try
-        {
-            if (pBuf && nBufLen > 0)
-                *pBuf = 0;
-            CString sInfo; sInfo.Format("RomeFileGetAttrValueF: exception for Buffer = '0x%08X', Length = %d, Attr = '%s', Index = %d.", pBuf, nBufLen, (CString)pszAttr, (int)nIndex);
-            ASSERT_OR_SETERROR_AND_RETURN(0,         sInfo);
-        }
-        catch (...)
-        {
-            ASSERT_OR_SETERROR_AND_RETURN(0,         "RomeFileGetAttrValueF: exception in catch block.");
-        }
+        AttrHandlesInvalidate(Core);
+        EngineCountSet(Core);
+        ListenersAddChange(Core, pFile, pAttr, -1, RX_CHANGE_SIZE);
+    }
+
+    ASSERT(Core.GetActiveObj() == pAttr->GetObj());
+    if (!pBatch)
+    {
+        ROME_API_LOGELEM(CLogFileElement3(LOGELEM_HIST, "user", "AttrSetSize", "attr='%s'><new s='%d'/><old s='%d'/></user>\n",
+                                pAttr->GetName(), nNewSize, nOldSize));
     }
+
+    return (nOldSize != nNewSize);
 }
 
 
-//! Get an array of floating point values.
-//! @param pFile          The pointer to a Rome file.
-//! @param pszAttr        The name of the parameter to get the values for.
-//! @param[out] pArray    The array to place the values in. This must be at least as large as the size in @p pSize.
-//! @param[in,out] pSize  (in)The size of the array to hold the values.
-//!                       If this size is too small, the size required will be set and this will return FALSE.
-//!                       (out) The number of data values returned in @p pArray.
-//! @param nVariant       The variant to get the values in.
-//! - #RX_VARIANT_INTERVAL      Represents the value stored at an index.
-//!                             This is the default variant (#RX_VARIANT_DEFAULT) for all parameters.
-//! - #RX_VARIANT_CUMULATIVE    Represents the sum of all values up to and including that index.
-//!                             This is currently the only other supported variant.
-//! - #RX_VARIANT_TEMPLATE (-1) Used in API functions to mean the variant specified
-//!                             by the current user template.
-//! - #RX_VARIANT_CATALOG  (-2) Used in API functions to mean the variant specified
-//!                             by the catalog. Currently this is always #RX_VARIANT_INTERVAL.
-//! @param pszUnit        The unit to retrieve the values in. Allowable values depend on the actual parameter.
-//!                       An empty string will use the catalog unit.
-//! @return RX_TRUE on success, RX_FALSE on failure.
+//! Set the root size of an attribute.
+//! This will create an attr that doesn't exist yet.
+//! The attr must be requested in the correct file type.
 //!
-//! @note This will create an attr that doesn't exist yet.
-//! @note The attr must be requested in the correct file type.
-//! @see RomeFileGetAttrValue(), RomeFileGetAttrSizeEx(), RomeFileSetFloatArray().
-//! @RomeAPI Wrapper for AttrGetFloatArray().
+//! @param pFile        pointer to a Rome file.
+//! @param pszAttr		The internal attr name (e.g. "CLAY").
+//! @param nNewSize		The new size (must be > 0).
 //!
-ROME_API RT_BOOL RomeFileGetFloatArray(RT_FileObj* pFile, RT_CNAME pszAttr, RT_REAL* pArray, RT_INT* pSize, RT_UINT nVariant /*= RX_VARIANT_CATALOG*/, RT_CNAME pszUnit /*= ""*/)
+//! @return  RX_TRUE (1) if the size changed, RX_FALSE (0) if unchanged, #RX_FAILURE (-1) on error.
+//!
+//! @warning This function cannot handle a size of greater than 32767.
+//! @note  This uses return type #RT_SHORT instead of #RT_BOOL to return a signed value.
+//! @see RomeFileGetAttrSizeEx().
+//! @RomeAPI Wrapper for UserCmdResizeDim().
+//!
+ROME_API RT_SHORT RomeFileSetAttrSize(CFileObj* pFile, RT_CNAME pszAttr, RT_INT nNewSize)
 {
     try
     {
@@ -3471,191 +9191,497 @@ ROME_API RT_BOOL RomeFileGetFloatArray(RT_FileObj* pFile, RT_CNAME pszAttr, RT_R
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pFile,              "RomeFileGetFloatArray: NULL file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,                  "RomeFileSetAttrSize: NULL file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszAttr),     "RomeFileSetAttrSize: empty attr name.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nNewSize >=0,           "RomeFileSetAttrSize: negative size.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nNewSize !=0,           "RomeFileSetAttrSize: zero size.");
         CRomeCore& Core = pFile->Core;
-        BOOL bValidApp = (&Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,          "RomeFileGetFloatArray: invalid file pointer.");
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,              "RomeFileSetAttrSize: invalid file pointer.");
 		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,           "RomeFileGetFloatArray: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,               "RomeFileSetAttrSize: RomeExit() has already been called.");
         BOOL bValidFile = CFileObj::IsValid(pFile);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidFile,         "RomeFileGetFloatArray: invalid file pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!strempty(pszAttr), "RomeFileGetFloatArray: empty attr name.");
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pArray,             "RomeFileGetFloatArray: NULL array pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pSize,              "RomeFileGetFloatArray: NULL size pointer.");
-        const int nArraySize = *pSize;
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(nArraySize,         "RomeFileGetFloatArray: non-positive size.");
-        BOOL bValidVariant = VariantIsValid(nVariant, TRUE);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidVariant,      "RomeFileGetFloatArray: invalid variant.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,             "RomeFileSetAttrSize: invalid file pointer.");
 #ifdef USE_ROMEAPI_REFCOUNT
         BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidRefs,         "RomeFileGetFloatArray: invalid file reference count.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,             "RomeFileSetAttrSize: invalid file reference count.");
 #endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
         BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,       "RomeFileGetFloatArray: Rome API function called on different thread from RomeInit().");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,           "RomeFileSetAttrSize: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&Core);
 
 	    // Wait for the stack to finish.
-        // This makes sure that a value retrieved below won't get changed by functions on the stack.
-	    Core.Engine.FinishUpdates();
+        // This makes sure that a change below won't get overwritten by functions on the stack.
+	    StatFinishUpdates(Core.Engine);
+
+	    FILEOBJ_READLOCK(pFile);
+
+        // Set the active object.
+        pFile->Core.SetActiveObj(pFile);
+
+        // In batch mode, only record the call in the diagnostic ring.
+        BATCHCORE* pBatch = CoreGetBatch(Core);
+        if (pBatch)
+        {
+            RT_SHORT nRet = FileSetAttrSize(pFile, pszAttr, nNewSize, pBatch);
+            BatchLog(pBatch, "RomeFileSetAttrSize", pszAttr, nNewSize, nRet);
+            return nRet;
+        }
 
         CString sFile = pFile->GetFileName();
-	    CLogFileElement3(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileGetFloatArray", "file='%s' attr='%s' size='%d'>\n", XMLEncode(sFile), pszAttr, *pSize);
+        ROME_API_LOGELEM(CLogFileElement3(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileSetAttrSize", "file='%s' attr='%s' size='%d'>\n", (CString)XMLEncode(sFile), XMLEncode(pszAttr), nNewSize));
 #if USE_ROMESHELL_LOGGING
         LogShellActivate(sFile);
-        LogFilePrintf4(LOG_SHELL, "//RomeFileGetFloatArray \"%s\" %d %d \"%s\"\n", pszAttr, *pSize, nVariant, (CString)pszUnit);
+        ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "RomeFileSetAttrSize \"%s\" %d\n", pszAttr, nNewSize));
 #endif
 
-        // Find the attribute in the file.
-	    CAttr* pAttr = FindOrCreate(pszAttr, pFile);
-	    if (!pAttr)
-		    return RX_FALSE;
-
-        // Set the active object for debugging purposes.
-        Core.SetActiveObj(pAttr->GetObj());
-
-		// Verify that the engine is finished before we get information back from the model.
-		ASSERT(Core.Engine.IsFinished());
-
-        RT_BOOL bSet = AttrGetFloatArray(pAttr, pArray, pSize, nVariant, pszUnit);
-        return bSet;
+        return FileSetAttrSize(pFile, pszAttr, nNewSize, NULL);
     }
     catch (...)
     {
         try
         {
-            CString sInfo; sInfo.Format("RomeFileGetFloatArray: exception for File = '0x%08X', Attr = '%s', Size = %d.", pFile, (CString)pszAttr, (int)*pSize);
-            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,    sInfo);
+            CString sInfo; sInfo.Format("RomeFileSetAttrSize: exception for File = '0x%08X', Attr = '%s', Size = %d.", pFile, (CString)pszAttr, (int)nNewSize);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,    "RomeFileGetFloatArray: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileSetAttrSize: exception in catch block.");
         }
     }
 }
 
 
-//! Get the full filename of a file object.
-//! This will include the table prefix.
-//!   Example: "climates\default".
-//! @param pFile  A pointer to a Rome file.
-//! @return A pointer to the filename, or NULL on failure.
+//! Check that every attr on a dimension followed its resize, including those which weren't named as columns.
+//! @param pDim   The dimension, which was just resized with CAttr::SetRootSize().
+//! @param nRows  Its new size.
+//! @return TRUE if each attr of its object on the dimension has @p nRows along it.
 //!
-//! @RomeAPI Wrapper for CFileObj::GetFileName().
+LOCAL BOOL DimAttrsFollowed(CAttr* pDim, int nRows)
+{
+    CSubObj* pObj = pDim->GetObj();
+    POSITION pos = pObj->m_params.GetStartPosition();
+    while (pos)
+    {
+        CAttr* pAttr = pObj->m_params.GetNextValue(pos);
+        for (int d = 0; d < CDimensions::MAXDIMNUM; d++)
+            if (pAttr != pDim && pAttr->dimensions.GetDimPtr(d) == pDim && pAttr->dimensions.GetSize(d) != nRows)
+                return FALSE;
+    }
+    return TRUE;
+}
+
+
+//! Set the number of rows of a dimension and the values of its columns, for RomeFileSetDimRows().
+//! The caller must have validated its arguments, hold the API lock and have drained the engine.
+//! @param pBatch  The batch mode state of the file's core, which the failed columns are recorded in,
+//!   or NULL if the core isn't in batch mode, in which case the changes are logged and can be undone.
+//! @return  The number of values set without error, or #RX_FAILURE (-1) on error.
+//! @see RomeFileSetDimRows() for the other arguments.
 //!
-ROME_API RT_CSTR RomeFileGetFullname(CFileObj* pFile)
+LOCAL RT_INT FileSetDimRows(CFileObj* pFile, RT_CNAME pszDimAttr, RT_INT nRows, RT_CNAME* ppszCols, RT_INT nCols, RT_CSTR* ppszValues, RT_UINT nVariant, BATCHCORE* pBatch)
+{
+    CRomeCore& Core = pFile->Core;
+
+    // Find the dimension, which may be given by one of its attrs.
+    CAttr* pAttr = StatFindOrCreate(pszDimAttr, pFile);
+    ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr,                  "RomeFileSetDimRows: failed to create dimension attr.");
+    CAttr* pDim = pAttr->IsDimension()? pAttr: pAttr->dimensions.GetDimPtr(0);
+    ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pDim,                   "RomeFileSetDimRows: the attr has no dimension.");
+    ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pDim->CanUserResize(),  "RomeFileSetDimRows: the dimension cannot be resized.");
+    ATTR_WRITELOCK(pDim);
+
+    // Find the columns before resizing, since creating an attr may put calc functions on the stack.
+    CArray<CAttr*, CAttr*> aCols;
+    aCols.SetSize(nCols);
+    for (int c = 0; c < nCols; c++)
+    {
+        aCols[c] = strempty(ppszCols[c])? NULL: StatFindOrCreate(ppszCols[c], pFile);
+        BOOL bOnDim = aCols[c] && (aCols[c]->dimensions.GetDimPtr(0) == pDim);
+        if (!bOnDim)
+            aCols[c] = NULL;
+        FileBaselineNoteSet(pFile, ppszCols[c], aCols[c]);
+    }
+    FileBaselineNoteSet(pFile, pszDimAttr, pAttr);
+    StatFinishUpdates(Core.Engine);
+
+    // In batch mode, resize once, and verify that every attr on the dimension followed.
+    // Otherwise (or if they didn't), resize a row at a time, as RomeFileSetAttrSize() does,
+    //   since only the resize command records undo information.
+    const int nOldSize = pDim->GetSize();
+    if (nOldSize != nRows)
+    {
+        BOOL bFollowed = FALSE;
+        if (pBatch)
+        {
+            pDim->SetRootSize(nRows);
+            bFollowed = DimAttrsFollowed(pDim, nRows);
+            if (!bFollowed)
+                pDim->SetRootSize(nOldSize);
+        }
+        if (!bFollowed)
+        {
+            const BOOL bDelete = (nRows < nOldSize);
+            int nIndex = bDelete? nOldSize - 1: nOldSize;
+            for (int i = abs(nRows - nOldSize); i > 0; i--)
+            {
+                UserCmdResizeDim(pDim, "", nIndex, bDelete);
+                bDelete? nIndex--: nIndex++;
+            }
+        }
+        AttrHandlesInvalidate(Core);
+        EngineCountSet(Core);
+        ListenersAddChange(Core, pFile, pDim, -1, RX_CHANGE_SIZE);
+        StatFinishUpdates(Core.Engine);
+    }
+    if (!pBatch)
+    {
+        ROME_API_LOGELEM(CLogFileElement3(LOGELEM_HIST, "user", "AttrSetSize", "attr='%s'><new s='%d'/><old s='%d'/></user>\n",
+                                pDim->GetName(), nRows, nOldSize));
+    }
+
+    // Batch mode doesn't record undo information, since nothing will be undone.
+    UINT nSetFlags = SIF_EXTERNAL | SIF_QUIET;
+    if (!pBatch)
+        nSetFlags |= SIF_UNDOINFO;
+
+    int nSet = 0;
+    BOOL bPtrChanged = FALSE;
+    for (int c = 0; c < nCols; c++)
+    {
+        CAttr* pCol = aCols[c];
+        if (pCol == NULL)
+        {
+            if (pBatch)
+                BatchLog(pBatch, "RomeFileSetDimRows", ppszCols[c], 0, RX_FAILURE);
+            continue;
+        }
+        CListing* pListing = pCol->GetListing();
+        const ParamType nType = pListing? pListing->GetType(): ATTR_PTR;
+        const BOOL bPtr = (nType == ATTR_PTR || nType == ATTR_SUB);
+
+        for (int r = 0; r < nRows; r++)
+        {
+            RT_CSTR pszValue = ppszValues[r*nCols + c];
+            if (pszValue == NULL)
+                continue;
+            BOOL bValidSize = (MAX_SETSTR_SIZE <= 0) || (strlen(pszValue) <= MAX_SETSTR_SIZE);
+            if (!bValidSize)
+                continue;
+#if USE_ROMESHELL_LOGGING
+            if (!pBatch)
+                ROME_API_LOG(LogFilePrintf3(LOG_SHELL, "RomeFileSetAttrValue \"%s\" \"%s\" %d\n", ppszCols[c], pszValue, r));
+#endif
+            RT_SHORT nRet = (RT_SHORT)::DoCmdSetStr(pCol, pszValue, r, nSetFlags, nVariant, "#U_TEMPLATE");
+            if (nRet == RX_FAILURE)
+                continue;
+            nSet++;
+            if (nRet == RX_TRUE)
+            {
+                EngineCountSet(Core);
+                ListenersAddChange(Core, pFile, pCol, r, RX_CHANGE_VALUE);
+                bPtrChanged |= bPtr;
+            }
+        }
+
+        // Settle this column before the next, which may depend on it.
+        StatFinishUpdates(Core.Engine);
+    }
+
+    // A new pointer value re-targets "#RD:" chained attr names, which makes attr handles stale.
+    if (bPtrChanged)
+        AttrHandlesInvalidate(Core);
+
+    return nSet;
+}
+
+
+//! Set the number of rows of a dimension and the values of its columns in one call.
+//! This replaces inserting (or deleting) the rows one at a time with "#INSERT" / "#DELETE",
+//!   where each row resizes every attr on the dimension again, and then setting each value
+//!   with its own engine drain. Here the engine stack is drained once per column, so that
+//!   a column (e.g. "OP_PTR") which sets defaults in other columns is settled before they are set.
+//!   In batch mode, which records no undo information, the dimension is also resized once.
+//! @param pFile       A pointer to a Rome file.
+//! @param pszDimAttr  The dimension, or any attr on it (e.g. "#RD:MAN_BASE_PTR:OP_DATE").
+//! @param nRows       The new number of rows (must be > 0).
+//! @param ppszCols    The attrs on the dimension to set (e.g. "#RD:MAN_BASE_PTR:OP_DATE",
+//!                    "#RD:MAN_BASE_PTR:OP_PTR"), in the order they are to be set.
+//! @param nCols       The number of elements in @p ppszCols.
+//! @param ppszValues  The values, by row: row @c r of column @c c is <tt>ppszValues[r*nCols + c]</tt>.
+//!                    A NULL element leaves that value unchanged.
+//! @param nVariant    The variant of all values (e.g. #RX_VARIANT_CATALOG).
+//! @return  The number of values set without error, or #RX_FAILURE (-1) on error.
+//!
+//! @note Outside batch mode the resize is made a row at a time, as for RomeFileSetAttrSize(), so that it can be undone.
+//! @see RomeFileSetAttrSize(), RomeFileSetAttrValues().
+//! @RomeAPI  Wrapper for CAttr::SetRootSize(), DoCmdSetStr().
+//!
+ROME_API RT_INT RomeFileSetDimRows(RT_FileObj* pFile, RT_CNAME pszDimAttr, RT_INT nRows, RT_CNAME* ppszCols, RT_INT nCols, RT_CSTR* ppszValues, RT_UINT nVariant)
 {
     try
     {
-        // Switch to the app's MFC module state while in this scope.
-        // This is required for many MFC functions to work correctly.
-        AFX_MANAGE_STATE(AfxGetAppModuleState());
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pFile,              "RomeFileGetFullname: NULL file pointer.");
-        BOOL bValidApp = (&pFile->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,          "RomeFileGetFullname: invalid file pointer.");
-		BOOL bExited = pFile->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,           "RomeFileGetFullname: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,                  "RomeFileSetDimRows: NULL file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszDimAttr),  "RomeFileSetDimRows: empty dimension attr name.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nRows > 0,              "RomeFileSetDimRows: non-positive row count.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nCols >= 0,             "RomeFileSetDimRows: negative column count.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(ppszCols || !nCols,     "RomeFileSetDimRows: NULL columns pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(ppszValues || !nCols,   "RomeFileSetDimRows: NULL values pointer.");
+        CRomeCore& Core = pFile->Core;
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,              "RomeFileSetDimRows: invalid file pointer.");
+		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,               "RomeFileSetDimRows: RomeExit() has already been called.");
         BOOL bValidFile = CFileObj::IsValid(pFile);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidFile,         "RomeFileGetFullname: invalid file pointer.");
-        LPCSTR pszFile = pFile->GetFileName();
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(pszFile,            "RomeFileGetFullname: NULL filename pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,             "RomeFileSetDimRows: invalid file pointer.");
 #ifdef USE_ROMEAPI_REFCOUNT
         BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidRefs,         "RomeFileGetFullname: invalid file reference count.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,             "RomeFileSetDimRows: invalid file reference count.");
 #endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
         BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,       "RomeFileGetFullname: Rome API function called on different thread from RomeInit().");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,           "RomeFileSetDimRows: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&Core);
+
+	    // Wait for the stack to finish.
+        // This makes sure that the changes below won't get overwritten by functions on the stack.
+	    StatFinishUpdates(Core.Engine);
+
+	    FILEOBJ_READLOCK(pFile);
+        pFile->Core.SetActiveObj(pFile);
+
+        // In batch mode, only record the call and the failed columns in the diagnostic ring.
+        BATCHCORE* pBatch = CoreGetBatch(Core);
+        if (pBatch)
+        {
+            RT_INT nSet = FileSetDimRows(pFile, pszDimAttr, nRows, ppszCols, nCols, ppszValues, nVariant, pBatch);
+            BatchLog(pBatch, "RomeFileSetDimRows", pszDimAttr, nRows, (nSet < 0)? RX_FAILURE: RX_TRUE);
+            return nSet;
+        }
 
-        CLogFileElement1(LOGELEM_HIST, "user", "RomeFileGetFullname", "file='%s'/>\n", XMLEncode(pszFile));
+        CString sFile = pFile->GetFileName();
+        ROME_API_LOGELEM(CLogFileElement4(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileSetDimRows", "file='%s' attr='%s' rows='%d' cols='%d'>\n", (CString)XMLEncode(sFile), XMLEncode(pszDimAttr), nRows, nCols));
 #if USE_ROMESHELL_LOGGING
-        LogShellActivate(pszFile);
-        LogFilePrintf1(LOG_SHELL, "//RomeFileGetFullname \"%s\"\n", pszFile);
+        // Log the equivalent single calls, so the RomeShell log still replays with older DLLs.
+        LogShellActivate(sFile);
+        ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "RomeFileSetAttrSize \"%s\" %d\n", pszDimAttr, nRows));
 #endif
 
-        return pszFile;
+        return FileSetDimRows(pFile, pszDimAttr, nRows, ppszCols, nCols, ppszValues, nVariant, NULL);
     }
     catch (...)
     {
-        ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeFileGetFullname: exception.");
+        try
+        {
+            CString sInfo; sInfo.Format("RomeFileSetDimRows: exception for File = '0x%08X', Attr = '%s', Rows = %d.", pFile, (CString)pszDimAttr, (int)nRows);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileSetDimRows: exception in catch block.");
+        }
     }
 }
 
 
-//! Return the full filename of a file object.
-//! See RomeFileGetFullname() [above] for full documentation.
-//!
-//! This version is required for use by Intel Fortran, which can't use functions
-//!   which return a string pointer. Instead it must have its first 2 arguments
-//!   be a pointer to a buffer and its length, to return the string in.
-//!   The function must have a return type of void.
-//! @param[out] pBuf is the pointer to a buffer to return a NUL-terminated string in.
-//! @param nBufLen is the length of the buffer to return a NUL-terminated string in.
-//! @param pFile pointer to a Rome file.
-//!
-//! @RomeAPI Wrapper for RomeFileGetFullname().
-//! @FortranAPI This function allows calling RomeFileGetFullname() from Fortran.
+//! Set the value string for a resolved attribute.
+//! This is the shared implementation of FileSetAttrStr() and RomeAttrHandleSetValue().
+//! The caller must have validated its arguments and must hold the API lock.
+//! @param Core      The Rome core the attr belongs to.
+//! @param pFile     The file the value is set through, for coalesced listeners.
+//! @param pAttr     The attr to set the value of.
+//! @param pszValue	 The "value" string, or "#INSERT" / "#DELETE".
+//! @param nIndex    The "flat" index (use 0 for a 1x1 attr).
+//! @param nVariant  The variant of the value.
+//! @param pszUnit   The unit of the value. An empty string will use the template unit.
+//! @return  RX_TRUE (1) if the value changed, RX_FALSE (0) if unchanged, #RX_FAILURE (-1) on error.
 //!
-ROME_API RT_void RomeFileGetFullnameF(RT_PCHAR pBuf, RT_UINT nBufLen, RT_FileObj* pFile)
+LOCAL RT_SHORT AttrSetValueStr(CRomeCore& Core, CFileObj* pFile, CAttr* pAttr, RT_CSTR pszValue, RT_INT nIndex, RT_UINT nVariant, RT_CNAME pszUnit)
 {
-    try
+    RT_SHORT nRet = 0;
+
+    // Set the active object for debugging purposes.
+    Core.SetActiveObj(pAttr->GetObj());
+
+    // Verify that the engine is finished before we alter the model.
+    // The stack was drained by the caller, so this only has work to do
+    //   when creating the attr put calc functions on the stack.
+    if (!Core.Engine.IsFinished())
+        StatFinishUpdates(Core.Engine);
+
+    ASSERT_OR_RETURN_FALSE(pAttr->IsValidUnits(pszUnit));
+    if (strlen(pszUnit) == 0) // need to use the default
+        pszUnit = "#U_TEMPLATE";
+
+    // Handle special values for INSERT and DELETE first.
+    BOOL bResize = FALSE;
+    if (strieq(pszValue, "#INSERT"))
     {
-        // Does not require AFX_MANAGE_STATE() macro.
+        // Insert in the dimension -- this will cause all dependent attrs to resize.
+        // Insertion is now handled by the command class CCmdResizeDim.
+        CAttr* pDim = pAttr->dimensions.GetDimPtr(0);
+        nRet = (RT_SHORT)UserCmdResizeDim(pDim, "", nIndex, FALSE /*INSERT*/);
+        bResize = TRUE;
+    }
+    else
+    if (strieq(pszValue, "#DELETE"))
+    {
+        // Delete in the dimension -- this will cause all dependent attrs to resize.
+        // Deletion is now handled by the command class CCmdResizeDim.
+        CAttr* pDim = pAttr->dimensions.GetDimPtr(0);
+        nRet = (RT_SHORT)UserCmdResizeDim(pDim, "", nIndex, TRUE /*DELETE*/);
+        bResize = TRUE;
+    }
+    else
+    {
+        // Batch mode doesn't record undo information, since nothing will be undone.
+        UINT nSetFlags = SIF_EXTERNAL | SIF_QUIET;
+        if (!CoreGetBatch(Core))
+            nSetFlags |= SIF_UNDOINFO;
+        nRet = (RT_SHORT)::DoCmdSetStr(pAttr, pszValue, nIndex, nSetFlags, nVariant, pszUnit);
+    }
 
-        // Switch to the app's MFC module state while in this scope.
-        // This is required for many MFC functions to work correctly.
-        AFX_MANAGE_STATE(AfxGetAppModuleState());
+    if (nRet == RX_TRUE)
+    {
+        EngineCountSet(Core);
+        ListenersAddChange(Core, pFile, pAttr, nIndex, bResize? RX_CHANGE_SIZE: RX_CHANGE_VALUE);
+    }
 
-		// Validate arguments unique to the Fortran function version.
-		// The remaining arguments will be validated in the normal Rome API call.
-        ASSERT_OR_SETERROR_AND_RETURN(pBuf,           "RomeFileGetFullnameF: NULL buffer pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN(nBufLen > 0,    "RomeFileGetFullnameF: non-positive buffer length.");
+    // A resize may delete attrs, and a new pointer value re-targets "#RD:" chained attr names.
+    // Either makes attr handles stale.
+    if (nRet != RX_FALSE)
+    {
+        CListing* pListing = bResize? NULL: Core.AttrCatalog.GetListing(pAttr->GetName());
+        ParamType nType    = pListing? pListing->GetType(): ATTR_PTR;
+        if (nType == ATTR_PTR || nType == ATTR_SUB)
+            AttrHandlesInvalidate(Core);
+    }
 
-        ROME_API_LOCK();
+    return nRet;
+}
 
-        // Does not require command logging.
 
-        LPCSTR pszName = RomeFileGetFullname(pFile);
-        CString sName;
-        sName = pszName;
-        CopyStrF(pBuf, nBufLen, pszName);
+//! Set the value string for an attribute in a file.
+//! This is the shared implementation of RomeFileSetAttrValueAux() and RomeFileSetAttrValues().
+//! The caller must have validated its arguments and must hold the API lock.
+//! @param pFile     A pointer to a Rome file.
+//! @param pszAttr   Internal attr name (e.g. "CLAY")
+//! @param pszValue	 The "value" string, or "#INSERT" / "#DELETE".
+//! @param nIndex    The "flat" index (use 0 for a 1x1 attr).
+//! @param nVariant  The variant of the value.
+//! @param pszUnit   The unit of the value. An empty string will use the template unit.
+//! @return  RX_TRUE (1) if the value changed, RX_FALSE (0) if unchanged, #RX_FAILURE (-1) on error.
+//!
+LOCAL RT_SHORT FileSetAttrStr(CFileObj* pFile, RT_CNAME pszAttr, RT_CSTR pszValue, RT_INT nIndex, RT_UINT nVariant, RT_CNAME pszUnit)
+{
+    CRomeCore& Core = pFile->Core;
+
+    CAttr* pAttr = NULL;
+    {
+        // @note Use CUpdateLock to lock the engine while we are creating the parameter.
+        // We don't want the engine running during web building done during creation of a new parameter.
+        // Parameter creation will run calc functions directly and throw others on the stack.
+        // @warning We must restrict the scope of this lock to just the parameter creation.
+        //   There is a FinishUpdates() call below which requires an unlocked state to run correctly.
+        CUpdateLock lock;
+
+        // Find the attribute in the file and create it if it doesn't exist.
+        pAttr = StatFindOrCreate(pszAttr, pFile);
     }
-    catch (...)
+
+    if (!pAttr)
     {
-        try
-        {
-            if (pBuf && nBufLen > 0)
-                *pBuf = 0;
-            CString sInfo; sInfo.Format("RomeFileGetFullnameF: exception for Buffer = '0x%08X', Length = %d, File = '0x%08X'.", pBuf, nBufLen, pFile);
-            ASSERT_OR_SETERROR_AND_RETURN(0,        sInfo);
-        }
-        catch (...)
-        {
-            ASSERT_OR_SETERROR_AND_RETURN(0,        "RomeFileGetFullnameF: exception in catch block.");
-        }
+        // The attr name must be listed in the catalog.
+        CListing* pAttrListing = Core.AttrCatalog.GetListing(pszAttr);
+        BOOL bValidAttrName = (pAttrListing != NULL);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidAttrName,     "RomeFileSetAttrValue: no Rusle2 parameter of that name.");
+
+        // The attr must be asked for in the correct object type.
+        LPCSTR pszObjName = pFile->GetObjType()->GetName();
+        BOOL bValidObjType = pAttrListing->IsValidObject(pszObjName);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidObjType,      "RomeFileSetAttrValue: Rusle2 parameter asked for in wrong object type.");
+
+        // If not handled above, give a generic error message.
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr,              "RomeFileSetAttrValue: failed to create attr.");
     }
+
+    FileBaselineNoteSet(pFile, pszAttr, pAttr);
+    return AttrSetValueStr(Core, pFile, pAttr, pszValue, nIndex, nVariant, pszUnit);
 }
 
 
-//! Perform an action using the Rome listener interface.
-//! @param pFile         A pointer to a Rome file.
-//! @param nActionType   The action to perform (e.g. #RX_LISTENER_ADD).
-//! @param pObserver     The observer that will listen for the events.
-//! @param pEventHandler The function to invoke for the events being listened for.
+//! Set the value string for an attribute.
+//! The attr must be requested in the correct file type.
+//! This function will use the unit and variant from the current template.
+//! This will create an attr that doesn't exist yet.
 //!
-//! @warning this is currently for internal use only.
-//! @return  RX_TRUE (success) or RX_FALSE (failure).
-//! @RomeAPI
+//! @param pFile    A pointer to a Rome file.
+//! @param pszAttr  Internal attr name (e.g. "CLAY")
+//! @param pszValue	The "value" string, @em not the "display" string.<br>
+//!                 Note: this string cannot exceed #MAX_SETSTR_SIZE in length.
+//!                 This can take on special values:
+//! -               "#INSERT" - insert at [before] the index
+//! -               "#DELETE" - remove at the index
 //!
-ROME_API RT_BOOL RomeFile_Listener(RT_FileObj* pFile, RT_UINT nActionType, RT_void* pObserver, RT_EventHandler pEventHandler)
+//! @note The allowed values and formats depends on the type of the parameter begin set:
+//! - #ATTR_BOL  Boolean parameters (class CBoolean) take the values "YES", "NO", "0", "1", and "NaN".
+//!   These strings are case-insensitive. The numeric versions must match exactly.
+//!   A string like "0.0" or ".0" will not be recognized.
+//! - #ATTR_DTE  Date parameters (class CDate) take values values are Rusle2 simulation dates, not real calendar dates.
+//!   These values are in the current (template) variant and unit.
+//!   "NaN" is accepted for a missing value.
+//! - #ATTR_FLT  Floating point parameters (class CFloat) take values in standard floating point format.
+//!   Examples: 2, -5, 800.3. Scientific notation is also accepted. Examples: 2E5, -2.8E-8.
+//!   "NaN" is accepted for a missing value.
+//!   These values are in the current (template) variant and unit.
+//! - #ATTR_INT  Integer parameters (stored in class CFloat) take signed integer values.
+//!   Examples: 2, -5. Scientific notation is also accepted as long as they represent an integer. Examples: 2E5, but NOT -2.8E-8.
+//!   "NaN" is accepted for a missing value.
+//!   Integer values generally do not use variant and unit.
+//! - #ATTR_LST  List parameters (class CListAttr) accept a finite set of string values specified in the catalog.
+//!   "NaN" is accepted for a missing value.
+//! - #ATTR_PTR  Pointer paramters (class CPtrAttr) accept internal Rusle2 filenames.
+//!   An empty string ("") is accepted for a missing (#NaN) value.
+//!   These filenames have their root folder (e.g. "profiles", "climates") stripped off.
+//!   That information is specified for the parameter by the catalog.
+//! - - "#ENTRY_CUSTOM" signifies that that data element has been modified by the user from
+//!      the choice they previously made, but it is distinct from "#ENTRY_NONE".
+//! - - "#ENTRY_DEFAULT" signifies to use the default file stored in the template instead.
+//! - - "#ENTRY_MODEL" signifies to use the hard-coded default file generate by the model.
+//! - - "#ENTRY_NONE" is used to specify an "empty" value set by the user (not the same as NaN).
+//! - - "#ENTRY_NULL" is used to signify that that data element is unset (not the same as NaN).
+//! - #ATTR_STR  String parameters (class CStrAttr) accept any string.
+//!   An empty string ("") is accepted for a missing (#NaN) value.
+//!
+//! @param nIndex	the "flat" index (use 0 for a 1x1 attr).
+//!   @warning This function cannot handle an index of greater than 32767.
+//!
+//! @return  RX_TRUE (1) if the value changed, RX_FALSE (0) if unchanged, #RX_FAILURE (-1) on error.
+//!
+//! @note This uses return type #RT_SHORT instead of #RT_BOOL to return a signed value.
+//! @see RomeFileGetAttrValue(), RomeFileSetAttrValue().
+//! @see #ENTRY_CUSTOM, #ENTRY_DEFAULT, #ENTRY_INTERNAL, #ENTRY_NONE, #ENTRY_MIXED, #ENTRY_MODEL, #ENTRY_NULL.
+//! @RomeAPI  Wrapper for DoCmdSetStr(), UserCmdResizeDim().
+//!
+ROME_API RT_SHORT RomeFileSetAttrValue(CFileObj* pFile, RT_CNAME pszAttr, RT_CSTR pszValue, RT_INT nIndex)
+{
+	RT_SHORT retVal = RomeFileSetAttrValueAux(pFile, pszAttr, pszValue, nIndex, RX_VARIANT_CATALOG, "#U_TEMPLATE");
+	return retVal;
+}
+
+
+ROME_API RT_SHORT RomeFileSetAttrValueAux(CFileObj* pFile, RT_CNAME pszAttr, RT_CSTR pszValue, RT_INT nIndex, RT_UINT nVariant, RT_CNAME pszUnit)
 {
     try
     {
@@ -3663,178 +9689,202 @@ ROME_API RT_BOOL RomeFile_Listener(RT_FileObj* pFile, RT_UINT nActionType, RT_vo
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_RETURN_FALSE(pFile);
-        BOOL bValidApp = (&pFile->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,        "RomeFile_Listener: invalid file pointer.");
-		BOOL bExited = pFile->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,         "RomeFile_Listener: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,              "RomeFileSetAttrValue: NULL file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszAttr), "RomeFileSetAttrValue: empty attr name.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pszValue,           "RomeFileSetAttrValue: NULL value pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nIndex >= 0,        "RomeFileSetAttrValue: negative index.");
+        BOOL bValidSize = (MAX_SETSTR_SIZE <= 0) || (strlen(pszValue) <= MAX_SETSTR_SIZE);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidSize,         "RomeFileSetAttrValue: value string exceeds MAX_SETSTR_SIZE.");
+        CRomeCore& Core = pFile->Core;
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,          "RomeFileSetAttrValue: invalid file pointer.");
+		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeFileSetAttrValue: RomeExit() has already been called.");
         BOOL bValidFile = CFileObj::IsValid(pFile);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidFile,       "RomeFile_Listener: invalid file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,         "RomeFileSetAttrValue: invalid file pointer.");
 #ifdef USE_ROMEAPI_REFCOUNT
         BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidRefs,       "RomeFile_Listener: invalid file reference count.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,         "RomeFileSetAttrValue: invalid file reference count.");
 #endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
         BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,     "RomeFile_Listener: Rome API function called on different thread from RomeInit().");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeFileSetAttrValue: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ASSERT((nActionType & RX_LISTENER_ACTION_MASK) == nActionType);
-        // TODO: test that this is the correct object type.
+        ROME_API_WRITELOCK(&Core);
 
-        ROME_API_LOCK();
+	    // Wait for the stack to finish.
+        // This makes sure that a value changed below won't get overwritten by functions on the stack.
+	    StatFinishUpdates(Core.Engine);
 
-        BOOL bRet = RX_FALSE;
+	    RT_SHORT nRet = 0;
 
-        switch (nActionType)
+        // In batch mode, only record the call in the diagnostic ring.
+        BATCHCORE* pBatch = CoreGetBatch(Core);
+        if (pBatch)
         {
-            UNUSED2(pObserver, pEventHandler);
-/*
-            case RX_LISTENER_ADD:
-                bRet = pFile->RomeFilesSet.Add(pObserver, pEventHandler);
-                break;
-            case RX_LISTENER_REMOVE:
-                bRet = pFile->RomeFilesSet.Remove(pObserver);
-		        // Call OnFinalRelease to check if the file can be deleted.
-                pFile->OnFinalRelease();
-                break;
-            case RX_LISTENER_REMOVEALL:
-                bRet = pFile->RomeFilesSet.RemoveAll(pObserver);
-		        // Call OnFinalRelease to check if the file can be deleted.
-                pFile->OnFinalRelease();
-                break;
-*/
-            case RX_LISTENER_ADD:
-            case RX_LISTENER_REMOVE:
-            case RX_LISTENER_REMOVEALL:
-            default:
-                ASSERT(FALSE);
-                break;
+            nRet = FileSetAttrStr(pFile, pszAttr, pszValue, nIndex, nVariant, pszUnit);
+            BatchLog(pBatch, "RomeFileSetAttrValue", pszAttr, nIndex, nRet);
+            return nRet;
         }
-        return bRet;
+
+        {
+            CString sFile = pFile->GetFileName();
+            ROME_API_LOGELEM(CLogFileElement4(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileSetAttrValue", "file='%s' attr='%s' value='%s' index='%d'>\n", (CString)XMLEncode(sFile), pszAttr, pszValue, nIndex));
+#if USE_ROMESHELL_LOGGING
+            LogShellActivate(sFile);
+            ROME_API_LOG(LogFilePrintf3(LOG_SHELL, "RomeFileSetAttrValue \"%s\" \"%s\" %d\n", pszAttr, pszValue, nIndex));
+#endif
+
+            nRet = FileSetAttrStr(pFile, pszAttr, pszValue, nIndex, nVariant, pszUnit);
+        }
+
+	    return nRet;
     }
     catch (...)
     {
         try
         {
-            CString sFile = pFile? pFile->GetFileName(): "NULL";
-            CString sInfo; sInfo.Format("RomeFile_Listener: exception for File = '%s', Action = %d", sFile, nActionType);
-            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,   sInfo);
+            CString sInfo; sInfo.Format("RomeFileSetAttrValue: exception for File = '0x%08X', Attr = '%s', Value = '%s', Index = %d.", pFile, (CString)pszAttr, (CString)pszValue, (int)nIndex);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,   "RomeFile_Listener: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileSetAttrValue: exception in catch block.");
         }
     }
 }
 
 
-//! Save a file object to its current location.
-//! @param pFile  Apointer to a Rome file.
-//! @return  RX_TRUE on success, #RX_FAILURE (-1) on error.
+//! Set the value strings for many attributes in a file, for RomeFileSetAttrValues().
+//! The caller must have validated its arguments, hold the API lock and have drained the engine.
+//! @param pBatch  The batch mode state of the file's core, which the failed values are recorded in,
+//!   or NULL if the core isn't in batch mode, in which case the values are logged to the RomeShell log.
+//! @return  The number of values set without error.
+//! @see RomeFileSetAttrValues() for the other arguments.
 //!
-//! @see RomeFilesOpen(), RomeFileSaveAs(), RomeFileSaveAsEx().
-//! @RomeAPI Wrapper for RomeFileSaveAs().
+LOCAL RT_INT FileSetAttrValues(CFileObj* pFile, RT_AttrValue* pValues, RT_INT nValues, RT_UINT nVariant, BATCHCORE* pBatch)
+{
+    int nSet = 0;
+    for (int i = 0; i < nValues; i++)
+    {
+        RT_AttrValue& value = pValues[i];
+        value.nResult = RX_FAILURE;
+        if (strempty(value.pszAttr) || value.pszValue == NULL || value.nIndex < 0)
+            continue;
+        BOOL bValidSize = (MAX_SETSTR_SIZE <= 0) || (strlen(value.pszValue) <= MAX_SETSTR_SIZE);
+        if (!bValidSize)
+            continue;
+#if USE_ROMESHELL_LOGGING
+        if (!pBatch)
+            ROME_API_LOG(LogFilePrintf3(LOG_SHELL, "RomeFileSetAttrValue \"%s\" \"%s\" %d\n", value.pszAttr, value.pszValue, value.nIndex));
+#endif
+
+        LPCSTR pszUnit = value.pszUnit? value.pszUnit: "";
+        value.nResult = FileSetAttrStr(pFile, value.pszAttr, value.pszValue, value.nIndex, nVariant, pszUnit);
+        if (value.nResult != RX_FAILURE)
+            nSet++;
+        else
+        if (pBatch)
+            BatchLog(pBatch, "RomeFileSetAttrValues", value.pszAttr, value.nIndex, RX_FAILURE);
+    }
+
+    return nSet;
+}
+
+
+//! Set the value strings for many attributes in a file in a single call.
+//! This is equivalent to calling RomeFileSetAttrValueAux() for each element of @p pValues in order,
+//!   but it takes the API lock, drains the engine stack and writes the history log once for the batch.
+//! @param pFile     A pointer to a Rome file.
+//! @param[in,out] pValues  The values to set.
+//!   On input @c pszAttr, @c nIndex, @c pszValue and @c pszUnit of each element must be set
+//!   (@c pszUnit may be NULL or empty for the template unit).
+//!   @c pszValue may be "#INSERT" or "#DELETE", as for RomeFileSetAttrValue().
+//!   On output @c nResult is RX_TRUE (1) if the value changed, RX_FALSE (0) if unchanged,
+//!   or #RX_FAILURE (-1) on error.
+//! @param nValues   The number of elements in @p pValues.
+//! @param nVariant  The variant of all values (e.g. #RX_VARIANT_CATALOG).
+//! @return  The number of values set without error, or #RX_FAILURE (-1) on error.
+//!
+//! @note An error in one value does not stop the remaining values from being set.
+//! @see RomeFileSetAttrValueAux(), RomeFileGetAttrValues().
+//! @RomeAPI  Wrapper for DoCmdSetStr(), UserCmdResizeDim().
 //!
-ROME_API RT_INT RomeFileSave(CFileObj* pFile)
+ROME_API RT_INT RomeFileSetAttrValues(RT_FileObj* pFile, RT_AttrValue* pValues, RT_INT nValues, RT_UINT nVariant)
 {
     try
     {
-        // Note: this function doesn't require resource locking.
-
 	    // Switch to the app's MFC module state while in this scope.
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,          "RomeFileSave: NULL file pointer.");
-        BOOL bValidApp = (&pFile->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,      "RomeFileSave: invalid file pointer.");
-		BOOL bExited = pFile->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,       "RomeFileSave: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,              "RomeFileSetAttrValues: NULL file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pValues,            "RomeFileSetAttrValues: NULL values pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nValues >= 0,       "RomeFileSetAttrValues: negative value count.");
+        CRomeCore& Core = pFile->Core;
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,          "RomeFileSetAttrValues: invalid file pointer.");
+		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeFileSetAttrValues: RomeExit() has already been called.");
         BOOL bValidFile = CFileObj::IsValid(pFile);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,     "RomeFileSave: invalid file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,         "RomeFileSetAttrValues: invalid file pointer.");
 #ifdef USE_ROMEAPI_REFCOUNT
         BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,     "RomeFileSave: invalid file reference count.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,         "RomeFileSetAttrValues: invalid file reference count.");
 #endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
         BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,   "RomeFileSave: Rome API function called on different thread from RomeInit().");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeFileSetAttrValues: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&Core);
+
+	    // Wait for the stack to finish.
+        // This makes sure that the values changed below won't get overwritten by functions on the stack.
+	    StatFinishUpdates(Core.Engine);
+
+        // In batch mode, only record the failed values in the diagnostic ring.
+        BATCHCORE* pBatch = CoreGetBatch(Core);
+        if (pBatch)
+            return FileSetAttrValues(pFile, pValues, nValues, nVariant, pBatch);
 
         CString sFile = pFile->GetFileName();
-	    CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileSave", "file='%s'>\n", XMLEncode(sFile));
+        ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileSetAttrValues", "file='%s' count='%d'>\n", (CString)XMLEncode(sFile), nValues));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf1(LOG_SHELL, "RomeFileSave \"%s\"\n", sFile);
+        LogShellActivate(sFile);
 #endif
 
-        return RomeFileSaveAs(pFile, pFile->GetFileName());
+        return FileSetAttrValues(pFile, pValues, nValues, nVariant, NULL);
     }
     catch (...)
     {
         try
         {
-            CString sFile = pFile? pFile->GetFileName(): "NULL";
-            CString sInfo; sInfo.Format("RomeFileSave: exception for File = '%s'", sFile);
+            CString sInfo; sInfo.Format("RomeFileSetAttrValues: exception for File = '0x%08X', Count = %d.", pFile, (int)nValues);
             ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileSave: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileSetAttrValues: exception in catch block.");
         }
     }
 }
 
 
-//! Save this file to the database under a specific name.
-//! Mark the file as clean after saving to the database.
-//! @param pFile  A pointer to a Rome file.
-//! @param pszNewName  The fullname of the file to save as.
-//! - Example: "profiles\working\farm1".
-//! - This can be an external file if prefix "#XML:" is used.<br>
-//!     Example: "#XML:C:\Rusle2\Export\profile1.pro.xml".
-//! - This can be an external file if prefix "#SKEL:" is used.<br>
-//!     Example: "#SKEL:C:\Rusle2\Export\management1.man.skel".
-//! @return  RX_TRUE on success, RX_FALSE on failure, #RX_FAILURE on error.
-//!
-//! @see RomeFilesOpen(), RomeFileSave(), RomeFileSaveAsEx().
-//! @RomeAPI Wrapper for RomeFileSaveAsEx().
-//!
-ROME_API RT_BOOL RomeFileSaveAs(CFileObj* pFile, RT_CSTR pszNewName)
-{
-    // Note: this function doesn't require the AFX_MANAGE_STATE macro.
-    // Note: this function doesn't require exception handling.
-    // Note: this function doesn't require resource locking.
-    // Note: this function doesn't require command logging.
-
-	return RomeFileSaveAsEx(pFile, pszNewName, 0);
-}
-
-
-//! Save this file to the database under a specific name.
-//! Mark the file as clean after saving to the database.
-//! @param pFile  A pointer to a Rome file.
-//! @param pszNewName  The fullname of the file to save as.
-//! - Example: "profiles\working\farm1".
-//! - This can be an external file if prefix "#XML:" is used.<br>
-//!     Example: "#XML:C:\Rusle2\Export\profile1.pro.xml".
-//! - This can be an external file if prefix "#SKEL:" is used.<br>
-//!     Example: "#SKEL:C:\Rusle2\Export\management1.man.skel".
-//! - This can be an external fileset if prefix "#FILESET:" is used.<br>
-//!     Example: "#FILESET:C:\Rusle2\Export\profile1.fileset.xml".
-//! @param nFlags  Flags which modify saving behavior.
-//! - #RX_FILE_SAVEASEX_CALC   Save calculated data in \<Calc> tags
-//!
-//! @return  RX_TRUE on success, RX_FALSE on failure, #RX_FAILURE on error.
+//! Perform an action using the Rome listener interface.
+//! @warning this is currently for internal use only.
+//! @param pObj           A pointer to a Rome [sub]object.
+//! @param nActionType    The action to perform (e.g. #RX_LISTENER_ADD).
+//! @param pObserver      The observer that will listen for the events.
+//! @param pEventHandler  The function to invoke for the events being listened for.
 //!
-//! @see RomeFilesOpen(), RomeFileSave(), RomeFileSaveAs().
-//! @RomeAPI Wrapper for CFileSys::Save().
+//! @return RX_TRUE (success) or RX_FALSE (failure).
+//! @RomeAPI
 //!
-ROME_API RT_BOOL RomeFileSaveAsEx(CFileObj* pFile, RT_CSTR pszNewName, RT_UINT nFlags)
+ROME_API RT_BOOL RomeObj_Listener(RT_SubObj* pObj, RT_UINT nActionType, RT_void* pObserver, RT_EventHandler pEventHandler)
 {
     try
     {
@@ -3842,179 +9892,116 @@ ROME_API RT_BOOL RomeFileSaveAsEx(CFileObj* pFile, RT_CSTR pszNewName, RT_UINT n
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,                 "RomeFileSaveAsEx: NULL file pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszNewName), "RomeFileSaveAsEx: empty attr name.");
-        CRomeCore& Core = pFile->Core;
-        BOOL bValidApp = (&Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,             "RomeFileSaveAsEx: invalid file pointer.");
-		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,              "RomeFileSaveAsEx: RomeExit() has already been called.");
-        BOOL bValidFile = CFileObj::IsValid(pFile);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,            "RomeFileSaveAsEx: invalid file pointer.");
-#if TARGET_ROMEDLL && defined(USE_ROMEAPI_REFCOUNT)
-        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,            "RomeFileSaveAsEx: invalid file reference count.");
-#endif
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pObj,                   "RomeObj_Listener: NULL object pointer.");
+        ASSERT((nActionType & RX_LISTENER_ACTION_MASK) == nActionType);
+        // TODO: test that this is the correct object type.
+        BOOL bValidApp = RomeCoreIsValid(&pObj->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,              "RomeObj_Listener: invalid object pointer.");
+		BOOL bExited = pObj->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,               "RomeObj_Listener: RomeExit() has already been called.");
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,          "RomeFileSaveAsEx: Rome API function called on different thread from RomeInit().");
-#endif
-
-        ROME_API_LOCK();
-
-        // Wait for the stack to finish.
-        // This makes sure that changes that would be made by functions on the stack
-        //   are done before the file is saved.
-	    Core.Engine.FinishUpdates();
-
-	    FILEOBJ_WRITELOCK(pFile);
-
-        CString sFile = pFile->GetFileName();
-        CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileSaveAsEx", "file='%s' new='%s'>\n", XMLEncode(sFile), XMLEncode(pszNewName));
-#if USE_ROMESHELL_LOGGING
-        LogFilePrintf3(LOG_SHELL, "RomeFileSaveAsEx \"%s\" \"%s\" %d\n", sFile, pszNewName, nFlags);
+        BOOL bSameThread = (pObj->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,           "RomeObj_Listener: Rome API function called on different thread from RomeInit().");
 #endif
 
-	    // The external filename, with any magic prefix stripped.
-	    LPCSTR pszDiskName = "";
-	    UINT   nExpFlags = 0;
-
-	    // Check for magic prefixes and strip them off:
-	    // "#XML:"      export as Rusle2 XML format.
-	    // "#SKEL:"     export as NRCS management skeleton format.
-        // "#FILESET:"  export as Rusle2 full fileset XML format.
-        if (strncmp(pszNewName, "#XML:", 5) == 0)
-	    {
-		    // Get the external filename following the magic prefix.
-		    pszDiskName = pszNewName + 5;
+        ROME_API_WRITELOCK(&pObj->Core);
 
-		    nExpFlags = EXPORTOBJECT_FORMAT_XML_NEW | EXPORTOBJECT_QUIET | ((nFlags & RX_FILE_SAVEASEX_CALC)? EXPORTOBJECT_CALC: 0);
-	    }
-#if USE_SKELETONS
-	    else
-	    if (strncmp(pszNewName, "#SKEL:", 6) == 0)
-	    {
-		    // Get the external filename following the magic prefix.
-		    pszDiskName = pszNewName + 6;
+        BOOL bRet = RX_FALSE;
 
-		    nExpFlags = EXPORTOBJECT_FORMAT_MAN_CFF | EXPORTOBJECT_QUIET;
-	    }
-#endif // USE_SKELETONS
-#if USE_FILESETS
-	    else
-	    if (strncmp(pszNewName, "#FILELIST:", 10) == 0)
-	    {
-		    // Get the external filename following the magic prefix.
-		    pszDiskName = pszNewName + 10;
+        switch (nActionType)
+        {
+            UNUSED2(pObserver, pEventHandler);
+/*
+            case RX_LISTENER_ADD:
+                bRet = pObj->ListenerSet.Add(pObserver, pEventHandler);
+                break;
+            case RX_LISTENER_REMOVE:
+                bRet = pObj->ListenerSet.Remove(pObserver);
+                break;
+            case RX_LISTENER_REMOVEALL:
+                bRet = pObj->ListenerSet.RemoveAll(pObserver);
+                break;
+*/
+            case RX_LISTENER_ADD:
+            case RX_LISTENER_REMOVE:
+            case RX_LISTENER_REMOVEALL:
+            default:
+                ASSERT(FALSE);
+                break;
+        }
 
-            // Do the export.
-            UINT nFilesetFlags  = 0/*EXPORTFILESET_COUNTS*/  // Output counts (unsupported)
-                                | EXPORTFILESET_META_SET    // Output metadata for the fileset
-                                | EXPORTFILESET_META_FILE   // Output metadata for each file
-                                | EXPORTFILESET_LIST_DEPS   // Output dependent files
-                                ;
-            CString sBaseFile = pFile->GetFileName();
-            CString sFilesetArgs = "purpose=\"dependents\" basefile=\"" + sBaseFile + "\"";
+        return bRet;
+    }
+    catch (...)
+    {
+        try
+        {
+            CString sObj = pObj? pObj->GetDisplayTitle(): "NULL";
+            CString sInfo; sInfo.Format("RomeObj_Listener: exception for Obj = '%s', Action = %d.", sObj, nActionType);
+            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,    "RomeObj_Listener: exception in catch block.");
+        }
+    }
+}
 
-            RT_BOOL nRet = FilesetExport(Core, pszDiskName, nFilesetFlags, sFilesetArgs);
-            return nRet;
-	    }
-	    else
-	    if (strncmp(pszNewName, "#FILESET:", 9) == 0)
-	    {
-		    // Get the external filename following the magic prefix.
-		    pszDiskName = pszNewName + 9;
 
-            // Do the export.
-            UINT nFilesetFlags  = 0/*EXPORTFILESET_COUNTS*/  // Output counts (unsupported)
-                                | EXPORTFILESET_META_SET    // Output metadata for the fileset
-                                | EXPORTFILESET_META_FILE   // Output metadata for each file
-                                | EXPORTFILESET_LIST_DEPS   // Output dependent files
-                                | EXPORTFILESET_DATA_OPEN   // Output XML data for open files
-                                | EXPORTFILESET_DATA_DB     // Output XML data for database files
-                                ;
-            if (nFlags & RX_FILE_SAVEASEX_CALC)
-                nFilesetFlags |= EXPORTFILESET_CALC_OPEN;
-            CString sBaseFile = pFile->GetFileName();
-            CString sFilesetArgs = "purpose=\"dependents\" basefile=\"" + sBaseFile + "\"";
+//! @} // Rome File functions
+/////////////////////////////////////////////////////////////////////////////
+//! @name Rome File attr handle functions
+//! @{
 
-            RT_BOOL nRet = FilesetExport(Core, pszDiskName, nFilesetFlags, sFilesetArgs);
-            return nRet;
-	    }
-#endif // USE_FILESETS
-	    else
-	    {
-		    // Use a flag to signify saving INTO the database.
-		    nExpFlags = EXPORTOBJECT_FORMAT_XML_OLD;
-	    }
+//! Close an attr handle returned by RomeFileResolveAttr().
+//! This may be called after the handle's file has been closed.
+//! @param pHandle  The attr handle returned by RomeFileResolveAttr().
+//!
+//! @warning Failing to close the handle will leak memory.
+//! @see RomeFileResolveAttr().
+//!
+ROME_API RT_void RomeAttrHandleClose(RT_AttrHandle* pHandle)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-	    RT_BOOL nRet = RX_FALSE;
-        UINT nFormat = (nExpFlags & EXPORTOBJECT_FORMAT_MASK);
-	    switch (nFormat)
-	    {
-		    case EXPORTOBJECT_FORMAT_XML_NEW:
-			    nRet = ExportObject(Core, pFile, pszDiskName, nExpFlags);
-			    break;
-#if USE_SKELETONS
-		    case EXPORTOBJECT_FORMAT_MAN_CFF:
-			    nRet = ExportObject(Core, pFile, pszDiskName, nExpFlags);
-			    break;
-#endif // USE_SKELETONS
-		    case EXPORTOBJECT_FORMAT_XML_OLD:
-		    {
-			    LPCSTR pszOldName = pFile->GetFileName();
-                Core.SetActiveObj(pFile);
-			    CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "FileSaveAs", "file='%s'>\n", XMLEncode(pszOldName));
-//			    CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "SaveAs", "file='%s'>\n",   XMLEncode(pszNewName));
+        ASSERT_OR_SETERROR_AND_RETURN(pHandle,              "RomeAttrHandleClose: NULL attr handle.");
 
-			    const UINT nSaveFlags = MoveFlag(~nFlags, RX_FILE_SAVEASEX_PRIVATE, FSF_MARKCLEAN | FSF_SAVE)
-                                      | MoveFlag( nFlags, RX_FILE_SAVEASEX_PRIVATE, FSF_PRIVATE)
-                                      | MoveFlag( nFlags, RX_FILE_SAVEASEX_CALC,    FSF_CALC)
-                                      ;
-			    nRet = Core.Files.Save(pFile, pszNewName, nSaveFlags);
+        // The handle's core outlives its file, so its lock is still taken.
+        ROME_API_WRITELOCK(pHandle->pCore);
 
-			    break;
-		    }
-		    default:
-                ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,    "RomeFileSaveAsEx: unknown flags argument.");
-			    break;
-	    }
-	    ASSERT(nRet);
+	    ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST, "user", "RomeAttrHandleClose", "handle='0x%08X'/>\n", (UINT)pHandle));
 
-	    return nRet;
+        // The handle's file may already be closed, so it must not be used here.
+        delete pHandle;
     }
     catch (...)
     {
         try
         {
-            CString sInfo; sInfo.Format("RomeFileSaveAsEx: exception for File = '0x%08X', NewName = '%s', Flags = %d.", pFile, (CString)pszNewName, nFlags);
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
+            CString sInfo; sInfo.Format("RomeAttrHandleClose: exception for Handle = 0x%X.", pHandle);
+            ASSERT_OR_SETERROR_AND_RETURN(0,        sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileSaveAsEx: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN(0,        "RomeAttrHandleClose: exception in catch block.");
         }
     }
-}
-
-
-//! Set the root size of an attribute.
-//! This will create an attr that doesn't exist yet.
-//! The attr must be requested in the correct file type.
-//!
-//! @param pFile        pointer to a Rome file.
-//! @param pszAttr		The internal attr name (e.g. "CLAY").
-//! @param nNewSize		The new size (must be > 0).
-//!
-//! @return  RX_TRUE (1) if the size changed, RX_FALSE (0) if unchanged, #RX_FAILURE (-1) on error.
+}
+
+
+//! Get the size of the attribute referred to by an attr handle.
+//! @param pHandle  The attr handle returned by RomeFileResolveAttr().
+//! @return  The attr size, or #RX_FAILURE (-1) on error.
 //!
-//! @warning This function cannot handle a size of greater than 32767.
-//! @note  This uses return type #RT_SHORT instead of #RT_BOOL to return a signed value.
-//! @see RomeFileGetAttrSizeEx().
-//! @RomeAPI Wrapper for UserCmdResizeDim().
+//! @see RomeFileResolveAttr(), RomeFileGetAttrSizeEx().
+//! @RomeAPI Wrapper for CAttr::GetSize().
 //!
-ROME_API RT_SHORT RomeFileSetAttrSize(CFileObj* pFile, RT_CNAME pszAttr, RT_INT nNewSize)
+ROME_API RT_INT RomeAttrHandleGetSize(RT_AttrHandle* pHandle)
 {
     try
     {
@@ -4022,155 +10009,81 @@ ROME_API RT_SHORT RomeFileSetAttrSize(CFileObj* pFile, RT_CNAME pszAttr, RT_INT
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,                  "RomeFileSetAttrSize: NULL file pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszAttr),     "RomeFileSetAttrSize: empty attr name.");
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nNewSize >=0,           "RomeFileSetAttrSize: negative size.");
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nNewSize !=0,           "RomeFileSetAttrSize: zero size.");
-        CRomeCore& Core = pFile->Core;
-        BOOL bValidApp = (&Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,              "RomeFileSetAttrSize: invalid file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pHandle,            "RomeAttrHandleGetSize: NULL attr handle.");
+        // Check the file before using it, since it may have been closed since the handle was resolved.
+        BOOL bValidFile = CFileObj::IsValid(pHandle->pFile);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,         "RomeAttrHandleGetSize: the handle's file has been closed.");
+        CFileObj*  pFile = pHandle->pFile;
+        CRomeCore& Core  = pFile->Core;
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,          "RomeAttrHandleGetSize: invalid file pointer.");
 		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,               "RomeFileSetAttrSize: RomeExit() has already been called.");
-        BOOL bValidFile = CFileObj::IsValid(pFile);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,             "RomeFileSetAttrSize: invalid file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeAttrHandleGetSize: RomeExit() has already been called.");
 #ifdef USE_ROMEAPI_REFCOUNT
         BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,             "RomeFileSetAttrSize: invalid file reference count.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,         "RomeAttrHandleGetSize: invalid file reference count.");
 #endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
         BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,           "RomeFileSetAttrSize: Rome API function called on different thread from RomeInit().");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeAttrHandleGetSize: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&Core);
 
 	    // Wait for the stack to finish.
-        // This makes sure that a change below won't get overwritten by functions on the stack.
-	    Core.Engine.FinishUpdates();
+        // This makes sure that a size retrieved below won't get changed by functions on the stack.
+	    StatFinishUpdates(Core.Engine);
 
 	    FILEOBJ_READLOCK(pFile);
 
-        // Set the active object.
-        pFile->Core.SetActiveObj(pFile);
-
         CString sFile = pFile->GetFileName();
-        CLogFileElement3(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileSetAttrSize", "file='%s' attr='%s' size='%d'>\n", (CString)XMLEncode(sFile), XMLEncode(pszAttr), nNewSize);
+	    ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeAttrHandleGetSize", "file='%s' attr='%s'>\n", XMLEncode(sFile), pHandle->sAttr));
 #if USE_ROMESHELL_LOGGING
         LogShellActivate(sFile);
-        LogFilePrintf2(LOG_SHELL, "RomeFileSetAttrSize \"%s\" %d\n", pszAttr, nNewSize);
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeFileGetAttrSizeEx \"%s\"\n", pHandle->sAttr));
 #endif
 
-	    // Find the attribute in the file.
-	    CAttr* pAttr = FindOrCreate(pszAttr, pFile);
-	    ATTR_WRITELOCK(pAttr);
+	    CAttr* pAttr = AttrHandleResolve(pHandle);
+	    ATTR_READLOCK(pAttr);
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr,                  "RomeFileSetAttrSize: failed to create attr.");
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr->IsDimension(),   "RomeFileSetAttrSize: cannot resize a non-dimension attr.");
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr->CanUserResize(), "RomeFileSetAttrSize: the attr cannot be resized.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr,              "RomeAttrHandleGetSize: failed to resolve attr.");
 
 		// Verify that the engine is finished before we get information back from the model.
-        Core.Engine.FinishUpdates();
-
-	    const int nOldSize   = pAttr->GetSize();
-        const int nDeltaSize = nNewSize - nOldSize;
-#if 1
-        const BOOL bDelete   = (nDeltaSize < 0);
-        const int nNumRows   = abs(nDeltaSize);
-		//! @note If we are deleting, resize by repeatedly deleting the last index.
-		//! If we are inserting, resize by repeatedly inserting after the last index.
-		int nIndex = bDelete? nOldSize - 1: nOldSize;
-		for (int i = nNumRows; i > 0; i--)
-        {
-            UserCmdResizeDim(pAttr, "", nIndex, bDelete);
-            bDelete? nIndex--: nIndex++;
-        }
-#else
-	    pAttr->SetRootSize(nNewSize);
-#endif
+        if (!Core.Engine.IsFinished())
+	        StatFinishUpdates(Core.Engine);
 
-        ASSERT(Core.GetActiveObj() == pAttr->GetObj());
-	    CLogFileElement3(LOGELEM_HIST, "user", "AttrSetSize", "attr='%s'><new s='%d'/><old s='%d'/></user>\n",
-                                pAttr->GetName(), nNewSize, nOldSize);
-
-	    return (nOldSize != nNewSize);
+        return pAttr->GetSize();
     }
     catch (...)
     {
         try
         {
-            CString sInfo; sInfo.Format("RomeFileSetAttrSize: exception for File = '0x%08X', Attr = '%s', Size = %d.", pFile, (CString)pszAttr, (int)nNewSize);
+            CString sInfo; sInfo.Format("RomeAttrHandleGetSize: exception for Handle = '0x%08X'.", pHandle);
             ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileSetAttrSize: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeAttrHandleGetSize: exception in catch block.");
         }
     }
 }
 
 
-//! Set the value string for an attribute.
-//! The attr must be requested in the correct file type.
-//! This function will use the unit and variant from the current template.
-//! This will create an attr that doesn't exist yet.
-//!
-//! @param pFile    A pointer to a Rome file.
-//! @param pszAttr  Internal attr name (e.g. "CLAY")
-//! @param pszValue	The "value" string, @em not the "display" string.<br>
-//!                 Note: this string cannot exceed #MAX_SETSTR_SIZE in length.
-//!                 This can take on special values:
-//! -               "#INSERT" - insert at [before] the index
-//! -               "#DELETE" - remove at the index
-//!
-//! @note The allowed values and formats depends on the type of the parameter begin set:
-//! - #ATTR_BOL  Boolean parameters (class CBoolean) take the values "YES", "NO", "0", "1", and "NaN".
-//!   These strings are case-insensitive. The numeric versions must match exactly.
-//!   A string like "0.0" or ".0" will not be recognized.
-//! - #ATTR_DTE  Date parameters (class CDate) take values values are Rusle2 simulation dates, not real calendar dates.
-//!   These values are in the current (template) variant and unit.
-//!   "NaN" is accepted for a missing value.
-//! - #ATTR_FLT  Floating point parameters (class CFloat) take values in standard floating point format.
-//!   Examples: 2, -5, 800.3. Scientific notation is also accepted. Examples: 2E5, -2.8E-8.
-//!   "NaN" is accepted for a missing value.
-//!   These values are in the current (template) variant and unit.
-//! - #ATTR_INT  Integer parameters (stored in class CFloat) take signed integer values.
-//!   Examples: 2, -5. Scientific notation is also accepted as long as they represent an integer. Examples: 2E5, but NOT -2.8E-8.
-//!   "NaN" is accepted for a missing value.
-//!   Integer values generally do not use variant and unit.
-//! - #ATTR_LST  List parameters (class CListAttr) accept a finite set of string values specified in the catalog.
-//!   "NaN" is accepted for a missing value.
-//! - #ATTR_PTR  Pointer paramters (class CPtrAttr) accept internal Rusle2 filenames.
-//!   An empty string ("") is accepted for a missing (#NaN) value.
-//!   These filenames have their root folder (e.g. "profiles", "climates") stripped off.
-//!   That information is specified for the parameter by the catalog.
-//! - - "#ENTRY_CUSTOM" signifies that that data element has been modified by the user from
-//!      the choice they previously made, but it is distinct from "#ENTRY_NONE".
-//! - - "#ENTRY_DEFAULT" signifies to use the default file stored in the template instead.
-//! - - "#ENTRY_MODEL" signifies to use the hard-coded default file generate by the model.
-//! - - "#ENTRY_NONE" is used to specify an "empty" value set by the user (not the same as NaN).
-//! - - "#ENTRY_NULL" is used to signify that that data element is unset (not the same as NaN).
-//! - #ATTR_STR  String parameters (class CStrAttr) accept any string.
-//!   An empty string ("") is accepted for a missing (#NaN) value.
-//!
-//! @param nIndex	the "flat" index (use 0 for a 1x1 attr).
-//!   @warning This function cannot handle an index of greater than 32767.
-//!
-//! @return  RX_TRUE (1) if the value changed, RX_FALSE (0) if unchanged, #RX_FAILURE (-1) on error.
+//! Get the "value" string for the attribute referred to by an attr handle.
+//! This is equivalent to RomeFileGetAttrValueAux() on the handle's file and attr name,
+//!   without looking up the attr name again.
+//! @param pHandle   The attr handle returned by RomeFileResolveAttr().
+//! @param nIndex    The "flat" index, or -1 for the "current" index of the parameter.
+//! @param nVariant  The variant to get the value in (e.g. #RX_VARIANT_CATALOG).
+//! @param pszUnit   The unit to get the value in. NULL or an empty string will use the template unit.
+//! @return  A string pointer for the value at the given index.
+//!   Returns NULL on error, including out-of-range index.
 //!
-//! @note This uses return type #RT_SHORT instead of #RT_BOOL to return a signed value.
-//! @see RomeFileGetAttrValue(), RomeFileSetAttrValue().
-//! @see #ENTRY_CUSTOM, #ENTRY_DEFAULT, #ENTRY_INTERNAL, #ENTRY_NONE, #ENTRY_MIXED, #ENTRY_MODEL, #ENTRY_NULL.
-//! @RomeAPI  Wrapper for DoCmdSetStr(), UserCmdResizeDim().
+//! @see RomeFileResolveAttr(), RomeFileGetAttrValueAux().
+//! @RomeAPI Wrapper for AttrGetStr().
 //!
-ROME_API RT_SHORT RomeFileSetAttrValue(CFileObj* pFile, RT_CNAME pszAttr, RT_CSTR pszValue, RT_INT nIndex)
-{
-	RT_SHORT retVal = RomeFileSetAttrValueAux(pFile, pszAttr, pszValue, nIndex, RX_VARIANT_CATALOG, "#U_TEMPLATE");
-	return retVal;
-}
-
-
-ROME_API RT_SHORT RomeFileSetAttrValueAux(CFileObj* pFile, RT_CNAME pszAttr, RT_CSTR pszValue, RT_INT nIndex, RT_UINT nVariant, RT_CNAME pszUnit)
+ROME_API RT_CSTR RomeAttrHandleGetValue(RT_AttrHandle* pHandle, RT_INT nIndex, RT_UINT nVariant, RT_CNAME pszUnit)
 {
     try
     {
@@ -4178,137 +10091,87 @@ ROME_API RT_SHORT RomeFileSetAttrValueAux(CFileObj* pFile, RT_CNAME pszAttr, RT_
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,              "RomeFileSetAttrValue: NULL file pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszAttr), "RomeFileSetAttrValue: empty attr name.");
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pszValue,           "RomeFileSetAttrValue: NULL value pointer.");
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nIndex >= 0,        "RomeFileSetAttrValue: negative index.");
-        BOOL bValidSize = (MAX_SETSTR_SIZE <= 0) || (strlen(pszValue) <= MAX_SETSTR_SIZE);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidSize,         "RomeFileSetAttrValue: value string exceeds MAX_SETSTR_SIZE.");
-        CRomeCore& Core = pFile->Core;
-        BOOL bValidApp = (&Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,          "RomeFileSetAttrValue: invalid file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pHandle,            "RomeAttrHandleGetValue: NULL attr handle.");
+        BOOL bValidIndex = ((nIndex >= 0) || (nIndex == -1));
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidIndex,        "RomeAttrHandleGetValue: invalid index.");
+        // Check the file before using it, since it may have been closed since the handle was resolved.
+        BOOL bValidFile = CFileObj::IsValid(pHandle->pFile);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidFile,         "RomeAttrHandleGetValue: the handle's file has been closed.");
+        CFileObj*  pFile = pHandle->pFile;
+        CRomeCore& Core  = pFile->Core;
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,          "RomeAttrHandleGetValue: invalid file pointer.");
 		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeFileSetAttrValue: RomeExit() has already been called.");
-        BOOL bValidFile = CFileObj::IsValid(pFile);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,         "RomeFileSetAttrValue: invalid file pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,           "RomeAttrHandleGetValue: RomeExit() has already been called.");
 #ifdef USE_ROMEAPI_REFCOUNT
         BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,         "RomeFileSetAttrValue: invalid file reference count.");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidRefs,         "RomeAttrHandleGetValue: invalid file reference count.");
 #endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
         BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeFileSetAttrValue: Rome API function called on different thread from RomeInit().");
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,       "RomeAttrHandleGetValue: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&Core);
 
 	    // Wait for the stack to finish.
-        // This makes sure that a value changed below won't get overwritten by functions on the stack.
-	    Core.Engine.FinishUpdates();
-
-	    RT_SHORT nRet = 0;
+        // This makes sure that a value retrieved below won't get changed by functions on the stack.
+	    StatFinishUpdates(Core.Engine);
 
+        // In batch mode, only record the call in the diagnostic ring.
+        BATCHCORE* pBatch = CoreGetBatch(Core);
+        if (pBatch)
         {
-            CString sFile = pFile->GetFileName();
-            CLogFileElement4(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFileSetAttrValue", "file='%s' attr='%s' value='%s' index='%d'>\n", (CString)XMLEncode(sFile), pszAttr, pszValue, nIndex);
+            CAttr*  pAttr    = AttrHandleResolve(pHandle);
+            RT_CSTR pszValue = pAttr? AttrGetValueStr(Core, pAttr, nIndex, nVariant, pszUnit? pszUnit: ""): NULL;
+            BatchLog(pBatch, "RomeAttrHandleGetValue", pHandle->sAttr, nIndex, pszValue? RX_TRUE: RX_FAILURE);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(pAttr,              "RomeAttrHandleGetValue: failed to resolve attr.");
+            return ArenaResult(pszValue);
+        }
+
+        CString sFile = pFile->GetFileName();
+	    ROME_API_LOGELEM(CLogFileElement3(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeAttrHandleGetValue", "file='%s' attr='%s' index='%d'>\n", XMLEncode(sFile), pHandle->sAttr, nIndex));
 #if USE_ROMESHELL_LOGGING
-            LogShellActivate(sFile);
-            LogFilePrintf3(LOG_SHELL, "RomeFileSetAttrValue \"%s\" \"%s\" %d\n", pszAttr, pszValue, nIndex);
+        LogShellActivate(sFile);
+        ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "RomeFileGetAttrValue \"%s\" %d\n", pHandle->sAttr, nIndex));
 #endif
 
-			CAttr* pAttr = NULL;
-			{
-				// @note Use CUpdateLock to lock the engine while we are creating the parameter.
-                // We don't want the engine running during web building done during creation of a new parameter.
-                // Parameter creation will run calc functions directly and throw others on the stack.
-                // @warning We must restrict the scope of this lock to just the parameter creation.
-                //   There is a FinishUpdates() call below which requires an unlocked state to run correctly.
-				CUpdateLock lock;
-
-				// Find the attribute in the file and create it if it doesn't exist.
-				pAttr = FindOrCreate(pszAttr, pFile);
-			}
-
-            if (!pAttr)
-            {
-                // The attr name must be listed in the catalog.
-                CListing* pAttrListing = Core.AttrCatalog.GetListing(pszAttr);
-                BOOL bValidAttrName = (pAttrListing != NULL);
-                ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidAttrName,     "RomeFileSetAttrValue: no Rusle2 parameter of that name.");
-
-                // The attr must be asked for in the correct object type.
-                LPCSTR pszObjName = pFile->GetObjType()->GetName();
-                BOOL bValidObjType = pAttrListing->IsValidObject(pszObjName);
-                ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidObjType,      "RomeFileSetAttrValue: Rusle2 parameter asked for in wrong object type.");
-
-                // If not handled above, give a generic error message.
-                ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr,              "RomeFileSetAttrValue: failed to create attr.");
-            }
-
-            // Set the active object for debugging purposes.
-            Core.SetActiveObj(pAttr->GetObj());
-
-			// Verify that the engine is finished before we alter the model.
-            Core.Engine.FinishUpdates();
-
-			ASSERT_OR_RETURN_FALSE(pAttr->IsValidUnits(pszUnit));
-			if (strlen(pszUnit) == 0) // need to use the default
-				pszUnit = "#U_TEMPLATE";
-
-	        // Handle special values for INSERT and DELETE first.
-		    if (strieq(pszValue, "#INSERT"))
-		    {
-//			    nRet = (RT_SHORT)AttrDoInsert(pAttr, nIndex, SIF_UNDOINFO | SIF_EXTERNAL | SIF_QUIET);
-	            // Insert in the dimension -- this will cause all dependent attrs to resize.
-	            // Insertion is now handled by the command class CCmdResizeDim.
-                CAttr* pDim = pAttr->dimensions.GetDimPtr(0);
-	            nRet = (RT_SHORT)UserCmdResizeDim(pDim, "", nIndex, FALSE /*INSERT*/);
-		    }
-		    else
-		    if (strieq(pszValue, "#DELETE"))
-		    {
-//			    nRet = (RT_SHORT)AttrDoRemove(pAttr, nIndex, SIF_UNDOINFO | SIF_EXTERNAL | SIF_QUIET);
-	            // Delete in the dimension -- this will cause all dependent attrs to resize.
-	            // Deletion is now handled by the command class CCmdResizeDim.
-                CAttr* pDim = pAttr->dimensions.GetDimPtr(0);
-	            nRet = (RT_SHORT)UserCmdResizeDim(pDim, "", nIndex, TRUE /*DELETE*/);
-		    }
-            else
-            {
-    	        nRet = (RT_SHORT)::DoCmdSetStr(pAttr, pszValue, nIndex, SIF_UNDOINFO | SIF_EXTERNAL | SIF_QUIET, nVariant, pszUnit);
-//				nRet = (RT_SHORT)::DoCmdSetStr(pAttr, pszValue, nIndex, SIF_UNDOINFO | SIF_EXTERNAL | SIF_QUIET);
-			}
-        }
+        CAttr* pAttr = AttrHandleResolve(pHandle);
+        ASSERT_OR_SETERROR_AND_RETURN_NULL(pAttr,              "RomeAttrHandleGetValue: failed to resolve attr.");
 
-	    return nRet;
+        return ArenaResult(AttrGetValueStr(Core, pAttr, nIndex, nVariant, pszUnit? pszUnit: ""));
     }
     catch (...)
     {
         try
         {
-            CString sInfo; sInfo.Format("RomeFileSetAttrValue: exception for File = '0x%08X', Attr = '%s', Value = '%s', Index = %d.", pFile, (CString)pszAttr, (CString)pszValue, (int)nIndex);
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
+            CString sInfo; sInfo.Format("RomeAttrHandleGetValue: exception for Handle = '0x%08X', Index = %d.", pHandle, (int)nIndex);
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFileSetAttrValue: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_NULL(0,    "RomeAttrHandleGetValue: exception in catch block.");
         }
     }
 }
 
 
-//! Perform an action using the Rome listener interface.
-//! @warning this is currently for internal use only.
-//! @param pObj           A pointer to a Rome [sub]object.
-//! @param nActionType    The action to perform (e.g. #RX_LISTENER_ADD).
-//! @param pObserver      The observer that will listen for the events.
-//! @param pEventHandler  The function to invoke for the events being listened for.
+//! Set the value string for the attribute referred to by an attr handle.
+//! This is equivalent to RomeFileSetAttrValueAux() on the handle's file and attr name,
+//!   without looking up the attr name again.
+//! @param pHandle   The attr handle returned by RomeFileResolveAttr().
+//! @param pszValue  The "value" string, or "#INSERT" / "#DELETE", as for RomeFileSetAttrValue().
+//! @param nIndex    The "flat" index (use 0 for a 1x1 attr).
+//! @param nVariant  The variant of the value (e.g. #RX_VARIANT_CATALOG).
+//! @param pszUnit   The unit of the value. NULL or an empty string will use the template unit.
+//! @return  RX_TRUE (1) if the value changed, RX_FALSE (0) if unchanged, #RX_FAILURE (-1) on error.
 //!
-//! @return RX_TRUE (success) or RX_FALSE (failure).
-//! @RomeAPI
+//! @note This uses return type #RT_SHORT instead of #RT_BOOL to return a signed value.
+//! @see RomeFileResolveAttr(), RomeFileSetAttrValueAux().
+//! @RomeAPI  Wrapper for DoCmdSetStr(), UserCmdResizeDim().
 //!
-ROME_API RT_BOOL RomeObj_Listener(RT_SubObj* pObj, RT_UINT nActionType, RT_void* pObserver, RT_EventHandler pEventHandler)
+ROME_API RT_SHORT RomeAttrHandleSetValue(RT_AttrHandle* pHandle, RT_CSTR pszValue, RT_INT nIndex, RT_UINT nVariant, RT_CNAME pszUnit)
 {
     try
     {
@@ -4316,64 +10179,77 @@ ROME_API RT_BOOL RomeObj_Listener(RT_SubObj* pObj, RT_UINT nActionType, RT_void*
 	    // This is required for many MFC functions to work correctly.
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(pObj,                   "RomeObj_Listener: NULL object pointer.");
-        ASSERT((nActionType & RX_LISTENER_ACTION_MASK) == nActionType);
-        // TODO: test that this is the correct object type.
-        BOOL bValidApp = (&pObj->Core == &App);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(bValidApp,              "RomeObj_Listener: invalid object pointer.");
-		BOOL bExited = pObj->Core.HasFlag(DLLSTATE_CLOSED);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bExited,               "RomeObj_Listener: RomeExit() has already been called.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pHandle,            "RomeAttrHandleSetValue: NULL attr handle.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pszValue,           "RomeAttrHandleSetValue: NULL value pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nIndex >= 0,        "RomeAttrHandleSetValue: negative index.");
+        BOOL bValidSize = (MAX_SETSTR_SIZE <= 0) || (strlen(pszValue) <= MAX_SETSTR_SIZE);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidSize,         "RomeAttrHandleSetValue: value string exceeds MAX_SETSTR_SIZE.");
+        // Check the file before using it, since it may have been closed since the handle was resolved.
+        BOOL bValidFile = CFileObj::IsValid(pHandle->pFile);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFile,         "RomeAttrHandleSetValue: the handle's file has been closed.");
+        CFileObj*  pFile = pHandle->pFile;
+        CRomeCore& Core  = pFile->Core;
+        BOOL bValidApp = RomeCoreIsValid(&Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,          "RomeAttrHandleSetValue: invalid file pointer.");
+		BOOL bExited = Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,           "RomeAttrHandleSetValue: RomeExit() has already been called.");
+#ifdef USE_ROMEAPI_REFCOUNT
+        BOOL bValidRefs = (pFile->m_nRomeRefs >= 1);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidRefs,         "RomeAttrHandleSetValue: invalid file reference count.");
+#endif
 #if USE_ROMEAPI_THREADIdS
         THREADId nCurThreadId = GetCurrentThreadId();
-        BOOL bSameThread = (pObj->Core.m_nThreadId == nCurThreadId);
-        ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,           "RomeObj_Listener: Rome API function called on different thread from RomeInit().");
+        BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,       "RomeAttrHandleSetValue: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&Core);
 
-        BOOL bRet = RX_FALSE;
+	    // Wait for the stack to finish.
+        // This makes sure that a value changed below won't get overwritten by functions on the stack.
+	    StatFinishUpdates(Core.Engine);
 
-        switch (nActionType)
+        // In batch mode, only record the call in the diagnostic ring.
+        BATCHCORE* pBatch = CoreGetBatch(Core);
+        if (pBatch)
         {
-            UNUSED2(pObserver, pEventHandler);
-/*
-            case RX_LISTENER_ADD:
-                bRet = pObj->ListenerSet.Add(pObserver, pEventHandler);
-                break;
-            case RX_LISTENER_REMOVE:
-                bRet = pObj->ListenerSet.Remove(pObserver);
-                break;
-            case RX_LISTENER_REMOVEALL:
-                bRet = pObj->ListenerSet.RemoveAll(pObserver);
-                break;
-*/
-            case RX_LISTENER_ADD:
-            case RX_LISTENER_REMOVE:
-            case RX_LISTENER_REMOVEALL:
-            default:
-                ASSERT(FALSE);
-                break;
+            CAttr*   pAttr = AttrHandleResolve(pHandle);
+            FileBaselineNoteSet(pFile, pHandle->sAttr, pAttr);
+            RT_SHORT nRet  = pAttr? AttrSetValueStr(Core, pFile, pAttr, pszValue, nIndex, nVariant, pszUnit? pszUnit: ""): RX_FAILURE;
+            BatchLog(pBatch, "RomeAttrHandleSetValue", pHandle->sAttr, nIndex, nRet);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr,              "RomeAttrHandleSetValue: failed to resolve attr.");
+            return nRet;
         }
 
-        return bRet;
+        CString sFile = pFile->GetFileName();
+        ROME_API_LOGELEM(CLogFileElement4(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeAttrHandleSetValue", "file='%s' attr='%s' value='%s' index='%d'>\n", (CString)XMLEncode(sFile), pHandle->sAttr, pszValue, nIndex));
+#if USE_ROMESHELL_LOGGING
+        LogShellActivate(sFile);
+        ROME_API_LOG(LogFilePrintf3(LOG_SHELL, "RomeFileSetAttrValue \"%s\" \"%s\" %d\n", pHandle->sAttr, pszValue, nIndex));
+#endif
+
+        CAttr* pAttr = AttrHandleResolve(pHandle);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pAttr,              "RomeAttrHandleSetValue: failed to resolve attr.");
+
+        FileBaselineNoteSet(pFile, pHandle->sAttr, pAttr);
+        return AttrSetValueStr(Core, pFile, pAttr, pszValue, nIndex, nVariant, pszUnit? pszUnit: "");
     }
     catch (...)
     {
         try
         {
-            CString sObj = pObj? pObj->GetDisplayTitle(): "NULL";
-            CString sInfo; sInfo.Format("RomeObj_Listener: exception for Obj = '%s', Action = %d.", sObj, nActionType);
-            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,    sInfo);
+            CString sInfo; sInfo.Format("RomeAttrHandleSetValue: exception for Handle = '0x%08X', Value = '%s', Index = %d.", pHandle, (CString)pszValue, (int)nIndex);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
         }
         catch (...)
         {
-            ASSERT_OR_SETERROR_AND_RETURN_FALSE(0,    "RomeObj_Listener: exception in catch block.");
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeAttrHandleSetValue: exception in catch block.");
         }
     }
 }
 
 
-//! @} // Rome File functions
+//! @} // Rome File attr handle functions
 /////////////////////////////////////////////////////////////////////////////
 //! @name Rome Filesystem functions
 //! @{
@@ -4401,7 +10277,7 @@ ROME_API RT_FileObj* RomeFilesAdd(RT_Files* pFiles, RT_CNAME pszObjType, RT_CSTR
         ASSERT_OR_SETERROR_AND_RETURN_NULL(pFiles,             "RomeFilesAdd: NULL file system pointer.");
         ASSERT_OR_SETERROR_AND_RETURN_NULL(pszObjType,         "RomeFilesAdd: NULL object name.");
         ASSERT_OR_SETERROR_AND_RETURN_NULL(pszFullname,        "RomeFilesAdd: NULL file name.");
-        BOOL bValidApp = (&pFiles->Core == &App);
+        BOOL bValidApp = RomeCoreIsValid(&pFiles->Core);
         ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,          "RomeFilesAdd: invalid file pointer.");
 		BOOL bExited = pFiles->Core.HasFlag(DLLSTATE_CLOSED);
         ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,           "RomeFilesAdd: RomeExit() has already been called.");
@@ -4413,7 +10289,7 @@ ROME_API RT_FileObj* RomeFilesAdd(RT_Files* pFiles, RT_CNAME pszObjType, RT_CSTR
         ASSERT_OR_SETERROR_AND_RETURN_NULL(!bSameThread,       "RomeFilesAdd: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&pFiles->Core);
 
 	    // Make local CString copies to be able to pass references to CFileObj constructor.
 	    CString sObjType = pszObjType;
@@ -4421,9 +10297,9 @@ ROME_API RT_FileObj* RomeFilesAdd(RT_Files* pFiles, RT_CNAME pszObjType, RT_CSTR
 
 	    FILESYS_WRITELOCK();
 
-        CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFilesAdd", "file='%s' type='%s'>\n", (CString)XMLEncode(sFullname), sObjType);
+        ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFilesAdd", "file='%s' type='%s'>\n", (CString)XMLEncode(sFullname), sObjType));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf2(LOG_SHELL, "RomeFilesAdd \"%s\" \"%s\"\n", sFullname, sObjType);
+        ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "RomeFilesAdd \"%s\" \"%s\"\n", sFullname, sObjType));
 #endif
 
 	    CFileObj* pNewFile = pFiles->NewFileObj(sObjType, sFullname);
@@ -4489,7 +10365,7 @@ ROME_API RT_void RomeFilesCloseAll(RT_Files* pFiles, RT_UINT nFlags /*=0*/)
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
         ASSERT_OR_SETERROR_AND_RETURN(pFiles,                  "RomeFilesCloseAll: NULL file system pointer.");
-        BOOL bValidApp = (&pFiles->Core == &App);
+        BOOL bValidApp = RomeCoreIsValid(&pFiles->Core);
         ASSERT_OR_SETERROR_AND_RETURN(bValidApp,               "RomeFilesCloseAll: invalid file system pointer.");
 		BOOL bExited = pFiles->Core.HasFlag(DLLSTATE_CLOSED);
         ASSERT_OR_SETERROR_AND_RETURN(!bExited,			       "RomeFilesCloseAll: RomeExit() has already been called.");
@@ -4501,19 +10377,21 @@ ROME_API RT_void RomeFilesCloseAll(RT_Files* pFiles, RT_UINT nFlags /*=0*/)
         ASSERT_OR_SETERROR_AND_RETURN(!bSameThread,            "RomeFilesCloseAll: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&pFiles->Core);
 
         //! @since 2009-05-06 If the default @p nFlags argument of 0 is used, this function will instead
         //!   use flags combination #RX_CLOSEALL_DeleteAllFiles.
         if (nFlags == 0)
             nFlags = RX_CLOSEALL_DeleteAllFiles;
 
-        CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFilesCloseAll", "flags='%d'>\n", nFlags);
+        ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFilesCloseAll", "flags='%d'>\n", nFlags));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf1(LOG_SHELL, "RomeFilesCloseAll %d\n", nFlags);
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeFilesCloseAll %d\n", nFlags));
 #endif
 
+        AttrHandlesInvalidate(pFiles->Core);
         pFiles->CloseAllFiles(nFlags);
+        FileBaselinesPrune(pFiles->Core, FALSE);
     }
     catch (...)
     {
@@ -4530,7 +10408,7 @@ ROME_API RT_void RomeFilesClose(RT_Files* pFiles, RT_UINT nFlags /*=0*/)
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
         ASSERT_OR_SETERROR_AND_RETURN(pFiles,                  "RomeFilesClose: NULL file system pointer.");
-        BOOL bValidApp = (&pFiles->Core == &App);
+        BOOL bValidApp = RomeCoreIsValid(&pFiles->Core);
         ASSERT_OR_SETERROR_AND_RETURN(bValidApp,               "RomeFilesClose: invalid file system pointer.");
 		BOOL bExited = pFiles->Core.HasFlag(DLLSTATE_CLOSED);
         ASSERT_OR_SETERROR_AND_RETURN(!bExited,			       "RomeFilesClose: RomeExit() has already been called.");
@@ -4542,14 +10420,16 @@ ROME_API RT_void RomeFilesClose(RT_Files* pFiles, RT_UINT nFlags /*=0*/)
         ASSERT_OR_SETERROR_AND_RETURN(!bSameThread,            "RomeFilesClose: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&pFiles->Core);
 
-        CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFilesClose", "flags='%d'>\n", nFlags);
+        ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFilesClose", "flags='%d'>\n", nFlags));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf1(LOG_SHELL, "RomeFilesClose %d\n", nFlags);
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeFilesClose %d\n", nFlags));
 #endif
 
+        AttrHandlesInvalidate(pFiles->Core);
         pFiles->CloseFiles(nFlags);
+        FileBaselinesPrune(pFiles->Core, FALSE);
     }
     catch (...)
     {
@@ -4575,7 +10455,7 @@ ROME_API RT_INT RomeFilesGetCount(RT_Files* pFiles)
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
         ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFiles,          "RomeFilesGetCount: NULL file system pointer.");
-        BOOL bValidApp = (&pFiles->Core == &App);
+        BOOL bValidApp = RomeCoreIsValid(&pFiles->Core);
         ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,       "RomeFilesGetCount: invalid file system pointer.");
 		BOOL bExited = pFiles->Core.HasFlag(DLLSTATE_CLOSED);
         ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,        "RomeFilesGetCount: RomeExit() has already been called.");
@@ -4587,11 +10467,11 @@ ROME_API RT_INT RomeFilesGetCount(RT_Files* pFiles)
         ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,    "RomeFilesGetCount: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&pFiles->Core);
 
-        CLogFileElement0(LOGELEM_HIST, "user", "RomeFilesGetCount", "/>\n");
+        ROME_API_LOGELEM(CLogFileElement0(LOGELEM_HIST, "user", "RomeFilesGetCount", "/>\n"));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf0(LOG_SHELL, "RomeFilesGetCount\n");
+        ROME_API_LOG(LogFilePrintf0(LOG_SHELL, "RomeFilesGetCount\n"));
 #endif
 
 	    return pFiles->GetFileCount();
@@ -4603,8 +10483,209 @@ ROME_API RT_INT RomeFilesGetCount(RT_Files* pFiles)
 }
 
 
+//! Find the files a file refers to directly, through its pointer and subobject attrs.
+//! @param pFiles   The filesystem the file belongs to.
+//! @param pFile    The file to find the references of.
+//! @param Visited  The files found so far, by name. Only the keys are used.
+//!   Files already in it are skipped, and those found are added to it.
+//! @param aFound   Returns the files found which weren't in @p Visited, in the order found.
+//! @note The caller must hold the API lock, which keeps the files loaded.
+//!
+LOCAL void FileGetReferences(RT_Files* pFiles, CFileObj* pFile, CMapStringToPtr& Visited, CArray<CFileObj*, CFileObj*>& aFound)
+{
+    // Loop through all attributes within file object
+    POSITION pos = pFile->m_params.GetStartPosition();
+    while (pos)
+    {
+        CAttr* pAttr = pFile->m_params.GetNextValue(pos);
+        CListing* pListing = pAttr->GetListing();
+        if (!pListing)
+            continue;
+
+        // looks like it could at least point to a true file object
+        ParamType attrType = pListing->GetType();
+        if (attrType != ATTR_PTR && attrType != ATTR_SUB)
+            continue;
+
+        void* pUnused;
+        const int numPtrs = pAttr->GetSize();
+        for (int i = 0; i < numPtrs; i++)
+        {
+            // If is ATTR_PTR, make sure that it exists in DB, otherwise will mess up the process.
+            // Would be caught by consistency check, but there is no guarantee that has been run.
+            // Files already found are skipped first, which saves most of the database lookups.
+            if (attrType == ATTR_PTR)
+            {
+                LPCSTR fileName = pAttr->GetStr(i);
+                if (Visited.Lookup(fileName, pUnused) || !pFiles->FileExists(fileName))
+                    continue;
+            }
+
+            CSubObj* pCheckSubObj = pAttr->GetPtr(i);
+            if (pCheckSubObj && pCheckSubObj->IsFile())
+            {
+                LPCSTR fileName = pCheckSubObj->GetFileName();
+                // If this file hasn't been added to list yet then do so
+                if (!Visited.Lookup(fileName, pUnused))
+                {
+                    Visited.SetAt(fileName, NULL);
+                    aFound.Add(static_cast<CFileObj*>(pCheckSubObj));
+                }
+            }
+        }
+    }
+}
+
+
+//! Find the files a file depends on, through its pointer and subobject attrs, and theirs in turn.
+//! Each file is visited once, through the objects its referencing attrs already point to,
+//!   so shared files (e.g. the vegetations of many operations) aren't reopened.
+//! @param pFiles  The filesystem the file belongs to.
+//! @param pRoot   The file to find the dependencies of.
+//! @param aDeps   Returns the filenames of the dependencies, in the order found. This doesn't include @p pRoot.
+//! @note The caller must hold the API lock, which keeps the dependencies loaded.
+//!
+LOCAL void FilesGetDependencies(RT_Files* pFiles, CFileObj* pRoot, CStringArray& aDeps)
+{
+    // The files found so far, including the root. Only the keys are used.
+    CMapStringToPtr Visited;
+    Visited.InitHashTable(1021);
+    Visited.SetAt(pRoot->GetFileName(), NULL);
+
+    CList<CFileObj*, CFileObj*> stack;
+    stack.AddHead(pRoot);
+
+    CArray<CFileObj*, CFileObj*> aFound;
+    while (!stack.IsEmpty())
+    {
+        CFileObj* pFile = stack.RemoveHead();
+
+        aFound.RemoveAll();
+        FileGetReferences(pFiles, pFile, Visited, aFound);
+        for (int i = 0; i < aFound.GetSize(); i++)
+        {
+            aDeps.Add(aFound[i]->GetFileName());
+            stack.AddHead(aFound[i]);
+        }
+    }
+}
+
+
+//! Add the attr values of a binary snapshot's tables (see BINSNAPWRITER) to a hash, as strings.
+//! Each string is hashed with its terminating NUL, so that strings can't run together.
+//! @param nHash  The hash so far.
+//! @param W      The tables.
+//! @param nLen   Adds the number of bytes hashed.
+//! @return The new hash.
+//!
+LOCAL ULONGLONG BinSnapHash(ULONGLONG nHash, const BINSNAPWRITER& W, UINT& nLen)
+{
+    LPCSTR pPool = (LPCSTR)W.aPool.GetData();
+    for (int a = 0; a < W.aAttrs.GetSize(); a++)
+    {
+        const BINSNAPATTR& Rec = W.aAttrs[a];
+        LPCSTR pszName = pPool + Rec.nName;
+        LPCSTR pszUnit = pPool + Rec.nUnit;
+        nHash = HashFnv1a(nHash, pszName, strlen(pszName) + 1);
+        nHash = HashFnv1a(nHash, pszUnit, strlen(pszUnit) + 1);
+        nHash = HashFnv1a(nHash, &Rec.nCount, sizeof(Rec.nCount));
+        nLen += (UINT)(strlen(pszName) + strlen(pszUnit) + 2 + sizeof(Rec.nCount));
+        for (UINT i = 0; i < Rec.nCount; i++)
+        {
+            LPCSTR pszValue = pPool + W.aValues[Rec.nFirst + i];
+            const size_t nValueLen = strlen(pszValue) + 1;
+            nHash = HashFnv1a(nHash, pszValue, nValueLen);
+            nLen += (UINT)nValueLen;
+        }
+    }
+    return nHash;
+}
+
+
+//! Make the result cache key for running a file and getting some of its outputs.
+//! The key is a hash of the file's inputs, the inputs of the files it refers to
+//!   through pointer and subobject attrs (as RomeFilesGetDependencies() follows them),
+//!   the outputs requested and the science version.
+//! The inputs are hashed as the values a binary snapshot (see BinSnapSave()) of each file holds,
+//!   without calculated values, read from the open files, so that edits to a dependency
+//!   (e.g. a climate changed through a "#RD:" chained attr) give a new key.
+//!   Dependencies are hashed with their names, in the order they are found.
+//!   The file's own name isn't hashed, so that separate files with the same inputs (e.g. two fields) share a result.
+//! The caller must hold the API lock, and have drained the engine.
+//! @param Core      The core the file belongs to.
+//! @param pFile     The file to make the key for.
+//! @param pOutputs  The outputs requested, as for RomeFileGetAttrValues().
+//! @param nOutputs  The number of elements in @p pOutputs.
+//! @param nVariant  The variant the outputs are requested in.
+//! @param sKey      Returns the key.
+//! @return TRUE on success, FALSE if a file can't be held by a snapshot (see BinSnapAddObj()), so no key is made.
+//!
+LOCAL BOOL ResultCacheKey(CRomeCore& Core, CFileObj* pFile, const RT_AttrValue* pOutputs, int nOutputs, RT_UINT nVariant, CString& sKey)
+{
+    CArray<CFileObj*, CFileObj*> aFiles;
+    aFiles.Add(pFile);
+
+    // Find the dependencies as FilesGetDependencies() does, keeping the objects.
+    CMapStringToPtr Visited;
+    Visited.InitHashTable(1021);
+    Visited.SetAt(pFile->GetFileName(), NULL);
+    CList<CFileObj*, CFileObj*> stack;
+    stack.AddHead(pFile);
+    CArray<CFileObj*, CFileObj*> aFound;
+    while (!stack.IsEmpty())
+    {
+        CFileObj* pNext = stack.RemoveHead();
+        aFound.RemoveAll();
+        FileGetReferences(&Core.Files, pNext, Visited, aFound);
+        for (int i = 0; i < aFound.GetSize(); i++)
+        {
+            aFiles.Add(aFound[i]);
+            stack.AddHead(aFound[i]);
+        }
+    }
+
+    ULONGLONG nHash = FNV1A_64_INIT;
+    UINT nLen = 0;
+    for (int f = 0; f < aFiles.GetSize(); f++)
+    {
+        if (f > 0)
+        {
+            LPCSTR pszName = aFiles[f]->GetFileName();
+            nHash = HashFnv1a(nHash, pszName, strlen(pszName) + 1);
+        }
+
+        BINSNAPWRITER W;
+        W.mapPool.InitHashTable(1031);
+        BinSnapAddStr(W, "");
+        CString sError;
+        if (!BinSnapAddObj(W, aFiles[f], "", FALSE, sError))
+            return FALSE;
+        nHash = HashFnv1a(nHash, &f, sizeof(f));
+        nHash = BinSnapHash(nHash, W, nLen);
+    }
+
+    const UINT nScience = Core.GetScienceVersion();
+    nHash = HashFnv1a(nHash, &nScience, sizeof(nScience));
+    nHash = HashFnv1a(nHash, &nVariant, sizeof(nVariant));
+    for (int i = 0; i < nOutputs; i++)
+    {
+        // Hash the terminating NULs too, so that names can't run together.
+        LPCSTR pszAttr = pOutputs[i].pszAttr? pOutputs[i].pszAttr: "";
+        LPCSTR pszUnit = pOutputs[i].pszUnit? pOutputs[i].pszUnit: "";
+        nHash = HashFnv1a(nHash, pszAttr, strlen(pszAttr) + 1);
+        nHash = HashFnv1a(nHash, &pOutputs[i].nIndex, sizeof(pOutputs[i].nIndex));
+        nHash = HashFnv1a(nHash, pszUnit, strlen(pszUnit) + 1);
+    }
+
+    sKey.Format("%016I64X-%08X-%d-%d", nHash, nLen, (int)aFiles.GetSize(), nOutputs);
+    return TRUE;
+}
+
+
 //! Return all object dependencies for file passed by pszFilename. This was implemented from CAttrView::BuildArrayAllReferencedFiles
 //! @note The depsArray arguement will dynamically create a 2d character array and must be deleted after use to avoid memory leaks.
+//!   Delete each element with delete[], then the array itself with delete[].
+//!   RomeFilesGetDependencyBlock() returns the same names in a caller-owned buffer instead.
 //! @param pFiles  A pointer to the Rome filesystem interface.
 //! @param pszFilename A valid filename within the open ROME database to find all dependencies
 //! @param depsArray A pointer to a 2d character array. This will be initialized during the function call and return any dependencies.
@@ -4622,104 +10703,39 @@ ROME_API RT_BOOL RomeFilesGetDependencies(RT_Files* pFiles, RT_CSTR pszFilename,
 
 		ASSERT_OR_SETERROR_AND_RETURN_FALSE(pFiles, "RomeFilesGetDependecies: NULL file system pointer.");
 		ASSERT_OR_SETERROR_AND_RETURN_NULL(pszFilename, "RomeFilesGetDependecies: NULL filename pointer.");
-		BOOL bValidApp = (&pFiles->Core == &App);
+		BOOL bValidApp = RomeCoreIsValid(&pFiles->Core);
 		ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp, "RomeFilesGetDependecies: invalid file system pointer.");
 		BOOL bExited = pFiles->Core.HasFlag(DLLSTATE_CLOSED);
 		ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited, "RomeFilesGetDependecies: RomeExit() has already been called.");
 		BOOL bValidFiles = CFileSys::IsValid(pFiles);
 		ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidFiles, "RomeFilesGetDependecies: invalid file system pointer.")
 #if USE_ROMEAPI_THREADIdS
-			THREADId nCurThreadId = GetCurrentThreadId();
-		BOOL bSameThread = (pFile->Core.m_nThreadId == nCurThreadId);
-		ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread, "RomeFileGetFloatArray: Rome API function called on different thread from RomeInit().");
+		THREADId nCurThreadId = GetCurrentThreadId();
+		BOOL bSameThread = (pFiles->Core.m_nThreadId == nCurThreadId);
+		ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread, "RomeFilesGetDependecies: Rome API function called on different thread from RomeInit().");
 #endif
 
-		ROME_API_LOCK();
+		ROME_API_WRITELOCK(&pFiles->Core);
 
 		// Wait for the stack to finish.
 		// This makes sure that a value retrieved below won't get changed by functions on the stack.
-		pFiles->Core.Engine.FinishUpdates();
+		StatFinishUpdates(pFiles->Core.Engine);
 
-		CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFilesGetDependecies", "file='%s'>\n", (CString)XMLEncode(pszFilename));
+		ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFilesGetDependecies", "file='%s'>\n", (CString)XMLEncode(pszFilename)));
 #if USE_ROMESHELL_LOGGING
-		LogFilePrintf2(LOG_SHELL, "RomeFilesGetDependecies \"%s\"\n", pszFilename);
+		ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeFilesGetDependecies \"%s\"\n", pszFilename));
 #endif
 
-		// Create CStringArray to store filesys.GetFileDependencies results
-		CStringArray csaDeps;
-		CList<CString> stack;
-		RT_FileObj* pFile;
-		POSITION pos;
-		CAttr* pAttr;
-
-		// if (ArrayFind(csaDeps, pszFilename) == -1) {
-		// 	csaDeps.Add(pszFilename);
-		//}
-
-		stack.AddHead(LPCSTR(pszFilename));
-
-		// While stack isn't empty
-		while (stack.GetSize() > 0)
-		{
-			// Open file at top of stack
-			pFile = RomeFilesOpen(pFiles, stack.RemoveHead(), 0);
-
-			// Begin parameter search for open file object
-			pos = pFile->m_params.GetStartPosition();
-
-			// Loop through all attributes within file object
-			while (pos)
-			{
-				pAttr = pFile->m_params.GetNextValue(pos);
-				CListing* pListing = pAttr->GetListing();
-				if (pListing)
-				{
-					ParamType attrType = pListing->GetType();
-					// looks like it could at least point to a true file object
-					if (attrType == ATTR_PTR || attrType == ATTR_SUB)
-					{
-						int numPtrs = pAttr->GetSize();
-						for (int i = 0; i < numPtrs; i++)
-						{
-							// If is ATTR_PTR, make sure that it exists in DB, otherwise will mess up the process.  
-							// Would be caught by consistency check, but there is no guarantee that has been run
-							if (attrType == ATTR_PTR)
-							{
-								LPCSTR fileName = pAttr->GetStr(i);
-								if (!App.Files.FileExists(fileName))
-								{
-									continue;
-								}
-							}
-							CSubObj* pCheckSubObj = pAttr->GetPtr(i);
-							if (pCheckSubObj)
-							{
-								if (pCheckSubObj->IsFile())
-								{
-									LPCSTR fileName = pCheckSubObj->GetFileName();
-									// If this file hasn't been added to list yet then do so
-									if (ArrayFind(csaDeps, fileName) == -1)
-									{
-										stack.AddHead(fileName);
-										csaDeps.Add(fileName);
-									}
-								}
-							}
-						}
-					}
-				}
-			}
-
-			RomeFileClose(pFile);
-		}
+		// Only the top file is opened. The files it depends on are reached through its attrs.
+		RT_FileObj* pFile = RomeFilesOpen(pFiles, pszFilename, 0);
+		ASSERT_OR_SETERROR_AND_RETURN_FALSE(pFile, "RomeFilesGetDependecies: failed to open file.");
 
-		//	RT_BOOL bDepsOK = pFiles->GetFileDependencies(pszFilename, false, csaDeps);
+		CStringArray csaDeps;
+		FilesGetDependencies(pFiles, pFile, csaDeps);
+		RomeFileClose(pFile);
 
-		//	// If filesys.GetFileDependencies returned true
-		//	if (bDepsOK)
-		//	{
 		// Set size return argument to size of csaDeps
-		depsSize = csaDeps.GetCount() - 1;
+		depsSize = csaDeps.GetCount();
 
 		// Initialize RT_CSTRA return argument
 		depsArray = new char*[depsSize];
@@ -4727,27 +10743,12 @@ ROME_API RT_BOOL RomeFilesGetDependencies(RT_Files* pFiles, RT_CSTR pszFilename,
 		// Manually copy contents of csaDeps to return argument depsArray as csaDeps will deallocate when leaving scope
 		for (int i = 0; i < depsSize; i++)
 		{
-			// Allocate length of csaDeps to depsArray for each element i
-			depsArray[i] = new char[csaDeps.GetAt(i).GetLength()];
-
-			// For each character in element i of csaDeps make a copy to depsArray
-			for (int j = 0; j < csaDeps.GetAt(i).GetLength(); j++)
-			{
-				depsArray[i][j] = csaDeps.GetAt(i).GetAt(j);
-			}
-
-			// Add null terminating character as CString GetAt method does not include this in length count
-			depsArray[i][csaDeps.GetAt(i).GetLength()] = '\0';
+			// Allocate room for the terminating NUL, which CString::GetLength() doesn't count
+			const int nLen = csaDeps[i].GetLength();
+			depsArray[i] = new char[nLen + 1];
+			memcpy(depsArray[i], (LPCSTR)csaDeps[i], nLen + 1);
 		}
-		//	}
-		//	else
-		//	{
-		//		// Null return arguments on failure and set size to 0
-		//		depsArray = 0;
-		//		depsSize = 0;
-		//	}
-
-		//	return bDepsOK;
+
 		return true;
 	}
 	catch (...)
@@ -4765,6 +10766,400 @@ ROME_API RT_BOOL RomeFilesGetDependencies(RT_Files* pFiles, RT_CSTR pszFilename,
 }
 
 
+//! Get all object dependencies of a file as one block of names in a caller-owned buffer.
+//! This finds the same files as RomeFilesGetDependencies(), without allocating memory the caller must free.
+//! @param pFiles       A pointer to the Rome filesystem interface returned by RomeGetFiles().
+//! @param pszFilename  A valid filename within the open database to find all dependencies of.
+//! @param[out] pBuf    The buffer to return the filenames in, each NUL-terminated, followed by an extra NUL.
+//!   Example: "climates\USA\Wisconsin\Dane County\0soils\...\0\0".
+//!   This may be NULL if @p nBufLen is 0, to query the size required.
+//! @param nBufLen      The length of @p pBuf.
+//! @return  The buffer length required to hold all names (including NULs), or #RX_FAILURE (-1) on error.
+//!   All names were returned if this is not larger than @p nBufLen. Otherwise @p pBuf is left empty.
+//!
+//! @see RomeFilesGetDependencies().
+//! @RomeAPI
+//!
+ROME_API RT_INT RomeFilesGetDependencyBlock(RT_Files* pFiles, RT_CSTR pszFilename, RT_PCHAR pBuf, RT_UINT nBufLen)
+{
+    try
+    {
+        // Switch to the app's MFC module state while in this scope.
+        // This is required for many MFC functions to work correctly.
+        AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFiles,                "RomeFilesGetDependencyBlock: NULL file system pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!strempty(pszFilename),"RomeFilesGetDependencyBlock: empty filename.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pBuf || nBufLen == 0,  "RomeFilesGetDependencyBlock: NULL buffer pointer.");
+        BOOL bValidApp = RomeCoreIsValid(&pFiles->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,             "RomeFilesGetDependencyBlock: invalid file system pointer.");
+		BOOL bExited = pFiles->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,              "RomeFilesGetDependencyBlock: RomeExit() has already been called.");
+        BOOL bValidFiles = CFileSys::IsValid(pFiles);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFiles,           "RomeFilesGetDependencyBlock: invalid file system pointer.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pFiles->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,          "RomeFilesGetDependencyBlock: Rome API function called on different thread from RomeInit().");
+#endif
+
+        ROME_API_WRITELOCK(&pFiles->Core);
+
+        // Wait for the stack to finish.
+        // This makes sure that a value retrieved below won't get changed by functions on the stack.
+        StatFinishUpdates(pFiles->Core.Engine);
+
+        ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFilesGetDependencyBlock", "file='%s'>\n", (CString)XMLEncode(pszFilename)));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeFilesGetDependencyBlock \"%s\"\n", pszFilename));
+#endif
+
+        RT_FileObj* pFile = RomeFilesOpen(pFiles, pszFilename, 0);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFile,                 "RomeFilesGetDependencyBlock: failed to open file.");
+
+        CStringArray aDeps;
+        FilesGetDependencies(pFiles, pFile, aDeps);
+        RomeFileClose(pFile);
+
+        UINT nNeeded = 1;
+        for (int i = 0; i < aDeps.GetSize(); i++)
+            nNeeded += aDeps[i].GetLength() + 1;
+
+        if (nNeeded <= nBufLen)
+        {
+            UINT nUsed = 0;
+            for (int i = 0; i < aDeps.GetSize(); i++)
+            {
+                const UINT nLen = aDeps[i].GetLength() + 1;
+                memcpy(pBuf + nUsed, (LPCSTR)aDeps[i], nLen);
+                nUsed += nLen;
+            }
+            pBuf[nUsed] = '\0';
+        }
+        else if (nBufLen > 0)
+            pBuf[0] = '\0';
+
+        return (RT_INT)nNeeded;
+    }
+    catch (...)
+    {
+        try
+        {
+            RT_App* pApp = pFiles? &pFiles->Core: NULL;
+            CString sInfo; sInfo.Format("RomeFilesGetDependencyBlock: exception for File = '%s'.", (CString)pszFilename);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFilesGetDependencyBlock: exception in catch block.");
+        }
+    }
+}
+
+
+//! The state shared by the workers of RomeFilesPreopen().
+typedef struct PREOPENRUN
+{
+    CString          sArgs;         //!< The arguments each worker's core is created with.
+    CString          sDatabase;     //!< The database each worker's core opens.
+    CString          sCacheDir;     //!< The shared cache each worker saves the files it opens to.
+    CCriticalSection Lock;          //!< Guards the members below.
+    CStringList      Queue;         //!< The files asked for which no worker has taken yet.
+    CMapStringToPtr  Refs;          //!< The files each file found refers to (CStringArray*), by name.
+} PREOPENRUN;
+
+
+//! Open one of the files asked for in a worker's core for RomeFilesPreopen(), and save it and
+//!   all the files it depends on to the shared cache, recording the files each refers to.
+//! Opening the file opens the files it depends on as well, each once, so they are only walked here.
+//!   The worker's files stay open, so a file asked for later which shares a dependency
+//!   finds it already loaded, and isn't walked again.
+//! @param pCore   The worker's core, with the database and shared cache open.
+//! @param sName   The file to open.
+//! @param Run     The run, whose @c Refs the references are added to.
+//! @param Seen    The files this worker has walked so far. Only the keys are used.
+//!
+LOCAL void PreopenFile(RT_App* pCore, const CString& sName, PREOPENRUN& Run, CMapStringToPtr& Seen)
+{
+    RT_Files* pFiles = RomeGetFiles(pCore);
+    RT_FileObj* pFile = RomeFilesOpen(pFiles, sName, 0);
+    if (pFile == NULL)
+        return;
+
+    ROME_API_WRITELOCK(pCore);
+    void* pUnused;
+    CArray<CFileObj*, CFileObj*> aWalk;
+    if (!Seen.Lookup(pFile->GetFileName(), pUnused))
+    {
+        Seen.SetAt(pFile->GetFileName(), NULL);
+        aWalk.Add(pFile);
+    }
+    for (int i = 0; i < aWalk.GetSize(); i++)
+    {
+        CFileObj* pWalk = aWalk[i];
+        const CString sWalk = pWalk->GetFileName();
+
+        CMapStringToPtr Visited;
+        Visited.SetAt(sWalk, NULL);
+        CArray<CFileObj*, CFileObj*> aFound;
+        FileGetReferences(pFiles, pWalk, Visited, aFound);
+        CStringArray* pRefs = new CStringArray;
+        for (int j = 0; j < aFound.GetSize(); j++)
+        {
+            const CString sFound = aFound[j]->GetFileName();
+            pRefs->Add(sFound);
+            if (!Seen.Lookup(sFound, pUnused))
+            {
+                Seen.SetAt(sFound, NULL);
+                aWalk.Add(aFound[j]);
+            }
+        }
+
+        // Only the file asked for went through SharedCacheOpen(), and another worker may have saved any of them.
+        CString sPath;
+        if (SharedCachePath(pFiles, sWalk, sPath) && GetFileAttributes(sPath) == INVALID_FILE_ATTRIBUTES)
+            SharedCacheSave(pFiles->Core, pWalk, sPath);
+
+        CSingleLock Lock(&Run.Lock, TRUE);
+        if (Run.Refs.Lookup(sWalk, pUnused))
+            delete pRefs;
+        else
+            Run.Refs.SetAt(sWalk, pRefs);
+    }
+}
+
+
+//! The thread procedure of a RomeFilesPreopen() worker.
+//! Each worker opens files in its own core, so workers never wait on each other's API lock.
+//!   The files asked for are taken from a shared queue, so files which don't share
+//!   dependencies are opened at the same time. A dependency shared by files taken by
+//!   different workers is opened by each of them.
+//! @param pParam  The run's #PREOPENRUN.
+//! @return 0 always. A worker whose core fails to start takes no files.
+//!
+LOCAL UINT AFX_CDECL PreopenWorkerProc(LPVOID pParam)
+{
+    PREOPENRUN& Run = *(PREOPENRUN*)pParam;
+
+    RT_App* pCore = RomeInit(Run.sArgs);
+    if (pCore && (RomeDatabaseOpen(RomeGetDatabase(pCore), Run.sDatabase) != RX_TRUE
+               || RomeDatabaseSetSharedCache(RomeGetDatabase(pCore), Run.sCacheDir) != RX_TRUE))
+    {
+        RomeExit(pCore);
+        pCore = NULL;
+    }
+    if (pCore == NULL)
+        return 0;
+
+    CMapStringToPtr Seen;
+    for (;;)
+    {
+        CString sName;
+        {
+            CSingleLock Lock(&Run.Lock, TRUE);
+            if (Run.Queue.IsEmpty())
+                break;
+            sName = Run.Queue.RemoveHead();
+        }
+        PreopenFile(pCore, sName, Run, Seen);
+    }
+
+    // This closes the worker's files as well.
+    RomeExit(pCore);
+    return 0;
+}
+
+
+//! Add a file to the order RomeFilesPreopen() opens files in, after the files it refers to.
+//! @param Run     The finished run, whose @c Refs hold the graph.
+//! @param sName   The file to add.
+//! @param Done    The files added so far, or being added. Only the keys are used.
+//! @param aOrder  The files in the order to open them.
+//!
+LOCAL void PreopenOrder(PREOPENRUN& Run, const CString& sName, CMapStringToPtr& Done, CStringArray& aOrder)
+{
+    void* pFound;
+    if (Done.Lookup(sName, pFound))
+        return;
+    // Marked before the references, so a cycle ends here.
+    Done.SetAt(sName, NULL);
+    if (Run.Refs.Lookup(sName, pFound))
+    {
+        const CStringArray& aRefs = *(const CStringArray*)pFound;
+        for (int i = 0; i < aRefs.GetSize(); i++)
+            PreopenOrder(Run, aRefs[i], Done, aOrder);
+    }
+    aOrder.Add(sName);
+}
+
+
+//! Load database files and all the files they depend on, opening the files asked for concurrently.
+//! Opening a file normally opens the files it points to one at a time on the calling thread,
+//!   and theirs in turn (e.g. a management's operations, and their vegetations and residues),
+//!   so a complex rotation is slow the first time it is used.
+//! This opens the files asked for on a pool of worker threads. Each worker has its own core
+//!   (see RomeInit() "/NewCore"), opens the files it takes from a shared queue along with
+//!   their dependencies, and saves them all to the shared cache (see RomeDatabaseSetSharedCache()).
+//!   A file's dependencies are opened in the worker which takes it, one at a time, so only
+//!   the files asked for are opened at the same time.
+//! Then this core maps the snapshots, starting with the files that depend on no others,
+//!   so each file finds the files it points to already loaded.
+//! @param pFiles      The filesystem interface returned by RomeGetFiles().
+//!   Its database must be open. Its core isn't locked while the workers run.
+//! @param pFilenames  The names of the database files to load (e.g. the files a profile's
+//!   CLIMATE_PTR, SOIL_PTR and management pointers are about to be set to).
+//! @param nFiles      The number of elements in @p pFilenames.
+//! @param nWorkers    The number of worker threads to use, or 0 to use one per processor.
+//!                    This is limited to #RX_BATCH_MAXWORKERS, and to @p nFiles.
+//! @return  The number of files loaded, including the files they depend on and those already open,
+//!   or #RX_FAILURE (-1) on error.
+//!
+//! @note Without a shared cache, the files can't be handed from one core to another,
+//!   so they are opened one at a time on the calling thread, as RomeDatabasePreload() does.
+//! @note Starting each worker's core takes about as long as opening a few files,
+//!   so this pays off for several files with many dependencies each (e.g. the managements
+//!   of a rotation), not for a single soil. A dependency shared by files taken by different
+//!   workers is opened by each of them.
+//! @note Loaded files hold no Rome API reference, so they don't need to be closed by RomeFileClose().
+//!   They stay loaded until they are closed by RomeFilesCloseAll() or RomeDatabaseClose().
+//! @see RomeDatabasePreload(), RomeFilesGetDependencies(), RomeEngineRunBatch().
+//! @RomeAPI
+//!
+ROME_API RT_INT RomeFilesPreopen(RT_Files* pFiles, const RT_CSTR* pFilenames, RT_INT nFiles, RT_INT nWorkers)
+{
+    try
+    {
+	    // Switch to the app's MFC module state while in this scope.
+	    // This is required for many MFC functions to work correctly.
+	    AFX_MANAGE_STATE(AfxGetAppModuleState());
+
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFiles,                 "RomeFilesPreopen: NULL file system pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nFiles >= 0,            "RomeFilesPreopen: negative file count.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFilenames || !nFiles,  "RomeFilesPreopen: NULL filenames pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(nWorkers >= 0,          "RomeFilesPreopen: negative worker count.");
+        BOOL bValidApp = RomeCoreIsValid(&pFiles->Core);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp,              "RomeFilesPreopen: invalid file system pointer.");
+		BOOL bExited = pFiles->Core.HasFlag(DLLSTATE_CLOSED);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited,               "RomeFilesPreopen: RomeExit() has already been called.");
+        BOOL bValidFiles = CFileSys::IsValid(pFiles);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidFiles,            "RomeFilesPreopen: invalid file system pointer.");
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pFiles->IsOpen(),       "RomeFilesPreopen: database not open.");
+#if USE_ROMEAPI_THREADIdS
+        THREADId nCurThreadId = GetCurrentThreadId();
+        BOOL bSameThread = (pFiles->Core.m_nThreadId == nCurThreadId);
+        ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bSameThread,           "RomeFilesPreopen: Rome API function called on different thread from RomeInit().");
+#endif
+
+        PREOPENRUN Run;
+        BOOL bShared = FALSE;
+        {
+            // Only hold the core's lock while reading its settings.
+            // The workers use their own cores, so the core stays usable while they run.
+            ROME_API_WRITELOCK(&pFiles->Core);
+
+	        ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST, "user", "RomeFilesPreopen", "files='%d' workers='%d'/>\n", nFiles, nWorkers));
+
+            Run.sDatabase = pFiles->m_sCurrentDatabase;
+            Run.sArgs = pFiles->Core.m_sCommandLine;
+            Run.sCacheDir = CoreApi(pFiles->Core).sSharedCacheDir;
+            bShared = !Run.sCacheDir.IsEmpty();
+        }
+
+        // The first argument is the name of the calling app, which RomeInit() ignores.
+        if (Run.sArgs.IsEmpty())
+            Run.sArgs = "RomeDLL";
+        Run.sArgs += " /NewCore /BatchMode";
+
+        void* pUnused;
+        CMapStringToPtr Asked;
+        CStringArray aRoots;
+        for (int i = 0; i < nFiles; i++)
+        {
+            if (strempty(pFilenames[i]) || Asked.Lookup(pFilenames[i], pUnused))
+                continue;
+            Asked.SetAt(pFilenames[i], NULL);
+            Run.Queue.AddTail(pFilenames[i]);
+            aRoots.Add(pFilenames[i]);
+        }
+
+        if (bShared && aRoots.GetSize() > 0)
+        {
+            if (nWorkers == 0)
+            {
+                SYSTEM_INFO SysInfo;
+                GetSystemInfo(&SysInfo);
+                nWorkers = SysInfo.dwNumberOfProcessors;
+            }
+            // A worker takes whole files asked for, so more workers than files would only start cores.
+            nWorkers = min(nWorkers, RX_BATCH_MAXWORKERS);
+            nWorkers = min(nWorkers, (int)aRoots.GetSize());
+            nWorkers = max(nWorkers, 1);
+
+            CWinThread* aThreads[RX_BATCH_MAXWORKERS];
+            int nThreads = 0;
+            for (int i = 0; i < nWorkers; i++)
+            {
+                CWinThread* pThread = AfxBeginThread(PreopenWorkerProc, &Run, THREAD_PRIORITY_NORMAL, 0, CREATE_SUSPENDED);
+                if (pThread == NULL)
+                    continue;
+                pThread->m_bAutoDelete = FALSE;
+                pThread->ResumeThread();
+                aThreads[nThreads++] = pThread;
+            }
+            for (int i = 0; i < nThreads; i++)
+            {
+                WaitForSingleObject(aThreads[i]->m_hThread, INFINITE);
+                delete aThreads[i];
+            }
+        }
+
+        // Files the workers didn't reach are opened as usual, along with the files they point to.
+        CMapStringToPtr Done;
+        CStringArray aOrder;
+        for (int i = 0; i < aRoots.GetSize(); i++)
+            PreopenOrder(Run, aRoots[i], Done, aOrder);
+
+        POSITION pos = Run.Refs.GetStartPosition();
+        while (pos)
+        {
+            CString sName;
+            void* pRefs;
+            Run.Refs.GetNextAssoc(pos, sName, pRefs);
+            delete (CStringArray*)pRefs;
+        }
+
+        ROME_API_WRITELOCK(&pFiles->Core);
+	    FILESYS_WRITELOCK();
+
+        // These aren't user commands, so they aren't logged individually.
+        RT_INT nLoaded = 0;
+        for (int i = 0; i < aOrder.GetSize(); i++)
+        {
+            CFileObj* pFile = NULL;
+            if (!SharedCacheOpen(pFiles, aOrder[i], OMF_USE_OPEN | OMF_NO_CREATE, pFile))
+                pFile = pFiles->OpenOrCreateFile(aOrder[i], OMF_USE_OPEN | OMF_NO_CREATE);
+            if (pFile)
+                nLoaded++;
+        }
+
+        return nLoaded;
+    }
+    catch (...)
+    {
+        try
+        {
+            RT_App* pApp = pFiles? &pFiles->Core: NULL;
+            CString sInfo; sInfo.Format("RomeFilesPreopen: exception for %d files.", (int)nFiles);
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    sInfo);
+        }
+        catch (...)
+        {
+            ASSERT_OR_SETERROR_AND_RETURN_FAILURE(0,    "RomeFilesPreopen: exception in catch block.");
+        }
+    }
+}
+
+
 //! Get a file in the collection of open Rome files.
 //! Increment the reference count on the file returned.
 //! @note This only returns files visible in the current access level.
@@ -4790,7 +11185,7 @@ ROME_API RT_FileObj* RomeFilesGetItem(RT_Files* pFiles, RT_INT nItem)
 	    AFX_MANAGE_STATE(AfxGetAppModuleState());
 
         ASSERT_OR_SETERROR_AND_RETURN_NULL(pFiles,             "RomeFilesGetItem: NULL file system pointer.");
-        BOOL bValidApp = (&pFiles->Core == &App);
+        BOOL bValidApp = RomeCoreIsValid(&pFiles->Core);
         ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,          "RomeFilesGetItem: invalid file system pointer.");
 		BOOL bExited = pFiles->Core.HasFlag(DLLSTATE_CLOSED);
         ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,           "RomeFilesGetItem: RomeExit() has already been called.");
@@ -4804,11 +11199,11 @@ ROME_API RT_FileObj* RomeFilesGetItem(RT_Files* pFiles, RT_INT nItem)
         BOOL bValidItem = (nItem >= 0);
         ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidItem,         "RomeFilesGetItem: invalid (negative) item index.");
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&pFiles->Core);
 
-        CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFilesGetItem", "index='%d'>\n", nItem);
+        ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFilesGetItem", "index='%d'>\n", nItem));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf1(LOG_SHELL, "RomeFilesGetItem %d\n", nItem);
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "RomeFilesGetItem %d\n", nItem));
 #endif
 
         RT_FileObj* pFile = pFiles->GetFile(nItem);
@@ -4838,6 +11233,119 @@ ROME_API RT_FileObj* RomeFilesGetItem(RT_Files* pFiles, RT_INT nItem)
 }
 
 
+//! Open a file, for RomeFilesOpen().
+//! The caller must have validated its arguments and hold the API lock.
+//! @param pBatch  The batch mode state of the filesystem's core, or NULL if it isn't in batch mode,
+//!   in which case the open is logged to the history log as a user command.
+//! @return  A pointer to the opened file, or NULL on failure.
+//! @see RomeFilesOpen() for the other arguments.
+//!
+LOCAL RT_FileObj* FilesOpen(RT_Files* pFiles, RT_CSTR pszFullname, RT_UINT nFlags, BATCHCORE* pBatch)
+{
+    //  Validate flags argument.
+    //! @note For a long time the Rome and IRome interfaces required passing in 0.
+    //! Additional flags weren't documented or used.
+    //! So we interpret 0 to mean the default flags #RX_FILESOPEN_USE_OPEN | #RX_FILESOPEN_NO_CREATE.
+    if (nFlags == 0)
+        nFlags = OMF_USE_OPEN | OMF_NO_CREATE;
+
+    // Log this as a user command.
+    nFlags |= OMF_CMD_USER;
+    if (!pBatch)
+        nFlags |= OMF_LOG_HIST;
+
+    // TODO: add flag OMF_AUTOMATION for files opened by automation,
+    //   and handle in all file open functions.
+
+    FILESYS_WRITELOCK();
+
+    CFileObj* pFO = NULL;
+
+    CRomeCore& Core = pFiles->Core;
+
+    // Check for magic prefixes and strip them off:
+    // "#BIN:"  import from a binary snapshot on disk.
+    // "#XML:"  import from Rusle2 XML file on disk.
+    // "<?xml"   import from Rusle2 XML string in memory.
+    if (strncmp(pszFullname, "#BIN:", 5) == 0)
+    {
+        // Get the external filename following the magic prefix.
+        LPCSTR pszDiskName = pszFullname + 5;
+
+        CString sError;
+        pFO = BinSnapOpen(pFiles, pszDiskName, sError);
+        TEST_OR_SETERROR_AND_RETURN_NULL(pFO,                           sError);
+    }
+    else
+    if (strncmp(pszFullname, "#XML:", 5) == 0)
+    {
+        // Get the external filename following the magic prefix.
+        LPCSTR pszDiskName = pszFullname + 5;
+
+        nFlags = (nFlags & ~(OMF_FORMAT_CFF | OMF_USE_OPEN)) | OMF_FORMAT_XML;
+        pFO = ImportObject(Core, pszDiskName, nFlags);
+    }
+    else
+    if (strncmp(pszFullname, "<?xml", 5) == 0)
+    {
+        // Load the XML data from the filename string argument.
+        CString buffer = pszFullname;
+
+        nFlags = (nFlags & ~(OMF_FORMAT_CFF | OMF_USE_OPEN)) | OMF_FORMAT_XML;
+        pFO = ImportObjectXML(Core, buffer, NULL /* fetch filename from <Filename> element */, nFlags);
+    }
+#ifdef BUILD_MOSES // ROMEDLL_IGNORE
+#if USE_SKELETONS
+    else
+    if (strncmp(pszFullname, "#SKEL:", 6) == 0)
+    {
+        // Get the external filename following the magic prefix.
+        LPCSTR pszDiskName = pszFullname + 6;
+
+        nFlags = (nFlags & ~OMF_FORMAT_XML) | OMF_FORMAT_CFF;
+        pFO = ImportObject(Core, pszDiskName, nFlags);
+    }
+#endif // USE_SKELETONS
+#endif // ROMEDLL_IGNORE
+#if USE_FILESETS
+    else
+    if (strncmp(pszFullname, "#FILESET:", 9) == 0)
+    {
+        // Get the external filename following the magic prefix.
+        LPCSTR pszDiskName = pszFullname + 9;
+
+        nFlags = (nFlags & ~OMF_FORMAT_XML) | OMF_FORMAT_CFF;
+        BOOL bOpened = FilesetOpen(Core, pszDiskName, nFlags);
+        if (!bOpened)
+            return NULL;
+
+        //! @todo open the base file and return its pointer.
+        return NULL;
+    }
+#endif // USE_FILESETS
+    else
+    {
+        // Opening a file which is already open doesn't change the file count.
+        const int nOpenFiles = pFiles->GetFileCount();
+        if (!SharedCacheOpen(pFiles, pszFullname, nFlags, pFO))
+            pFO = pFiles->OpenOrCreateFile(pszFullname, nFlags);
+        if (pFO && pFiles->GetFileCount() == nOpenFiles)
+            InterlockedIncrement(&RomeStatFileOpenHits);
+    }
+    if (pFO)
+        InterlockedIncrement(&RomeStatFileOpens);
+
+#ifdef USE_ROMEAPI_REFCOUNT
+    //! @note This increments the reference count of times this pointer is returned by the Rome API.
+    //! The file will be closed when this count drops to 0.
+    if (pFO)
+        VERIFY(pFO->m_nRomeRefs++ >= 0);
+#endif
+
+    return pFO;
+}
+
+
 //! Open a named file in the Rome filesystem.
 //! This can be a file in the database or one generated dynamically.
 //! This can return a file with a different name than the one asked for
@@ -4869,7 +11377,9 @@ ROME_API RT_FileObj* RomeFilesGetItem(RT_Files* pFiles, RT_INT nItem)
 //!   This can be an external file if prefix "#SKEL:" is used.<br>
 //!     Example: "#SKEL:C:\Rusle2\Export\management1.man.skel".
 //!   This can be an external fileset if prefix "#FILESET:" is used.<br>
-//!     Example: "#FILESET:C:\Rusle2\Export\profile1.fileset.xml".
+//!     Example: "#FILESET:C:\Rusle2\Export\profile1.fileset.xml".<br>
+//!   This can be a binary snapshot saved by RomeFileSaveAsEx() if prefix "#BIN:" is used.<br>
+//!     Example: "#BIN:C:\Rusle2\Export\profile1.pro.bin".
 //! @param nFlags  Flags corresponding to internal flags of type enum #OpenModeFlags.<br>
 //!   Currently the user should pass in 0 for this argument.<br>
 //!   The following flags are added internally:
@@ -4898,7 +11408,7 @@ ROME_API RT_FileObj* RomeFilesOpen(RT_Files* pFiles, RT_CSTR pszFullname, RT_UIN
         TEST_OR_SETERROR_AND_RETURN_NULL(!strieq(pszFullname, ENTRY_NONE),   "RomeFilesOpen: attempt to open file '#ENTRY_NONE'.");
         TEST_OR_SETERROR_AND_RETURN_NULL(!strieq(pszFullname, ENTRY_NULL),   "RomeFilesOpen: attempt to open file '#ENTRY_NULL'.");
         TEST_OR_SETERROR_AND_RETURN_NULL(!strempty(pszFullname),            "RomeFilesOpen: attempt to open empty filename.");
-        BOOL bValidApp = (&pFiles->Core == &App);
+        BOOL bValidApp = RomeCoreIsValid(&pFiles->Core);
         ASSERT_OR_SETERROR_AND_RETURN_NULL(bValidApp,                       "RomeFilesOpen: invalid file system pointer.");
 		BOOL bExited = pFiles->Core.HasFlag(DLLSTATE_CLOSED);
         ASSERT_OR_SETERROR_AND_RETURN_NULL(!bExited,                        "RomeFilesOpen: RomeExit() has already been called.");
@@ -4914,94 +11424,23 @@ ROME_API RT_FileObj* RomeFilesOpen(RT_Files* pFiles, RT_CSTR pszFullname, RT_UIN
 
 	    // TODO: validate filename argument.
 
-        ROME_API_LOCK();
-
-        CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFilesOpen", "file='%s' flags='%d'>\n", (CString)XMLEncode(pszFullname), nFlags);
-#if USE_ROMESHELL_LOGGING
-        LogFilePrintf2(LOG_SHELL, "RomeFilesOpen \"%s\" %d\n", pszFullname, nFlags);
-#endif
-
-	    //  Validate flags argument.
-	    //! @note For a long time the Rome and IRome interfaces required passing in 0.
-	    //! Additional flags weren't documented or used.
-	    //! So we interpret 0 to mean the default flags #RX_FILESOPEN_USE_OPEN | #RX_FILESOPEN_NO_CREATE.
-	    if (nFlags == 0)
-		    nFlags = OMF_USE_OPEN | OMF_NO_CREATE;
-
-	    // Log this as a user command.
-	    nFlags |= (OMF_LOG_HIST | OMF_CMD_USER);
-
-	    // TODO: add flag OMF_AUTOMATION for files opened by automation,
-	    //   and handle in all file open functions.
-
-	    FILESYS_WRITELOCK();
-
-	    CFileObj* pFO = NULL;
-
-        CRomeCore& Core = pFiles->Core;
-
-	    // Check for magic prefixes and strip them off:
-	    // "#XML:"  import from Rusle2 XML file on disk.
-	    // "<?xml"   import from Rusle2 XML string in memory.
-	    if (strncmp(pszFullname, "#XML:", 5) == 0)
-	    {
-		    // Get the external filename following the magic prefix.
-		    LPCSTR pszDiskName = pszFullname + 5;
-
-		    nFlags = (nFlags & ~(OMF_FORMAT_CFF | OMF_USE_OPEN)) | OMF_FORMAT_XML;
-		    pFO = ImportObject(Core, pszDiskName, nFlags);
-	    }
-	    else
-	    if (strncmp(pszFullname, "<?xml", 5) == 0)
-	    {
-            // Load the XML data from the filename string argument.
-		    CString buffer = pszFullname;
-
-		    nFlags = (nFlags & ~(OMF_FORMAT_CFF | OMF_USE_OPEN)) | OMF_FORMAT_XML;
-		    pFO = ImportObjectXML(Core, buffer, NULL /* fetch filename from <Filename> element */, nFlags);
-	    }
-#ifdef BUILD_MOSES // ROMEDLL_IGNORE
-#if USE_SKELETONS
-	    else
-	    if (strncmp(pszFullname, "#SKEL:", 6) == 0)
-	    {
-		    // Get the external filename following the magic prefix.
-		    LPCSTR pszDiskName = pszFullname + 6;
-
-		    nFlags = (nFlags & ~OMF_FORMAT_XML) | OMF_FORMAT_CFF;
-		    pFO = ImportObject(Core, pszDiskName, nFlags);
-	    }
-#endif // USE_SKELETONS
-#endif // ROMEDLL_IGNORE
-#if USE_FILESETS
-	    else
-	    if (strncmp(pszFullname, "#FILESET:", 9) == 0)
-	    {
-		    // Get the external filename following the magic prefix.
-		    LPCSTR pszDiskName = pszFullname + 9;
+        ROME_API_WRITELOCK(&pFiles->Core);
 
-		    nFlags = (nFlags & ~OMF_FORMAT_XML) | OMF_FORMAT_CFF;
-		    BOOL bOpened = FilesetOpen(Core, pszDiskName, nFlags);
-			if (!bOpened)
-				return NULL;
-
-			//! @todo open the base file and return its pointer.
-			return NULL;
-	    }
-#endif // USE_FILESETS
-	    else
-	    {
-		    pFO = pFiles->OpenOrCreateFile(pszFullname, nFlags);
-	    }
+        // In batch mode, only record the call in the diagnostic ring.
+        BATCHCORE* pBatch = CoreGetBatch(pFiles->Core);
+        if (pBatch)
+        {
+            RT_FileObj* pFO = FilesOpen(pFiles, pszFullname, nFlags, pBatch);
+            BatchLog(pBatch, "RomeFilesOpen", pszFullname, 0, pFO? RX_TRUE: RX_FAILURE);
+            return pFO;
+        }
 
-#ifdef USE_ROMEAPI_REFCOUNT
-        //! @note This increments the reference count of times this pointer is returned by the Rome API.
-        //! The file will be closed when this count drops to 0.
-        if (pFO)
-            VERIFY(pFO->m_nRomeRefs++ >= 0);
+        ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFilesOpen", "file='%s' flags='%d'>\n", (CString)XMLEncode(pszFullname), nFlags));
+#if USE_ROMESHELL_LOGGING
+        ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "RomeFilesOpen \"%s\" %d\n", pszFullname, nFlags));
 #endif
 
-	    return pFO;
+	    return FilesOpen(pFiles, pszFullname, nFlags, NULL);
     }
     catch (...)
     {
@@ -5019,16 +11458,82 @@ ROME_API RT_FileObj* RomeFilesOpen(RT_Files* pFiles, RT_CSTR pszFullname, RT_UIN
 }
 
 
+//! Free the memory held by the API caches, for #RX_PRAGMA_TRIM.
+//! The database stays open, and so do the files and the catalog image.
+//! - The results saved by RomeFileRunCached() are removed, but its limit is kept.
+//! - The database cache of the filesystem is cleared (#RX_PRAGMA_DB_CLEAR_CACHE).
+//! - The unused blocks of the calling thread's string arena are freed. Its strings stay valid.
+//! - The C runtime and process heaps are compacted, returning free pages to the system.
+//! The caller must hold the API lock.
+//! @param pFiles  The filesystem to clear the database cache of.
+//! @return  The number of bytes freed from the result cache and the arena.
+//!
+LOCAL RT_INT MemTrim(CFileSys* pFiles)
+{
+    INT_PTR nFreed = 0;
+    {
+        RFX_CRITICAL_SECTION();
+        POSITION pos = ResultCacheList.GetHeadPosition();
+        while (pos)
+        {
+            const RESULTCACHEENTRY* pEntry = ResultCacheList.GetNext(pos);
+            nFreed += pEntry->sKey.GetLength() + 1 + pEntry->aFound.GetSize();
+            for (int i = 0; i < pEntry->aValues.GetSize(); i++)
+                nFreed += pEntry->aValues[i].GetLength() + 1;
+        }
+        ResultCacheTrim(0);
+    }
+
+    pFiles->Pragma(RX_PRAGMA_DB_CLEAR_CACHE, NULL);
+
+    // Strings are only added to ArenaCurrent and the blocks before it, so the blocks after it are empty.
+    if (ArenaCurrent)
+    {
+        while (ArenaCurrent->pNext)
+        {
+            ARENABLOCK* pBlock = ArenaCurrent->pNext;
+            ArenaCurrent->pNext = pBlock->pNext;
+            const LONG nSize = (LONG)(sizeof(ARENABLOCK) + pBlock->nSize);
+            InterlockedExchangeAdd(&ArenaBytes, -nSize);
+            nFreed += nSize;
+            free(pBlock);
+        }
+    }
+
+    _heapmin();
+    HeapCompact(GetProcessHeap(), 0);
+    return (RT_INT)nFreed;
+}
+
+
 //! Invoke a 'pragma' function.
 //! This is a general "backdoor" through which unsupported operations may be done.
 //! @param pFiles the filesystem interface returned by RomeGetFiles().
 //! @param nPragma an integer pragma value (e.g. #RX_PRAGMA_DB_CLEAR_CACHE).
 //! @param pExtra may be used to pass in extra data.
 //!
+//! These pragmas are handled here (for the core the filesystem belongs to):
+//! - #RX_PRAGMA_BATCH_MODE  Enter batch mode if @p pExtra is non-NULL, or leave it if NULL.
+//!     In batch mode the attr get/set, float array, size, attr handle, file open/close and engine run
+//!     functions don't write the history or RomeShell logs, and setting values doesn't record undo information.
+//!     Instead each call (or each failed value in RomeFileGetAttrValues(), RomeFileSetAttrValues(),
+//!     RomeFileGetFloatArrays() and RomeFileSetDimRows()) is recorded in a ring of the last #RX_BATCH_RINGSIZE calls.
+//!     Since nothing is logged, the core's calls don't wait for the other cores' (see #ApiLogLock).
+//!     Returns RX_TRUE.
+//! - #RX_PRAGMA_BATCH_DUMP  Write the ring of calls to the history log (e.g. after an error).
+//!     Returns the number of calls written, or 0 if not in batch mode.
+//! - #RX_PRAGMA_TRIM  Free the memory held by the API caches, without closing the database
+//!     or any files: the RomeFileRunCached() results, the database cache, the unused blocks
+//!     of the calling thread's string arena and the free heap pages (see RomeGetMemoryStats()).
+//!     Returns the number of bytes freed from the result cache and the arena.
+//!     Undo information is kept by CFileSys, which the API can't clear;
+//!     use batch mode to stop it being recorded.
+//!
 //! @return a value which may depend on the action,
 //!   but often indicates success (RX_TRUE) or failure (RX_FALSE).
 //!
 //! @warning This is an internal function.
+//! @since Batch mode may also be set with the RomeInit() "/BatchMode" argument.
 //! @RomeAPI Wrapper for CFileSys::Pragma().
 //!
 ROME_API RT_INT RomeFilesPragma(RT_Files* pFiles, RT_UINT nPragma, void* pExtra)
@@ -5040,7 +11545,7 @@ ROME_API RT_INT RomeFilesPragma(RT_Files* pFiles, RT_UINT nPragma, void* pExtra)
         AFX_MANAGE_STATE(AfxGetAppModuleState());
 
         ASSERT_OR_SETERROR_AND_RETURN_ZERO(pFiles,             "RomeFilesPragma: NULL file system pointer.");
-        BOOL bValidApp = (&pFiles->Core == &App);
+        BOOL bValidApp = RomeCoreIsValid(&pFiles->Core);
         ASSERT_OR_SETERROR_AND_RETURN_ZERO(bValidApp,          "RomeFilesPragma: invalid file system pointer.");
 		BOOL bExited = pFiles->Core.HasFlag(DLLSTATE_CLOSED);
         ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bExited,           "RomeFilesPragma: RomeExit() has already been called.");
@@ -5052,14 +11557,25 @@ ROME_API RT_INT RomeFilesPragma(RT_Files* pFiles, RT_UINT nPragma, void* pExtra)
         ASSERT_OR_SETERROR_AND_RETURN_ZERO(!bSameThread,       "RomeFilesPragma: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        ROME_API_WRITELOCK(&pFiles->Core);
 
         // TODO: do more intelligent logging of the "pExtra" info. This can be logged according to type.
-        CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFilesPragma", "pragma='%d' args='%0x08X'>\n", nPragma, (UINT)pExtra);
+        ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeFilesPragma", "pragma='%d' args='%0x08X'>\n", nPragma, (UINT)pExtra));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf2(LOG_SHELL, "//RomeFilesPragma %d %d\n", nPragma, (UINT)pExtra);
+        ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "//RomeFilesPragma %d %d\n", nPragma, (UINT)pExtra));
 #endif
 
+        if (nPragma == RX_PRAGMA_BATCH_MODE)
+            CoreSetBatch(pFiles->Core, pExtra != NULL);
+            return RX_TRUE;
+        if (nPragma == RX_PRAGMA_BATCH_DUMP)
+        {
+            BATCHCORE* pBatch = CoreGetBatch(pFiles->Core);
+            return pBatch? BatchDump(pBatch): 0;
+        }
+        if (nPragma == RX_PRAGMA_TRIM)
+            return MemTrim(pFiles);
+
         return pFiles->Pragma(nPragma, pExtra);
     }
     catch (...)
@@ -5121,11 +11637,12 @@ ROME_API RT_BOOL RomeProgressCreate(RT_Statusbar* pStatus, RT_INT nLower /*= 0*/
         ASSERT_OR_SETERROR_AND_RETURN_FALSE(nStep>=1,        "RomeProgressCreate: invalid step value (must be > 0).");
         ASSERT_OR_SETERROR_AND_RETURN_FALSE(nUpper>nLower,   "RomeProgressCreate: invalid upper index (less than lower index).");
 
-        ROME_API_LOCK();
+        // The statusbar belongs to the static App instance.
+        ROME_API_WRITELOCK(&App);
 
-        CLogFileElement3(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeProgressCreate", "lower='%d' upper='%d' step='%d'>\n", nLower, nUpper, nStep);
+        ROME_API_LOGELEM(CLogFileElement3(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeProgressCreate", "lower='%d' upper='%d' step='%d'>\n", nLower, nUpper, nStep));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf3(LOG_SHELL, "//RomeProgressCreate %d %d %d\n", nLower, nUpper, nStep);
+        ROME_API_LOG(LogFilePrintf3(LOG_SHELL, "//RomeProgressCreate %d %d %d\n", nLower, nUpper, nStep));
 #endif
 
 #ifdef BUILD_MOSES // ROMEDLL_IGNORE
@@ -5183,11 +11700,12 @@ ROME_API RT_BOOL RomeProgressSetRange(RT_Statusbar* pStatus, RT_INT nLower /*= 0
         ASSERT_OR_SETERROR_AND_RETURN_FALSE(nUpper>=0,       "RomeProgressCreate: invalid (negative) upper index.");
         ASSERT_OR_SETERROR_AND_RETURN_FALSE(nUpper>nLower,   "RomeProgressCreate: invalid upper index (less than lower index).");
 
-        ROME_API_LOCK();
+        // The statusbar belongs to the static App instance.
+        ROME_API_WRITELOCK(&App);
 
-        CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeProgressSetRange", "lower='%d' upper='%d'>\n", nLower, nUpper);
+        ROME_API_LOGELEM(CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeProgressSetRange", "lower='%d' upper='%d'>\n", nLower, nUpper));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf2(LOG_SHELL, "//RomeProgressSetRange %d %d\n", nLower, nUpper);
+        ROME_API_LOG(LogFilePrintf2(LOG_SHELL, "//RomeProgressSetRange %d %d\n", nLower, nUpper));
 #endif
 
 #ifdef BUILD_MOSES // ROMEDLL_IGNORE
@@ -5243,11 +11761,12 @@ ROME_API RT_BOOL RomeProgressSetStep(RT_Statusbar* pStatus, RT_INT nStep /*= 1*/
 #endif
         ASSERT_OR_SETERROR_AND_RETURN_FALSE(nStep>=1,        "RomeProgressCreate: invalid step value (must be > 0).");
 
-        ROME_API_LOCK();
+        // The statusbar belongs to the static App instance.
+        ROME_API_WRITELOCK(&App);
 
-        CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeProgressSetStep", "step='%d'>\n", nStep);
+        ROME_API_LOGELEM(CLogFileElement1(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeProgressSetStep", "step='%d'>\n", nStep));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf1(LOG_SHELL, "//RomeProgressStep %d\n", nStep);
+        ROME_API_LOG(LogFilePrintf1(LOG_SHELL, "//RomeProgressStep %d\n", nStep));
 #endif
 
 #ifdef BUILD_MOSES // ROMEDLL_IGNORE
@@ -5301,11 +11820,12 @@ ROME_API RT_BOOL RomeProgressStepIt(RT_Statusbar* pStatus)
         ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,   "RomeProgressStepIt: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        // The statusbar belongs to the static App instance.
+        ROME_API_WRITELOCK(&App);
 
-        CLogFileElement0(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeProgressStepIt", ">\n");
+        ROME_API_LOGELEM(CLogFileElement0(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeProgressStepIt", ">\n"));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf0(LOG_SHELL, "//RomeProgressStepIt\n");
+        ROME_API_LOG(LogFilePrintf0(LOG_SHELL, "//RomeProgressStepIt\n"));
 #endif
 
 #ifdef BUILD_MOSES // ROMEDLL_IGNORE
@@ -5359,11 +11879,12 @@ ROME_API RT_BOOL RomeProgressDestroy(RT_Statusbar* pStatus)
         ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,   "RomeProgressDestroy: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        // The statusbar belongs to the static App instance.
+        ROME_API_WRITELOCK(&App);
 
-        CLogFileElement0(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeProgressDestroy", ">\n");
+        ROME_API_LOGELEM(CLogFileElement0(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeProgressDestroy", ">\n"));
 #if USE_ROMESHELL_LOGGING
-        LogFilePrintf0(LOG_SHELL, "//RomeProgressDestroy\n");
+        ROME_API_LOG(LogFilePrintf0(LOG_SHELL, "//RomeProgressDestroy\n"));
 #endif
 
 #ifdef BUILD_MOSES // ROMEDLL_IGNORE
@@ -5423,7 +11944,8 @@ ROME_API RT_BOOL RomeStatusbarMessage(RT_Statusbar* pStatus, RT_CSTR lpszNewText
         ASSERT_OR_SETERROR_AND_RETURN_FALSE(!bSameThread,   "RomeStatusbarMessage: Rome API function called on different thread from RomeInit().");
 #endif
 
-        ROME_API_LOCK();
+        // The statusbar belongs to the static App instance.
+        ROME_API_WRITELOCK(&App);
 
         // Don't log this function - it gets called too many times and floods the log file.
 //      CLogFileElement2(LOGELEM_HIST | LOGELEM_ENDTAG, "user", "RomeStatusbarMessage", "text='%s' flags='%d'>\n", (CString)XMLEncode(lpszNewText), bUpdate);
@@ -5455,7 +11977,7 @@ ROME_API RT_BOOL   RomeSetMessageCallback(RT_App* pApp, int(*call_back)(LPCSTR a
 	AFX_MANAGE_STATE(AfxGetAppModuleState());
 
 	ASSERT_OR_SETERROR_AND_RETURN_FAILURE(pApp, "RomeSetMessageCallback: NULL Rome app pointer.");
-	BOOL bValidApp = (pApp == &App);
+	BOOL bValidApp = RomeCoreIsValid(pApp);
 	ASSERT_OR_SETERROR_AND_RETURN_FAILURE(bValidApp, "RomeSetMessageCallback: invalid Rome pointer.");
 	BOOL bExited = pApp->HasFlag(DLLSTATE_CLOSED);
 	ASSERT_OR_SETERROR_AND_RETURN_FAILURE(!bExited, "RomeSetMessageCallback: RomeExit() has already been called.");
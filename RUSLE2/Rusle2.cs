@@ -1,7 +1,9 @@
 ﻿using SnapPlus.Models.Erosion.Interfaces;
 using System;
+using System.Collections.Generic;
 using System.IO;
 using System.Runtime.InteropServices;
+using System.Threading.Tasks;
 
 namespace SnapPlus.Models.Erosion
 {
@@ -29,6 +31,158 @@ namespace SnapPlus.Models.Erosion
         public const int RX_FALSE = 0;
         public const int RX_FAILURE = -1;
 
+        //#define RX_VARIANT_CATALOG      ((RT_UINT)-2)
+        private const uint RX_VARIANT_CATALOG = unchecked((uint)-2);
+
+        //#define RX_DBFIND_FILES     1<<0
+        //#define RX_DBFIND_RECURSE   1<<2
+        private const uint RX_DBFIND_FILES = 1 << 0;
+        private const uint RX_DBFIND_RECURSE = 1 << 2;
+
+        //#define RX_DBFILEINFO_NAME   1
+        //#define RX_DBFILEINFO_FULL   7
+        //#define RX_DBFILEINFO_DATE  11
+        public const uint RX_DBFILEINFO_NAME = 1;
+        public const uint RX_DBFILEINFO_FULL = 7;
+        public const uint RX_DBFILEINFO_DATE = 11;
+
+        //#define RX_EVENT_BATCH_ITEM_DONE    1
+        //#define RX_EVENT_ENGINE_RUN_DONE    2
+        //#define RX_EVENT_CHANGES            3
+        private const uint RX_EVENT_BATCH_ITEM_DONE = 1;
+        private const uint RX_EVENT_ENGINE_RUN_DONE = 2;
+        private const uint RX_EVENT_CHANGES = 3;
+        //#define RX_CHANGE_SIZE              2
+        private const uint RX_CHANGE_SIZE = 2;
+
+        //#define RX_PRAGMA_BATCH_MODE        0x10000
+        //#define RX_PRAGMA_BATCH_DUMP        0x10001
+        private const uint RX_PRAGMA_BATCH_MODE = 0x10000;
+        private const uint RX_PRAGMA_BATCH_DUMP = 0x10001;
+        private const uint RX_PRAGMA_TRIM = 0x10002;
+
+        //#define RX_ARENA_RESET              0x0000
+        //#define RX_ARENA_RELEASE            0x0001
+        private const uint RX_ARENA_RESET = 0x0000;
+        private const uint RX_ARENA_RELEASE = 0x0001;
+        //#define RX_FILERESET_RESTORE        0x0000
+        //#define RX_FILERESET_CAPTURE        0x0001
+        //#define RX_FILERESET_RELEASE        0x0002
+        private const uint RX_FILERESET_RESTORE = 0x0000;
+        private const uint RX_FILERESET_CAPTURE = 0x0001;
+        private const uint RX_FILERESET_RELEASE = 0x0002;
+
+        /// <summary>
+        /// Mirror of the RT_AttrValue struct used by RomeFileGetAttrValues and RomeFileSetAttrValues.
+        /// </summary>
+        [StructLayout(LayoutKind.Sequential)]
+        private struct RT_AttrValue
+        {
+            public IntPtr pszAttr;
+            public int nIndex;
+            public IntPtr pszValue;
+            public IntPtr pszUnit;
+            public int nResult;
+        }
+
+        /// <summary>
+        /// Mirror of the RT_FloatArray struct used by RomeFileGetFloatArrays.
+        /// </summary>
+        [StructLayout(LayoutKind.Sequential)]
+        private struct RT_FloatArray
+        {
+            public IntPtr pszAttr;
+            public uint nVariant;
+            public IntPtr pszUnit;
+            public int nOffset;
+            public int nSize;
+            public int nResult;
+        }
+
+        /// <summary>
+        /// Mirror of the RT_BatchItem struct used by RomeEngineRunBatch.
+        /// </summary>
+        [StructLayout(LayoutKind.Sequential)]
+        private struct RT_BatchItem
+        {
+            public IntPtr pszFile;
+            public IntPtr pInputs;
+            public int nInputs;
+            public IntPtr pOutputs;
+            public int nOutputs;
+            public IntPtr pOutBuf;
+            public uint nOutBufLen;
+            public int nWorker;
+            public int nResult;
+        }
+
+        /// <summary>
+        /// Mirror of the RT_ChangeEvent struct delivered to a RomeListenerCoalesced listener.
+        /// </summary>
+        [StructLayout(LayoutKind.Sequential)]
+        private struct RT_ChangeEvent
+        {
+            public IntPtr pFile;
+            public IntPtr pObj;
+            public IntPtr pszAttr;
+            public int nFirst;
+            public int nLast;
+            public uint nFlags;
+        }
+
+        /// <summary>
+        /// Mirror of the RT_ChangeBatch struct, the event data of RX_EVENT_CHANGES.
+        /// </summary>
+        [StructLayout(LayoutKind.Sequential)]
+        private struct RT_ChangeBatch
+        {
+            public IntPtr pEvents;
+            public int nEvents;
+        }
+
+        /// <summary>
+        /// The RT_EventHandler callback R2 invokes as each RomeEngineRunBatch item finishes.
+        /// </summary>
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        private delegate int RT_EventHandler(IntPtr observer, uint eventType, IntPtr eventData);
+
+        // Completes the task of an EngineRunAsync call; the observer is a GCHandle to its TaskCompletionSource.
+        // Kept in a static field so the delegate outlives every run R2 holds it for.
+        private static readonly RT_EventHandler engineRunDone = (observer, eventType, eventData) =>
+        {
+            if (eventType == RX_EVENT_ENGINE_RUN_DONE)
+            {
+                GCHandle done = GCHandle.FromIntPtr(observer);
+                var tcs = (TaskCompletionSource<int>)done.Target;
+                done.Free();
+                tcs.SetResult((int)eventData.ToInt64());
+            }
+            return RX_TRUE;
+        };
+
+        // Passes the changes of a FileListenChanges listener to its callback; the observer is a GCHandle to it.
+        // Kept in a static field so the delegate outlives every listener R2 holds it for.
+        private static readonly RT_EventHandler changesDelivered = (observer, eventType, eventData) =>
+        {
+            if (eventType == RX_EVENT_CHANGES)
+            {
+                var onChanges = (Action<IReadOnlyList<(string attrName, int first, int last, bool resized)>>)GCHandle.FromIntPtr(observer).Target;
+                RT_ChangeBatch batch = Marshal.PtrToStructure<RT_ChangeBatch>(eventData);
+                int eventSize = Marshal.SizeOf<RT_ChangeEvent>();
+                var changes = new (string attrName, int first, int last, bool resized)[batch.nEvents];
+                for (int ii = 0; ii < batch.nEvents; ii++)
+                {
+                    RT_ChangeEvent change = Marshal.PtrToStructure<RT_ChangeEvent>(batch.pEvents + ii * eventSize);
+                    changes[ii] = (Marshal.PtrToStringAnsi(change.pszAttr), change.nFirst, change.nLast, (change.nFlags & RX_CHANGE_SIZE) != 0);
+                }
+                onChanges(changes);
+            }
+            return RX_TRUE;
+        };
+
+        // The observers of the FileListenChanges listeners, by file, so they can be removed and freed.
+        private readonly Dictionary<IntPtr, GCHandle> fileListeners = new Dictionary<IntPtr, GCHandle>();
+
         #region Lifecycle Methods
 
         /*
@@ -72,15 +226,26 @@ namespace SnapPlus.Models.Erosion
             return instance;
         }
 
+        /// <summary>
+        /// Creates an instance with its own R2 core (RomeInit /NewCore), separate from the Singleton's, e.g. for
+        /// a worker thread or to time starting R2. It opens no database. Dispose it to exit its core.
+        /// </summary>
+        /// <param name="r2DataPath">Path to data files, as for the Singleton.</param>
+        /// <returns>The new instance.</returns>
+        public static Rusle2 CreateInstance(string r2DataPath)
+        {
+            return new Rusle2(r2DataPath, newCore: true);
+        }
+
         /// <summary>
         /// Initializes a new instance of the <see cref="Rusle2"/> class.
         /// </summary>
         private Rusle2()
         { }
 
-        private Rusle2(string r2Path)
+        private Rusle2(string r2Path, bool newCore = false)
         {
-            if (!Init(r2Path)) throw new Exception($"Could not initialize RUSLE2 with path {r2Path}");
+            if (!Init(r2Path, newCore)) throw new Exception($"Could not initialize RUSLE2 with path {r2Path}");
             if (!GetDatabase()) throw new Exception($"Could not initialize RUSLE2 database at {r2Path}");
             if (!GetEngine()) throw new Exception($"Could not initialize RUSLE2 engine with path {r2Path}");
             if (!EngineSetAutorun(false)) throw new Exception($"Could not set RUSLE2 engine to autorun=false, path {r2Path}");
@@ -100,11 +265,12 @@ namespace SnapPlus.Models.Erosion
         /// Initialize the RUSLE2 DLL.
         /// </summary>
         /// <param name="r2DataPath">Path to data files, e.g. "TestData" or @"C:\ProgramData\UWSoils\SnapPlus3\RUSLE2".</param>
+        /// <param name="newCore">Start a core of its own rather than sharing the process's first one.</param>
         /// <returns>True if successful.</returns>
-        private bool Init(string r2DataPath)
+        private bool Init(string r2DataPath, bool newCore = false)
         {
             // This also works if you just pass it the path, but this is what the docs say
-            IntPtr ptr = heap.StringToPtr(@"SnapPlus3 /DirRoot={r2DataPath}");
+            IntPtr ptr = heap.StringToPtr(@"SnapPlus3 /DirRoot={r2DataPath}" + (newCore ? " /NewCore" : ""));
             handle = Rusle2.RomeInit(ptr);
             return (handle != IntPtr.Zero);
         }
@@ -166,9 +332,15 @@ namespace SnapPlus.Models.Erosion
         /// </summary>
         private void zeroOutInternalState()
         {
+            // Close the files while the core is alive: RomeExit frees a core made by CreateInstance, filesystem and all.
+            if (fileSystemPtr != IntPtr.Zero)
+                FilesCloseAll();
             RomeExit(handle); // Should close database, any open files too?
             handle = IntPtr.Zero;
-            FilesCloseAll();
+            // RomeExit removed the listeners, so only their observers are left to free.
+            foreach (GCHandle observer in fileListeners.Values)
+                observer.Free();
+            fileListeners.Clear();
             database = IntPtr.Zero;
             fileSystemPtr = IntPtr.Zero;
             engine = IntPtr.Zero;
@@ -258,7 +430,8 @@ namespace SnapPlus.Models.Erosion
 
             if (File.Exists(path))
             {
-                IntPtr pathPtr = heap.StringToPtr(path);
+                using var scratch = heap.Scratch();
+                IntPtr pathPtr = scratch.Ptr(path);
                 success = RomeDatabaseOpen(database, pathPtr);
                 if (success)
                     openDatabasePath = path;
@@ -277,6 +450,122 @@ namespace SnapPlus.Models.Erosion
             return success;
         }
 
+        /// <summary>
+        /// Load the database files under a table or folder ahead of time, so the first scenario run
+        /// isn't slowed down by R2 reading and parsing its climate, soil, operations etc. on first use.
+        /// </summary>
+        /// <param name="pattern">Table or folder to load, e.g. @"climates\USA\Wisconsin".</param>
+        /// <param name="recurse">Also load files in subfolders.</param>
+        /// <returns>The number of files loaded, or -1 on error.</returns>
+        public int DatabasePreload(string pattern, bool recurse = true)
+        {
+            using var scratch = heap.Scratch();
+            IntPtr patternPtr = scratch.Ptr(pattern);
+            return RomeDatabasePreload(database, patternPtr, RX_DBFIND_FILES | (recurse ? RX_DBFIND_RECURSE : 0));
+        }
+
+        /// <summary>
+        /// Load database files and everything they point to before they're needed, e.g. the climate, soil and
+        /// management a profile is about to be set to. With a shared cache (DatabaseSetSharedCache) R2 opens
+        /// the given files on a pool of worker threads, each file with its dependencies on one worker; without
+        /// one they are loaded one at a time, as DatabasePreload does. Worth it for several files with many
+        /// dependencies each, e.g. the managements of a rotation, rather than a single file.
+        /// </summary>
+        /// <param name="fileNames">R2 names of the files, e.g. @"managements\Cg-Sb test".</param>
+        /// <param name="workers">Worker threads to use, or 0 for one per processor; no more than there are files.</param>
+        /// <returns>The number of files loaded, including their dependencies, or -1 on error.</returns>
+        public int FilesPreopen(IReadOnlyList<string> fileNames, int workers = 0)
+        {
+            if (fileSystemPtr == IntPtr.Zero && !GetFiles())
+                return -1;
+            using var scratch = heap.Scratch();
+            IntPtr[] names = new IntPtr[fileNames.Count];
+            for (int ii = 0; ii < names.Length; ii++)
+                names[ii] = scratch.Ptr(fileNames[ii]);
+            return RomeFilesPreopen(fileSystemPtr, names, names.Length, workers);
+        }
+
+        /// <summary>
+        /// Cache serialized snapshots of the open database's files in a folder shared with other workers, so each
+        /// file is read from the database and its XML parsed once for all of them instead of once per worker.
+        /// This is a disk cache, not shared memory: every worker still sets its own copy of each file it opens from
+        /// the snapshot, so this saves warm-up time, not memory. Pairs well with DatabasePreload. The database must
+        /// be read-only, and every worker sharing the folder must use the same one.
+        /// </summary>
+        /// <param name="cacheDir">Folder for the snapshots, e.g. next to the .gdb. Null or empty stops using a cache.</param>
+        /// <returns>True on success; false if the database isn't read-only or the folder can't be created.</returns>
+        public bool DatabaseSetSharedCache(string cacheDir)
+        {
+            using var scratch = heap.Scratch();
+            IntPtr cacheDirPtr = cacheDir == null ? IntPtr.Zero : scratch.Ptr(cacheDir);
+            return RomeDatabaseSetSharedCache(database, cacheDirPtr) > 0;
+        }
+
+        /// <summary>
+        /// Enumerate the database files under a table or folder without R2 reading the whole result set first,
+        /// e.g. all SSURGO soils. Rows are fetched from R2 a batch at a time, with all the fields asked for.
+        /// </summary>
+        /// <param name="pattern">Table or folder to search, e.g. "soils".</param>
+        /// <param name="recurse">Also find files in subfolders.</param>
+        /// <param name="infoTypes">The fields of each file to return, e.g. RX_DBFILEINFO_FULL and RX_DBFILEINFO_DATE. Defaults to the full name.</param>
+        /// <returns>For each file, its fields in the order asked for.</returns>
+        public IEnumerable<string[]> DatabaseFindFiles(string pattern, bool recurse = true, params uint[] infoTypes)
+        {
+            if (infoTypes == null || infoTypes.Length == 0)
+                infoTypes = new[] { RX_DBFILEINFO_FULL };
+            IntPtr cursor;
+            using (var scratch = heap.Scratch())
+                cursor = RomeDatabaseFindOpenStream(database, scratch.Ptr(pattern), RX_DBFIND_FILES | (recurse ? RX_DBFIND_RECURSE : 0));
+            if (cursor == IntPtr.Zero)
+                yield break;
+
+            int bufLen = 64 * 1024;
+            IntPtr buf = Marshal.AllocHGlobal(bufLen);
+            try
+            {
+                while (true)
+                {
+                    int rows = RomeDatabaseFindNextBatch(cursor, FindBatchRows, infoTypes, infoTypes.Length, buf, (uint)bufLen);
+                    if (rows < 0 && bufLen < 1024 * 1024)
+                    {
+                        // A row didn't fit at all, so try again with more room.
+                        bufLen *= 4;
+                        buf = Marshal.ReAllocHGlobal(buf, (IntPtr)bufLen);
+                        continue;
+                    }
+                    if (rows <= 0)
+                        break;
+
+                    // Copy the whole batch out before yielding, since the buffer is reused by the next call.
+                    var batch = new string[rows][];
+                    IntPtr at = buf;
+                    for (int rr = 0; rr < rows; rr++)
+                    {
+                        batch[rr] = new string[infoTypes.Length];
+                        for (int ff = 0; ff < infoTypes.Length; ff++)
+                        {
+                            // Step over the field by its length in bytes, which may differ from its length in characters.
+                            int len = 0;
+                            while (Marshal.ReadByte(at, len) != 0)
+                                len++;
+                            batch[rr][ff] = Marshal.PtrToStringAnsi(at, len);
+                            at += len + 1;
+                        }
+                    }
+                    foreach (string[] row in batch)
+                        yield return row;
+                }
+            }
+            finally
+            {
+                Marshal.FreeHGlobal(buf);
+                RomeDatabaseFindCloseStream(cursor);
+            }
+        }
+
+        // Rows fetched from R2 in each call made by DatabaseFindFiles
+        private const int FindBatchRows = 512;
+
         /// <summary>
         /// Close the R2 database, but only if it's open.
         /// </summary>
@@ -325,7 +614,8 @@ namespace SnapPlus.Models.Erosion
                 if (!GetFiles())
                     throw new Exception(@"Could not open R2 'filesystem'");
             }
-            IntPtr r2FakePathPtr = heap.StringToPtr(r2FakePath);
+            using var scratch = heap.Scratch();
+            IntPtr r2FakePathPtr = scratch.Ptr(r2FakePath);
             IntPtr fileObj = RomeFilesOpen(fileSystemPtr, r2FakePathPtr, flags);
             string errMesg = null;
             if (fileObj == IntPtr.Zero)
@@ -353,6 +643,86 @@ namespace SnapPlus.Models.Erosion
             return true;
         }
 
+        /// <summary>
+        /// Open an in-memory copy of an open file, e.g. one point of a parameter sweep over the profile.
+        /// This is a full copy, made by saving the file privately and opening it again, so it costs about as much as
+        /// that. Only the climate, soil, management etc. files that the source points to are shared, not copied.
+        /// </summary>
+        /// <param name="fileHandle">An open R2 file handle.</param>
+        /// <param name="newName">R2 name for the copy, or null to have R2 make one up.</param>
+        /// <returns>The copy's file handle, or IntPtr.Zero on error. Close it with FileClose.</returns>
+        public IntPtr FileClone(IntPtr fileHandle, string newName = null)
+        {
+            using var scratch = heap.Scratch();
+            IntPtr newNamePtr = newName == null ? IntPtr.Zero : scratch.Ptr(newName);
+            return RomeFileClone(fileHandle, newNamePtr);
+        }
+
+        /// <summary>
+        /// Capture the current values of an open file (usually the profile, just after opening it) as the
+        /// baseline that FileReset restores it to. Calling this again replaces the baseline.
+        /// </summary>
+        /// <returns>The number of values captured, or -1 on error.</returns>
+        public int FileCaptureBaseline(IntPtr fileHandle)
+        {
+            return RomeFileReset(fileHandle, RX_FILERESET_CAPTURE);
+        }
+
+        /// <summary>
+        /// Restore an open file to its baseline between scenarios, instead of FilesCloseAll and opening it again.
+        /// Only the values that differ are set, so pointers like the climate and soil stay loaded when they
+        /// are the same, and the cost is proportional to what the last scenario changed.
+        /// </summary>
+        /// <returns>The number of values and sizes changed, or -1 on error (e.g. no baseline was captured).</returns>
+        public int FileReset(IntPtr fileHandle)
+        {
+            return RomeFileReset(fileHandle, RX_FILERESET_RESTORE);
+        }
+
+        /// <summary>
+        /// Free the baseline of an open file. Closing the file frees it too.
+        /// </summary>
+        /// <returns>True if the file had a baseline.</returns>
+        public bool FileReleaseBaseline(IntPtr fileHandle)
+        {
+            return RomeFileReset(fileHandle, RX_FILERESET_RELEASE) == RX_TRUE;
+        }
+
+        /// <summary>
+        /// Get the changes made through an open file in batches: once each time the engine finishes (EngineRun,
+        /// EngineRunEx, FileRunCached), with one entry for each attr set or resized since the last batch and the
+        /// range of indexes changed (-1 if none). Changes the engine's calc functions make aren't listed.
+        /// The callback runs on the thread that ran the engine, and may call R2. Listening again replaces it.
+        /// </summary>
+        /// <param name="fileHandle">An open R2 file handle. Stop listening before closing it.</param>
+        /// <param name="onChanges">Gets each batch of changes.</param>
+        /// <returns>True if the listener was added.</returns>
+        public bool FileListenChanges(IntPtr fileHandle, Action<IReadOnlyList<(string attrName, int first, int last, bool resized)>> onChanges)
+        {
+            FileStopListening(fileHandle);
+            GCHandle observer = GCHandle.Alloc(onChanges);
+            if (RomeFileListenerCoalesced(fileHandle, RX_TRUE, GCHandle.ToIntPtr(observer), changesDelivered) == 0)
+            {
+                observer.Free();
+                return false;
+            }
+            fileListeners[fileHandle] = observer;
+            return true;
+        }
+
+        /// <summary>
+        /// Remove the listener FileListenChanges added to a file.
+        /// </summary>
+        /// <returns>True if the file had a listener.</returns>
+        public bool FileStopListening(IntPtr fileHandle)
+        {
+            if (!fileListeners.Remove(fileHandle, out GCHandle observer))
+                return false;
+            RomeFileListenerCoalesced(fileHandle, RX_FALSE, GCHandle.ToIntPtr(observer), null);
+            observer.Free();
+            return true;
+        }
+
         public bool FilesCloseAll()
         {
             RomeFilesCloseAll(fileSystemPtr, 0); // Secood argument ignored;
@@ -365,6 +735,344 @@ namespace SnapPlus.Models.Erosion
             return RomeEngineRun(engine);
         }
 
+        /// <summary>
+        /// Run the engine, as EngineRun does, and get the number of values set through R2 since the last run.
+        /// </summary>
+        /// <returns>The number of values set before the run (see EngineGetSetCount), or -1 on error.</returns>
+        public int EngineRunEx()
+        {
+            return RomeEngineRunEx(engine, 0);
+        }
+
+        /// <summary>
+        /// Start running the engine on an R2 thread and return at once, so the caller can get the next scenario
+        /// ready (e.g. in another Rusle2 instance) while this one calculates. Calls on this instance made before
+        /// the run finishes wait for it, so reading outputs afterwards sees the new results.
+        /// </summary>
+        /// <returns>A task with the result EngineRunEx would have returned, or -1 if the run couldn't start.
+        /// It completes on the R2 thread, so continuations shouldn't block.</returns>
+        public Task<int> EngineRunAsync()
+        {
+            var tcs = new TaskCompletionSource<int>(TaskCreationOptions.RunContinuationsAsynchronously);
+            GCHandle done = GCHandle.Alloc(tcs);
+            if (RomeEngineRunAsync(engine, 0, GCHandle.ToIntPtr(done), engineRunDone) != RX_TRUE)
+            {
+                done.Free();
+                tcs.SetResult(RX_FAILURE);
+            }
+            return tcs.Task;
+        }
+
+        /// <summary>
+        /// The number of attribute values set or resized through R2 since the engine last ran. This counts calls,
+        /// not the calcs the engine has to redo.
+        /// </summary>
+        public int EngineGetSetCount()
+        {
+            return RomeEngineGetSetCount(engine);
+        }
+
+        /// <summary>
+        /// Run many files at once on a pool of R2 worker threads, each with its own R2 core, instead of looping
+        /// EngineRun over them one at a time. Each file is opened from the open database, has its inputs set, is run,
+        /// and has its outputs read back. Workers that finish early take runs from the others, so long rotations
+        /// don't hold up the batch.
+        /// </summary>
+        /// <param name="runs">R2 name of each file to run (e.g. a profile) and the attribute values to set in it first.</param>
+        /// <param name="outputs">Attribute name and index of the values to get from each file after it runs.</param>
+        /// <param name="workers">Number of worker threads, or 0 for one per processor.</param>
+        /// <param name="runDone">Called with the index of each run and its result (1 done, 0 outputs didn't fit, -1 error) as it finishes.
+        /// This is called on an R2 worker thread, one call at a time.</param>
+        /// <returns>The outputs of each run in the same order as runs; an entry is null if that run failed.</returns>
+        public string[][] EngineRunBatch(IReadOnlyList<(string fileName, IReadOnlyList<(string attrName, string value, int index)> inputs)> runs,
+            IReadOnlyList<(string attrName, int index)> outputs, int workers = 0, Action<int, int> runDone = null)
+        {
+            int valueSize = Marshal.SizeOf<RT_AttrValue>();
+            int itemSize = Marshal.SizeOf<RT_BatchItem>();
+            int outBufLen = 64 * outputs.Count + 1;
+            RT_BatchItem[] items = new RT_BatchItem[runs.Count];
+            List<IntPtr> allocs = new List<IntPtr>();
+            using var scratch = heap.Scratch();
+            GCHandle pinned = GCHandle.Alloc(items, GCHandleType.Pinned);
+            try
+            {
+                for (int ii = 0; ii < runs.Count; ii++)
+                {
+                    var inputs = runs[ii].inputs ?? Array.Empty<(string attrName, string value, int index)>();
+                    items[ii].pszFile = scratch.Ptr(runs[ii].fileName);
+                    items[ii].nInputs = inputs.Count;
+                    items[ii].pInputs = Marshal.AllocHGlobal(Math.Max(1, inputs.Count) * valueSize);
+                    allocs.Add(items[ii].pInputs);
+                    for (int jj = 0; jj < inputs.Count; jj++)
+                    {
+                        RT_AttrValue value = new RT_AttrValue
+                        {
+                            pszAttr = scratch.Name(inputs[jj].attrName),
+                            nIndex = inputs[jj].index,
+                            pszValue = scratch.Ptr(inputs[jj].value),
+                        };
+                        Marshal.StructureToPtr(value, items[ii].pInputs + jj * valueSize, false);
+                    }
+
+                    items[ii].nOutputs = outputs.Count;
+                    items[ii].pOutputs = Marshal.AllocHGlobal(Math.Max(1, outputs.Count) * valueSize);
+                    allocs.Add(items[ii].pOutputs);
+                    for (int jj = 0; jj < outputs.Count; jj++)
+                    {
+                        RT_AttrValue value = new RT_AttrValue
+                        {
+                            pszAttr = scratch.Name(outputs[jj].attrName),
+                            nIndex = outputs[jj].index,
+                        };
+                        Marshal.StructureToPtr(value, items[ii].pOutputs + jj * valueSize, false);
+                    }
+                    items[ii].pOutBuf = Marshal.AllocHGlobal(outBufLen);
+                    items[ii].nOutBufLen = (uint)outBufLen;
+                    allocs.Add(items[ii].pOutBuf);
+                }
+
+                IntPtr itemsPtr = pinned.AddrOfPinnedObject();
+                RT_EventHandler handler = null;
+                if (runDone != null)
+                {
+                    handler = (observer, eventType, eventData) =>
+                    {
+                        if (eventType == RX_EVENT_BATCH_ITEM_DONE)
+                        {
+                            int index = (int)((eventData.ToInt64() - itemsPtr.ToInt64()) / itemSize);
+                            runDone(index, Marshal.PtrToStructure<RT_BatchItem>(eventData).nResult);
+                        }
+                        return RX_TRUE;
+                    };
+                }
+                RomeEngineRunBatch(handle, itemsPtr, items.Length, workers, IntPtr.Zero, handler);
+                GC.KeepAlive(handler);
+
+                string[][] results = new string[runs.Count][];
+                for (int ii = 0; ii < items.Length; ii++)
+                {
+                    if (items[ii].nResult == RX_FAILURE)
+                        continue;
+                    results[ii] = new string[outputs.Count];
+                    for (int jj = 0; jj < outputs.Count; jj++)
+                    {
+                        RT_AttrValue value = Marshal.PtrToStructure<RT_AttrValue>(items[ii].pOutputs + jj * valueSize);
+                        if (value.nResult == RX_TRUE)
+                            results[ii][jj] = heap.PtrToString(value.pszValue);
+                    }
+                }
+                return results;
+            }
+            finally
+            {
+                pinned.Free();
+                foreach (IntPtr alloc in allocs)
+                    Marshal.FreeHGlobal(alloc);
+            }
+        }
+
+        /// <summary>
+        /// Run a file and get some of its outputs, reusing R2's saved result when a file with the same inputs
+        /// (including its climate, soil, management etc.) was already run for the same outputs. Fields that share
+        /// a climate/soil/slope/management tuple then only get calculated once.
+        /// </summary>
+        /// <param name="fileHandle">An open R2 file handle.</param>
+        /// <param name="outputs">Attribute name and index of each output to get.</param>
+        /// <param name="attrUnits">Units for all outputs, or empty for the template units.</param>
+        /// <returns>The outputs in the same order as requested; an entry is null if R2 couldn't get that value.</returns>
+        public string[] FileRunCached(IntPtr fileHandle, IReadOnlyList<(string attrName, int index)> outputs, string attrUnits = "")
+        {
+            using var scratch = heap.Scratch();
+            RT_AttrValue[] batch = new RT_AttrValue[outputs.Count];
+            IntPtr attrUnitsPtr = scratch.Name(attrUnits);
+            for (int ii = 0; ii < outputs.Count; ii++)
+            {
+                batch[ii].pszAttr = scratch.Name(outputs[ii].attrName);
+                batch[ii].nIndex = outputs[ii].index;
+                batch[ii].pszUnit = attrUnitsPtr;
+            }
+
+            string[] results = new string[outputs.Count];
+            int bufLen = 64 * outputs.Count + 1;
+            IntPtr buf = scratch.Buffer(bufLen);
+            int needed = RomeFileRunCached(fileHandle, batch, batch.Length, RX_VARIANT_CATALOG, buf, (uint)bufLen);
+            if (needed > bufLen) // Buffer too small; the second call is served from the cache
+            {
+                bufLen = needed;
+                buf = scratch.Buffer(bufLen);
+                needed = RomeFileRunCached(fileHandle, batch, batch.Length, RX_VARIANT_CATALOG, buf, (uint)bufLen);
+            }
+            if (needed < 0)
+                return results;
+            for (int ii = 0; ii < batch.Length; ii++)
+            {
+                if (batch[ii].nResult == RX_TRUE)
+                    results[ii] = heap.PtrToString(batch[ii].pszValue);
+            }
+            return results;
+        }
+
+        /// <summary>
+        /// Set how many results FileRunCached keeps in memory. 0 turns the cache off.
+        /// </summary>
+        /// <returns>The previous limit, or -1 on error.</returns>
+        public int ResultCacheSetLimit(int limit)
+        {
+            return RomeResultCacheSetLimit(handle, limit);
+        }
+
+        /// <summary>
+        /// Mirror of the RT_LockStats struct filled in by RomeGetLockStats.
+        /// </summary>
+        [StructLayout(LayoutKind.Sequential)]
+        private struct RT_LockStats
+        {
+            public int nSharedLocks;
+            public int nExclusiveLocks;
+            public int nSharedWaits;
+            public int nExclusiveWaits;
+            public int nUnsettled;
+            public double dWaitMs;
+        }
+
+        /// <summary>
+        /// Get the API lock counters of this instance's core. Read-only calls (getting values,
+        /// titles and find results) share the lock with each other, but still read the model one
+        /// at a time; all other calls wait for it.
+        /// </summary>
+        /// <returns>The counters, or null on error.</returns>
+        public (int sharedLocks, int exclusiveLocks, int sharedWaits, int exclusiveWaits, int unsettled, double waitMs)? GetLockStats(bool reset = false)
+        {
+            RT_LockStats stats = new RT_LockStats();
+            if (!RomeGetLockStats(handle, ref stats, reset))
+                return null;
+            return (stats.nSharedLocks, stats.nExclusiveLocks, stats.nSharedWaits, stats.nExclusiveWaits, stats.nUnsettled, stats.dWaitMs);
+        }
+
+        /// <summary>
+        /// Get the call counts and timings of the R2 API functions as JSON text, optionally
+        /// resetting them (e.g. between batches). See RomeGetStats in api-rome.cpp for the layout.
+        /// </summary>
+        /// <returns>The JSON text, or null on error.</returns>
+        public string GetStats(bool reset = false)
+        {
+            int needed = RomeGetStats(handle, IntPtr.Zero, 0, false);
+            if (needed < 0)
+                return null;
+            // Leave room for functions first called between the two calls
+            int bufLen = needed + 4096;
+            IntPtr buf = Marshal.AllocHGlobal(bufLen);
+            try
+            {
+                needed = RomeGetStats(handle, buf, (uint)bufLen, reset);
+                if (needed < 0 || needed > bufLen)
+                    return null;
+                return heap.PtrToString(buf);
+            }
+            finally
+            {
+                Marshal.FreeHGlobal(buf);
+            }
+        }
+
+        /// <summary>
+        /// Get a breakdown of the memory used by R2 as JSON text: the process totals, the open files and their
+        /// attrs, the result cache, string arenas and mapped caches. See RomeGetMemoryStats in api-rome.cpp for the layout.
+        /// </summary>
+        /// <returns>The JSON text, or null on error.</returns>
+        public string GetMemoryStats()
+        {
+            int needed = RomeGetMemoryStats(handle, IntPtr.Zero, 0);
+            if (needed < 0)
+                return null;
+            // Leave room for the numbers growing between the two calls
+            int bufLen = needed + 256;
+            IntPtr buf = Marshal.AllocHGlobal(bufLen);
+            try
+            {
+                needed = RomeGetMemoryStats(handle, buf, (uint)bufLen);
+                if (needed < 0 || needed > bufLen)
+                    return null;
+                return heap.PtrToString(buf);
+            }
+            finally
+            {
+                Marshal.FreeHGlobal(buf);
+            }
+        }
+
+        /// <summary>
+        /// Free the memory held by R2's caches without closing the database or any files, e.g. every so many
+        /// scenarios in a long-lived process: the FileRunCached results, the database cache, this thread's unused
+        /// arena blocks and free heap pages. Undo information can't be dropped this way; use SetBatchMode to stop recording it.
+        /// </summary>
+        /// <returns>The bytes freed from the result cache and arena, which is also 0 on error.</returns>
+        public int TrimMemory()
+        {
+            if (fileSystemPtr == IntPtr.Zero && !GetFiles())
+                return 0;
+            return RomeFilesPragma(fileSystemPtr, RX_PRAGMA_TRIM, IntPtr.Zero);
+        }
+
+        /// <summary>
+        /// Reset the calling thread's string arena, turning it on if needed. While it is on, the strings
+        /// returned by the R2 getters stay valid until the next reset instead of until the next call.
+        /// The wrappers here copy every string at once, so this matters to callers that keep raw pointers.
+        /// Release the arena (release = true) before the thread ends.
+        /// </summary>
+        /// <returns>The bytes the arena was using before the reset, or -1 on error.</returns>
+        public int ArenaReset(bool release = false)
+        {
+            return RomeArenaReset(handle, release ? RX_ARENA_RELEASE : RX_ARENA_RESET);
+        }
+
+        /// <summary>
+        /// Turn batch mode on or off. In batch mode getting and setting values and running the engine
+        /// skip the history and RomeShell logs and don't record undo information; the last calls are
+        /// kept in memory instead, and can be written to the history log with DumpBatchLog.
+        /// </summary>
+        /// <returns>True if successful.</returns>
+        public bool SetBatchMode(bool batch)
+        {
+            if (fileSystemPtr == IntPtr.Zero && !GetFiles())
+                return false;
+            return RomeFilesPragma(fileSystemPtr, RX_PRAGMA_BATCH_MODE, batch ? new IntPtr(1) : IntPtr.Zero) == RX_TRUE;
+        }
+
+        /// <summary>
+        /// Write the calls kept in batch mode to the history log, e.g. after a run fails.
+        /// </summary>
+        /// <returns>The number of calls written, or 0 if not in batch mode.</returns>
+        public int DumpBatchLog()
+        {
+            if (fileSystemPtr == IntPtr.Zero && !GetFiles())
+                return 0;
+            return RomeFilesPragma(fileSystemPtr, RX_PRAGMA_BATCH_DUMP, IntPtr.Zero);
+        }
+
+        /// <summary>
+        /// Load FileRunCached results saved by an earlier session with ResultCacheSave.
+        /// </summary>
+        /// <returns>The number of loaded results which are in the cache afterwards (fewer than were saved if the cache
+        /// limit is lower), or -1 on error (e.g. no such file, or one saved by an older version).</returns>
+        public int ResultCacheLoad(string path)
+        {
+            using var scratch = heap.Scratch();
+            IntPtr pathPtr = scratch.Ptr(path);
+            return RomeResultCacheLoad(handle, pathPtr);
+        }
+
+        /// <summary>
+        /// Save the FileRunCached results to disk, for a later session to load with ResultCacheLoad.
+        /// </summary>
+        /// <returns>The number of results saved, or -1 on error.</returns>
+        public int ResultCacheSave(string path)
+        {
+            using var scratch = heap.Scratch();
+            IntPtr pathPtr = scratch.Ptr(path);
+            return RomeResultCacheSave(handle, pathPtr);
+        }
+
         public bool EngineGetAutorun()
         {
             return RomeEngineGetAutorun(engine);
@@ -380,34 +1088,107 @@ namespace SnapPlus.Models.Erosion
 
         public string GetTitle(string key)
         {
-            IntPtr keyPtr = heap.StringToPtr(key);
+            using var scratch = heap.Scratch();
+            IntPtr keyPtr = scratch.Name(key);
             return heap.PtrToString(RomeGetTitle(handle, keyPtr));
         }
 
+        /// <summary>
+        /// Get the titles of many keys with one call into R2, e.g. for the labels of a report.
+        /// Keys like "SLOPE_STEEP:#ATTR_UNITS" work as with GetTitle; the other special keys don't.
+        /// </summary>
+        /// <param name="keys">The title keys.</param>
+        /// <returns>The titles in the same order, with "" for a key that has none, or null on error.</returns>
+        public string[] GetTitles(IReadOnlyList<string> keys)
+        {
+            using var scratch = heap.Scratch();
+            IntPtr[] keyPtrs = new IntPtr[keys.Count];
+            for (int ii = 0; ii < keys.Count; ii++)
+                keyPtrs[ii] = scratch.Name(keys[ii]);
+            int bufLen = 32 * keys.Count + 1;
+            while (true)
+            {
+                using var bufScope = heap.Scratch();
+                IntPtr buf = bufScope.Buffer(bufLen);
+                int needed = RomeGetTitles(handle, keyPtrs, (uint)keyPtrs.Length, buf, (uint)bufLen);
+                if (needed < 0)
+                    return null;
+                if (needed > bufLen)
+                {
+                    bufLen = needed;
+                    continue;
+                }
+                // Titles may be translations, so find each end by its NUL rather than its length as a string
+                string[] titles = new string[keys.Count];
+                int offset = 0;
+                for (int ii = 0; ii < titles.Length; ii++)
+                {
+                    int len = 0;
+                    while (Marshal.ReadByte(buf, offset + len) != 0)
+                        len++;
+                    titles[ii] = Marshal.PtrToStringAnsi(buf + offset, len);
+                    offset += len + 1;
+                }
+                return titles;
+            }
+        }
+
+        /// <summary>
+        /// Load a user template, e.g. to switch between English and metric units for a report.
+        /// Loading the template that is already loaded is cheap if its file hasn't changed. Only that one template is
+        /// kept, so switching to another template reads and parses its file again every time, even if it was loaded
+        /// before. To alternate between templates cheaply, give each one its own instance (see CreateInstance).
+        /// </summary>
+        /// <param name="fileName">The template file, or just its name for one in R2's Users folder.</param>
+        /// <returns>true if the template was loaded.</returns>
+        public bool TemplateLoad(string fileName)
+        {
+            using var scratch = heap.Scratch();
+            return RomeTemplateLoad(handle, scratch.Ptr(fileName));
+        }
+
         public IntPtr FileGetAttr(IntPtr fileHandle, string attrName)
         {
-            IntPtr attrNamePtr = heap.StringToPtr(attrName); // TODO: Mem leak, figure out how to dispose
+            using var scratch = heap.Scratch();
+            IntPtr attrNamePtr = scratch.Name(attrName);
             return RomeFileGetAttr(fileHandle, attrNamePtr);
         }
 
         public int FileGetAttrSize(IntPtr fileHandle, string attrName)
         {
-            IntPtr attrNamePtr = heap.StringToPtr(attrName); // TODO: Mem leak, figure out how to dispose
+            using var scratch = heap.Scratch();
+            IntPtr attrNamePtr = scratch.Name(attrName);
             return RomeFileGetAttrSize(fileHandle, attrNamePtr);
         }
 
         public int GetAttrDimSize(string attrName)
         {
-            IntPtr attrNamePtr = heap.StringToPtr(attrName);
+            using var scratch = heap.Scratch();
+            IntPtr attrNamePtr = scratch.Name(attrName);
             return RomeCatalogGetAttrDimCount(handle, attrNamePtr);
         }
 
         public string FileGetAttrValue(IntPtr fileHandle, string attrName, int index)
         {
-            IntPtr attrNamePtr = heap.StringToPtr(attrName); // TODO: Mem leak, figure out how to dispose
+            using var scratch = heap.Scratch();
+            IntPtr attrNamePtr = scratch.Name(attrName);
             return heap.PtrToString(RomeFileGetAttrValue(fileHandle, attrNamePtr, index));
         }
 
+        /// <summary>
+        /// FileGetAttrValue without making a string: the value is copied into the caller's buffer, so a loop
+        /// over many values (e.g. parsing them with double.TryParse) makes no allocations at all.
+        /// </summary>
+        /// <param name="value">Buffer for the value.</param>
+        /// <param name="charsWritten">The length of the value.</param>
+        /// <returns>True if successful; false if R2 couldn't get the value or it didn't fit in the buffer.</returns>
+        public bool FileTryGetAttrValue(IntPtr fileHandle, string attrName, int index, Span<char> value, out int charsWritten)
+        {
+            using var scratch = heap.Scratch();
+            IntPtr attrNamePtr = scratch.Name(attrName);
+            return heap.PtrToChars(RomeFileGetAttrValue(fileHandle, attrNamePtr, index), value, out charsWritten);
+        }
+
         public string FileGetAttrValueAux(IntPtr fileHandle, string attrName, int index, string attrUnits)
         {
             //18Aug21 JWW Get GDB Climate precip in inches
@@ -415,15 +1196,17 @@ namespace SnapPlus.Models.Erosion
             IntPtr RX_VARIANT_CATALOG = IntPtr.Zero - 2;
 
             //ROME_API RT_CSTR RomeFileGetAttrValueAux(RT_FileObj * pFile, RT_CNAME pszAttr, RT_INT nIndex, RT_UINT nVariant, RT_CNAME pszUnit);
-            IntPtr attrNamePtr = heap.StringToPtr(attrName); // TODO: Mem leak, figure out how to dispose
-            IntPtr attrUnitsPtr = heap.StringToPtr(attrUnits); // TODO: Mem leak, figure out how to dispose
+            using var scratch = heap.Scratch();
+            IntPtr attrNamePtr = scratch.Name(attrName);
+            IntPtr attrUnitsPtr = scratch.Name(attrUnits);
             return heap.PtrToString(RomeFileGetAttrValueAux(fileHandle, attrNamePtr, index, RX_VARIANT_CATALOG, attrUnitsPtr));
         }
 
         public int FileSetAttrValue(IntPtr fileHandle, string attrName, string value, int index)
         {
-            IntPtr attrNamePtr = heap.StringToPtr(attrName); // TODO: Mem leak, figure out how to dispose
-            IntPtr attrValuePtr = heap.StringToPtr(value);   // Ditto
+            using var scratch = heap.Scratch();
+            IntPtr attrNamePtr = scratch.Name(attrName);
+            IntPtr attrValuePtr = scratch.Ptr(value);
             return RomeFileSetAttrValue(fileHandle, attrNamePtr, attrValuePtr, index);
         }
 
@@ -436,10 +1219,193 @@ namespace SnapPlus.Models.Erosion
         /// <returns>1 if successful, 0 if unsuccessful, -1 if error.</returns>
         public int FileSetAttrSize(IntPtr fileHandle, string attrName, int newSize)
         {
-            IntPtr attrNamePtr = heap.StringToPtr(attrName); // TODO: Mem leak, figure out how to dispose
+            using var scratch = heap.Scratch();
+            IntPtr attrNamePtr = scratch.Name(attrName);
             return RomeFileSetAttrSize(fileHandle, attrNamePtr, newSize);
         }
 
+        /// <summary>
+        /// Size a dimension and fill its columns with one call into R2, e.g. a management's operation rows
+        /// (OP_DATE, OP_PTR, ...). R2 resizes the dimension once instead of once per "#INSERT" or "#DELETE",
+        /// and settles each column before setting the next, so put columns like OP_PTR before ones they default.
+        /// </summary>
+        /// <param name="fileHandle">An open R2 file handle.</param>
+        /// <param name="dimAttr">The dimension, or any attribute on it (e.g. "#RD:MAN_BASE_PTR:OP_DATE").</param>
+        /// <param name="columns">Attributes on the dimension to set, in order.</param>
+        /// <param name="rows">One value per column for each row; a null value leaves it unchanged. The dimension gets rows.Count rows.</param>
+        /// <returns>The number of values set without error, or -1 if the call itself failed.</returns>
+        public int FileSetDimRows(IntPtr fileHandle, string dimAttr, IReadOnlyList<string> columns, IReadOnlyList<string[]> rows)
+        {
+            using var scratch = heap.Scratch();
+            IntPtr[] cols = new IntPtr[columns.Count];
+            for (int cc = 0; cc < cols.Length; cc++)
+                cols[cc] = scratch.Name(columns[cc]);
+            IntPtr[] values = new IntPtr[rows.Count * cols.Length];
+            for (int rr = 0; rr < rows.Count; rr++)
+            {
+                for (int cc = 0; cc < cols.Length; cc++)
+                {
+                    string value = cc < rows[rr].Length ? rows[rr][cc] : null;
+                    values[rr * cols.Length + cc] = value == null ? IntPtr.Zero : scratch.Ptr(value);
+                }
+            }
+            return RomeFileSetDimRows(fileHandle, scratch.Name(dimAttr), rows.Count, cols, cols.Length, values, RX_VARIANT_CATALOG);
+        }
+
+        /// <summary>
+        /// Set many attribute values in a file with one call into R2. R2 takes its lock and drains the engine
+        /// once for the whole batch, instead of once per value as with FileSetAttrValue.
+        /// </summary>
+        /// <param name="fileHandle">An open R2 file handle.</param>
+        /// <param name="values">Attribute name, value and index of each value, set in order. Values may be "#INSERT" or "#DELETE".</param>
+        /// <returns>The number of values set without error, or -1 if the call itself failed.</returns>
+        public int FileSetAttrValues(IntPtr fileHandle, IReadOnlyList<(string attrName, string value, int index)> values)
+        {
+            using var scratch = heap.Scratch();
+            RT_AttrValue[] batch = new RT_AttrValue[values.Count];
+            for (int ii = 0; ii < values.Count; ii++)
+            {
+                batch[ii].pszAttr = scratch.Name(values[ii].attrName);
+                batch[ii].nIndex = values[ii].index;
+                batch[ii].pszValue = scratch.Ptr(values[ii].value);
+            }
+            return RomeFileSetAttrValues(fileHandle, batch, batch.Length, RX_VARIANT_CATALOG);
+        }
+
+        /// <summary>
+        /// Get many attribute values from a file with one call into R2.
+        /// </summary>
+        /// <param name="fileHandle">An open R2 file handle.</param>
+        /// <param name="attrs">Attribute name and index of each value to get.</param>
+        /// <param name="attrUnits">Units for all values, or empty for the template units.</param>
+        /// <returns>The values in the same order as attrs; an entry is null if R2 couldn't get that value.</returns>
+        public string[] FileGetAttrValues(IntPtr fileHandle, IReadOnlyList<(string attrName, int index)> attrs, string attrUnits = "")
+        {
+            using var scratch = heap.Scratch();
+            RT_AttrValue[] batch = new RT_AttrValue[attrs.Count];
+            IntPtr attrUnitsPtr = scratch.Name(attrUnits);
+            for (int ii = 0; ii < attrs.Count; ii++)
+            {
+                batch[ii].pszAttr = scratch.Name(attrs[ii].attrName);
+                batch[ii].nIndex = attrs[ii].index;
+                batch[ii].pszUnit = attrUnitsPtr;
+            }
+
+            string[] results = new string[attrs.Count];
+            int bufLen = 64 * attrs.Count + 1;
+            IntPtr buf = scratch.Buffer(bufLen);
+            int needed = RomeFileGetAttrValues(fileHandle, batch, batch.Length, RX_VARIANT_CATALOG, buf, (uint)bufLen);
+            if (needed > bufLen) // Buffer too small, try again with exactly the size R2 asked for
+            {
+                bufLen = needed;
+                buf = scratch.Buffer(bufLen);
+                needed = RomeFileGetAttrValues(fileHandle, batch, batch.Length, RX_VARIANT_CATALOG, buf, (uint)bufLen);
+            }
+            if (needed < 0)
+                return results;
+            for (int ii = 0; ii < batch.Length; ii++)
+            {
+                if (batch[ii].nResult == RX_TRUE)
+                    results[ii] = heap.PtrToString(batch[ii].pszValue);
+            }
+            return results;
+        }
+
+        /// <summary>
+        /// Resolve an attribute name in a file once, so values can be read and written in a loop without R2
+        /// parsing and looking up the name (e.g. "#RD:MAN_BASE_PTR:OP_DATE") on every call.
+        /// </summary>
+        /// <param name="fileHandle">An open R2 file handle.</param>
+        /// <param name="attrName">Attribute name, which may have a remote prefix.</param>
+        /// <returns>An attr handle, or IntPtr.Zero on error. Close it with AttrHandleClose.</returns>
+        public IntPtr FileResolveAttr(IntPtr fileHandle, string attrName)
+        {
+            using var scratch = heap.Scratch();
+            IntPtr attrNamePtr = scratch.Name(attrName);
+            return RomeFileResolveAttr(fileHandle, attrNamePtr);
+        }
+
+        public void AttrHandleClose(IntPtr attrHandle)
+        {
+            RomeAttrHandleClose(attrHandle);
+        }
+
+        public int AttrHandleGetSize(IntPtr attrHandle)
+        {
+            return RomeAttrHandleGetSize(attrHandle);
+        }
+
+        public string AttrHandleGetValue(IntPtr attrHandle, int index, string attrUnits = "")
+        {
+            using var scratch = heap.Scratch();
+            IntPtr attrUnitsPtr = scratch.Name(attrUnits);
+            return heap.PtrToString(RomeAttrHandleGetValue(attrHandle, index, RX_VARIANT_CATALOG, attrUnitsPtr));
+        }
+
+        public int AttrHandleSetValue(IntPtr attrHandle, string value, int index)
+        {
+            using var scratch = heap.Scratch();
+            IntPtr attrValuePtr = scratch.Ptr(value);
+            return RomeAttrHandleSetValue(attrHandle, attrValuePtr, index, RX_VARIANT_CATALOG, IntPtr.Zero);
+        }
+
+        public IntPtr ProfileResolveAttr(string attrName)
+        {
+            return FileResolveAttr(profile, attrName);
+        }
+
+        /// <summary>
+        /// Get several numeric outputs (e.g. SLOPE_DEGRAD, NET_C_FACTOR) from a file as doubles, with no string
+        /// formatting or parsing. R2 writes all arrays one after another into a single buffer.
+        /// </summary>
+        /// <param name="fileHandle">An open R2 file handle.</param>
+        /// <param name="attrs">Attribute name and units of each array; empty units means the catalog units.</param>
+        /// <param name="offsets">Index in the returned buffer of the first value of each array.</param>
+        /// <param name="sizes">Number of values in each array; 0 if R2 couldn't get that array.</param>
+        /// <returns>The values of all arrays, or null if the call itself failed.</returns>
+        public double[] FileGetFloatArrays(IntPtr fileHandle, IReadOnlyList<(string attrName, string attrUnits)> attrs, out int[] offsets, out int[] sizes)
+        {
+            using var scratch = heap.Scratch();
+            RT_FloatArray[] batch = new RT_FloatArray[attrs.Count];
+            for (int ii = 0; ii < attrs.Count; ii++)
+            {
+                batch[ii].pszAttr = scratch.Name(attrs[ii].attrName);
+                batch[ii].nVariant = RX_VARIANT_CATALOG;
+                batch[ii].pszUnit = scratch.Name(attrs[ii].attrUnits ?? "");
+            }
+            offsets = new int[attrs.Count];
+            sizes = new int[attrs.Count];
+
+            // Ask R2 for the size first, then have it write straight into the (pinned) managed array.
+            int needed = RomeFileGetFloatArrays(fileHandle, batch, batch.Length, null, 0);
+            if (needed < 0)
+                return null;
+            double[] values = new double[needed];
+            if (RomeFileGetFloatArrays(fileHandle, batch, batch.Length, values, values.Length) < 0)
+                return null;
+            for (int ii = 0; ii < batch.Length; ii++)
+            {
+                offsets[ii] = batch[ii].nOffset;
+                sizes[ii] = batch[ii].nResult == RX_TRUE ? batch[ii].nSize : 0;
+            }
+            return values;
+        }
+
+        public double[] ProfileGetFloatArrays(IReadOnlyList<(string attrName, string attrUnits)> attrs, out int[] offsets, out int[] sizes)
+        {
+            return FileGetFloatArrays(profile, attrs, out offsets, out sizes);
+        }
+
+        public int ProfileSetAttrValues(IReadOnlyList<(string attrName, string value, int index)> values)
+        {
+            return FileSetAttrValues(profile, values);
+        }
+
+        public string[] ProfileGetAttrValues(IReadOnlyList<(string attrName, int index)> attrs)
+        {
+            return FileGetAttrValues(profile, attrs);
+        }
+
         public IntPtr ProfileGetAttr(string attrName)
         {
             return FileGetAttr(profile, attrName);
@@ -460,6 +1426,11 @@ namespace SnapPlus.Models.Erosion
             return FileSetAttrSize(profile, attrName, newSize);
         }
 
+        public int ProfileSetDimRows(string dimAttr, IReadOnlyList<string> columns, IReadOnlyList<string[]> rows)
+        {
+            return FileSetDimRows(profile, dimAttr, columns, rows);
+        }
+
         public int ProfileGetAttrSize(string attrName)
         {
             return FileGetAttrSize(profile, attrName);
@@ -503,7 +1474,8 @@ namespace SnapPlus.Models.Erosion
         /// <returns>True if successful, false if not.</returns>
         public bool FileSaveAsXml(IntPtr fileHandle, string filePath)
         {
-            IntPtr filePathPtr = heap.StringToPtr($"#XML:{filePath}");
+            using var scratch = heap.Scratch();
+            IntPtr filePathPtr = scratch.Ptr($"#XML:{filePath}");
             switch (RomeFileSaveAs(fileHandle, filePathPtr))
             {
                 case RX_TRUE: return true;
@@ -513,6 +1485,22 @@ namespace SnapPlus.Models.Erosion
             }
         }
 
+        /// <summary>
+        /// Save an open R2 "file" as a binary snapshot on disk, which FilesOpen($"#BIN:{filePath}") opens again.
+        /// A snapshot is a different container for the same value strings an XML file holds: opening it skips the
+        /// XML parse, but the values are still parsed and the outputs calculated again. A snapshot can only be
+        /// opened by an R2 with the same science version.
+        /// </summary>
+        /// <param name="fileHandle">An open R2 file handle.</param>
+        /// <param name="filePath">Path to the snapshot file. An existing file is replaced.</param>
+        /// <returns>True if successful, false if not.</returns>
+        public bool FileSaveAsBinary(IntPtr fileHandle, string filePath)
+        {
+            using var scratch = heap.Scratch();
+            IntPtr filePathPtr = scratch.Ptr($"#BIN:{filePath}");
+            return RomeFileSaveAs(fileHandle, filePathPtr) == RX_TRUE;
+        }
+
         /// <summary>
         /// Return the number of files open in the Rome file system
         /// </summary>
@@ -534,6 +1522,50 @@ namespace SnapPlus.Models.Erosion
             return RomeFilesGetItem(fileSystemPtr, index);
         }
 
+        /// <summary>
+        /// Return the names of all the files a database file depends on (climate, soil, management, and everything those point to).
+        /// </summary>
+        /// <param name="fileSystemPtr">The open file system</param>
+        /// <param name="fileName">R2 name of the file, e.g. "profiles\default"</param>
+        /// <returns>The dependency names, or null on error</returns>
+        public string[] FilesGetDependencies(IntPtr fileSystemPtr, string fileName)
+        {
+            using var scratch = heap.Scratch();
+            IntPtr fileNamePtr = scratch.Ptr(fileName);
+            int bufLen = 4096;
+            IntPtr buf = Marshal.AllocHGlobal(bufLen);
+            try
+            {
+                int needed = RomeFilesGetDependencyBlock(fileSystemPtr, fileNamePtr, buf, (uint)bufLen);
+                if (needed > bufLen) // Buffer too small, try again with exactly the size R2 asked for
+                {
+                    Marshal.FreeHGlobal(buf);
+                    bufLen = needed;
+                    buf = Marshal.AllocHGlobal(bufLen);
+                    needed = RomeFilesGetDependencyBlock(fileSystemPtr, fileNamePtr, buf, (uint)bufLen);
+                }
+                if (needed < 0 || needed > bufLen)
+                    return null;
+
+                // The block is NUL-separated names ending with an empty name
+                List<string> deps = new List<string>();
+                int start = 0;
+                while (Marshal.ReadByte(buf, start) != 0)
+                {
+                    int end = start;
+                    while (Marshal.ReadByte(buf, end) != 0)
+                        end++;
+                    deps.Add(heap.PtrToString(buf + start));
+                    start = end + 1;
+                }
+                return deps.ToArray();
+            }
+            finally
+            {
+                Marshal.FreeHGlobal(buf);
+            }
+        }
+
         /// <summary>
         /// Return the full name for the (open) file
         /// </summary>
@@ -561,6 +1593,21 @@ namespace SnapPlus.Models.Erosion
         [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
         private static extern unsafe bool RomeDatabaseOpen(IntPtr handle, IntPtr path);
 
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeDatabaseSetSharedCache(IntPtr databaseHandle, IntPtr cacheDir);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeDatabasePreload(IntPtr databaseHandle, IntPtr pattern, uint findFlags);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern IntPtr RomeDatabaseFindOpenStream(IntPtr databaseHandle, IntPtr pattern, uint findFlags);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeDatabaseFindNextBatch(IntPtr cursor, int maxRows, uint[] infoTypes, int infoTypeCount, IntPtr buf, uint bufLen);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern void RomeDatabaseFindCloseStream(IntPtr cursor);
+
         [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
         private static extern unsafe bool RomeDatabaseClose(IntPtr handle, IntPtr dbNameIsIgnoredByR2);
 
@@ -576,6 +1623,15 @@ namespace SnapPlus.Models.Erosion
         [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
         private static extern void RomeFileClose(IntPtr fileHandle);
 
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern IntPtr RomeFileClone(IntPtr fileHandle, IntPtr newName);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeFileReset(IntPtr fileHandle, uint flags);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeFileListenerCoalesced(IntPtr fileHandle, int add, IntPtr observer, RT_EventHandler eventHandler);
+
         [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
         private static extern void RomeFilesClose(IntPtr fileHandle, int flags = 0);
 
@@ -585,6 +1641,45 @@ namespace SnapPlus.Models.Erosion
         [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
         private static extern bool RomeEngineRun(IntPtr engineHandle); // uses internal engine pointer
 
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeEngineRunEx(IntPtr engineHandle, uint flags);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeEngineGetSetCount(IntPtr engineHandle);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeEngineRunAsync(IntPtr engineHandle, uint flags, IntPtr observer, RT_EventHandler eventHandler);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeEngineRunBatch(IntPtr romeHandle, IntPtr items, int count, int workers, IntPtr observer, RT_EventHandler eventHandler);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeFileRunCached(IntPtr fileHandle, [In, Out] RT_AttrValue[] outputs, int count, uint variant, IntPtr buf, uint bufLen);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeResultCacheSetLimit(IntPtr romeHandle, int limit);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeResultCacheLoad(IntPtr romeHandle, IntPtr fileName);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeFilesPragma(IntPtr filesHandle, uint pragma, IntPtr extra);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern bool RomeGetLockStats(IntPtr romeHandle, ref RT_LockStats stats, bool reset);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeGetStats(IntPtr romeHandle, IntPtr buf, uint bufLen, bool reset);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeGetMemoryStats(IntPtr romeHandle, IntPtr buf, uint bufLen);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeArenaReset(IntPtr romeHandle, uint flags);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeResultCacheSave(IntPtr romeHandle, IntPtr fileName);
+
         [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
         private static extern bool RomeEngineGetAutorun(IntPtr engineHandle); // uses internal engine pointer
 
@@ -594,6 +1689,12 @@ namespace SnapPlus.Models.Erosion
         [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
         private static extern IntPtr RomeGetTitle(IntPtr handle, IntPtr key);
 
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeGetTitles(IntPtr handle, IntPtr[] keys, uint keyCount, IntPtr buf, uint bufLen);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern bool RomeTemplateLoad(IntPtr handle, IntPtr fileName);
+
         [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
         private static extern IntPtr RomeFileGetAttr(IntPtr fileHandle, IntPtr attrName);
 
@@ -607,9 +1708,36 @@ namespace SnapPlus.Models.Erosion
         [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
         private static extern int RomeFileSetAttrValue(IntPtr fileHandle, IntPtr attrName, IntPtr value, int index);
 
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeFileSetAttrValues(IntPtr fileHandle, [In, Out] RT_AttrValue[] values, int count, uint variant);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeFileGetAttrValues(IntPtr fileHandle, [In, Out] RT_AttrValue[] values, int count, uint variant, IntPtr buf, uint bufLen);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeFileGetFloatArrays(IntPtr fileHandle, [In, Out] RT_FloatArray[] arrays, int count, [Out] double[] buf, int bufLen);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern IntPtr RomeFileResolveAttr(IntPtr fileHandle, IntPtr attrName);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern void RomeAttrHandleClose(IntPtr attrHandle);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeAttrHandleGetSize(IntPtr attrHandle);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern IntPtr RomeAttrHandleGetValue(IntPtr attrHandle, int index, uint variant, IntPtr attrUnits);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern short RomeAttrHandleSetValue(IntPtr attrHandle, IntPtr value, int index, uint variant, IntPtr attrUnits);
+
         [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
         private static extern int RomeFileSetAttrSize(IntPtr fileHandle, IntPtr attrName, int newSize);
 
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeFileSetDimRows(IntPtr fileHandle, IntPtr dimAttr, int rows, IntPtr[] columns, int columnCount, IntPtr[] values, uint variant);
+
         [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
         private static extern int RomeFileGetAttrSize(IntPtr fileHandle, IntPtr attrName);
 
@@ -637,6 +1765,12 @@ namespace SnapPlus.Models.Erosion
         [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
         private static extern IntPtr RomeFilesGetItem(IntPtr fileSystemPtr, int index);
 
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeFilesGetDependencyBlock(IntPtr fileSystemPtr, IntPtr fileName, IntPtr buf, uint bufLen);
+
+        [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
+        private static extern int RomeFilesPreopen(IntPtr fileSystemPtr, IntPtr[] fileNames, int count, int workers);
+
         [DllImport(@"RomeDLL.dll", CharSet = CharSet.Unicode, SetLastError = true, CallingConvention = CallingConvention.Cdecl)]
         private static extern IntPtr RomeFileGetFullname(IntPtr fileHandle);
     }
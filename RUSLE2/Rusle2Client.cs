@@ -0,0 +1,261 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.IO.Pipes;
+using System.Text;
+
+namespace SnapPlus.Models.Erosion
+{
+    /// <summary>
+    /// One scenario for the model server: a file to open, the inputs to set in it and the outputs to get
+    /// after the engine runs. The same shape as FileSetAttrValues and FileGetAttrValues.
+    /// </summary>
+    public class Rusle2Scenario
+    {
+        public string FileName { get; set; }
+        public IReadOnlyList<(string attrName, string value, int index)> Inputs { get; set; }
+        public IReadOnlyList<(string attrName, int index)> Outputs { get; set; }
+        public string AttrUnits { get; set; } = "";
+    }
+
+    /// <summary>
+    /// The binary protocol between Rusle2Client, the model server (R2ConsoleApp --serve) and its workers.
+    /// Every message is a frame: its length as a little-endian Int32, then that many bytes. Strings are
+    /// BinaryWriter strings (a 7-bit encoded length, then UTF-8).
+    ///   Request:  version byte, op byte, file, units, input count, (attr, value, index)..., output count, (attr, index)...
+    ///   Response: status byte, then for StatusOk the value count and (has value, value)..., or else the error message.
+    /// </summary>
+    public static class Rusle2Protocol
+    {
+        public const string DefaultPipeName = "Rusle2ModelServer";
+        public const byte Version = 1;
+        public const byte OpRunScenario = 1;
+        public const byte StatusOk = 0;
+        public const byte StatusFailed = 1;
+        // Larger frames are refused, so a broken peer can't make the other side allocate without limit
+        public const int MaxFrameLength = 64 * 1024 * 1024;
+
+        /// <summary>
+        /// Write one frame.
+        /// </summary>
+        public static void WriteFrame(Stream stream, byte[] payload, int length)
+        {
+            Span<byte> header = stackalloc byte[4];
+            System.Buffers.Binary.BinaryPrimitives.WriteInt32LittleEndian(header, length);
+            stream.Write(header);
+            stream.Write(payload, 0, length);
+            stream.Flush();
+        }
+
+        /// <summary>
+        /// Read one frame.
+        /// </summary>
+        /// <returns>The payload, or null if the stream ended before the frame started.</returns>
+        public static byte[] ReadFrame(Stream stream)
+        {
+            byte[] header = new byte[4];
+            if (!ReadAll(stream, header, allowEnd: true))
+                return null;
+            int length = System.Buffers.Binary.BinaryPrimitives.ReadInt32LittleEndian(header);
+            if (length < 0 || length > MaxFrameLength)
+                throw new InvalidDataException($"Bad frame length {length}");
+            byte[] payload = new byte[length];
+            ReadAll(stream, payload, allowEnd: false);
+            return payload;
+        }
+
+        private static bool ReadAll(Stream stream, byte[] buf, bool allowEnd)
+        {
+            int done = 0;
+            while (done < buf.Length)
+            {
+                int read = stream.Read(buf, done, buf.Length - done);
+                if (read == 0)
+                {
+                    if (allowEnd && done == 0)
+                        return false;
+                    throw new EndOfStreamException("The connection closed in the middle of a frame");
+                }
+                done += read;
+            }
+            return true;
+        }
+
+        public static byte[] EncodeRequest(Rusle2Scenario scenario, out int length)
+        {
+            var mem = new MemoryStream();
+            using (var writer = new BinaryWriter(mem, Encoding.UTF8, leaveOpen: true))
+            {
+                writer.Write(Version);
+                writer.Write(OpRunScenario);
+                writer.Write(scenario.FileName ?? "");
+                writer.Write(scenario.AttrUnits ?? "");
+                var inputs = scenario.Inputs ?? Array.Empty<(string, string, int)>();
+                writer.Write(inputs.Count);
+                foreach (var (attrName, value, index) in inputs)
+                {
+                    writer.Write(attrName ?? "");
+                    writer.Write(value ?? "");
+                    writer.Write(index);
+                }
+                var outputs = scenario.Outputs ?? Array.Empty<(string, int)>();
+                writer.Write(outputs.Count);
+                foreach (var (attrName, index) in outputs)
+                {
+                    writer.Write(attrName ?? "");
+                    writer.Write(index);
+                }
+            }
+            length = (int)mem.Length;
+            return mem.GetBuffer();
+        }
+
+        public static Rusle2Scenario DecodeRequest(byte[] payload)
+        {
+            using var reader = new BinaryReader(new MemoryStream(payload), Encoding.UTF8);
+            byte version = reader.ReadByte();
+            byte op = reader.ReadByte();
+            if (version != Version || op != OpRunScenario)
+                throw new InvalidDataException($"Unsupported request version {version} op {op}");
+            var scenario = new Rusle2Scenario { FileName = reader.ReadString(), AttrUnits = reader.ReadString() };
+            var inputs = new (string attrName, string value, int index)[CheckCount(reader.ReadInt32(), payload.Length)];
+            for (int ii = 0; ii < inputs.Length; ii++)
+                inputs[ii] = (reader.ReadString(), reader.ReadString(), reader.ReadInt32());
+            var outputs = new (string attrName, int index)[CheckCount(reader.ReadInt32(), payload.Length)];
+            for (int ii = 0; ii < outputs.Length; ii++)
+                outputs[ii] = (reader.ReadString(), reader.ReadInt32());
+            scenario.Inputs = inputs;
+            scenario.Outputs = outputs;
+            return scenario;
+        }
+
+        /// <summary>
+        /// Encode the outputs of a scenario; a null entry is a value R2 couldn't get.
+        /// </summary>
+        public static byte[] EncodeResponse(string[] values, out int length)
+        {
+            var mem = new MemoryStream();
+            using (var writer = new BinaryWriter(mem, Encoding.UTF8, leaveOpen: true))
+            {
+                writer.Write(StatusOk);
+                writer.Write(values.Length);
+                foreach (string value in values)
+                {
+                    writer.Write(value != null);
+                    if (value != null)
+                        writer.Write(value);
+                }
+            }
+            length = (int)mem.Length;
+            return mem.GetBuffer();
+        }
+
+        public static byte[] EncodeError(string message, out int length)
+        {
+            var mem = new MemoryStream();
+            using (var writer = new BinaryWriter(mem, Encoding.UTF8, leaveOpen: true))
+            {
+                writer.Write(StatusFailed);
+                writer.Write(message ?? "");
+            }
+            length = (int)mem.Length;
+            return mem.GetBuffer();
+        }
+
+        /// <summary>
+        /// Decode a response.
+        /// </summary>
+        /// <exception cref="InvalidOperationException">The scenario failed; the message is the server's.</exception>
+        public static string[] DecodeResponse(byte[] payload)
+        {
+            using var reader = new BinaryReader(new MemoryStream(payload), Encoding.UTF8);
+            if (reader.ReadByte() != StatusOk)
+                throw new InvalidOperationException(reader.ReadString());
+            string[] values = new string[CheckCount(reader.ReadInt32(), payload.Length)];
+            for (int ii = 0; ii < values.Length; ii++)
+                values[ii] = reader.ReadBoolean() ? reader.ReadString() : null;
+            return values;
+        }
+
+        // Every item takes at least a byte, so a count can't be more than the payload length
+        private static int CheckCount(int count, int payloadLength)
+        {
+            if (count < 0 || count > payloadLength)
+                throw new InvalidDataException($"Bad item count {count}");
+            return count;
+        }
+    }
+
+    /// <summary>
+    /// Client of the out-of-process model server (R2ConsoleApp --serve), for hosts like a web tier that
+    /// can't load RomeDLL themselves: it is MFC-bound and holds one model per process, which is what the
+    /// Rusle2.GetInstance singleton reflects. The server keeps a pool of worker processes with R2 initialized
+    /// and the database open, and gives each scenario to the next idle one.
+    /// A client is one connection, and sends one scenario at a time; use a client per thread for concurrency.
+    /// </summary>
+    public class Rusle2Client : IDisposable
+    {
+        private readonly NamedPipeClientStream pipe;
+        private readonly object sync = new object();
+        private bool disposedValue;
+
+        /// <summary>
+        /// Connect to a model server on this machine, or on another one with serverName.
+        /// </summary>
+        /// <param name="pipeName">The server's --pipe name.</param>
+        /// <param name="timeoutMs">How long to wait for the server to accept the connection.</param>
+        /// <param name="serverName">The server's machine name, or "." for this one.</param>
+        public Rusle2Client(string pipeName = Rusle2Protocol.DefaultPipeName, int timeoutMs = 5000, string serverName = ".")
+        {
+            pipe = new NamedPipeClientStream(serverName, pipeName, PipeDirection.InOut);
+            pipe.Connect(timeoutMs);
+        }
+
+        /// <summary>
+        /// Run one scenario on the server: open the file, set the inputs, run the engine and get the outputs,
+        /// on a fresh copy of the file (the worker closes it afterwards).
+        /// </summary>
+        /// <param name="fileName">The R2 file to start from, e.g. @"profiles\default".</param>
+        /// <param name="inputs">Attribute name, value and index of each input, set in order, as for FileSetAttrValues.</param>
+        /// <param name="outputs">Attribute name and index of each output, as for FileGetAttrValues.</param>
+        /// <param name="attrUnits">Units for all outputs, or empty for the template units.</param>
+        /// <returns>The outputs in the same order; an entry is null if R2 couldn't get that value.</returns>
+        /// <exception cref="InvalidOperationException">The server couldn't run the scenario.</exception>
+        /// <exception cref="IOException">The connection to the server failed.</exception>
+        public string[] RunScenario(string fileName, IReadOnlyList<(string attrName, string value, int index)> inputs,
+            IReadOnlyList<(string attrName, int index)> outputs, string attrUnits = "")
+        {
+            return RunScenario(new Rusle2Scenario { FileName = fileName, Inputs = inputs, Outputs = outputs, AttrUnits = attrUnits });
+        }
+
+        /// <inheritdoc cref="RunScenario(string, IReadOnlyList{ValueTuple{string, string, int}}, IReadOnlyList{ValueTuple{string, int}}, string)"/>
+        public string[] RunScenario(Rusle2Scenario scenario)
+        {
+            byte[] request = Rusle2Protocol.EncodeRequest(scenario, out int length);
+            lock (sync)
+            {
+                Rusle2Protocol.WriteFrame(pipe, request, length);
+                byte[] response = Rusle2Protocol.ReadFrame(pipe);
+                if (response == null)
+                    throw new EndOfStreamException("The model server closed the connection");
+                return Rusle2Protocol.DecodeResponse(response);
+            }
+        }
+
+        protected virtual void Dispose(bool disposing)
+        {
+            if (!disposedValue)
+            {
+                if (disposing)
+                    pipe.Dispose();
+                disposedValue = true;
+            }
+        }
+
+        public void Dispose()
+        {
+            Dispose(disposing: true);
+            GC.SuppressFinalize(this);
+        }
+    }
+}
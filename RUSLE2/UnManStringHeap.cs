@@ -7,14 +7,28 @@ namespace SnapPlus.Models.Erosion
     /// <summary>
     /// Manager for allocating unmanaged strings for use by R2. Ensure that they get deallocated per
     /// https://www.deleaker.com/blog/2021/03/19/unmanaged-memory-leaks-in-dotnet/.
+    /// Strings that are only needed for the length of an R2 call should go through a Scratch() scope,
+    /// and attribute names through InternPtr, so a scenario loop makes no unmanaged allocations.
     /// </summary>
     public class UnManStringHeap : IDisposable
     {
+        // Bytes in each block of a thread's scratch space; a longer string gets a block of its own
+        private const int ScratchBlockSize = 16 * 1024;
+        // Most distinct strings kept by InternPtr; R2 has a few thousand attribute names at most
+        private const int MaxInterned = 8192;
+
         private List<IntPtr> unManStrings = new List<IntPtr>();
+        private Dictionary<string, IntPtr> interned = new Dictionary<string, IntPtr>();
         private bool _disposed;
 
+        // Each thread's scratch space: pinned blocks that are reused once the scope that filled them ends
+        [ThreadStatic] private static List<byte[]> scratchBlocks;
+        [ThreadStatic] private static int scratchBlock;
+        [ThreadStatic] private static int scratchOffset;
+
         /// <summary>
         /// Convert a .NET string to a pointer that a C++ DLL like RomeAPI can use.
+        /// The string stays allocated until this heap is disposed, so only use this for strings that R2 keeps.
         /// </summary>
         /// <param name="str">String to be converted.</param>
         /// <returns>The pointer as an IntPtr.</returns>
@@ -27,6 +41,146 @@ namespace SnapPlus.Models.Erosion
             return ret;
         }
 
+        /// <summary>
+        /// Get a pointer to a copy of a string that lasts as long as this heap, allocating it only the first
+        /// time the string is seen. Meant for attribute names and units, which come from a small fixed set.
+        /// </summary>
+        /// <param name="str">String to be converted.</param>
+        /// <returns>The pointer, or IntPtr.Zero if the heap already holds too many strings.</returns>
+        public IntPtr InternPtr(string str)
+        {
+            lock (interned)
+            {
+                if (interned.TryGetValue(str, out IntPtr ptr))
+                    return ptr;
+                if (interned.Count >= MaxInterned)
+                    return IntPtr.Zero;
+                ptr = Marshal.StringToHGlobalAnsi(str);
+                interned.Add(str, ptr);
+                return ptr;
+            }
+        }
+
+        /// <summary>
+        /// Start a scope for strings passed to R2 for the length of one call, e.g.
+        /// <c>using var scratch = heap.Scratch();</c>. The strings are copied into reusable pinned
+        /// buffers of the calling thread, and the space is given back when the scope is disposed.
+        /// Scopes may be nested (e.g. in a callback), as long as they end in the reverse order.
+        /// </summary>
+        public ScratchScope Scratch()
+        {
+            if (scratchBlocks == null)
+                scratchBlocks = new List<byte[]> { GC.AllocateUninitializedArray<byte>(ScratchBlockSize, pinned: true) };
+            return new ScratchScope(this, scratchBlock, scratchOffset);
+        }
+
+        /// <summary>
+        /// Strings for the length of one R2 call; see Scratch().
+        /// </summary>
+        public ref struct ScratchScope
+        {
+            private readonly UnManStringHeap heap;
+            private readonly int block;
+            private readonly int offset;
+
+            internal ScratchScope(UnManStringHeap heap, int block, int offset)
+            {
+                this.heap = heap;
+                this.block = block;
+                this.offset = offset;
+            }
+
+            /// <summary>
+            /// Copy a string into the scratch space.
+            /// </summary>
+            /// <returns>A pointer to the NUL-terminated ANSI copy, valid until this scope is disposed.</returns>
+            public IntPtr Ptr(string str)
+            {
+                return ScratchAdd(str ?? "");
+            }
+
+            /// <summary>
+            /// Get a pointer for an attribute name or unit, interned by the heap so it is only converted once.
+            /// </summary>
+            public IntPtr Name(string str)
+            {
+                IntPtr ptr = str == null ? IntPtr.Zero : heap.InternPtr(str);
+                return ptr != IntPtr.Zero ? ptr : Ptr(str);
+            }
+
+            /// <summary>
+            /// Reserve an uninitialized buffer in the scratch space, e.g. for R2 to return strings in.
+            /// </summary>
+            /// <returns>A pointer to the buffer, valid until this scope is disposed.</returns>
+            public IntPtr Buffer(int length)
+            {
+                byte[] buf = ScratchReserve(Math.Max(1, length), out int at);
+                return Marshal.UnsafeAddrOfPinnedArrayElement(buf, at);
+            }
+
+            public void Dispose()
+            {
+                scratchBlock = block;
+                scratchOffset = offset;
+            }
+        }
+
+        private static IntPtr ScratchAdd(string str)
+        {
+            // Strings from R2's catalog and database are ASCII, which copies straight across. Anything
+            // else goes through the system code page the same way StringToHGlobalAnsi does.
+            byte[] ansi = null;
+            int len = str.Length;
+            for (int ii = 0; ii < str.Length; ii++)
+            {
+                if (str[ii] >= 0x80)
+                {
+                    IntPtr tmp = Marshal.StringToHGlobalAnsi(str);
+                    try
+                    {
+                        len = 0;
+                        while (Marshal.ReadByte(tmp, len) != 0)
+                            len++;
+                        ansi = new byte[len];
+                        Marshal.Copy(tmp, ansi, 0, len);
+                    }
+                    finally
+                    {
+                        Marshal.FreeHGlobal(tmp);
+                    }
+                    break;
+                }
+            }
+
+            byte[] buf = ScratchReserve(len + 1, out int at);
+            if (ansi != null)
+                System.Buffer.BlockCopy(ansi, 0, buf, at, len);
+            else
+            {
+                for (int ii = 0; ii < len; ii++)
+                    buf[at + ii] = (byte)str[ii];
+            }
+            buf[at + len] = 0;
+            return Marshal.UnsafeAddrOfPinnedArrayElement(buf, at);
+        }
+
+        // Take the next needed bytes of this thread's scratch space, moving on to the next block (or a new one) if it's full
+        private static byte[] ScratchReserve(int needed, out int at)
+        {
+            byte[] buf = scratchBlocks[scratchBlock];
+            if (scratchOffset + needed > buf.Length)
+            {
+                scratchBlock++;
+                scratchOffset = 0;
+                if (scratchBlock == scratchBlocks.Count || scratchBlocks[scratchBlock].Length < needed)
+                    scratchBlocks.Insert(scratchBlock, GC.AllocateUninitializedArray<byte>(Math.Max(needed, ScratchBlockSize), pinned: true));
+                buf = scratchBlocks[scratchBlock];
+            }
+            at = scratchOffset;
+            scratchOffset += needed;
+            return buf;
+        }
+
         /// <summary>
         /// Just the opposite: Given a char * - style pointer to an ANSI string, return a .NET string. Does not affect the char *.
         /// </summary>
@@ -37,19 +191,48 @@ namespace SnapPlus.Models.Erosion
             return Marshal.PtrToStringAnsi(stringPtr);
         }
 
+        /// <summary>
+        /// Like PtrToString, but into a caller's buffer instead of a new string. Bytes are copied across as
+        /// characters, which is exact for the ASCII that R2 values are made of.
+        /// </summary>
+        /// <param name="stringPtr">IntPtr to address of first character of null-terminated string.</param>
+        /// <param name="dest">Buffer for the characters; no terminator is written.</param>
+        /// <param name="charsWritten">The length of the string, or 0 if it was null or didn't fit.</param>
+        /// <returns>True if the string was copied; false if the pointer was null or dest was too small.</returns>
+        public unsafe bool PtrToChars(IntPtr stringPtr, Span<char> dest, out int charsWritten)
+        {
+            charsWritten = 0;
+            if (stringPtr == IntPtr.Zero)
+                return false;
+            ReadOnlySpan<byte> src = System.Runtime.InteropServices.MemoryMarshal.CreateReadOnlySpanFromNullTerminated((byte*)stringPtr);
+            if (src.Length > dest.Length)
+                return false;
+            for (int ii = 0; ii < src.Length; ii++)
+                dest[ii] = (char)src[ii];
+            charsWritten = src.Length;
+            return true;
+        }
+
         protected virtual void Dispose(bool disposing)
         {
             if (!_disposed)
             {
+                // These came from StringToHGlobalAnsi, so they go back with FreeHGlobal (Marshal.Release is for COM objects)
                 for (int ii=0; ii < unManStrings.Count; ii++)
                 {
-                    
+
                     if (unManStrings[ii] != IntPtr.Zero)
                     {
-                        Marshal.Release(unManStrings[ii]);
+                        Marshal.FreeHGlobal(unManStrings[ii]);
                         unManStrings[ii] = IntPtr.Zero;
                     }
                 }
+                lock (interned)
+                {
+                    foreach (IntPtr ptr in interned.Values)
+                        Marshal.FreeHGlobal(ptr);
+                    interned.Clear();
+                }
                 _disposed = true;
             }
         }